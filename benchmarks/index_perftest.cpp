@@ -103,6 +103,17 @@ void perftest(IndexType const& index, std::string const& type)
     }
 }
 
+/// The prefetching variant of a block index type; other index types have none.
+template <typename IndexType>
+struct prefetching_index {
+    using type = void;
+};
+
+template <typename BlockCodec>
+struct prefetching_index<pisa::block_freq_index<BlockCodec>> {
+    using type = pisa::block_freq_index<BlockCodec, false, true>;
+};
+
 template <typename IndexType>
 void perftest(const char* index_filename, std::string const& type)
 {
@@ -115,24 +126,40 @@ void perftest(const char* index_filename, std::string const& type)
     perftest<IndexType, true>(index, type);
 }
 
+template <typename IndexType>
+void run_perftest(const char* index_filename, std::string const& type, bool prefetch)
+{
+    using prefetching_type = typename prefetching_index<IndexType>::type;
+    if (!prefetch) {
+        perftest<IndexType>(index_filename, type);
+    } else if constexpr (!std::is_void_v<prefetching_type>) {
+        perftest<prefetching_type>(index_filename, type + "+prefetch");
+    } else {
+        spdlog::error("Prefetching is only supported by block indexes");
+        std::exit(1);
+    }
+}
+
 int main(int argc, const char** argv)
 {
     using namespace pisa;
 
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <index type> <index filename>" << std::endl;
+    if (argc != 3 && !(argc == 4 && std::string(argv[3]) == "--prefetch")) {
+        std::cerr << "Usage: " << argv[0] << " <index type> <index filename> [--prefetch]"
+                  << std::endl;
         return 1;
     }
 
     std::string type = argv[1];
     const char* index_filename = argv[2];
+    bool prefetch = argc == 4;
 
     if (false) {
-#define LOOP_BODY(R, DATA, T)                                    \
-    }                                                            \
-    else if (type == BOOST_PP_STRINGIZE(T))                      \
-    {                                                            \
-        perftest<BOOST_PP_CAT(T, _index)>(index_filename, type); \
+#define LOOP_BODY(R, DATA, T)                                                  \
+    }                                                                          \
+    else if (type == BOOST_PP_STRINGIZE(T))                                    \
+    {                                                                          \
+        run_perftest<BOOST_PP_CAT(T, _index)>(index_filename, type, prefetch); \
         /**/
 
         BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PISA_INDEX_TYPES);
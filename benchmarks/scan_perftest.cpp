@@ -1,7 +1,14 @@
 #include "mio/mmap.hpp"
 #include "spdlog/spdlog.h"
 
+#include "block_freq_index.hpp"
+#include "codec/block_codecs.hpp"
+#include "codec/maskedvbyte.hpp"
+#include "codec/qmx.hpp"
+#include "codec/simdbp.hpp"
+#include "codec/streamvbyte.hpp"
 #include "mappable/mapper.hpp"
+#include "memory_source.hpp"
 #include "sequence/partitioned_sequence.hpp"
 #include "sequence/uniform_partitioned_sequence.hpp"
 #include "sequence_collection.hpp"
@@ -131,6 +138,77 @@ void perftest(const char* index_filename)
             (elapsed / calls * 1000));
     }
 }
+
+// Scans and skips through the long lists of a block index, decoding docids as `BlockCodec` does.
+template <typename BlockCodec>
+void block_perftest(const char* index_filename, const char* decoding)
+{
+    pisa::block_freq_index<BlockCodec> index(pisa::MemorySource::mapped_file(std::string(index_filename)));
+    spdlog::info("Decoding {} docids", decoding);
+
+    size_t min_length = 4096;
+    std::vector<size_t> long_lists;
+    for (size_t i = 0; i < index.size(); ++i) {
+        if (index[i].size() >= min_length) {
+            long_lists.push_back(i);
+        }
+    }
+
+    {
+        auto tick = get_time_usecs();
+        size_t postings = 0;
+        for (auto i: long_lists) {
+            auto reader = index[i];
+            for (size_t pos = 0; pos < reader.size(); ++pos, reader.next()) {
+                do_not_optimize_away(reader.docid());
+            }
+            postings += reader.size();
+        }
+        double elapsed = get_time_usecs() - tick;
+        spdlog::info(
+            "Read {} postings of lists longer than {}: {:.1f} ns per posting",
+            postings,
+            min_length,
+            (elapsed / postings * 1000));
+    }
+
+    for (uint64_t skip = 1; skip <= 16384; skip <<= 2) {
+        std::vector<std::pair<size_t, std::vector<uint64_t>>> skip_values;
+        for (auto i: long_lists) {
+            auto reader = index[i];
+            skip_values.emplace_back(i, std::vector<uint64_t>());
+            for (uint64_t pos = skip; pos < reader.size(); pos += skip) {
+                reader.move(pos);
+                skip_values.back().second.push_back(reader.docid());
+            }
+        }
+
+        auto tick = get_time_usecs();
+        size_t calls = 0;
+        for (auto const& [i, values]: skip_values) {
+            auto reader = index[i];
+            for (auto val: values) {
+                reader.next_geq(val);
+                do_not_optimize_away(reader.docid());
+            }
+            calls += values.size();
+        }
+        double elapsed = get_time_usecs() - tick;
+        spdlog::info(
+            "Performed {} next_geq() with skip={}: {:.1f} ns per call",
+            calls,
+            skip,
+            (elapsed / calls * 1000));
+    }
+}
+
+template <typename BlockCodec>
+void block_perftest(const char* index_filename)
+{
+    block_perftest<pisa::with_docid_decoding<BlockCodec, false>>(index_filename, "gap");
+    block_perftest<pisa::with_docid_decoding<BlockCodec, true>>(index_filename, "absolute");
+}
+
 int main(int argc, const char** argv)
 {
     using pisa::compact_elias_fano;
@@ -154,6 +232,18 @@ int main(int argc, const char** argv)
         perftest<uniform_partitioned_sequence<>>(index_filename);
     } else if (type == "part") {
         perftest<partitioned_sequence<>>(index_filename);
+    } else if (type == "block_optpfor") {
+        block_perftest<pisa::optpfor_block>(index_filename);
+    } else if (type == "block_interpolative") {
+        block_perftest<pisa::interpolative_block>(index_filename);
+    } else if (type == "block_maskedvbyte") {
+        block_perftest<pisa::maskedvbyte_block>(index_filename);
+    } else if (type == "block_qmx") {
+        block_perftest<pisa::qmx_block>(index_filename);
+    } else if (type == "block_simdbp") {
+        block_perftest<pisa::simdbp_block>(index_filename);
+    } else if (type == "block_streamvbyte") {
+        block_perftest<pisa::streamvbyte_block>(index_filename);
     } else {
         spdlog::error("Unknown type {}", type);
     }
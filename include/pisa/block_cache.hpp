@@ -0,0 +1,237 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace pisa {
+
+/// A cache of decoded posting blocks, shared by all the enumerators of one block index.
+///
+/// Blocks are keyed by (term, block) and hold the docids and frequencies exactly as an
+/// enumerator uses them after decoding. The cache holds at most `capacity()` blocks, which is
+/// the byte budget divided by the size of a decoded block, rounded down: a budget smaller than
+/// one block caches nothing.
+///
+/// The cache is split into shards, each evicting with CLOCK, with at least
+/// `min_blocks_per_shard` blocks each so that small budgets are not spread too thin. Inserts
+/// and misses take the shard's mutex. Hits usually do not: each shard keeps a direct-mapped
+/// table of hints from keys to slots, and every slot is a sequence lock, so a hit copies the
+/// block out and then checks that no insert overwrote it meanwhile. A hint that is missing or
+/// stale falls back to the locked lookup.
+class BlockCache {
+  public:
+    struct Stats {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t evictions = 0;
+    };
+
+    static constexpr std::size_t min_blocks_per_shard = 16;
+
+    /// Creates a cache of blocks of at most `block_size` postings, using up to `byte_budget`
+    /// bytes for decoded postings, over at most `shards` shards.
+    BlockCache(std::size_t byte_budget, std::size_t block_size, std::size_t shards = 64)
+        : m_block_size(block_size),
+          m_capacity(byte_budget / (2 * block_size * sizeof(std::uint32_t))),
+          m_shards(std::clamp<std::size_t>(
+              m_capacity / min_blocks_per_shard, 1, std::max<std::size_t>(shards, 1)))
+    {
+        // The remainder goes to the first shards, so that the capacities add up to the budget.
+        for (std::size_t idx = 0; idx < m_shards.size(); ++idx) {
+            auto& shard = m_shards[idx];
+            shard.capacity =
+                m_capacity / m_shards.size() + (idx < m_capacity % m_shards.size() ? 1 : 0);
+            shard.slots = std::make_unique<Slot[]>(shard.capacity);
+            shard.postings = std::make_unique<std::atomic<std::uint32_t>[]>(
+                2 * block_size * shard.capacity);
+            shard.index.reserve(shard.capacity);
+            std::size_t hints = 1;
+            while (hints < 4 * shard.capacity) {
+                hints *= 2;
+            }
+            shard.hint_mask = hints - 1;
+            shard.hints = std::make_unique<std::atomic<std::uint32_t>[]>(hints);
+        }
+    }
+
+    [[nodiscard]] auto block_size() const noexcept -> std::size_t { return m_block_size; }
+
+    /// The maximum number of blocks cached at once.
+    [[nodiscard]] auto capacity() const noexcept -> std::size_t { return m_capacity; }
+
+    /// Copies the `n` docids and freqs of the cached block into `docs` and `freqs`, and returns
+    /// `true`, or returns `false` if the block is not cached.
+    auto lookup(std::uint32_t term, std::uint32_t block, std::uint32_t* docs, std::uint32_t* freqs, std::size_t n)
+        -> bool
+    {
+        auto key = make_key(term, block);
+        auto& shard = shard_of(key);
+        if (auto hint = shard.hints[hint_of(shard, key)].load(std::memory_order_acquire);
+            hint != 0 && try_copy_out(shard, hint - 1, key, docs, freqs, n)) {
+            shard.hits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto pos = shard.index.find(key);
+        if (pos == shard.index.end()) {
+            shard.misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        shard.hits.fetch_add(1, std::memory_order_relaxed);
+        shard.slots[pos->second].referenced.store(true, std::memory_order_relaxed);
+        // Writers hold the mutex, so the copy cannot be torn.
+        auto const* postings = shard.postings.get() + 2 * m_block_size * pos->second;
+        for (std::size_t idx = 0; idx < n; ++idx) {
+            docs[idx] = postings[idx].load(std::memory_order_relaxed);
+            freqs[idx] = postings[m_block_size + idx].load(std::memory_order_relaxed);
+        }
+        shard.hints[hint_of(shard, key)].store(pos->second + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Caches the `n` docids and freqs of a block, evicting another block if the shard is full.
+    void insert(
+        std::uint32_t term,
+        std::uint32_t block,
+        std::uint32_t const* docs,
+        std::uint32_t const* freqs,
+        std::size_t n)
+    {
+        auto key = make_key(term, block);
+        auto& shard = shard_of(key);
+        if (shard.capacity == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (shard.index.find(key) != shard.index.end()) {
+            return;  // Another enumerator got here first.
+        }
+        std::size_t slot = shard.size;
+        if (slot < shard.capacity) {
+            ++shard.size;
+        } else {
+            while (shard.slots[shard.hand].referenced.load(std::memory_order_relaxed)) {
+                shard.slots[shard.hand].referenced.store(false, std::memory_order_relaxed);
+                shard.hand = (shard.hand + 1) % shard.capacity;
+            }
+            slot = shard.hand;
+            shard.hand = (shard.hand + 1) % shard.capacity;
+            shard.index.erase(shard.slots[slot].key.load(std::memory_order_relaxed));
+            shard.evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+        shard.index.emplace(key, slot);
+
+        // An odd version tells lock-free readers that the slot is being overwritten.
+        auto& entry = shard.slots[slot];
+        auto version = entry.version.load(std::memory_order_relaxed);
+        entry.version.store(version + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        entry.key.store(key, std::memory_order_relaxed);
+        entry.referenced.store(false, std::memory_order_relaxed);
+        auto* postings = shard.postings.get() + 2 * m_block_size * slot;
+        for (std::size_t idx = 0; idx < n; ++idx) {
+            postings[idx].store(docs[idx], std::memory_order_relaxed);
+            postings[m_block_size + idx].store(freqs[idx], std::memory_order_relaxed);
+        }
+        entry.version.store(version + 2, std::memory_order_release);
+        shard.hints[hint_of(shard, key)].store(slot + 1, std::memory_order_release);
+    }
+
+    /// Hit, miss and eviction counts, summed over all shards.
+    [[nodiscard]] auto stats() const -> Stats
+    {
+        Stats total;
+        for (auto const& shard: m_shards) {
+            total.hits += shard.hits.load(std::memory_order_relaxed);
+            total.misses += shard.misses.load(std::memory_order_relaxed);
+            total.evictions += shard.evictions.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+  private:
+    struct Slot {
+        std::atomic<std::uint64_t> key{0};
+        std::atomic<std::uint32_t> version{0};
+        std::atomic<bool> referenced{false};
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::size_t capacity = 0;
+        std::size_t size = 0;
+        std::size_t hand = 0;
+        std::unique_ptr<Slot[]> slots;
+        std::unique_ptr<std::atomic<std::uint32_t>[]> postings;
+        std::unordered_map<std::uint64_t, std::size_t> index;
+        /// Slot of a key plus one, or 0; written under the mutex, read without it.
+        std::unique_ptr<std::atomic<std::uint32_t>[]> hints;
+        std::size_t hint_mask = 0;
+        std::atomic<std::uint64_t> hits{0};
+        std::atomic<std::uint64_t> misses{0};
+        std::atomic<std::uint64_t> evictions{0};
+    };
+
+    [[nodiscard]] static auto make_key(std::uint32_t term, std::uint32_t block) -> std::uint64_t
+    {
+        return (std::uint64_t(term) << 32U) | block;
+    }
+
+    /// Mixes the key so that consecutive blocks of a term spread over the shards and hints.
+    [[nodiscard]] static auto mix(std::uint64_t key) -> std::uint64_t
+    {
+        return key * 0x9E3779B97F4A7C15ULL;
+    }
+
+    [[nodiscard]] auto shard_of(std::uint64_t key) -> Shard&
+    {
+        return m_shards[(mix(key) >> 32U) % m_shards.size()];
+    }
+
+    [[nodiscard]] static auto hint_of(Shard const& shard, std::uint64_t key) -> std::size_t
+    {
+        return mix(key) & shard.hint_mask;
+    }
+
+    /// Copies block `key` out of `slot` without the mutex, and returns `false` if the slot
+    /// holds another block or was overwritten during the copy.
+    auto try_copy_out(
+        Shard& shard,
+        std::size_t slot,
+        std::uint64_t key,
+        std::uint32_t* docs,
+        std::uint32_t* freqs,
+        std::size_t n) const -> bool
+    {
+        auto& entry = shard.slots[slot];
+        auto version = entry.version.load(std::memory_order_acquire);
+        if ((version & 1U) != 0 || entry.key.load(std::memory_order_relaxed) != key) {
+            return false;
+        }
+        auto const* postings = shard.postings.get() + 2 * m_block_size * slot;
+        for (std::size_t idx = 0; idx < n; ++idx) {
+            docs[idx] = postings[idx].load(std::memory_order_relaxed);
+            freqs[idx] = postings[m_block_size + idx].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (entry.version.load(std::memory_order_relaxed) != version) {
+            return false;
+        }
+        // Only written when clear, so that hot blocks do not bounce the line between cores.
+        if (not entry.referenced.load(std::memory_order_relaxed)) {
+            entry.referenced.store(true, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    std::size_t m_block_size;
+    std::size_t m_capacity;
+    std::vector<Shard> m_shards;
+};
+
+}  // namespace pisa
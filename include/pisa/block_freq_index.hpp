@@ -14,16 +14,29 @@ namespace pisa {
 
 struct BlockIndexTag;
 
-template <typename BlockCodec, bool Profile = false>
+/// `Prefetch` only changes how lists are read (see `block_posting_list`), not the index format.
+template <typename BlockCodec, bool Profile = false, bool Prefetch = false>
 class block_freq_index {
   public:
     using index_layout_tag = BlockIndexTag;
+    static constexpr std::size_t block_size = BlockCodec::block_size;
     block_freq_index() = default;
     explicit block_freq_index(MemorySource source) : m_source(std::move(source))
     {
         mapper::map(*this, m_source.data(), mapper::map_flags::warmup);
     }
 
+    /// Appends the encoding of a posting list to `out`, as the builders would store it.
+    template <typename DocsIterator, typename FreqsIterator>
+    static void write_posting_list(
+        std::vector<uint8_t>& out, uint64_t n, DocsIterator docs_begin, FreqsIterator freqs_begin)
+    {
+        if (!n) {
+            throw std::invalid_argument("List must be nonempty");
+        }
+        block_posting_list<BlockCodec, Profile>::write(out, n, docs_begin, freqs_begin);
+    }
+
     class builder {
       public:
         builder(uint64_t num_docs, global_parameters const& params) : m_params(params)
@@ -103,11 +116,8 @@ class block_freq_index {
             FreqsIterator freqs_begin,
             uint64_t /* occurrences */)
         {
-            if (!n) {
-                throw std::invalid_argument("List must be nonempty");
-            }
             std::vector<std::uint8_t> buf;
-            block_posting_list<BlockCodec, Profile>::write(buf, n, docs_begin, freqs_begin);
+            write_posting_list(buf, n, docs_begin, freqs_begin);
             m_postings_bytes_written += buf.size();
             m_postings_output.write(reinterpret_cast<char const*>(buf.data()), buf.size());
             m_endpoints.push_back(m_postings_bytes_written);
@@ -171,7 +181,8 @@ class block_freq_index {
 
     uint64_t num_docs() const { return m_num_docs; }
 
-    using document_enumerator = typename block_posting_list<BlockCodec, Profile>::document_enumerator;
+    using document_enumerator =
+        typename block_posting_list<BlockCodec, Profile, Prefetch>::document_enumerator;
 
     document_enumerator operator[](size_t i) const
     {
@@ -179,7 +190,19 @@ class block_freq_index {
         compact_elias_fano::enumerator endpoints(m_endpoints, 0, m_lists.size(), m_size, m_params);
 
         auto endpoint = endpoints.move(i).second;
-        return document_enumerator(m_lists.data() + endpoint, num_docs(), i);
+        return document_enumerator(m_lists.data() + endpoint, num_docs(), i, m_block_cache);
+    }
+
+    /// Makes enumerators share decoded blocks through `cache`, or stop sharing if it is null.
+    /// The cache must not be shared with other indexes, and must outlive the enumerators.
+    ///
+    /// \throws std::invalid_argument  if the cache blocks are smaller than the codec's
+    void set_block_cache(BlockCache* cache)
+    {
+        if (cache != nullptr && cache->block_size() < BlockCodec::block_size) {
+            throw std::invalid_argument("Block cache blocks are smaller than the index blocks");
+        }
+        m_block_cache = cache;
     }
 
     void warmup(size_t i) const
@@ -204,6 +227,7 @@ class block_freq_index {
     {
         std::swap(m_params, other.m_params);
         std::swap(m_size, other.m_size);
+        std::swap(m_block_cache, other.m_block_cache);
         m_endpoints.swap(other.m_endpoints);
         m_lists.swap(other.m_lists);
     }
@@ -222,5 +246,6 @@ class block_freq_index {
     bit_vector m_endpoints;
     mapper::mappable_vector<uint8_t> m_lists;
     MemorySource m_source;
+    BlockCache* m_block_cache{nullptr};
 };
 }  // namespace pisa
@@ -1,13 +1,73 @@
 #pragma once
 
+#include <array>
+#include <cstring>
+
+#include "block_cache.hpp"
 #include "codec/block_codecs.hpp"
 #include "util/block_profiler.hpp"
+#include "util/broadword.hpp"
+#include "util/intrinsics.hpp"
 #include "util/util.hpp"
 
 namespace pisa {
 
-template <typename BlockCodec, bool Profile = false>
+/// With `Prefetch`, enumerators prefetch the compressed bytes of the block after the one they
+/// enter, so that its misses overlap with the work on the current block. A block found by a
+/// skip is decoded right away, so prefetching it would hide nothing.
+///
+/// If `BlockCodec` sets `bitmap_span_per_posting`, the docids of blocks dense enough are stored
+/// as a bitmap over the docids the block spans, followed by the coded freqs as usual. Whether a
+/// block is a bitmap follows from its size and maximum, so it takes no extra space, and
+/// enumerators scan its words instead of decoding it.
+template <typename BlockCodec, bool Profile = false, bool Prefetch = false>
 struct block_posting_list {
+    static constexpr uint32_t bitmap_span = bitmap_span_per_posting<BlockCodec>::value;
+    static constexpr std::size_t max_bitmap_words = (bitmap_span * BlockCodec::block_size + 63) / 64;
+
+    /// Whether the docids of a block of `n` postings spanning `span` docids are a bitmap.
+    static constexpr bool is_bitmap_block(uint64_t span, uint64_t n)
+    {
+        return bitmap_span > 0 && span <= bitmap_span * n;
+    }
+
+    /// Encodes the `n` docid gaps of a block, with `gaps_universe` as in `BlockCodec::encode`.
+    static void
+    encode_doc_gaps(uint32_t const* gaps, uint32_t gaps_universe, size_t n, std::vector<uint8_t>& out)
+    {
+        uint64_t span = uint64_t(gaps_universe) + n;
+        if (!is_bitmap_block(span, n)) {
+            BlockCodec::encode(gaps, gaps_universe, n, out);
+            return;
+        }
+        size_t begin = out.size();
+        out.resize(begin + ceil_div(span, 8));
+        uint32_t offset = -1;
+        for (size_t i = 0; i < n; ++i) {
+            offset += gaps[i] + 1;
+            out[begin + offset / 8] |= uint8_t(1U << (offset % 8));
+        }
+    }
+
+    /// Decodes the `n` docid gaps of a block, returning the end of its docids.
+    static uint8_t const*
+    decode_doc_gaps(uint8_t const* in, uint32_t* gaps, uint32_t gaps_universe, size_t n)
+    {
+        uint64_t span = uint64_t(gaps_universe) + n;
+        if (!is_bitmap_block(span, n)) {
+            return BlockCodec::decode(in, gaps, gaps_universe, n);
+        }
+        uint32_t previous = -1;
+        size_t i = 0;
+        for (uint32_t offset = 0; i < n; ++offset) {
+            if (((in[offset / 8] >> (offset % 8)) & 1U) != 0U) {
+                gaps[i++] = offset - previous - 1;
+                previous = offset;
+            }
+        }
+        return in + ceil_div(span, 8);
+    }
+
     template <typename DocsIterator, typename FreqsIterator>
     static void
     write(std::vector<uint8_t>& out, uint32_t n, DocsIterator docs_begin, FreqsIterator freqs_begin)
@@ -39,7 +99,7 @@ struct block_posting_list {
             }
             *((uint32_t*)&out[begin_block_maxs + 4 * b]) = last_doc;
 
-            BlockCodec::encode(
+            encode_doc_gaps(
                 docs_buf.data(), last_doc - block_base - (cur_block_size - 1), cur_block_size, out);
             BlockCodec::encode(freqs_buf.data(), uint32_t(-1), cur_block_size, out);
             if (b != blocks - 1) {
@@ -79,25 +139,39 @@ struct block_posting_list {
 
     class document_enumerator {
       public:
-        document_enumerator(uint8_t const* data, uint64_t universe, size_t term_id = 0)
+        /// Decoded blocks are looked up in and added to `cache`, if given, under `term_id`.
+        document_enumerator(
+            uint8_t const* data, uint64_t universe, size_t term_id = 0, BlockCache* cache = nullptr)
             : m_base(TightVariableByte::decode(data, &m_n, 1)),
               m_blocks(ceil_div(m_n, BlockCodec::block_size)),
               m_block_maxs(m_base),
               m_block_endpoints(m_block_maxs + 4 * m_blocks),
               m_blocks_data(m_block_endpoints + 4 * (m_blocks - 1)),
-              m_universe(universe)
+              m_universe(universe),
+              m_term_id(term_id),
+              m_cache(cache)
         {
             if (Profile) {
                 // std::cout << "OPEN\t" << m_term_id << "\t" << m_blocks << "\n";
                 m_block_profile = block_profiler::open_list(term_id, m_blocks);
             }
-            m_docs_buf.resize(BlockCodec::block_size);
-            m_freqs_buf.resize(BlockCodec::block_size);
             reset();
         }
 
         void reset() { decode_docs_block(0); }
 
+        // ANYTIME: Points the enumerator at another list, reusing its decoding buffers.
+        void reopen(uint8_t const* data, uint64_t universe)
+        {
+            m_base = TightVariableByte::decode(data, &m_n, 1);
+            m_blocks = ceil_div(m_n, BlockCodec::block_size);
+            m_block_maxs = m_base;
+            m_block_endpoints = m_block_maxs + 4 * m_blocks;
+            m_blocks_data = m_block_endpoints + 4 * (m_blocks - 1);
+            m_universe = universe;
+            reset();
+        }
+
         void PISA_ALWAYSINLINE next()
         {
             ++m_pos_in_block;
@@ -107,6 +181,19 @@ struct block_posting_list {
                     return;
                 }
                 decode_docs_block(m_cur_block + 1);
+                return;
+            }
+            if constexpr (bitmap_span > 0) {
+                if (m_bitmap_block) {
+                    m_cur_docid = m_bitmap_base + next_bitmap_offset(m_cur_docid + 1 - m_bitmap_base);
+                    return;
+                }
+            }
+            if constexpr (absolute_docids) {
+                if (PISA_UNLIKELY(m_pos_in_block == m_decoded_end)) {
+                    decode_docs_chunk();
+                }
+                m_cur_docid = m_docs_buf[m_pos_in_block];
             } else {
                 m_cur_docid += m_docs_buf[m_pos_in_block] + 1;
             }
@@ -131,10 +218,7 @@ struct block_posting_list {
             decode_docs_block(block);
 
             // Get to the identifier now
-            while (docid() < lower_bound) {
-                m_cur_docid += m_docs_buf[++m_pos_in_block] + 1;
-                assert(m_pos_in_block < m_cur_block_size);
-            }
+            seek_in_block(lower_bound);
         }
 
         void PISA_ALWAYSINLINE next_geq(uint64_t lower_bound)
@@ -151,14 +235,10 @@ struct block_posting_list {
                 while (block_max(block) < lower_bound) {
                     ++block;
                 }
-
                 decode_docs_block(block);
             }
 
-            while (docid() < lower_bound) {
-                m_cur_docid += m_docs_buf[++m_pos_in_block] + 1;
-                assert(m_pos_in_block < m_cur_block_size);
-            }
+            seek_in_block(lower_bound);
         }
 
         void PISA_ALWAYSINLINE move(uint64_t pos)
@@ -168,8 +248,23 @@ struct block_posting_list {
             if (PISA_UNLIKELY(block != m_cur_block)) {
                 decode_docs_block(block);
             }
-            while (position() < pos) {
-                m_cur_docid += m_docs_buf[++m_pos_in_block] + 1;
+            if constexpr (bitmap_span > 0) {
+                if (m_bitmap_block) {
+                    m_pos_in_block = pos % BlockCodec::block_size;
+                    m_cur_docid = m_bitmap_base + select_in_bitmap(m_pos_in_block);
+                    return;
+                }
+            }
+            if constexpr (absolute_docids) {
+                m_pos_in_block = pos % BlockCodec::block_size;
+                while (m_decoded_end <= m_pos_in_block) {
+                    decode_docs_chunk();
+                }
+                m_cur_docid = m_docs_buf[m_pos_in_block];
+            } else {
+                while (position() < pos) {
+                    m_cur_docid += m_docs_buf[++m_pos_in_block] + 1;
+                }
             }
         }
 
@@ -201,7 +296,7 @@ struct block_posting_list {
                     ((b + 1) * block_size <= size()) ? block_size : (size() % block_size);
 
                 uint32_t cur_base = (b != 0U ? block_max(b - 1) : uint32_t(-1)) + 1;
-                uint8_t const* freq_ptr = BlockCodec::decode(
+                uint8_t const* freq_ptr = decode_doc_gaps(
                     ptr, buf.data(), block_max(b) - cur_base - (cur_block_size - 1), cur_block_size);
                 ptr = BlockCodec::decode(freq_ptr, buf.data(), uint32_t(-1), cur_block_size);
                 bytes += ptr - freq_ptr;
@@ -229,7 +324,7 @@ struct block_posting_list {
             void decode_doc_gaps(std::vector<uint32_t>& out) const
             {
                 out.resize(size);
-                BlockCodec::decode(docs_begin, out.data(), doc_gaps_universe, size);
+                block_posting_list::decode_doc_gaps(docs_begin, out.data(), doc_gaps_universe, size);
             }
 
             void decode_freqs(std::vector<uint32_t>& out) const
@@ -268,7 +363,7 @@ struct block_posting_list {
                 blocks.back().max = block_max(b);
 
                 uint8_t const* freq_ptr =
-                    BlockCodec::decode(ptr, buf.data(), gaps_universe, cur_block_size);
+                    decode_doc_gaps(ptr, buf.data(), gaps_universe, cur_block_size);
                 blocks.back().freqs_begin = freq_ptr;
                 ptr = BlockCodec::decode(freq_ptr, buf.data(), uint32_t(-1), cur_block_size);
                 blocks.back().end = ptr;
@@ -279,17 +374,169 @@ struct block_posting_list {
         }
 
       private:
+        static constexpr bool absolute_docids = decodes_absolute_docids<BlockCodec>::value;
+
         uint32_t block_max(uint32_t block) const { return ((uint32_t const*)m_block_maxs)[block]; }
 
+        /// Prefetches every cache line of the compressed docids and freqs of `block`, so that
+        /// its misses overlap rather than stall the decoder one at a time. The end of the last
+        /// block is not stored, so only its first line is prefetched.
+        void prefetch_block(uint64_t block) const
+        {
+            auto const* endpoints = (uint32_t const*)m_block_endpoints;
+            uint8_t const* begin = m_blocks_data + (block != 0U ? endpoints[block - 1] : 0);
+            uint8_t const* end = block + 1 < m_blocks ? m_blocks_data + endpoints[block] : begin + 1;
+            for (uint8_t const* line = begin; line < end; line += 64) {
+                intrinsics::prefetch(line);
+            }
+        }
+
+        /// Offset from the block base of the first docid of the current bitmap block at or after
+        /// `offset`, which must not be past the block maximum, so that the scan stops there.
+        uint32_t PISA_ALWAYSINLINE next_bitmap_offset(uint32_t offset) const
+        {
+            uint32_t word = offset / 64;
+            uint64_t bits = m_bitmap[word] & (~uint64_t(0) << (offset % 64));
+            while (bits == 0) {
+                bits = m_bitmap[++word];
+            }
+            return word * 64 + broadword::lsb(bits);
+        }
+
+        /// Number of docids of the current bitmap block before `offset`.
+        uint32_t PISA_ALWAYSINLINE bitmap_rank(uint32_t offset) const
+        {
+            uint32_t word = offset / 64;
+            uint64_t below = (uint64_t(1) << (offset % 64)) - 1;
+            return m_bitmap_ranks[word] + broadword::popcount(m_bitmap[word] & below);
+        }
+
+        /// Offset from the block base of the docid at `rank` in the current bitmap block.
+        uint32_t select_in_bitmap(uint32_t rank) const
+        {
+            uint32_t word = 0;
+            while (word + 1 < m_bitmap_words && m_bitmap_ranks[word + 1] <= rank) {
+                ++word;
+            }
+            return word * 64 + broadword::select_in_word(m_bitmap[word], rank - m_bitmap_ranks[word]);
+        }
+
+        /// Loads the bitmap of the current block, spanning the docids from `base` to the block
+        /// maximum, and its rank directory. Returns the end of the bitmap.
+        uint8_t const* load_bitmap(uint8_t const* data, uint32_t base)
+        {
+            uint32_t span = m_cur_block_max - base + 1;
+            m_bitmap_base = base;
+            m_bitmap_words = ceil_div(span, 64);
+            m_bitmap[m_bitmap_words - 1] = 0;
+            std::memcpy(m_bitmap.data(), data, ceil_div(span, 8));
+            uint32_t rank = 0;
+            for (uint32_t word = 0; word < m_bitmap_words; ++word) {
+                m_bitmap_ranks[word] = rank;
+                rank += broadword::popcount(m_bitmap[word]);
+            }
+            return data + ceil_div(span, 8);
+        }
+
+        /// Turns the next chunk of docid gaps in the current block into docids.
+        void PISA_ALWAYSINLINE decode_docs_chunk()
+        {
+            intrinsics::prefix_sum_gaps(m_docs_buf.data() + m_decoded_end, m_docs_buf[m_decoded_end - 1]);
+            m_decoded_end += intrinsics::docid_chunk_size;
+        }
+
+        /// Moves within the current block to the first docid not less than `lower_bound`,
+        /// which must not exceed the block maximum.
+        void PISA_ALWAYSINLINE seek_in_block(uint64_t lower_bound)
+        {
+            if constexpr (bitmap_span > 0) {
+                if (m_bitmap_block) {
+                    if (docid() < lower_bound) {
+                        uint32_t offset = next_bitmap_offset(lower_bound - m_bitmap_base);
+                        m_pos_in_block = bitmap_rank(offset);
+                        m_cur_docid = m_bitmap_base + offset;
+                    }
+                    return;
+                }
+            }
+            if constexpr (absolute_docids) {
+                if (docid() >= lower_bound) {
+                    return;
+                }
+                // Short skips are the common case, so check the next docid before searching.
+                if (m_pos_in_block + 1 < m_decoded_end && m_docs_buf[m_pos_in_block + 1] >= lower_bound) {
+                    m_cur_docid = m_docs_buf[++m_pos_in_block];
+                    return;
+                }
+                // Chunks are decoded only as the search reaches them. Values past the end of the
+                // block are garbage, but the block maximum precedes them and is not less than
+                // `lower_bound`, so the first match is always a docid of the block.
+                uint32_t chunk = m_pos_in_block & ~uint32_t(intrinsics::docid_chunk_size - 1);
+                uint32_t mask = intrinsics::geq_mask(m_docs_buf.data() + chunk, lower_bound)
+                    & (~uint32_t(0) << (m_pos_in_block - chunk));
+                while (mask == 0) {
+                    chunk += intrinsics::docid_chunk_size;
+                    if (chunk == m_decoded_end) {
+                        decode_docs_chunk();
+                    }
+                    mask = intrinsics::geq_mask(m_docs_buf.data() + chunk, lower_bound);
+                }
+                unsigned long lane;
+                intrinsics::bsf64(&lane, mask);
+                m_pos_in_block = chunk + lane;
+                m_cur_docid = m_docs_buf[m_pos_in_block];
+            } else {
+                while (docid() < lower_bound) {
+                    m_cur_docid += m_docs_buf[++m_pos_in_block] + 1;
+                }
+            }
+            assert(m_pos_in_block < m_cur_block_size);
+        }
+
         void PISA_NOINLINE decode_docs_block(uint64_t block)
         {
             static const uint64_t block_size = BlockCodec::block_size;
             uint32_t endpoint = block != 0U ? ((uint32_t const*)m_block_endpoints)[block - 1] : 0;
             uint8_t const* block_data = m_blocks_data + endpoint;
+            if constexpr (Prefetch) {
+                if (block + 1 < m_blocks) {
+                    prefetch_block(block + 1);
+                }
+            }
             m_cur_block_size =
                 ((block + 1) * block_size <= size()) ? block_size : (size() % block_size);
             uint32_t cur_base = (block != 0U ? block_max(block - 1) : uint32_t(-1)) + 1;
             m_cur_block_max = block_max(block);
+            m_cur_block = block;
+            m_pos_in_block = 0;
+
+            if constexpr (bitmap_span > 0) {
+                m_bitmap_block = is_bitmap_block(m_cur_block_max - cur_base + 1, m_cur_block_size);
+                if (m_bitmap_block) {
+                    // Bitmaps are cheaper to load than to copy out of the cache.
+                    m_freqs_block_data = load_bitmap(block_data, cur_base);
+                    intrinsics::prefetch(m_freqs_block_data);
+                    m_cur_docid = cur_base + next_bitmap_offset(0);
+                    m_freqs_decoded = false;
+                    if (Profile) {
+                        ++m_block_profile[2 * m_cur_block];
+                    }
+                    return;
+                }
+            }
+
+            if (m_cache != nullptr
+                && m_cache->lookup(
+                    m_term_id, block, m_docs_buf.data(), m_freqs_buf.data(), m_cur_block_size)) {
+                if constexpr (absolute_docids) {
+                    m_decoded_end = ceil_div(m_cur_block_size, intrinsics::docid_chunk_size)
+                        * intrinsics::docid_chunk_size;
+                }
+                m_freqs_decoded = true;
+                m_cur_docid = m_docs_buf[0];
+                return;
+            }
+
             m_freqs_block_data = BlockCodec::decode(
                 block_data,
                 m_docs_buf.data(),
@@ -297,15 +544,30 @@ struct block_posting_list {
                 m_cur_block_size);
             intrinsics::prefetch(m_freqs_block_data);
 
-            m_docs_buf[0] += cur_base;
+            if constexpr (absolute_docids) {
+                intrinsics::prefix_sum_gaps(m_docs_buf.data(), cur_base - 1);
+                m_decoded_end = intrinsics::docid_chunk_size;
+            } else {
+                m_docs_buf[0] += cur_base;
+            }
 
-            m_cur_block = block;
-            m_pos_in_block = 0;
             m_cur_docid = m_docs_buf[0];
             m_freqs_decoded = false;
             if (Profile) {
                 ++m_block_profile[2 * m_cur_block];
             }
+
+            if (m_cache != nullptr) {
+                // Cached blocks are complete, so that hits never go back to the codec.
+                if constexpr (absolute_docids) {
+                    while (m_decoded_end < m_cur_block_size) {
+                        decode_docs_chunk();
+                    }
+                }
+                decode_freqs_block();
+                m_cache->insert(
+                    m_term_id, block, m_docs_buf.data(), m_freqs_buf.data(), m_cur_block_size);
+            }
         }
 
         void PISA_NOINLINE decode_freqs_block()
@@ -327,18 +589,28 @@ struct block_posting_list {
         uint8_t const* m_block_endpoints;
         uint8_t const* m_blocks_data;
         uint64_t m_universe;
+        uint32_t m_term_id;
+        BlockCache* m_cache;
 
         uint32_t m_cur_block{0};
         uint32_t m_pos_in_block{0};
         uint32_t m_cur_block_max{0};
         uint32_t m_cur_block_size{0};
         uint32_t m_cur_docid{0};
+        uint32_t m_decoded_end{0};
 
         uint8_t const* m_freqs_block_data{nullptr};
         bool m_freqs_decoded{false};
 
-        std::vector<uint32_t> m_docs_buf;
-        std::vector<uint32_t> m_freqs_buf;
+        // Decoding buffers are kept inline, so that opening a cursor does not allocate.
+        alignas(32) std::array<uint32_t, BlockCodec::block_size + intrinsics::docid_chunk_size> m_docs_buf;
+        alignas(32) std::array<uint32_t, BlockCodec::block_size> m_freqs_buf;
+
+        bool m_bitmap_block{false};
+        uint32_t m_bitmap_base{0};
+        uint32_t m_bitmap_words{0};
+        std::array<uint64_t, max_bitmap_words> m_bitmap;
+        std::array<uint32_t, max_bitmap_words> m_bitmap_ranks;
 
         block_profiler::counter_type* m_block_profile;
     };
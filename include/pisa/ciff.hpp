@@ -0,0 +1,343 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "fmt/format.h"
+#include "gsl/span"
+#include "spdlog/spdlog.h"
+#include "tbb/pipeline.h"
+#include "tbb/task_arena.h"
+
+#include "memory_source.hpp"
+#include "util/progress.hpp"
+
+// Reads indexes in the Common Index File Format (https://github.com/osirrc/ciff): a header,
+// the posting lists and then the document records, each a length-delimited protocol buffers
+// message. Only the wire format is decoded, so no protobuf runtime is required.
+
+namespace pisa::ciff {
+
+/// Decodes the protocol buffers wire format from a span of bytes.
+class WireReader {
+  public:
+    explicit WireReader(gsl::span<char const> bytes)
+        : m_pos(bytes.data()), m_end(bytes.data() + bytes.size())
+    {}
+
+    [[nodiscard]] auto empty() const -> bool { return m_pos == m_end; }
+
+    [[nodiscard]] auto varint() -> std::uint64_t
+    {
+        std::uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (m_pos == m_end) {
+                throw std::runtime_error("CIFF: truncated varint");
+            }
+            auto byte = static_cast<std::uint8_t>(*m_pos++);
+            value |= std::uint64_t(byte & 0x7FU) << static_cast<unsigned>(shift);
+            if ((byte & 0x80U) == 0) {
+                return value;
+            }
+        }
+        throw std::runtime_error("CIFF: varint longer than 10 bytes");
+    }
+
+    /// Reads `size` raw bytes.
+    [[nodiscard]] auto bytes(std::uint64_t size) -> gsl::span<char const>
+    {
+        if (size > static_cast<std::uint64_t>(m_end - m_pos)) {
+            throw std::runtime_error("CIFF: truncated message");
+        }
+        gsl::span<char const> span(m_pos, size);
+        m_pos += size;
+        return span;
+    }
+
+    /// Reads a varint-prefixed message or string.
+    [[nodiscard]] auto delimited() -> gsl::span<char const> { return bytes(varint()); }
+
+    [[nodiscard]] auto fixed64() -> std::uint64_t
+    {
+        std::uint64_t value;
+        std::memcpy(&value, bytes(sizeof(value)).data(), sizeof(value));
+        return value;
+    }
+
+    /// Reads a field key, returning its field number and wire type.
+    [[nodiscard]] auto key() -> std::pair<std::uint32_t, std::uint32_t>
+    {
+        auto key = varint();
+        return {static_cast<std::uint32_t>(key >> 3U), static_cast<std::uint32_t>(key & 7U)};
+    }
+
+    /// Skips the value of a field with the given wire type.
+    void skip(std::uint32_t wire_type)
+    {
+        switch (wire_type) {
+        case 0: (void)varint(); break;
+        case 1: (void)bytes(8); break;
+        case 2: (void)delimited(); break;
+        case 5: (void)bytes(4); break;
+        default: throw std::runtime_error(fmt::format("CIFF: unsupported wire type {}", wire_type));
+        }
+    }
+
+  private:
+    char const* m_pos;
+    char const* m_end;
+};
+
+struct Header {
+    std::int32_t version = 0;
+    std::int32_t num_postings_lists = 0;
+    std::int32_t num_docs = 0;
+    std::int32_t total_postings_lists = 0;
+    std::int32_t total_docs = 0;
+    std::int64_t total_terms_in_collection = 0;
+    double average_doclength = 0.0;
+    std::string description{};
+
+    [[nodiscard]] static auto parse(gsl::span<char const> message) -> Header
+    {
+        Header header;
+        WireReader reader(message);
+        while (not reader.empty()) {
+            auto [field, wire_type] = reader.key();
+            if (field == 1 && wire_type == 0) {
+                header.version = static_cast<std::int32_t>(reader.varint());
+            } else if (field == 2 && wire_type == 0) {
+                header.num_postings_lists = static_cast<std::int32_t>(reader.varint());
+            } else if (field == 3 && wire_type == 0) {
+                header.num_docs = static_cast<std::int32_t>(reader.varint());
+            } else if (field == 4 && wire_type == 0) {
+                header.total_postings_lists = static_cast<std::int32_t>(reader.varint());
+            } else if (field == 5 && wire_type == 0) {
+                header.total_docs = static_cast<std::int32_t>(reader.varint());
+            } else if (field == 6 && wire_type == 0) {
+                header.total_terms_in_collection = static_cast<std::int64_t>(reader.varint());
+            } else if (field == 7 && wire_type == 1) {
+                auto bits = reader.fixed64();
+                std::memcpy(&header.average_doclength, &bits, sizeof(bits));
+            } else if (field == 8 && wire_type == 2) {
+                auto text = reader.delimited();
+                header.description.assign(text.data(), text.size());
+            } else {
+                reader.skip(wire_type);
+            }
+        }
+        return header;
+    }
+};
+
+/// A posting list with absolute document IDs; CIFF stores them as gaps.
+struct PostingsList {
+    std::string_view term{};
+    std::vector<std::uint32_t> documents{};
+    std::vector<std::uint32_t> frequencies{};
+
+    /// Parses `message`, whose term then points into it.
+    ///
+    /// \throws std::runtime_error  unless the documents are strictly increasing and below
+    ///                             `num_docs`
+    [[nodiscard]] static auto parse(gsl::span<char const> message, std::uint32_t num_docs)
+        -> PostingsList
+    {
+        PostingsList list;
+        WireReader reader(message);
+        std::uint64_t docid = 0;
+        while (not reader.empty()) {
+            auto [field, wire_type] = reader.key();
+            if (field == 1 && wire_type == 2) {
+                auto term = reader.delimited();
+                list.term = std::string_view(term.data(), term.size());
+            } else if (field == 2 && wire_type == 0) {
+                // Every posting takes a few bytes, which caps the reservation on bad input.
+                auto df = std::min<std::uint64_t>(reader.varint(), message.size());
+                list.documents.reserve(df);
+                list.frequencies.reserve(df);
+            } else if (field == 4 && wire_type == 2) {
+                WireReader posting(reader.delimited());
+                std::uint64_t gap = 0;
+                std::uint32_t tf = 0;
+                while (not posting.empty()) {
+                    auto [posting_field, posting_wire_type] = posting.key();
+                    if (posting_field == 1 && posting_wire_type == 0) {
+                        gap = posting.varint();
+                    } else if (posting_field == 2 && posting_wire_type == 0) {
+                        tf = static_cast<std::uint32_t>(posting.varint());
+                    } else {
+                        posting.skip(posting_wire_type);
+                    }
+                }
+                // Every gap is checked, since a zero gap or one wrapping around 32 bits would
+                // still end the list below `num_docs` but break its compression.
+                if (not list.documents.empty() && gap == 0) {
+                    throw std::runtime_error(fmt::format(
+                        "CIFF: document {} of term {} is repeated", docid, list.term));
+                }
+                if (gap >= num_docs || docid + gap >= num_docs) {
+                    throw std::runtime_error(fmt::format(
+                        "CIFF: document {} + {} of term {} is out of range", docid, gap, list.term));
+                }
+                docid += gap;
+                list.documents.push_back(static_cast<std::uint32_t>(docid));
+                list.frequencies.push_back(tf);
+            } else {
+                reader.skip(wire_type);
+            }
+        }
+        return list;
+    }
+};
+
+struct DocRecord {
+    std::uint32_t docid = 0;
+    std::string_view collection_docid{};
+    std::uint32_t doclength = 0;
+
+    [[nodiscard]] static auto parse(gsl::span<char const> message) -> DocRecord
+    {
+        DocRecord record;
+        WireReader reader(message);
+        while (not reader.empty()) {
+            auto [field, wire_type] = reader.key();
+            if (field == 1 && wire_type == 0) {
+                record.docid = static_cast<std::uint32_t>(reader.varint());
+            } else if (field == 2 && wire_type == 2) {
+                auto name = reader.delimited();
+                record.collection_docid = std::string_view(name.data(), name.size());
+            } else if (field == 3 && wire_type == 0) {
+                record.doclength = static_cast<std::uint32_t>(reader.varint());
+            } else {
+                reader.skip(wire_type);
+            }
+        }
+        return record;
+    }
+};
+
+/// Number of posting lists decoded by a single task of `to_collection`.
+constexpr std::size_t lists_per_chunk = 1024;
+
+/// Writes the CIFF index in `source` as a binary collection with `.docs`, `.freqs` and
+/// `.sizes` files, the terms to `.terms` and the document names to `.documents`.
+///
+/// Messages are sliced from the mapped file in order, posting lists are decoded by parallel
+/// tasks, and each chunk of lists is written in order as a single buffer per file. At most
+/// two chunks per worker thread are in flight.
+///
+/// \throws std::runtime_error  if the input is malformed
+inline void to_collection(MemorySource const& source, std::string const& output_basename)
+{
+    WireReader reader(source.span());
+    auto header = Header::parse(reader.delimited());
+    if (header.num_postings_lists < 0 || header.num_docs < 0) {
+        throw std::runtime_error("CIFF: negative list or document count in header");
+    }
+    spdlog::info(
+        "CIFF version {}: {} posting lists, {} documents",
+        header.version,
+        header.num_postings_lists,
+        header.num_docs);
+
+    struct Chunk {
+        std::vector<gsl::span<char const>> messages{};
+        std::vector<std::uint32_t> docs{};
+        std::vector<std::uint32_t> freqs{};
+        std::string terms{};
+    };
+
+    std::ofstream dos(output_basename + ".docs");
+    std::ofstream fos(output_basename + ".freqs");
+    std::ofstream tos(output_basename + ".terms");
+    auto num_docs = static_cast<std::uint32_t>(header.num_docs);
+    std::uint32_t singleton = 1;
+    dos.write(reinterpret_cast<char const*>(&singleton), sizeof(singleton));
+    dos.write(reinterpret_cast<char const*>(&num_docs), sizeof(num_docs));
+
+    auto append_sequence = [](std::vector<std::uint32_t>& out, auto const& values) {
+        out.push_back(static_cast<std::uint32_t>(values.size()));
+        out.insert(out.end(), values.begin(), values.end());
+    };
+
+    std::size_t lists_read = 0;
+    std::size_t postings = 0;
+    {
+        pisa::progress progress("Reading posting lists", header.num_postings_lists);
+        std::size_t max_chunks = 2 * std::max<std::size_t>(1, tbb::this_task_arena::max_concurrency());
+        tbb::parallel_pipeline(
+            max_chunks,
+            tbb::make_filter<void, std::shared_ptr<Chunk>>(
+                tbb::filter::serial_in_order,
+                [&](tbb::flow_control& fc) -> std::shared_ptr<Chunk> {
+                    if (lists_read == static_cast<std::size_t>(header.num_postings_lists)) {
+                        fc.stop();
+                        return nullptr;
+                    }
+                    auto chunk = std::make_shared<Chunk>();
+                    while (lists_read < static_cast<std::size_t>(header.num_postings_lists)
+                           && chunk->messages.size() < lists_per_chunk) {
+                        chunk->messages.push_back(reader.delimited());
+                        lists_read += 1;
+                    }
+                    return chunk;
+                })
+                & tbb::make_filter<std::shared_ptr<Chunk>, std::shared_ptr<Chunk>>(
+                    tbb::filter::parallel,
+                    [&](std::shared_ptr<Chunk> chunk) {
+                        for (auto message: chunk->messages) {
+                            auto list = PostingsList::parse(message, num_docs);
+                            append_sequence(chunk->docs, list.documents);
+                            append_sequence(chunk->freqs, list.frequencies);
+                            chunk->terms.append(list.term);
+                            chunk->terms.push_back('\n');
+                        }
+                        return chunk;
+                    })
+                & tbb::make_filter<std::shared_ptr<Chunk>, void>(
+                    tbb::filter::serial_in_order, [&](std::shared_ptr<Chunk> chunk) {
+                        dos.write(
+                            reinterpret_cast<char const*>(chunk->docs.data()),
+                            chunk->docs.size() * sizeof(std::uint32_t));
+                        fos.write(
+                            reinterpret_cast<char const*>(chunk->freqs.data()),
+                            chunk->freqs.size() * sizeof(std::uint32_t));
+                        tos.write(chunk->terms.data(), chunk->terms.size());
+                        postings += chunk->docs.size() - chunk->messages.size();
+                        progress.update(chunk->messages.size());
+                    }));
+    }
+
+    std::vector<std::uint32_t> sizes(num_docs + 1, 0);
+    sizes[0] = num_docs;
+    std::vector<std::string_view> names(num_docs);
+    for (std::uint32_t record_idx = 0; record_idx < num_docs; ++record_idx) {
+        auto record = DocRecord::parse(reader.delimited());
+        if (record.docid >= num_docs) {
+            throw std::runtime_error(
+                fmt::format("CIFF: document record {} is out of range", record.docid));
+        }
+        sizes[record.docid + 1] = record.doclength;
+        names[record.docid] = record.collection_docid;
+    }
+    std::ofstream sos(output_basename + ".sizes");
+    sos.write(reinterpret_cast<char const*>(sizes.data()), sizes.size() * sizeof(std::uint32_t));
+    std::ofstream docos(output_basename + ".documents");
+    for (auto name: names) {
+        docos << name << '\n';
+    }
+
+    spdlog::info("Number of terms: {}", header.num_postings_lists);
+    spdlog::info("Number of documents: {}", num_docs);
+    spdlog::info("Number of postings: {}", postings);
+}
+
+}  // namespace pisa::ciff
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+// ANYTIME: Hot and cold tiers of clusters. Clusters the anytime algorithms rarely visit for a
+// query log are cold: their postings can be kept out of memory, and the timeout algorithms
+// expect them to cost more than resident clusters while they are out of memory.
+
+namespace pisa {
+
+class cluster_tiers {
+  public:
+    /// Every cluster is hot; visits are only recorded.
+    explicit cluster_tiers(std::size_t num_clusters)
+        : m_cold(num_clusters, false), m_visits(num_clusters)
+    {}
+
+    /// Clusters flagged in `cold` are expected to cost `cold_cost` times a hot cluster.
+    cluster_tiers(std::vector<bool> cold, float cold_cost)
+        : m_cold(std::move(cold)), m_cold_cost(cold_cost), m_visits(m_cold.size())
+    {}
+
+    [[nodiscard]] auto num_clusters() const -> std::size_t { return m_cold.size(); }
+
+    [[nodiscard]] auto is_cold(std::size_t cluster) const -> bool { return m_cold[cluster]; }
+
+    /// Cold clusters for which `resident` holds are in memory, and cost as much as hot ones.
+    /// Without it, cold clusters are assumed to be out of memory.
+    void track_residency(std::function<bool(std::size_t)> resident)
+    {
+        m_resident = std::move(resident);
+    }
+
+    /// Expected cost of processing `cluster`, relative to a hot cluster.
+    [[nodiscard]] auto cost(std::size_t cluster) const -> float
+    {
+        if (not m_cold[cluster] || (m_resident && m_resident(cluster))) {
+            return 1.0F;
+        }
+        return m_cold_cost;
+    }
+
+    /// Safe to call from concurrent queries.
+    void record_visit(std::size_t cluster)
+    {
+        m_visits[cluster].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] auto visits() const -> std::vector<std::uint64_t>
+    {
+        std::vector<std::uint64_t> visits;
+        for (auto const& count: m_visits) {
+            visits.push_back(count.load(std::memory_order_relaxed));
+        }
+        return visits;
+    }
+
+  private:
+    std::vector<bool> m_cold;
+    float m_cold_cost = 1.0F;
+    std::function<bool(std::size_t)> m_resident{};
+    std::vector<std::atomic<std::uint64_t>> m_visits;
+};
+
+/// Flags as cold every cluster outside the most visited ones that together account for
+/// `hot_fraction` of all visits. Clusters never visited are always cold.
+[[nodiscard]] inline auto classify_clusters(std::vector<std::uint64_t> const& visits, double hot_fraction)
+    -> std::vector<bool>
+{
+    std::vector<std::size_t> clusters(visits.size());
+    std::iota(clusters.begin(), clusters.end(), 0);
+    std::stable_sort(clusters.begin(), clusters.end(), [&](auto lhs, auto rhs) {
+        return visits[lhs] > visits[rhs];
+    });
+    auto total = std::accumulate(visits.begin(), visits.end(), std::uint64_t(0));
+    std::vector<bool> cold(visits.size(), true);
+    std::uint64_t covered = 0;
+    for (auto cluster: clusters) {
+        if (visits[cluster] == 0 || covered >= hot_fraction * total) {
+            break;
+        }
+        cold[cluster] = false;
+        covered += visits[cluster];
+    }
+    return cold;
+}
+
+/// Writes one `cluster visits` line per cluster.
+inline void write_cluster_visits(std::vector<std::uint64_t> const& visits, std::string const& filename)
+{
+    std::ofstream os(filename);
+    for (std::size_t cluster = 0; cluster < visits.size(); ++cluster) {
+        os << cluster << ' ' << visits[cluster] << '\n';
+    }
+}
+
+[[nodiscard]] inline auto read_cluster_visits(std::string const& filename) -> std::vector<std::uint64_t>
+{
+    std::vector<std::uint64_t> visits;
+    std::uint64_t cluster, count;
+    std::ifstream is(filename);
+    while (is >> cluster >> count) {
+        if (cluster != visits.size()) {
+            spdlog::error("Cluster visit file must be sorted in ascending order of cluster.");
+            std::exit(EXIT_FAILURE);
+        }
+        visits.push_back(count);
+    }
+    return visits;
+}
+
+/// Writes one `cluster tier` line per cluster, where the tier is either `hot` or `cold`.
+inline void write_cluster_tiers(std::vector<bool> const& cold, std::string const& filename)
+{
+    std::ofstream os(filename);
+    for (std::size_t cluster = 0; cluster < cold.size(); ++cluster) {
+        os << cluster << ' ' << (cold[cluster] ? "cold" : "hot") << '\n';
+    }
+}
+
+[[nodiscard]] inline auto read_cluster_tiers(std::string const& filename) -> std::vector<bool>
+{
+    std::vector<bool> cold;
+    std::uint64_t cluster;
+    std::string tier;
+    std::ifstream is(filename);
+    while (is >> cluster >> tier) {
+        if (cluster != cold.size() || (tier != "hot" && tier != "cold")) {
+            spdlog::error("Cluster tier file must list every cluster in order, as hot or cold.");
+            std::exit(EXIT_FAILURE);
+        }
+        cold.push_back(tier == "cold");
+    }
+    return cold;
+}
+
+}  // namespace pisa
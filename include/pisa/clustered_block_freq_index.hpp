@@ -0,0 +1,716 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+    #include <sys/mman.h>
+#endif
+
+#include "block_posting_list.hpp"
+#include "global_parameters.hpp"
+#include "mappable/mappable_vector.hpp"
+#include "mappable/mapper.hpp"
+#include "memory_source.hpp"
+#include "util/broadword.hpp"
+#include "util/likely.hpp"
+
+// ANYTIME: A block index storing every posting list as one segment per cluster (docid range)
+// containing the term. Each list has a directory of its segments, and a bitmap of the clusters
+// it appears in with the rank of every bitmap word, so a cursor enters any cluster in constant
+// time instead of skipping through blocks. With `Interleaved`, the segments of all terms for one cluster are stored
+// together, so processing a cluster reads a contiguous region of the file.
+//
+// ANYTIME: An interleaved index can also be tiered: the regions of its cold clusters are moved
+// to a separate file that is only mapped once a cursor first reads from it. The size of every
+// list and the first docid of every segment are kept with the directory, so opening a cursor,
+// or entering a cold cluster, reads nothing from the cold tier until a posting past the first
+// one, or a frequency, is needed.
+
+namespace pisa {
+
+struct ClusteredIndexTag;
+
+namespace detail {
+
+    /// Postings of the cold clusters of a tiered index, mapped on first access. The tier also
+    /// tracks which cold clusters were read since it was last evicted, and how many bytes they
+    /// take: pages dropped by the kernel under memory pressure are not noticed.
+    class cold_tier {
+      public:
+        /// `cluster_bytes` holds the size of the region of every cluster, 0 for hot ones.
+        cold_tier(std::string path, std::vector<uint64_t> cluster_bytes)
+            : m_path(std::move(path)),
+              m_cluster_bytes(std::move(cluster_bytes)),
+              m_resident(m_cluster_bytes.size())
+        {}
+
+        [[nodiscard]] auto data() -> uint8_t const*
+        {
+            std::call_once(m_mapped, [this] {
+                m_source = MemorySource::mapped_file(m_path);
+                m_data.store(
+                    reinterpret_cast<uint8_t const*>(m_source.data()), std::memory_order_release);
+            });
+            return m_data.load(std::memory_order_relaxed);
+        }
+
+        /// Records that `cluster` is read. Safe to call from concurrent queries.
+        void touch(uint64_t cluster)
+        {
+            if (not m_resident[cluster].load(std::memory_order_relaxed)
+                && not m_resident[cluster].exchange(true, std::memory_order_relaxed)) {
+                m_resident_bytes.fetch_add(m_cluster_bytes[cluster], std::memory_order_relaxed);
+            }
+        }
+
+        [[nodiscard]] auto is_resident(uint64_t cluster) const -> bool
+        {
+            return m_resident[cluster].load(std::memory_order_relaxed);
+        }
+
+        /// Bytes of the clusters read since the last eviction.
+        [[nodiscard]] auto resident_bytes() const -> uint64_t
+        {
+            return m_resident_bytes.load(std::memory_order_relaxed);
+        }
+
+        /// Drops the pages of the tier; they are read back from the file on the next access.
+        void evict()
+        {
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+            if (auto data = m_data.load(std::memory_order_acquire); data != nullptr) {
+                madvise(const_cast<uint8_t*>(data), m_source.size(), MADV_DONTNEED);
+            }
+#endif
+            for (auto& resident: m_resident) {
+                resident.store(false, std::memory_order_relaxed);
+            }
+            m_resident_bytes.store(0, std::memory_order_relaxed);
+        }
+
+      private:
+        std::string m_path;
+        std::once_flag m_mapped;
+        MemorySource m_source;
+        std::atomic<uint8_t const*> m_data{nullptr};
+        std::vector<uint64_t> m_cluster_bytes;
+        std::vector<std::atomic<bool>> m_resident;
+        std::atomic<uint64_t> m_resident_bytes{0};
+    };
+
+}  // namespace detail
+
+template <typename BlockCodec, bool Interleaved = false>
+class clustered_block_freq_index {
+  public:
+    using index_layout_tag = ClusteredIndexTag;
+    clustered_block_freq_index() = default;
+    explicit clustered_block_freq_index(MemorySource source) : m_source(std::move(source))
+    {
+        mapper::map(*this, m_source.data(), mapper::map_flags::warmup);
+    }
+
+    class builder {
+      public:
+        /// Builds an index over clusters ending at `boundaries`, as read from a `.cluster-range`
+        /// file. Without boundaries, the whole collection is a single cluster.
+        builder(uint64_t num_docs, global_parameters const& params, std::vector<uint32_t> boundaries = {})
+            : m_params(params), m_num_docs(num_docs), m_boundaries(std::move(boundaries))
+        {
+            if (not std::is_sorted(m_boundaries.begin(), m_boundaries.end())) {
+                throw std::invalid_argument("Cluster boundaries must be sorted in ascending order");
+            }
+            // As in `DocToRange`, the last cluster covers every remaining document.
+            for (auto& boundary: m_boundaries) {
+                boundary = std::min<uint64_t>(boundary, num_docs);
+            }
+            if (m_boundaries.empty()) {
+                m_boundaries.push_back(num_docs);
+            } else {
+                m_boundaries.back() = num_docs;
+            }
+            m_bitmap_words = (m_boundaries.size() + 63) / 64;
+            m_terms_start.push_back(0);
+            m_cluster_lists.resize(Interleaved ? m_boundaries.size() : 0);
+        }
+
+        template <typename DocsIterator, typename FreqsIterator>
+        void add_posting_list(
+            uint64_t n,
+            DocsIterator docs_begin,
+            FreqsIterator freqs_begin,
+            uint64_t /* occurrences */)
+        {
+            if (!n) {
+                throw std::invalid_argument("List must be nonempty");
+            }
+            m_clusters.resize(m_clusters.size() + m_bitmap_words, 0);
+            auto bitmap = std::prev(m_clusters.end(), m_bitmap_words);
+
+            DocsIterator docs_it(docs_begin);
+            FreqsIterator freqs_it(freqs_begin);
+            uint32_t cluster = 0;
+            uint64_t position = 0;
+            while (position < n) {
+                uint64_t docid = *docs_it;
+                if (docid >= m_num_docs) {
+                    throw std::invalid_argument("Document ID out of range");
+                }
+                while (docid >= m_boundaries[cluster]) {
+                    ++cluster;
+                }
+                // Segments store document IDs relative to the start of their cluster.
+                uint32_t cluster_begin = cluster == 0 ? 0 : m_boundaries[cluster - 1];
+                m_docs_buf.clear();
+                m_freqs_buf.clear();
+                while (position < n && (docid = *docs_it) < m_boundaries[cluster]) {
+                    m_docs_buf.push_back(docid - cluster_begin);
+                    m_freqs_buf.push_back(*freqs_it);
+                    ++docs_it;
+                    ++freqs_it;
+                    ++position;
+                }
+                bitmap[cluster / 64] |= uint64_t(1) << (cluster % 64);
+                m_segment_cluster.push_back(cluster);
+                m_segment_position.push_back(position - m_docs_buf.size());
+                m_segment_first.push_back(m_docs_buf.front());
+                auto& out = Interleaved ? m_cluster_lists[cluster] : m_lists;
+                m_segment_offset.push_back(out.size());
+                block_posting_list<BlockCodec>::write(
+                    out, m_docs_buf.size(), m_docs_buf.begin(), m_freqs_buf.begin());
+            }
+            uint32_t rank = 0;
+            for (uint64_t word = 0; word < m_bitmap_words; ++word) {
+                m_cluster_ranks.push_back(rank);
+                rank += broadword::popcount(bitmap[word]);
+            }
+            m_terms_start.push_back(m_segment_cluster.size());
+            m_list_sizes.push_back(n);
+        }
+
+        void build(clustered_block_freq_index& sq)
+        {
+            if constexpr (Interleaved) {
+                std::vector<uint64_t> cluster_offsets;
+                for (auto& cluster_list: m_cluster_lists) {
+                    cluster_offsets.push_back(m_lists.size());
+                    m_lists.insert(m_lists.end(), cluster_list.begin(), cluster_list.end());
+                    std::vector<uint8_t>().swap(cluster_list);
+                }
+                cluster_offsets.push_back(m_lists.size());
+                for (size_t segment = 0; segment < m_segment_offset.size(); ++segment) {
+                    m_segment_offset[segment] += cluster_offsets[m_segment_cluster[segment]];
+                }
+                sq.m_cluster_offsets.steal(cluster_offsets);
+            }
+            sq.m_params = m_params;
+            sq.m_size = m_terms_start.size() - 1;
+            sq.m_num_docs = m_num_docs;
+            sq.m_bitmap_words = m_bitmap_words;
+            sq.m_boundaries.steal(m_boundaries);
+            sq.m_clusters.steal(m_clusters);
+            sq.m_cluster_ranks.steal(m_cluster_ranks);
+            sq.m_terms_start.steal(m_terms_start);
+            sq.m_list_sizes.steal(m_list_sizes);
+            sq.m_segment_cluster.steal(m_segment_cluster);
+            sq.m_segment_position.steal(m_segment_position);
+            sq.m_segment_first.steal(m_segment_first);
+            sq.m_segment_offset.steal(m_segment_offset);
+            sq.m_lists.steal(m_lists);
+        }
+
+      private:
+        global_parameters m_params;
+        uint64_t m_num_docs;
+        std::vector<uint32_t> m_boundaries;
+        uint64_t m_bitmap_words;
+        std::vector<uint64_t> m_clusters;
+        std::vector<uint32_t> m_cluster_ranks;
+        std::vector<uint64_t> m_terms_start;
+        std::vector<uint32_t> m_list_sizes;
+        std::vector<uint32_t> m_segment_cluster;
+        std::vector<uint32_t> m_segment_position;
+        std::vector<uint32_t> m_segment_first;
+        std::vector<uint64_t> m_segment_offset;
+        std::vector<uint8_t> m_lists;
+        std::vector<std::vector<uint8_t>> m_cluster_lists;
+        std::vector<uint32_t> m_docs_buf;
+        std::vector<uint32_t> m_freqs_buf;
+    };
+
+    size_t size() const { return m_size; }
+
+    uint64_t num_docs() const { return m_num_docs; }
+
+    size_t num_clusters() const { return m_boundaries.size(); }
+
+    class document_enumerator {
+      public:
+        void reset() { open(0); }
+
+        void PISA_ALWAYSINLINE next()
+        {
+            ensure_loaded();
+            m_segment.next();
+            if (PISA_UNLIKELY(m_segment.docid() == m_segment_universe)) {
+                open(m_cur_segment + 1);
+            } else {
+                m_cur_docid = m_segment_begin + m_segment.docid();
+            }
+        }
+
+        void PISA_ALWAYSINLINE next_geq(uint64_t lower_bound)
+        {
+            if (lower_bound <= m_cur_docid) {
+                return;
+            }
+            if (PISA_UNLIKELY(lower_bound >= m_segment_begin + m_segment_universe)) {
+                global_geq(lower_bound);
+                return;
+            }
+            ensure_loaded();
+            m_segment.next_geq(lower_bound - m_segment_begin);
+            if (PISA_UNLIKELY(m_segment.docid() == m_segment_universe)) {
+                open(m_cur_segment + 1);
+            } else {
+                m_cur_docid = m_segment_begin + m_segment.docid();
+            }
+        }
+
+        // ANYTIME: Moves to the first posting not lower than `lower_bound`, possibly backwards,
+        // by entering the cluster of `lower_bound` directly.
+        void global_geq(uint64_t lower_bound)
+        {
+            if (PISA_UNLIKELY(lower_bound >= m_index->m_num_docs)) {
+                open(m_num_segments);
+                return;
+            }
+            auto const& boundaries = m_index->m_boundaries;
+            auto cluster = std::distance(
+                boundaries.begin(), std::upper_bound(boundaries.begin(), boundaries.end(), lower_bound));
+            enter_cluster(cluster);
+            if (m_cur_docid < lower_bound) {
+                ensure_loaded();
+                m_segment.next_geq(lower_bound - m_segment_begin);
+                if (m_segment.docid() == m_segment_universe) {
+                    open(m_cur_segment + 1);
+                } else {
+                    m_cur_docid = m_segment_begin + m_segment.docid();
+                }
+            }
+        }
+
+        /// Moves to the first posting of `cluster`, or of the first cluster after it containing
+        /// the term, in constant time: the segment is the rank of the cluster's bitmap word plus
+        /// the clusters set before it within the word.
+        void enter_cluster(uint64_t cluster)
+        {
+            if (PISA_UNLIKELY(cluster >= m_index->num_clusters())) {
+                open(m_num_segments);
+                return;
+            }
+            uint64_t word = cluster / 64;
+            uint64_t mask = (uint64_t(1) << (cluster % 64)) - 1;
+            open(m_cluster_ranks[word] + broadword::popcount(m_cluster_bitmap[word] & mask));
+        }
+
+        void move(uint64_t pos)
+        {
+            if (pos >= m_size) {
+                open(m_num_segments);
+                return;
+            }
+            auto const* positions = m_index->m_segment_position.data() + m_first_segment;
+            uint64_t segment =
+                std::distance(positions, std::upper_bound(positions, positions + m_num_segments, pos))
+                - 1;
+            if (segment != m_cur_segment || pos < position()) {
+                open(segment);
+            }
+            ensure_loaded();
+            m_segment.move(pos - positions[segment]);
+            m_cur_docid = m_segment_begin + m_segment.docid();
+        }
+
+        uint64_t docid() const { return m_cur_docid; }
+
+        uint64_t PISA_ALWAYSINLINE freq()
+        {
+            ensure_loaded();
+            return m_segment.freq();
+        }
+
+        uint64_t position() const
+        {
+            if (m_cur_segment == m_num_segments) {
+                return m_size;
+            }
+            return m_index->m_segment_position[m_first_segment + m_cur_segment]
+                + (m_pending ? 0 : m_segment.position());
+        }
+
+        uint64_t size() const { return m_size; }
+
+        uint64_t num_segments() const { return m_num_segments; }
+
+        uint64_t stats_freqs_size()
+        {
+            uint64_t bytes = 0;
+            for (uint64_t segment = 0; segment < m_num_segments; ++segment) {
+                open(segment);
+                ensure_loaded();
+                bytes += m_segment.stats_freqs_size();
+            }
+            reset();
+            return bytes;
+        }
+
+      private:
+        friend class clustered_block_freq_index;
+
+        document_enumerator(clustered_block_freq_index const& index, size_t term_id)
+            : m_index(&index),
+              m_first_segment(index.m_terms_start[term_id]),
+              m_num_segments(index.m_terms_start[term_id + 1] - m_first_segment),
+              m_cluster_bitmap(index.m_clusters.data() + term_id * index.m_bitmap_words),
+              m_cluster_ranks(index.m_cluster_ranks.data() + term_id * index.m_bitmap_words),
+              m_size(index.m_list_sizes[term_id]),
+              m_pending(index.is_cold(index.m_segment_cluster[m_first_segment])),
+              m_segment(
+                  m_pending ? placeholder_list() : index.segment_data(m_first_segment),
+                  m_pending ? 1 : index.cluster_size(index.m_segment_cluster[m_first_segment]))
+        {
+            set_segment(0);
+        }
+
+        /// A list of one posting, which cursors decode instead of a cold first segment.
+        static uint8_t const* placeholder_list()
+        {
+            static std::vector<uint8_t> const list = [] {
+                std::vector<uint8_t> out;
+                uint32_t docid = 0;
+                uint32_t freq = 1;
+                block_posting_list<BlockCodec>::write(out, 1, &docid, &freq);
+                return out;
+            }();
+            return list.data();
+        }
+
+        /// Moves to the first posting of `segment`. A cold segment is only read once a posting
+        /// past its first one, or a frequency, is needed: until then, its first docid comes from
+        /// the directory.
+        void PISA_NOINLINE open(uint64_t segment)
+        {
+            m_pending = false;
+            if (segment < m_num_segments) {
+                auto global_segment = m_first_segment + segment;
+                auto cluster = m_index->m_segment_cluster[global_segment];
+                if (m_index->is_cold(cluster)) {
+                    m_pending = true;
+                } else {
+                    m_segment.reopen(m_index->segment_data(global_segment), m_index->cluster_size(cluster));
+                }
+            }
+            set_segment(segment);
+        }
+
+        void PISA_ALWAYSINLINE ensure_loaded()
+        {
+            if (PISA_UNLIKELY(m_pending)) {
+                load_pending();
+            }
+        }
+
+        void PISA_NOINLINE load_pending()
+        {
+            auto global_segment = m_first_segment + m_cur_segment;
+            m_segment.reopen(
+                m_index->segment_data(global_segment),
+                m_index->cluster_size(m_index->m_segment_cluster[global_segment]));
+            m_pending = false;
+        }
+
+        void set_segment(uint64_t segment)
+        {
+            m_cur_segment = segment;
+            if (segment == m_num_segments) {
+                m_segment_begin = m_index->m_num_docs;
+                m_segment_universe = 0;
+                m_cur_docid = m_index->m_num_docs;
+                return;
+            }
+            auto cluster = m_index->m_segment_cluster[m_first_segment + segment];
+            m_segment_begin = m_index->cluster_begin(cluster);
+            m_segment_universe = m_index->cluster_size(cluster);
+            m_cur_docid = m_segment_begin
+                + (m_pending ? m_index->m_segment_first[m_first_segment + segment] : m_segment.docid());
+        }
+
+        clustered_block_freq_index const* m_index;
+        uint64_t m_first_segment;
+        uint64_t m_num_segments;
+        uint64_t const* m_cluster_bitmap;
+        uint32_t const* m_cluster_ranks;
+        uint64_t m_size;
+        /// Whether the current segment is cold and not decoded yet.
+        bool m_pending;
+
+        uint64_t m_cur_segment{0};
+        uint64_t m_segment_begin{0};
+        uint64_t m_segment_universe{0};
+        uint64_t m_cur_docid{0};
+        typename block_posting_list<BlockCodec>::document_enumerator m_segment;
+    };
+
+    document_enumerator operator[](size_t i) const
+    {
+        assert(i < size());
+        return document_enumerator(*this, i);
+    }
+
+    /// Segments of a list may be spread over the file, so the list is warmed up by decoding it.
+    /// Segments in the cold tier are left alone.
+    void warmup(size_t i) const
+    {
+        assert(i < size());
+        auto list = (*this)[i];
+        volatile uint64_t tmp;
+        for (size_t segment = 0; segment < list.num_segments(); ++segment) {
+            auto global_segment = m_terms_start[i] + segment;
+            if (is_cold(m_segment_cluster[global_segment])) {
+                continue;
+            }
+            list.open(segment);
+            auto n = segment_size(i, global_segment);
+            for (size_t pos = 0; pos < n; ++pos, list.m_segment.next()) {
+                tmp = list.m_segment.freq();
+            }
+        }
+        (void)tmp;
+    }
+
+    [[nodiscard]] bool is_tiered() const { return m_cold.size() != 0; }
+
+    [[nodiscard]] bool is_cold(uint64_t cluster) const
+    {
+        return m_cold.size() != 0 && m_cold[cluster] != 0;
+    }
+
+    /// Whether the postings of `cluster` are in memory: hot clusters always are, and cold ones
+    /// once read since the cold tier was last evicted.
+    [[nodiscard]] bool is_resident(uint64_t cluster) const
+    {
+        return not is_cold(cluster) || (m_cold_tier && m_cold_tier->is_resident(cluster));
+    }
+
+    /// Attaches the cold tier written by `write_tiered`. It is only mapped when first read.
+    void open_cold_tier(std::string const& path)
+    {
+        // Cold regions are stored in cluster order, so each ends where the next one begins.
+        std::ifstream is(path, std::ios::binary | std::ios::ate);
+        if (not is) {
+            throw std::runtime_error("Cannot open cold tier " + path);
+        }
+        auto end = static_cast<uint64_t>(is.tellg());
+        std::vector<uint64_t> cluster_bytes(num_clusters(), 0);
+        for (uint64_t cluster = num_clusters(); cluster > 0; --cluster) {
+            if (is_cold(cluster - 1)) {
+                cluster_bytes[cluster - 1] = end - m_cluster_offsets[cluster - 1];
+                end = m_cluster_offsets[cluster - 1];
+            }
+        }
+        m_cold_tier = std::make_shared<detail::cold_tier>(path, std::move(cluster_bytes));
+    }
+
+    /// Releases the memory of the cold tier, if it has been mapped.
+    void evict_cold_tier() const
+    {
+        if (m_cold_tier) {
+            m_cold_tier->evict();
+        }
+    }
+
+    /// Bytes of the cold clusters read since the cold tier was last evicted.
+    [[nodiscard]] uint64_t cold_tier_resident_bytes() const
+    {
+        return m_cold_tier ? m_cold_tier->resident_bytes() : 0;
+    }
+
+    /// Evicts the cold tier once the cold clusters read since the last eviction exceed
+    /// `budget` bytes, and returns whether it did.
+    bool enforce_cold_tier_budget(uint64_t budget) const
+    {
+        if (cold_tier_resident_bytes() <= budget) {
+            return false;
+        }
+        evict_cold_tier();
+        return true;
+    }
+
+    /// Writes this index to `output_path` with the regions of the clusters flagged in `cold`
+    /// moved to `cold_path`. Only the interleaved layout keeps a cluster contiguous.
+    void write_tiered(
+        std::vector<bool> const& cold, std::string const& output_path, std::string const& cold_path) const
+    {
+        static_assert(Interleaved, "Only interleaved indexes can be tiered");
+        if (cold.size() != num_clusters()) {
+            throw std::invalid_argument("Expected one tier per cluster");
+        }
+        if (is_tiered()) {
+            throw std::invalid_argument("Index is already tiered");
+        }
+        std::vector<uint8_t> lists;
+        std::vector<uint8_t> cold_flags(cold.begin(), cold.end());
+        std::vector<uint64_t> cluster_offsets;
+        std::ofstream cold_os(cold_path, std::ios::binary);
+        uint64_t cold_size = 0;
+        for (uint64_t cluster = 0; cluster < num_clusters(); ++cluster) {
+            auto begin = m_lists.begin() + m_cluster_offsets[cluster];
+            auto end = m_lists.begin() + m_cluster_offsets[cluster + 1];
+            if (cold[cluster]) {
+                cluster_offsets.push_back(cold_size);
+                cold_os.write(reinterpret_cast<char const*>(&*begin), std::distance(begin, end));
+                cold_size += std::distance(begin, end);
+            } else {
+                cluster_offsets.push_back(lists.size());
+                lists.insert(lists.end(), begin, end);
+            }
+        }
+        cluster_offsets.push_back(lists.size());
+        std::vector<uint64_t> segment_offset(m_segment_offset.begin(), m_segment_offset.end());
+        for (size_t segment = 0; segment < segment_offset.size(); ++segment) {
+            auto cluster = m_segment_cluster[segment];
+            segment_offset[segment] += cluster_offsets[cluster] - m_cluster_offsets[cluster];
+        }
+
+        auto boundaries = copy_of(m_boundaries);
+        auto clusters = copy_of(m_clusters);
+        auto cluster_ranks = copy_of(m_cluster_ranks);
+        auto terms_start = copy_of(m_terms_start);
+        auto list_sizes = copy_of(m_list_sizes);
+        auto segment_cluster = copy_of(m_segment_cluster);
+        auto segment_position = copy_of(m_segment_position);
+        auto segment_first = copy_of(m_segment_first);
+
+        clustered_block_freq_index tiered;
+        tiered.m_params = m_params;
+        tiered.m_size = m_size;
+        tiered.m_num_docs = m_num_docs;
+        tiered.m_bitmap_words = m_bitmap_words;
+        tiered.m_boundaries.steal(boundaries);
+        tiered.m_clusters.steal(clusters);
+        tiered.m_cluster_ranks.steal(cluster_ranks);
+        tiered.m_terms_start.steal(terms_start);
+        tiered.m_list_sizes.steal(list_sizes);
+        tiered.m_segment_cluster.steal(segment_cluster);
+        tiered.m_segment_position.steal(segment_position);
+        tiered.m_segment_first.steal(segment_first);
+        tiered.m_segment_offset.steal(segment_offset);
+        tiered.m_cluster_offsets.steal(cluster_offsets);
+        tiered.m_cold.steal(cold_flags);
+        tiered.m_lists.steal(lists);
+        mapper::freeze(tiered, output_path.c_str());
+    }
+
+    void swap(clustered_block_freq_index& other)
+    {
+        std::swap(m_params, other.m_params);
+        std::swap(m_size, other.m_size);
+        std::swap(m_num_docs, other.m_num_docs);
+        std::swap(m_bitmap_words, other.m_bitmap_words);
+        m_boundaries.swap(other.m_boundaries);
+        m_clusters.swap(other.m_clusters);
+        m_cluster_ranks.swap(other.m_cluster_ranks);
+        m_terms_start.swap(other.m_terms_start);
+        m_list_sizes.swap(other.m_list_sizes);
+        m_segment_cluster.swap(other.m_segment_cluster);
+        m_segment_position.swap(other.m_segment_position);
+        m_segment_first.swap(other.m_segment_first);
+        m_segment_offset.swap(other.m_segment_offset);
+        m_cluster_offsets.swap(other.m_cluster_offsets);
+        m_cold.swap(other.m_cold);
+        m_lists.swap(other.m_lists);
+        m_cold_tier.swap(other.m_cold_tier);
+    }
+
+    template <typename Visitor>
+    void map(Visitor& visit)
+    {
+        visit(m_params, "m_params")(m_size, "m_size")(m_num_docs, "m_num_docs")(
+            m_bitmap_words, "m_bitmap_words")(m_boundaries, "m_boundaries")(
+            m_clusters, "m_clusters")(m_cluster_ranks, "m_cluster_ranks")(
+            m_terms_start, "m_terms_start")(m_list_sizes, "m_list_sizes")(
+            m_segment_cluster, "m_segment_cluster")(m_segment_position, "m_segment_position")(
+            m_segment_first, "m_segment_first")(m_segment_offset, "m_segment_offset")(m_cluster_offsets, "m_cluster_offsets")(
+            m_cold, "m_cold")(m_lists, "m_lists");
+    }
+
+  private:
+    uint64_t cluster_begin(uint64_t cluster) const
+    {
+        return cluster == 0 ? 0 : m_boundaries[cluster - 1];
+    }
+
+    uint64_t cluster_size(uint64_t cluster) const
+    {
+        return m_boundaries[cluster] - cluster_begin(cluster);
+    }
+
+    /// Start of the given segment, in the cold tier if its cluster is cold.
+    uint8_t const* segment_data(uint64_t segment) const
+    {
+        if (PISA_UNLIKELY(is_cold(m_segment_cluster[segment]))) {
+            if (not m_cold_tier) {
+                throw std::runtime_error("Cold cluster accessed, but no cold tier was opened");
+            }
+            m_cold_tier->touch(m_segment_cluster[segment]);
+            return m_cold_tier->data() + m_segment_offset[segment];
+        }
+        return m_lists.data() + m_segment_offset[segment];
+    }
+
+    /// Number of postings of the given segment of `term`, from the directory.
+    uint64_t segment_size(size_t term, uint64_t segment) const
+    {
+        uint64_t end = segment + 1 < m_terms_start[term + 1] ? m_segment_position[segment + 1]
+                                                             : m_list_sizes[term];
+        return end - m_segment_position[segment];
+    }
+
+    template <typename T>
+    static std::vector<T> copy_of(mapper::mappable_vector<T> const& vec)
+    {
+        return std::vector<T>(vec.begin(), vec.end());
+    }
+
+    global_parameters m_params;
+    size_t m_size{0};
+    size_t m_num_docs{0};
+    uint64_t m_bitmap_words{0};
+    mapper::mappable_vector<uint32_t> m_boundaries;
+    mapper::mappable_vector<uint64_t> m_clusters;
+    /// Number of clusters of the term before each word of its bitmap.
+    mapper::mappable_vector<uint32_t> m_cluster_ranks;
+    mapper::mappable_vector<uint64_t> m_terms_start;
+    mapper::mappable_vector<uint32_t> m_list_sizes;
+    mapper::mappable_vector<uint32_t> m_segment_cluster;
+    mapper::mappable_vector<uint32_t> m_segment_position;
+    /// First docid of each segment, relative to its cluster.
+    mapper::mappable_vector<uint32_t> m_segment_first;
+    mapper::mappable_vector<uint64_t> m_segment_offset;
+    /// Start of the region of each cluster, in the file holding it (interleaved only).
+    mapper::mappable_vector<uint64_t> m_cluster_offsets;
+    /// Nonzero for the clusters stored in the cold tier; empty if the index is not tiered.
+    mapper::mappable_vector<uint8_t> m_cold;
+    mapper::mappable_vector<uint8_t> m_lists;
+    MemorySource m_source;
+    std::shared_ptr<detail::cold_tier> m_cold_tier;
+};
+}  // namespace pisa
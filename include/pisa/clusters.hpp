@@ -2,6 +2,12 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -9,6 +15,9 @@
 
 #include "tokenizer.hpp"
 #include <boost/algorithm/string/join.hpp>
+#include "codec/block_codecs.hpp"
+#include "memory_source.hpp"
+#include "payload_vector.hpp"
 #include "query/queries.hpp"
 #include "query/term_processor.hpp"
 
@@ -51,6 +60,222 @@ std::unordered_map<std::string, cluster_queue> read_selected_clusters(std::strin
     return selected_clusters;
 }
 
+// ANYTIME: Binary format of the selected clusters, mapped instead of parsed. The layout is:
+//   - the 8-byte `selected_clusters_magic`,
+//   - the number of bytes taken by the query ID dictionary (uint64),
+//   - the query ID dictionary: a `Payload_Vector` of the query IDs in sorted order,
+//   - the cluster queues: a `Payload_Vector` whose i-th payload is the queue of the i-th
+//     query ID, stored as its length followed by zig-zag encoded deltas between
+//     consecutive cluster IDs (the first from 0), all as variable bytes.
+// A delta between two 32-bit IDs takes 33 bits once zig-zag encoded, so the deltas use a
+// 64-bit variable byte code with the layout of `TightVariableByte`.
+constexpr std::array<char, 8> selected_clusters_magic{'P', 'I', 'S', 'A', 'C', 'L', 'Q', '1'};
+
+// Appends `value` in the layout of `TightVariableByte`, which only takes 32-bit values:
+// 7 bits per byte, least significant first, with the high bit set on the last byte.
+inline void encode_tight_vbyte64(uint64_t value, std::vector<uint8_t>& out)
+{
+    while (value >= (1U << 7)) {
+        out.push_back(static_cast<uint8_t>(value & ((1U << 7) - 1)));
+        value >>= 7U;
+    }
+    out.push_back(static_cast<uint8_t>(value | (1U << 7)));
+}
+
+// Decodes a value written by `encode_tight_vbyte64` from `[in, end)`.
+inline auto decode_tight_vbyte64(uint8_t const* in, uint8_t const* end, uint64_t& value)
+    -> uint8_t const*
+{
+    value = 0;
+    for (unsigned shift = 0; in != end && shift < 64; shift += 7) {
+        uint8_t c = *in++;
+        value |= static_cast<uint64_t>(c & 127U) << shift;
+        if ((c & 128U) != 0) {
+            return in;
+        }
+    }
+    throw std::runtime_error("Corrupted selected clusters: truncated cluster queue");
+}
+
+// Writes `selected_clusters` in the binary format.
+inline void write_selected_clusters(
+    std::unordered_map<std::string, cluster_queue> const& selected_clusters,
+    std::string const& out_file)
+{
+    std::vector<std::string> ids;
+    ids.reserve(selected_clusters.size());
+    for (auto const& entry: selected_clusters) {
+        ids.push_back(entry.first);
+    }
+    std::sort(ids.begin(), ids.end());
+    auto dictionary = encode_payload_vector(gsl::span<std::string const>(ids));
+    auto queues = encode_payload_vector(ids.begin(), ids.end(), [&](auto const& id, auto out) {
+        auto const& clusters = selected_clusters.at(id);
+        std::vector<uint8_t> bytes;
+        TightVariableByte::encode_single(clusters.size(), bytes);
+        int64_t previous = 0;
+        for (auto cluster: clusters) {
+            int64_t delta = static_cast<int64_t>(cluster) - previous;
+            encode_tight_vbyte64(
+                (static_cast<uint64_t>(delta) << 1U) ^ static_cast<uint64_t>(delta >> 63), bytes);
+            previous = cluster;
+        }
+        std::transform(bytes.begin(), bytes.end(), out, [](auto b) { return std::byte{b}; });
+    });
+
+    std::ofstream os(out_file, std::ios::binary);
+    uint64_t dictionary_bytes = sizeof(uint64_t) * (dictionary.offsets.size() + 1)
+        + dictionary.payloads.size();
+    os.write(selected_clusters_magic.data(), selected_clusters_magic.size());
+    os.write(reinterpret_cast<char const*>(&dictionary_bytes), sizeof(dictionary_bytes));
+    dictionary.to_stream(os);
+    queues.to_stream(os);
+}
+
+// Read-only view over selected clusters stored in the binary format.
+class SelectedClusters {
+  public:
+    explicit SelectedClusters(MemorySource source) : m_source(std::move(source))
+    {
+        auto bytes = gsl::span<std::byte const>(
+            reinterpret_cast<std::byte const*>(m_source.data()), m_source.size());
+        if (not is_binary(bytes)) {
+            throw std::invalid_argument("Not a binary selected clusters file");
+        }
+        auto [dictionary_bytes, tail] =
+            unpack_head<uint64_t>(bytes.subspan(selected_clusters_magic.size()));
+        auto [dictionary, queues] = split(tail, dictionary_bytes);
+        m_ids = Payload_Vector<>::from(dictionary);
+        m_queues = Payload_Vector<>::from(queues);
+        if (m_ids.size() != m_queues.size()) {
+            throw std::runtime_error(fmt::format(
+                "Corrupted selected clusters: {} query IDs but {} cluster queues",
+                m_ids.size(),
+                m_queues.size()));
+        }
+    }
+
+    [[nodiscard]] static auto from_mapped(std::string const& path) -> SelectedClusters
+    {
+        return SelectedClusters(MemorySource::mapped_file(path));
+    }
+
+    // Checks whether `bytes` begin with the binary format's magic number.
+    [[nodiscard]] static auto is_binary(gsl::span<std::byte const> bytes) -> bool
+    {
+        return bytes.size() >= selected_clusters_magic.size()
+            && std::memcmp(bytes.data(), selected_clusters_magic.data(), selected_clusters_magic.size())
+            == 0;
+    }
+
+    [[nodiscard]] auto size() const -> std::size_t { return m_ids.size(); }
+
+    // Decodes the clusters to visit for query `id`, if any.
+    [[nodiscard]] auto find(std::string_view id) const -> std::optional<cluster_queue>
+    {
+        auto pos = pisa::binary_search(m_ids.begin(), m_ids.end(), id);
+        if (not pos) {
+            return std::nullopt;
+        }
+        auto encoded = m_queues[*pos];
+        auto const* in = reinterpret_cast<uint8_t const*>(encoded.data());
+        auto const* end = in + encoded.size();
+        // The length shares the layout of the deltas, so it is decoded with bounds checks too.
+        uint64_t length;
+        in = decode_tight_vbyte64(in, end, length);
+        // Every delta takes at least one byte.
+        if (length > static_cast<uint64_t>(end - in)) {
+            throw std::runtime_error(fmt::format(
+                "Corrupted selected clusters: {} clusters in a queue of {} bytes", length, end - in));
+        }
+        cluster_queue clusters(length);
+        int64_t previous = 0;
+        for (auto& cluster: clusters) {
+            uint64_t zigzag;
+            in = decode_tight_vbyte64(in, end, zigzag);
+            previous += static_cast<int64_t>(zigzag >> 1U) ^ -static_cast<int64_t>(zigzag & 1U);
+            cluster = static_cast<uint32_t>(previous);
+        }
+        return clusters;
+    }
+
+    // Calls `fn(id, clusters)` for every query, in the order of query IDs.
+    template <typename Fn>
+    void for_each(Fn fn) const
+    {
+        for (auto id: m_ids) {
+            fn(id, *find(id));
+        }
+    }
+
+  private:
+    MemorySource m_source;
+    Payload_Vector<> m_ids{gsl::span<std::size_t const>{}, gsl::span<std::byte const>{}};
+    Payload_Vector<> m_queues{gsl::span<std::size_t const>{}, gsl::span<std::byte const>{}};
+};
+
+/// ANYTIME: Replaces every cluster of `queue` with its sub-ranges, in increasing order, where
+/// `parents` holds the cluster each sub-range was split from. This keeps cluster orderings
+/// valid after `split_clusters`.
+[[nodiscard]] inline auto expand_cluster_queue(cluster_queue const& queue, std::vector<uint32_t> const& parents)
+    -> cluster_queue
+{
+    std::vector<std::pair<uint32_t, uint32_t>> children;
+    for (uint32_t range = 0; range < parents.size(); ++range) {
+        children.emplace_back(parents[range], range);
+    }
+    std::sort(children.begin(), children.end());
+    cluster_queue expanded;
+    for (auto cluster: queue) {
+        auto pos = std::lower_bound(
+            children.begin(), children.end(), std::make_pair(cluster, uint32_t{0}));
+        for (; pos != children.end() && pos->first == cluster; ++pos) {
+            expanded.push_back(pos->second);
+        }
+    }
+    return expanded;
+}
+
+// Resolves the clusters to visit for each of `queries` from `in_file`, which can be in either
+// the text or the binary format. Queries without clusters are reported and abort the run.
+inline std::vector<cluster_queue> read_query_clusters(std::string const& in_file, std::vector<Query> const& queries)
+{
+    std::vector<cluster_queue> query_clusters;
+    query_clusters.reserve(queries.size());
+    size_t missing = 0;
+    auto resolve = [&](auto&& find) {
+        for (auto const& query: queries) {
+            auto clusters = find(query.id.value());
+            if (not clusters) {
+                spdlog::error("No clusters selected for query `{}`", query.id.value());
+                ++missing;
+            }
+            query_clusters.push_back(clusters.value_or(cluster_queue{}));
+        }
+    };
+    auto source = MemorySource::mapped_file(in_file);
+    if (SelectedClusters::is_binary(gsl::span<std::byte const>(
+            reinterpret_cast<std::byte const*>(source.data()), source.size()))) {
+        SelectedClusters selected_clusters(std::move(source));
+        spdlog::info("Mapped {} queries worth of selected clusters.", selected_clusters.size());
+        resolve([&](auto const& id) { return selected_clusters.find(id); });
+    } else {
+        auto selected_clusters = read_selected_clusters(in_file);
+        spdlog::info("Read {} queries worth of selected clusters.", selected_clusters.size());
+        resolve([&](auto const& id) -> std::optional<cluster_queue> {
+            if (auto pos = selected_clusters.find(id); pos != selected_clusters.end()) {
+                return pos->second;
+            }
+            return std::nullopt;
+        });
+    }
+    if (missing > 0) {
+        spdlog::error("Missing clusters for {} of {} queries.", missing, queries.size());
+        std::exit(1);
+    }
+    return query_clusters;
+}
+
 
 };
 
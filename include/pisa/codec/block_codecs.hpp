@@ -1,5 +1,7 @@
 #pragma once
 
+#include <type_traits>
+
 #include "FastPFor/headers/optpfor.h"
 #include "FastPFor/headers/variablebyte.h"
 
@@ -11,6 +13,41 @@
 
 namespace pisa {
 
+/// Whether posting lists of `BlockCodec` turn docid gaps into absolute docids with a SIMD prefix
+/// sum, so that enumerators search a block instead of summing its gaps one at a time. Codecs opt
+/// in with a `static constexpr bool absolute_docids = true` member; `scan_perftest` compares both.
+template <typename BlockCodec, typename = void>
+struct decodes_absolute_docids: std::false_type {};
+
+template <typename BlockCodec>
+struct decodes_absolute_docids<BlockCodec, std::void_t<decltype(BlockCodec::absolute_docids)>>
+    : std::bool_constant<BlockCodec::absolute_docids> {};
+
+/// `BlockCodec` with docid decoding set to `Absolute`, overriding the codec's own choice.
+/// The encoding is the same, so indexes built with `BlockCodec` can be read either way.
+template <typename BlockCodec, bool Absolute>
+struct with_docid_decoding: BlockCodec {
+    static constexpr bool absolute_docids = Absolute;
+};
+
+/// How many docids, per posting, a block of `BlockCodec` may span and still be stored as a
+/// bitmap rather than coded gaps, or zero if the codec never uses bitmaps. Codecs opt in with a
+/// `static constexpr uint32_t bitmap_span_per_posting` member.
+template <typename BlockCodec, typename = void>
+struct bitmap_span_per_posting: std::integral_constant<uint32_t, 0> {};
+
+template <typename BlockCodec>
+struct bitmap_span_per_posting<BlockCodec, std::void_t<decltype(BlockCodec::bitmap_span_per_posting)>>
+    : std::integral_constant<uint32_t, BlockCodec::bitmap_span_per_posting> {};
+
+/// `BlockCodec` storing the docids of every block at least `1 / SpanPerPosting` dense as a
+/// bitmap. This changes the encoding, so it is a separate index type.
+template <typename BlockCodec, uint32_t SpanPerPosting = 4>
+struct with_dense_bitmaps: BlockCodec {
+    static_assert(SpanPerPosting > 0);
+    static constexpr uint32_t bitmap_span_per_posting = SpanPerPosting;
+};
+
 // workaround: VariableByte::decodeArray needs the buffer size, while we
 // only know the number of values. It also pads to 32 bits. We need to
 // rewrite
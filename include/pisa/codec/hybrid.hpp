@@ -0,0 +1,167 @@
+#pragma once
+
+#include <array>
+#include <istream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "boost/preprocessor/seq/enum.hpp"
+#include "boost/preprocessor/seq/for_each.hpp"
+#include "boost/preprocessor/seq/size.hpp"
+#include "boost/preprocessor/stringize.hpp"
+
+#include "codec/block_codecs.hpp"
+#include "codec/simdbp.hpp"
+#include "dec_time_prediction.hpp"
+#include "util/compiler_attribute.hpp"
+#include "util/likely.hpp"
+
+/// Codecs a `hybrid_block` can choose from, in the order of their tags.
+#define PISA_HYBRID_CODECS (interpolative)(optpfor)(simdbp)
+
+namespace pisa {
+
+/// How `hybrid_block` picks a codec for a block: the one minimising its size in bytes plus
+/// `bytes_per_ns` times its predicted decoding time in nanoseconds.
+struct hybrid_policy {
+    enum class codec : uint8_t { BOOST_PP_SEQ_ENUM(PISA_HYBRID_CODECS) };
+    static constexpr std::size_t num_codecs = BOOST_PP_SEQ_SIZE(PISA_HYBRID_CODECS);
+
+    /// Defaults to rough per-block decoding times, which favour interpolative only where it
+    /// saves a lot of space; fitted predictors can be read with `from_stream`.
+    hybrid_policy()
+    {
+        predictor(codec::interpolative).bias() = 1000;
+        predictor(codec::optpfor).bias() = 250;
+        predictor(codec::simdbp).bias() = 60;
+    }
+
+    [[nodiscard]] static auto parse_codec(std::string const& name) -> codec
+    {
+        if (false) {
+#define LOOP_BODY(R, DATA, T)               \
+    }                                       \
+    else if (name == BOOST_PP_STRINGIZE(T)) \
+    {                                       \
+        return codec::T;                    \
+        /**/
+            BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PISA_HYBRID_CODECS);
+#undef LOOP_BODY
+        } else {
+            throw std::invalid_argument("Invalid hybrid codec " + name);
+        }
+    }
+
+    /// Reads a policy from lines `bytes_per_ns <value>` or `<codec> <feature or bias> <weight>`,
+    /// where features are those of `time_prediction`. Unlisted weights keep their defaults.
+    [[nodiscard]] static auto from_stream(std::istream& is) -> hybrid_policy
+    {
+        hybrid_policy policy;
+        std::string line;
+        while (std::getline(is, line)) {
+            std::istringstream iss(line);
+            std::string name;
+            if (!(iss >> name)) {
+                continue;
+            }
+            if (name == "bytes_per_ns") {
+                iss >> policy.bytes_per_ns;
+            } else {
+                std::string feature;
+                float weight;
+                if (!(iss >> feature >> weight)) {
+                    throw std::invalid_argument("Invalid hybrid policy line: " + line);
+                }
+                auto& predictor = policy.predictor(parse_codec(name));
+                if (feature == "bias") {
+                    predictor.bias() = weight;
+                } else {
+                    predictor[time_prediction::parse_feature_type(feature)] = weight;
+                }
+            }
+        }
+        return policy;
+    }
+
+    [[nodiscard]] auto predictor(codec c) -> time_prediction::predictor&
+    {
+        return predictors[static_cast<std::size_t>(c)];
+    }
+
+    float bytes_per_ns = 0.1;
+    std::array<time_prediction::predictor, num_codecs> predictors{};
+};
+
+/// Encodes every full block with the codec its `policy()` finds cheapest, behind a one-byte tag
+/// that decoding dispatches on. Partial blocks, so short lists in particular, are always
+/// interpolative and untagged, as in the other block codecs.
+struct hybrid_block {
+    static const uint64_t block_size = 128;
+    using codec = hybrid_policy::codec;
+
+    /// The policy used when encoding; decoding does not depend on it.
+    [[nodiscard]] static auto policy() -> hybrid_policy&
+    {
+        static hybrid_policy policy;
+        return policy;
+    }
+
+    static void encode(uint32_t const* in, uint32_t sum_of_values, size_t n, std::vector<uint8_t>& out)
+    {
+        assert(n <= block_size);
+        if (n < block_size) {
+            interpolative_block::encode(in, sum_of_values, n, out);
+            return;
+        }
+
+        thread_local std::array<std::vector<uint8_t>, hybrid_policy::num_codecs> candidates;
+        for (auto& candidate: candidates) {
+            candidate.clear();
+        }
+        interpolative_block::encode(in, sum_of_values, n, candidates[tag(codec::interpolative)]);
+        optpfor_block::encode(in, sum_of_values, n, candidates[tag(codec::optpfor)]);
+        simdbp_block::encode(in, sum_of_values, n, candidates[tag(codec::simdbp)]);
+
+        time_prediction::feature_vector features;
+        time_prediction::values_statistics(std::vector<uint32_t>(in, in + n), features);
+        auto& policy = hybrid_block::policy();
+        std::size_t best = 0;
+        float best_cost = std::numeric_limits<float>::max();
+        for (std::size_t c = 0; c < hybrid_policy::num_codecs; ++c) {
+            features[time_prediction::feature_type::size] = candidates[c].size();
+            float cost = candidates[c].size() + policy.bytes_per_ns * policy.predictors[c](features);
+            if (cost < best_cost) {
+                best = c;
+                best_cost = cost;
+            }
+        }
+        out.push_back(best);
+        out.insert(out.end(), candidates[best].begin(), candidates[best].end());
+    }
+
+    static uint8_t const* decode(uint8_t const* in, uint32_t* out, uint32_t sum_of_values, size_t n)
+    {
+        assert(n <= block_size);
+        if (PISA_UNLIKELY(n < block_size)) {
+            return interpolative_block::decode(in, out, sum_of_values, n);
+        }
+        assert(*in < hybrid_policy::num_codecs);
+        return decoders[*in](in + 1, out, sum_of_values, n);
+    }
+
+  private:
+    using decoder = uint8_t const* (*)(uint8_t const*, uint32_t*, uint32_t, size_t);
+
+    /// Decoders indexed by codec tag.
+    static constexpr std::array<decoder, hybrid_policy::num_codecs> decoders{
+        &interpolative_block::decode, &optpfor_block::decode, &simdbp_block::decode};
+
+    [[nodiscard]] static constexpr auto tag(codec c) -> std::size_t
+    {
+        return static_cast<std::size_t>(c);
+    }
+};
+
+}  // namespace pisa
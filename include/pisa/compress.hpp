@@ -4,12 +4,15 @@
 #include <fstream>
 #include <iostream>
 #include <numeric>
+#include <memory>
 #include <optional>
 #include <thread>
 
 #include <boost/algorithm/string/predicate.hpp>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
+#include <tbb/pipeline.h>
+#include <tbb/task_arena.h>
 
 #include "configuration.hpp"
 #include "ensure.hpp"
@@ -65,6 +68,13 @@ struct QuantizedScorer {
     LinearQuantizer quantizer;
 };
 
+/// Bounds on the posting lists compressed by a single task of `compress_index_streaming`.
+constexpr std::size_t compress_batch_lists = 4096;
+constexpr std::size_t compress_batch_postings = 1U << 22U;
+
+/// Compresses `input` in a pipeline: batches of consecutive lists are read from the mapped
+/// collection, encoded by parallel tasks, and written in term order to the stream builder.
+/// At most two batches per worker thread are in flight, which bounds the memory held.
 template <typename CollectionType, typename Wand>
 void compress_index_streaming(
     binary_freq_collection const& input,
@@ -76,47 +86,86 @@ void compress_index_streaming(
     spdlog::info("Processing {} documents (streaming)", input.num_docs());
     double tick = get_time_usecs();
 
+    struct Batch {
+        std::size_t first_term_id = 0;
+        std::vector<binary_freq_collection::sequence> lists{};
+        std::vector<std::vector<std::uint8_t>> encoded{};
+    };
+
     typename CollectionType::stream_builder builder(input.num_docs(), params);
     size_t postings = 0;
     {
         pisa::progress progress("Create index", input.size());
 
-        size_t term_id = 0;
-        if (quantized_scorer) {
-            auto&& [scorer, quantizer] = *quantized_scorer;
+        auto encode = [&](Batch& batch) {
+            batch.encoded.resize(batch.lists.size());
             std::vector<std::uint64_t> quantized_scores;
-            for (auto const& plist: input) {
-                auto term_scorer = scorer->term_scorer(term_id);
+            for (size_t idx = 0; idx < batch.lists.size(); ++idx) {
+                auto const& plist = batch.lists[idx];
                 std::size_t size = plist.docs.size();
-                for (size_t pos = 0; pos < size; ++pos) {
-                    auto doc = *(plist.docs.begin() + pos);
-                    auto freq = *(plist.freqs.begin() + pos);
-                    auto score = term_scorer(doc, freq);
-                    quantized_scores.push_back(quantizer(score));
+                if (quantized_scorer) {
+                    auto&& [scorer, quantizer] = *quantized_scorer;
+                    auto term_scorer = scorer->term_scorer(batch.first_term_id + idx);
+                    quantized_scores.clear();
+                    for (size_t pos = 0; pos < size; ++pos) {
+                        auto doc = *(plist.docs.begin() + pos);
+                        auto freq = *(plist.freqs.begin() + pos);
+                        quantized_scores.push_back(quantizer(term_scorer(doc, freq)));
+                    }
+                    CollectionType::write_posting_list(
+                        batch.encoded[idx], size, plist.docs.begin(), quantized_scores.begin());
+                } else {
+                    CollectionType::write_posting_list(
+                        batch.encoded[idx], size, plist.docs.begin(), plist.freqs.begin());
                 }
-                auto sum = std::accumulate(
-                    quantized_scores.begin(), quantized_scores.end(), std::uint64_t(0));
-                builder.add_posting_list(size, plist.docs.begin(), quantized_scores.begin(), sum);
-                term_id += 1;
-                quantized_scores.clear();
-                progress.update(1);
-            }
-        } else {
-            for (auto const& plist: input) {
-                size_t size = plist.docs.size();
-                uint64_t freqs_sum =
-                    std::accumulate(plist.freqs.begin(), plist.freqs.begin() + size, uint64_t(0));
-                builder.add_posting_list(size, plist.docs.begin(), plist.freqs.begin(), freqs_sum);
-                progress.update(1);
-                postings += size;
-                term_id += 1;
             }
-        }
+        };
+
+        auto it = input.begin();
+        auto last = input.end();
+        std::size_t term_id = 0;
+        std::size_t max_batches = 2 * std::max<std::size_t>(
+            1, tbb::this_task_arena::max_concurrency());
+        tbb::parallel_pipeline(
+            max_batches,
+            tbb::make_filter<void, std::shared_ptr<Batch>>(
+                tbb::filter::serial_in_order,
+                [&](tbb::flow_control& fc) -> std::shared_ptr<Batch> {
+                    if (it == last) {
+                        fc.stop();
+                        return nullptr;
+                    }
+                    auto batch = std::make_shared<Batch>();
+                    batch->first_term_id = term_id;
+                    std::size_t batch_postings = 0;
+                    while (it != last && batch->lists.size() < compress_batch_lists
+                           && batch_postings < compress_batch_postings) {
+                        batch->lists.push_back(*it);
+                        batch_postings += it->docs.size();
+                        ++it;
+                    }
+                    term_id += batch->lists.size();
+                    return batch;
+                })
+                & tbb::make_filter<std::shared_ptr<Batch>, std::shared_ptr<Batch>>(
+                    tbb::filter::parallel,
+                    [&](std::shared_ptr<Batch> batch) {
+                        encode(*batch);
+                        return batch;
+                    })
+                & tbb::make_filter<std::shared_ptr<Batch>, void>(
+                    tbb::filter::serial_in_order, [&](std::shared_ptr<Batch> batch) {
+                        for (size_t idx = 0; idx < batch->lists.size(); ++idx) {
+                            builder.add_posting_list(batch->encoded[idx]);
+                            postings += batch->lists[idx].docs.size();
+                        }
+                        progress.update(batch->lists.size());
+                    }));
     }
 
     builder.build(output_filename);
     double elapsed_secs = (get_time_usecs() - tick) / 1000000;
-    spdlog::info("Index compressed in {} seconds", elapsed_secs);
+    spdlog::info("Index of {} postings compressed in {} seconds", postings, elapsed_secs);
 
     if (check && not quantized_scorer) {
         verify_collection<binary_freq_collection, CollectionType>(input, output_filename.c_str());
@@ -134,7 +183,8 @@ void compress_index(
     std::string const& seq_type,
     std::optional<std::string> const& wand_data_filename,
     ScorerParams const& scorer_params,
-    bool quantized)
+    bool quantized,
+    std::optional<std::string> const& clusters_filename)
 {
     if constexpr (std::is_same_v<typename CollectionType::index_layout_tag, BlockIndexTag>) {
         std::optional<QuantizedScorer<WandType>> quantized_scorer{};
@@ -163,7 +213,22 @@ void compress_index(
     spdlog::info("Processing {} documents", input.num_docs());
     double tick = get_time_usecs();
 
-    typename CollectionType::builder builder(input.num_docs(), params);
+    // ANYTIME: Clustered indexes group every posting list by the given document clusters
+    auto builder = [&]() -> typename CollectionType::builder {
+        if constexpr (std::is_same_v<typename CollectionType::index_layout_tag, ClusteredIndexTag>) {
+            if (not clusters_filename) {
+                spdlog::warn("No document clusters given: the index will hold a single cluster");
+                return typename CollectionType::builder(input.num_docs(), params);
+            }
+            return typename CollectionType::builder(
+                input.num_docs(), params, read_cluster_ranges(*clusters_filename));
+        } else {
+            if (clusters_filename) {
+                spdlog::warn("Document clusters are only used by clustered index types");
+            }
+            return typename CollectionType::builder(input.num_docs(), params);
+        }
+    }();
     size_t postings = 0;
     {
         pisa::progress progress("Create index", input.size());
@@ -241,7 +306,8 @@ void compress(
     std::string const& output_filename,
     ScorerParams const& scorer_params,
     bool quantize,
-    bool check)
+    bool check,
+    std::optional<std::string> const& clusters_filename)
 {
     binary_freq_collection input(input_basename.c_str());
     global_parameters params;
@@ -259,7 +325,8 @@ void compress(
             index_encoding,                                                      \
             wand_data_filename,                                                  \
             scorer_params,                                                       \
-            quantize);                                                           \
+            quantize,                                                            \
+            clusters_filename);                                                  \
         /**/
         BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PISA_INDEX_TYPES);
 #undef LOOP_BODY
@@ -19,8 +19,10 @@ class BlockMaxScoredCursor: public MaxScoredCursor<Cursor, Wand> {
         TermScorer term_scorer,
         float weight,
         float max_score,
-        typename Wand::wand_data_enumerator wdata)
-        : MaxScoredCursor<Cursor, Wand>(std::move(cursor), std::move(term_scorer), weight, max_score, wdata)
+        typename Wand::wand_data_enumerator wdata,
+        std::uint32_t term_id)
+        : MaxScoredCursor<Cursor, Wand>(
+            std::move(cursor), std::move(term_scorer), weight, max_score, wdata, term_id)
     {}
     BlockMaxScoredCursor(BlockMaxScoredCursor const&) = delete;
     BlockMaxScoredCursor(BlockMaxScoredCursor&&) = default;
@@ -43,10 +45,10 @@ class BlockMaxScoredCursor: public MaxScoredCursor<Cursor, Wand> {
 
 template <typename Index, typename WandType, typename Scorer>
 [[nodiscard]] auto make_block_max_scored_cursors(
-    Index const& index, WandType const& wdata, Scorer const& scorer, Query query)
+    Index const& index, WandType const& wdata, Scorer const& scorer, Query const& query)
 {
-    auto terms = query.terms;
-    auto query_term_freqs = query_freqs(terms);
+    auto& query_term_freqs = query_freqs_buffer();
+    query_freqs(query.terms, query_term_freqs);
 
     std::vector<BlockMaxScoredCursor<typename Index::document_enumerator, WandType>> cursors;
     cursors.reserve(query_term_freqs.size());
@@ -59,7 +61,8 @@ template <typename Index, typename WandType, typename Scorer>
                 scorer.term_scorer(term.first),
                 weight,
                 max_weight,
-                wdata.getenum(term.first));
+                wdata.getenum(term.first),
+                term.first);
         });
     return cursors;
 }
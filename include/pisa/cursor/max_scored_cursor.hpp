@@ -18,9 +18,10 @@ class MaxScoredCursor: public ScoredCursor<Cursor> {
             TermScorer term_scorer, 
             float query_weight, 
             float max_score,
-            typename Wand::wand_data_enumerator wdata)
+            typename Wand::wand_data_enumerator wdata,
+            std::uint32_t term_id)
         : ScoredCursor<Cursor>(std::move(cursor), std::move(term_scorer), query_weight),
-          m_max_score(max_score), m_wdata(std::move(wdata))
+          m_max_score(max_score), m_wdata(std::move(wdata)), m_term_id(term_id)
     {}
     MaxScoredCursor(MaxScoredCursor const&) = delete;
     MaxScoredCursor(MaxScoredCursor&&) = default;
@@ -40,6 +41,9 @@ class MaxScoredCursor: public ScoredCursor<Cursor> {
       return m_wdata.range_score(range);
     }
 
+    // ANYTIME: Used to look up term-pair range bounds
+    [[nodiscard]] auto term_id() const noexcept -> std::uint32_t { return m_term_id; }
+
 
   private:
     float m_max_score;
@@ -50,6 +54,7 @@ class MaxScoredCursor: public ScoredCursor<Cursor> {
   
     // ANYTIME: Move wand data into max_scored_cursor so can access range max values
     typename Wand::wand_data_enumerator m_wdata;
+    std::uint32_t m_term_id;
 
     void update_max_score(float new_score) {
         m_max_score = this->query_weight() * new_score;
@@ -58,10 +63,10 @@ class MaxScoredCursor: public ScoredCursor<Cursor> {
 
 template <typename Index, typename WandType, typename Scorer>
 [[nodiscard]] auto
-make_max_scored_cursors(Index const& index, WandType const& wdata, Scorer const& scorer, Query query)
+make_max_scored_cursors(Index const& index, WandType const& wdata, Scorer const& scorer, Query const& query)
 {
-    auto terms = query.terms;
-    auto query_term_freqs = query_freqs(terms);
+    auto& query_term_freqs = query_freqs_buffer();
+    query_freqs(query.terms, query_term_freqs);
 
     std::vector<MaxScoredCursor<typename Index::document_enumerator, WandType>> cursors;
     cursors.reserve(query_term_freqs.size());
@@ -70,7 +75,7 @@ make_max_scored_cursors(Index const& index, WandType const& wdata, Scorer const&
             float query_weight = term.second;
             auto max_weight = query_weight * wdata.max_term_weight(term.first);
             return MaxScoredCursor<typename Index::document_enumerator, WandType>(
-                index[term.first], scorer.term_scorer(term.first), query_weight, max_weight, wdata.getenum(term.first));
+                index[term.first], scorer.term_scorer(term.first), query_weight, max_weight, wdata.getenum(term.first), term.first);
         });
     return cursors;
 }
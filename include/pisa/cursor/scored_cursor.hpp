@@ -47,10 +47,10 @@ class ScoredCursor {
 };
 
 template <typename Index, typename Scorer>
-[[nodiscard]] auto make_scored_cursors(Index const& index, Scorer const& scorer, Query query)
+[[nodiscard]] auto make_scored_cursors(Index const& index, Scorer const& scorer, Query const& query)
 {
-    auto terms = query.terms;
-    auto query_term_freqs = query_freqs(terms);
+    auto& query_term_freqs = query_freqs_buffer();
+    query_freqs(query.terms, query_term_freqs);
 
     std::vector<ScoredCursor<typename Index::document_enumerator>> cursors;
     cursors.reserve(query_term_freqs.size());
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <vector>
+
+#include "clusters.hpp"
+#include "util/likely.hpp"
+
+// ANYTIME: Federated search over several shard indexes. The ranges of all shards form one global
+// range space, and their documents one global docid space, in shard order. Wrapped in a
+// `ShardCursor`, the cursors of every shard can then be handed together to any of the anytime
+// algorithms, which share one top-k queue (and one deadline) across the shards.
+
+namespace pisa {
+
+/// Where a shard lies in the global docid and range spaces.
+struct ShardSpace {
+    std::uint64_t doc_offset;
+    std::uint64_t num_docs;
+    std::uint64_t range_offset;
+    std::uint64_t num_ranges;
+    /// End of the global docid space, shared by all exhausted cursors.
+    std::uint64_t max_docid;
+};
+
+/// Lays out the shards one after another. `shard_ranges` are the ranges of every shard, as given
+/// by the `all_ranges()` of its wand data; a shard without ranges is a single range.
+[[nodiscard]] inline auto federate_ranges(
+    std::vector<cluster_map> const& shard_ranges, std::vector<std::uint64_t> const& shard_sizes)
+    -> std::pair<cluster_map, std::vector<ShardSpace>>
+{
+    cluster_map ranges;
+    std::vector<ShardSpace> spaces;
+    std::uint64_t doc_offset = 0;
+    for (std::size_t shard = 0; shard < shard_sizes.size(); ++shard) {
+        spaces.push_back(ShardSpace{doc_offset, shard_sizes[shard], ranges.size(), 0, 0});
+        if (shard_ranges[shard].empty()) {
+            ranges.emplace_back(doc_offset, doc_offset + shard_sizes[shard]);
+        }
+        for (auto [first, last]: shard_ranges[shard]) {
+            ranges.emplace_back(doc_offset + first, doc_offset + last);
+        }
+        spaces.back().num_ranges = ranges.size() - spaces.back().range_offset;
+        doc_offset += shard_sizes[shard];
+    }
+    for (auto& space: spaces) {
+        space.max_docid = doc_offset;
+    }
+    return {std::move(ranges), std::move(spaces)};
+}
+
+/// A max-scored cursor of one shard, seen through the global docid and range spaces. Outside
+/// its own ranges, it has no score bound; past its own documents, it is exhausted.
+template <typename Cursor>
+class ShardCursor {
+  public:
+    ShardCursor(Cursor cursor, ShardSpace space)
+        : m_cursor(std::move(cursor)), m_space(space), m_max_score(m_cursor.max_score())
+    {}
+    ShardCursor(ShardCursor const&) = delete;
+    ShardCursor(ShardCursor&&) = default;
+    ShardCursor& operator=(ShardCursor const&) = delete;
+    ShardCursor& operator=(ShardCursor&&) = default;
+    ~ShardCursor() = default;
+
+    [[nodiscard]] PISA_ALWAYSINLINE auto docid() const -> std::uint32_t
+    {
+        return to_global(m_cursor.docid());
+    }
+    [[nodiscard]] PISA_ALWAYSINLINE auto freq() -> std::uint32_t { return m_cursor.freq(); }
+    [[nodiscard]] PISA_ALWAYSINLINE auto score() -> float { return m_cursor.score(); }
+    [[nodiscard]] PISA_ALWAYSINLINE auto query_weight() const noexcept -> float
+    {
+        return m_cursor.query_weight();
+    }
+    [[nodiscard]] PISA_ALWAYSINLINE auto size() -> std::size_t { return m_cursor.size(); }
+    [[nodiscard]] PISA_ALWAYSINLINE auto max_score() const noexcept -> float { return m_max_score; }
+
+    void PISA_ALWAYSINLINE next() { m_cursor.next(); }
+
+    void PISA_ALWAYSINLINE next_geq(std::uint32_t docid)
+    {
+        if (docid > m_space.doc_offset) {
+            m_cursor.next_geq(to_local(docid));
+        }
+    }
+
+    /// Cursors of later shards are already past `docid`, and stay where they are.
+    void global_geq(std::uint32_t docid)
+    {
+        if (docid >= m_space.doc_offset) {
+            m_cursor.global_geq(to_local(docid));
+        }
+    }
+
+    void update_range_max_score(std::uint64_t range)
+    {
+        if (in_shard(range)) {
+            m_cursor.update_range_max_score(range - m_space.range_offset);
+            m_max_score = m_cursor.max_score();
+        } else {
+            m_max_score = 0.0F;
+        }
+    }
+
+    float get_range_max_score(std::uint64_t range)
+    {
+        return in_shard(range) ? m_cursor.get_range_max_score(range - m_space.range_offset) : 0.0F;
+    }
+
+    /// Term IDs are local to the shard, so term-pair bounds cannot be used across shards.
+    [[nodiscard]] auto term_id() const noexcept -> std::uint32_t { return m_cursor.term_id(); }
+
+    [[nodiscard]] PISA_ALWAYSINLINE auto block_max_score() -> float
+    {
+        return m_cursor.block_max_score();
+    }
+    [[nodiscard]] PISA_ALWAYSINLINE auto block_max_docid() -> std::uint32_t
+    {
+        return to_global(m_cursor.block_max_docid());
+    }
+    PISA_ALWAYSINLINE void block_max_next_geq(std::uint32_t docid)
+    {
+        if (docid > m_space.doc_offset) {
+            m_cursor.block_max_next_geq(to_local(docid));
+        }
+    }
+    PISA_ALWAYSINLINE void block_max_global_geq(std::uint32_t docid)
+    {
+        if (docid >= m_space.doc_offset) {
+            m_cursor.block_max_global_geq(to_local(docid));
+        }
+    }
+
+  private:
+    [[nodiscard]] PISA_ALWAYSINLINE auto in_shard(std::uint64_t range) const -> bool
+    {
+        return range >= m_space.range_offset && range < m_space.range_offset + m_space.num_ranges;
+    }
+
+    [[nodiscard]] PISA_ALWAYSINLINE auto to_global(std::uint64_t docid) const -> std::uint32_t
+    {
+        if (PISA_UNLIKELY(docid >= m_space.num_docs)) {
+            return m_space.max_docid;
+        }
+        return m_space.doc_offset + docid;
+    }
+
+    /// Docids past the shard are clamped to its end, which exhausts the cursor.
+    [[nodiscard]] PISA_ALWAYSINLINE auto to_local(std::uint64_t docid) const -> std::uint32_t
+    {
+        return std::min(docid - m_space.doc_offset, m_space.num_docs);
+    }
+
+    Cursor m_cursor;
+    ShardSpace m_space;
+    float m_max_score;
+};
+
+/// Wraps the cursors of one shard and appends them to `cursors`.
+template <typename Cursor>
+void append_shard_cursors(
+    std::vector<ShardCursor<Cursor>>& cursors, std::vector<Cursor> shard_cursors, ShardSpace space)
+{
+    for (auto& cursor: shard_cursors) {
+        cursors.emplace_back(std::move(cursor), space);
+    }
+}
+
+}  // namespace pisa
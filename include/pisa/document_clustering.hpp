@@ -0,0 +1,286 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include "forward_index.hpp"
+#include "reorder_docids.hpp"
+#include "util/progress.hpp"
+#include "wand_utils.hpp"
+
+// ANYTIME: Clusters documents with spherical k-means over their sparse term vectors, so that
+// collections can be clustered without an external shard map.
+
+namespace pisa {
+
+struct KMeansClusteringOptions {
+    std::string input_basename;
+    std::string output_basename;
+    std::string output_clusters;
+    std::optional<std::string> input_fwd;
+    std::optional<std::string> document_lexicon;
+    std::optional<std::string> reordered_document_lexicon;
+    std::size_t num_clusters;
+    std::size_t sample_size;
+    std::size_t iterations;
+    std::size_t centroid_terms;
+    std::size_t min_length;
+    std::uint64_t seed;
+};
+
+/// Spherical k-means over documents represented as binary term vectors weighted by IDF and
+/// normalized to unit length. Centroids keep only their `centroid_terms` heaviest terms, and are
+/// stored per term, so that assigning a document only touches the centroids sharing its terms.
+class kmeans_clustering {
+  public:
+    kmeans_clustering(forward_index const& fwd, std::size_t num_clusters, std::size_t centroid_terms)
+        : m_fwd(fwd), m_num_clusters(num_clusters), m_centroid_terms(centroid_terms)
+    {
+        if (num_clusters == 0) {
+            throw std::invalid_argument("Number of clusters must be positive");
+        }
+        std::vector<std::uint32_t> df(fwd.term_count(), 0);
+        for (std::uint32_t document = 0; document < fwd.size(); ++document) {
+            for (auto term: fwd.terms(document)) {
+                df[term] += 1;
+            }
+        }
+        m_idf.resize(fwd.term_count(), 0.0F);
+        m_term_centroids.resize(fwd.term_count());
+        for (std::size_t term = 0; term < df.size(); ++term) {
+            if (df[term] > 0) {
+                m_idf[term] = std::log(static_cast<float>(fwd.size()) / df[term]) + 1.0F;
+            }
+        }
+    }
+
+    /// Runs `iterations` rounds of k-means over `sample`, starting from sample documents chosen
+    /// with k-means++. Clusters left empty are re-seeded from a random sample document.
+    void fit(std::vector<std::uint32_t> const& sample, std::size_t iterations, std::mt19937_64& rng)
+    {
+        if (sample.empty()) {
+            throw std::invalid_argument("Cannot cluster an empty sample");
+        }
+        auto centroids = seed_centroids(sample, rng);
+        set_centroids(centroids);
+        if (iterations == 0) {
+            return;
+        }
+
+        std::vector<std::uint32_t> assignment(sample.size());
+        pisa::progress progress("Fitting clusters", iterations);
+        for (std::size_t iteration = 0; iteration < iterations; ++iteration) {
+            assign(sample, assignment);
+            std::vector<std::vector<std::uint32_t>> members(m_num_clusters);
+            for (std::size_t pos = 0; pos < sample.size(); ++pos) {
+                members[assignment[pos]].push_back(sample[pos]);
+            }
+            tbb::parallel_for(std::size_t(0), m_num_clusters, [&](std::size_t cluster) {
+                if (not members[cluster].empty()) {
+                    centroids[cluster] = mean(members[cluster]);
+                }
+            });
+            for (std::size_t cluster = 0; cluster < m_num_clusters; ++cluster) {
+                if (members[cluster].empty()) {
+                    centroids[cluster] = document_vector(sample[rng() % sample.size()]);
+                }
+            }
+            set_centroids(centroids);
+            progress.update(1);
+        }
+    }
+
+    /// Writes the cluster of every document in `documents` to the same position of `assignment`.
+    void assign(std::vector<std::uint32_t> const& documents, std::vector<std::uint32_t>& assignment) const
+    {
+        assignment.resize(documents.size());
+        tbb::parallel_for(
+            tbb::blocked_range<std::size_t>(0, documents.size()), [&](auto const& range) {
+                std::vector<float> similarity(m_num_clusters);
+                for (auto pos = range.begin(); pos != range.end(); ++pos) {
+                    assignment[pos] = nearest(documents[pos], similarity);
+                }
+            });
+    }
+
+  private:
+    using sparse_vector = std::vector<std::pair<std::uint32_t, float>>;
+
+    /// Picks the initial centroids among `sample` with k-means++: every next seed is drawn with
+    /// probability proportional to its squared cosine distance to the closest seed so far.
+    [[nodiscard]] auto seed_centroids(std::vector<std::uint32_t> const& sample, std::mt19937_64& rng) const
+        -> std::vector<sparse_vector>
+    {
+        std::vector<sparse_vector> centroids;
+        centroids.push_back(document_vector(sample[rng() % sample.size()]));
+        std::vector<float> closest(sample.size(), 0.0F);
+        std::vector<float> seed(m_idf.size(), 0.0F);
+        std::vector<double> distances(sample.size());
+        pisa::progress progress("Seeding clusters", m_num_clusters);
+        progress.update(1);
+        while (centroids.size() < m_num_clusters) {
+            for (auto [term, weight]: centroids.back()) {
+                seed[term] = weight;
+            }
+            tbb::parallel_for(std::size_t(0), sample.size(), [&](std::size_t pos) {
+                float similarity = 0.0F;
+                float norm = 0.0F;
+                for (auto term: m_fwd.terms(sample[pos])) {
+                    similarity += m_idf[term] * seed[term];
+                    norm += m_idf[term] * m_idf[term];
+                }
+                if (norm > 0.0F) {
+                    closest[pos] = std::max(closest[pos], similarity / std::sqrt(norm));
+                }
+                double distance = std::max(0.0F, 1.0F - closest[pos]);
+                distances[pos] = distance * distance;
+            });
+            for (auto [term, weight]: centroids.back()) {
+                seed[term] = 0.0F;
+            }
+            std::size_t next = rng() % sample.size();
+            if (std::accumulate(distances.begin(), distances.end(), 0.0) > 0.0) {
+                next = std::discrete_distribution<std::size_t>(distances.begin(), distances.end())(rng);
+            }
+            centroids.push_back(document_vector(sample[next]));
+            progress.update(1);
+        }
+        return centroids;
+    }
+
+    [[nodiscard]] auto document_vector(std::uint32_t document) const -> sparse_vector
+    {
+        sparse_vector vec;
+        float norm = 0.0F;
+        for (auto term: m_fwd.terms(document)) {
+            vec.emplace_back(term, m_idf[term]);
+            norm += m_idf[term] * m_idf[term];
+        }
+        normalize(vec, norm);
+        return vec;
+    }
+
+    /// Unit-length mean of the document vectors of `members`, truncated to its heaviest terms.
+    [[nodiscard]] auto mean(std::vector<std::uint32_t> const& members) const -> sparse_vector
+    {
+        std::unordered_map<std::uint32_t, float> sum;
+        for (auto document: members) {
+            for (auto [term, weight]: document_vector(document)) {
+                sum[term] += weight;
+            }
+        }
+        sparse_vector vec(sum.begin(), sum.end());
+        if (vec.size() > m_centroid_terms) {
+            std::nth_element(
+                vec.begin(),
+                std::next(vec.begin(), m_centroid_terms),
+                vec.end(),
+                [](auto const& lhs, auto const& rhs) { return lhs.second > rhs.second; });
+            vec.resize(m_centroid_terms);
+        }
+        float norm = 0.0F;
+        for (auto const& entry: vec) {
+            norm += entry.second * entry.second;
+        }
+        normalize(vec, norm);
+        return vec;
+    }
+
+    static void normalize(sparse_vector& vec, float squared_norm)
+    {
+        if (squared_norm > 0.0F) {
+            float scale = 1.0F / std::sqrt(squared_norm);
+            for (auto& entry: vec) {
+                entry.second *= scale;
+            }
+        }
+    }
+
+    /// Rebuilds the per-term lists of centroid weights.
+    void set_centroids(std::vector<sparse_vector> const& centroids)
+    {
+        for (auto& term_centroids: m_term_centroids) {
+            term_centroids.clear();
+        }
+        for (std::uint32_t cluster = 0; cluster < centroids.size(); ++cluster) {
+            for (auto [term, weight]: centroids[cluster]) {
+                m_term_centroids[term].emplace_back(cluster, weight);
+            }
+        }
+    }
+
+    [[nodiscard]] auto nearest(std::uint32_t document, std::vector<float>& similarity) const
+        -> std::uint32_t
+    {
+        std::fill(similarity.begin(), similarity.end(), 0.0F);
+        for (auto term: m_fwd.terms(document)) {
+            for (auto [cluster, weight]: m_term_centroids[term]) {
+                similarity[cluster] += m_idf[term] * weight;
+            }
+        }
+        // Documents are not normalized here: it does not change their nearest centroid.
+        return std::distance(
+            similarity.begin(), std::max_element(similarity.begin(), similarity.end()));
+    }
+
+    forward_index const& m_fwd;
+    std::size_t m_num_clusters;
+    std::size_t m_centroid_terms;
+    std::vector<float> m_idf;
+    std::vector<std::vector<std::pair<std::uint32_t, float>>> m_term_centroids;
+};
+
+/// Clusters the documents of a collection, reassigns document IDs so that every cluster is a
+/// contiguous range, and writes the reordered collection along with its cluster range file.
+[[nodiscard]] inline auto cluster_documents(KMeansClusteringOptions const& options) -> int
+{
+    forward_index fwd = options.input_fwd
+        ? forward_index::read(*options.input_fwd)
+        : forward_index::from_inverted_index(options.input_basename, options.min_length, true);
+
+    std::mt19937_64 rng(options.seed);
+    std::vector<std::uint32_t> documents(fwd.size());
+    std::iota(documents.begin(), documents.end(), 0U);
+    std::vector<std::uint32_t> sample(documents);
+    if (sample.size() > options.sample_size) {
+        std::shuffle(sample.begin(), sample.end(), rng);
+        sample.resize(options.sample_size);
+        std::sort(sample.begin(), sample.end());
+    }
+    spdlog::info(
+        "Clustering {} documents into {} clusters from a sample of {}",
+        documents.size(),
+        options.num_clusters,
+        sample.size());
+
+    kmeans_clustering kmeans(fwd, options.num_clusters, options.centroid_terms);
+    kmeans.fit(sample, options.iterations, rng);
+    std::vector<std::uint32_t> clusters;
+    kmeans.assign(documents, clusters);
+
+    auto boundaries = detail::group_by_cluster(documents, clusters);
+    spdlog::info("Found {} non-empty clusters", boundaries.size());
+    auto mapping = get_mapping(documents);
+    fwd.clear();
+    documents.clear();
+    reorder_inverted_index(options.input_basename, options.output_basename, mapping);
+    if (options.document_lexicon) {
+        reorder_lexicon(*options.document_lexicon, *options.reordered_document_lexicon, mapping);
+    }
+    write_cluster_ranges(boundaries, options.output_clusters);
+    return 0;
+}
+
+}  // namespace pisa
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "mappable/mappable_vector.hpp"
+#include "mappable/mapper.hpp"
+#include "memory_source.hpp"
+
+// ANYTIME: Statistics of a whole collection, stored with each shard cut from it, so that the
+// shard's wand data scores its postings exactly as the monolithic index would.
+
+namespace pisa {
+
+class global_statistics {
+  public:
+    global_statistics() = default;
+    explicit global_statistics(MemorySource source) : m_source(std::move(source))
+    {
+        mapper::map(*this, m_source.data(), mapper::map_flags::warmup);
+    }
+
+    /// Term counts are over the whole collection, but indexed by the term IDs of the shard.
+    global_statistics(
+        std::uint64_t num_docs,
+        std::uint64_t collection_len,
+        std::vector<std::uint32_t> term_posting_counts,
+        std::vector<std::uint32_t> term_occurrence_counts)
+        : m_num_docs(num_docs), m_collection_len(collection_len)
+    {
+        m_term_posting_counts.steal(term_posting_counts);
+        m_term_occurrence_counts.steal(term_occurrence_counts);
+    }
+
+    [[nodiscard]] auto num_docs() const -> std::uint64_t { return m_num_docs; }
+    [[nodiscard]] auto collection_len() const -> std::uint64_t { return m_collection_len; }
+    [[nodiscard]] auto num_terms() const -> std::size_t { return m_term_posting_counts.size(); }
+
+    [[nodiscard]] auto term_posting_count(std::size_t term_id) const -> std::uint32_t
+    {
+        return m_term_posting_counts[term_id];
+    }
+
+    [[nodiscard]] auto term_occurrence_count(std::size_t term_id) const -> std::uint32_t
+    {
+        return m_term_occurrence_counts[term_id];
+    }
+
+    template <typename Visitor>
+    void map(Visitor& visit)
+    {
+        visit(m_num_docs, "m_num_docs")(m_collection_len, "m_collection_len")(
+            m_term_posting_counts, "m_term_posting_counts")(
+            m_term_occurrence_counts, "m_term_occurrence_counts");
+    }
+
+  private:
+    std::uint64_t m_num_docs = 0;
+    std::uint64_t m_collection_len = 0;
+    mapper::mappable_vector<std::uint32_t> m_term_posting_counts;
+    mapper::mappable_vector<std::uint32_t> m_term_occurrence_counts;
+    MemorySource m_source;
+};
+
+}  // namespace pisa
@@ -5,6 +5,7 @@
 #include "boost/preprocessor/stringize.hpp"
 
 #include "codec/block_codecs.hpp"
+#include "codec/hybrid.hpp"
 #include "codec/maskedvbyte.hpp"
 #include "codec/qmx.hpp"
 #include "codec/simdbp.hpp"
@@ -15,6 +16,7 @@
 
 #include "binary_freq_collection.hpp"
 #include "block_freq_index.hpp"
+#include "clustered_block_freq_index.hpp"
 
 #include "freq_index.hpp"
 #include "sequence/partitioned_sequence.hpp"
@@ -42,13 +44,20 @@ using block_qmx_index = block_freq_index<pisa::qmx_block>;
 using block_simple8b_index = block_freq_index<pisa::simple8b_block>;
 using block_simple16_index = block_freq_index<pisa::simple16_block>;
 using block_simdbp_index = block_freq_index<pisa::simdbp_block>;
+using block_hybrid_index = block_freq_index<pisa::hybrid_block>;
+using block_dense_simdbp_index = block_freq_index<pisa::with_dense_bitmaps<pisa::simdbp_block>>;
+
+using clustered_simdbp_index = clustered_block_freq_index<pisa::simdbp_block>;
+using clustered_interleaved_simdbp_index = clustered_block_freq_index<pisa::simdbp_block, true>;
 
 }  // namespace pisa
 
-#define PISA_INDEX_TYPES                                                                    \
-    (ef)(single)(pefuniform)(pefopt)(block_optpfor)(block_varintg8iu)(block_streamvbyte)(   \
-        block_maskedvbyte)(block_interpolative)(block_qmx)(block_varintgb)(block_simple8b)( \
-        block_simple16)(block_simdbp)
+#define PISA_INDEX_TYPES                                                                      \
+    (ef)(single)(pefuniform)(pefopt)(block_optpfor)(block_varintg8iu)(block_streamvbyte)(     \
+        block_maskedvbyte)(block_interpolative)(block_qmx)(block_varintgb)(block_simple8b)(   \
+        block_simple16)(block_simdbp)(block_hybrid)(block_dense_simdbp)(clustered_simdbp)(    \
+        clustered_interleaved_simdbp)
 #define PISA_BLOCK_INDEX_TYPES                                                                    \
     (block_optpfor)(block_varintg8iu)(block_streamvbyte)(block_maskedvbyte)(block_interpolative)( \
-        block_qmx)(block_varintgb)(block_simple8b)(block_simple16)(block_simdbp)
+        block_qmx)(block_varintgb)(block_simple8b)(block_simple16)(block_simdbp)(block_hybrid)(   \
+        block_dense_simdbp)
@@ -5,8 +5,10 @@
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <numeric>
 #include <optional>
+#include <queue>
 #include <sstream>
 #include <thread>
 #include <unordered_map>
@@ -20,10 +22,15 @@
 #include "range/v3/view/iota.hpp"
 #include "spdlog/spdlog.h"
 #include "tbb/concurrent_queue.h"
+#include "tbb/parallel_for.h"
+#include "tbb/pipeline.h"
+#include "tbb/task_arena.h"
 #include "tbb/task_group.h"
+#include "temporary_directory.hpp"
 #include "type_safe.hpp"
 
 #include "binary_collection.hpp"
+#include "range_statistics.hpp"
 #include "util/util.hpp"
 
 namespace pisa {
@@ -264,7 +271,11 @@ namespace invert {
         return batch;
     }
 
-    void merge_batches(std::string const& output_basename, uint32_t batch_count, uint32_t term_count)
+    void merge_batches(
+        std::string const& output_basename,
+        uint32_t batch_count,
+        uint32_t term_count,
+        range_statistics::builder* stats = nullptr)
     {
         std::vector<binary_collection> doc_collections;
         std::vector<binary_collection> freq_collections;
@@ -280,6 +291,11 @@ namespace invert {
 
         std::ofstream sos(output_basename + ".sizes");
         write_sequence(sos, gsl::span<uint32_t const>(document_sizes));
+        if (stats != nullptr) {
+            for (std::size_t docid = 0; docid < document_sizes.size(); ++docid) {
+                stats->add_document(docid, document_sizes[docid]);
+            }
+        }
 
         std::vector<binary_collection::const_iterator> doc_iterators;
         std::vector<binary_collection::const_iterator> freq_iterators;
@@ -327,6 +343,10 @@ namespace invert {
                 spdlog::error(msg);
                 throw std::runtime_error(msg);
             }
+            if (stats != nullptr) {
+                stats->add_postings(dlist, flist);
+                stats->finish_term();
+            }
             postings_count += dlist.size();
             write_sequence(dos, gsl::span<uint32_t const>(dlist));
             write_sequence(fos, gsl::span<uint32_t const>(flist));
@@ -337,12 +357,327 @@ namespace invert {
         spdlog::info("Number of postings: {}", postings_count);
     }
 
+    /// Bytes of memory taken by one posting of a run being sorted, including sorting buffers.
+    constexpr std::size_t run_bytes_per_posting = 2 * sizeof(std::pair<Term_Id, Document_Id>);
+
+    /// Bytes of memory taken by one posting of a chunk being merged: its docid and frequency,
+    /// read from the mapped runs and copied again when the chunk is serialized.
+    constexpr std::size_t merge_bytes_per_posting = 4 * sizeof(std::uint32_t);
+
+    /// Writes sorted postings as a run: `.terms` holds a single sequence with the IDs of the
+    /// terms present in the run, in increasing order, and `.docs` and `.freqs` hold one sequence
+    /// per present term, in the format of a `binary_freq_collection` without the document count
+    /// header. Runs thus take space in their postings only, not in the size of the vocabulary.
+    void write_run(std::string const& basename, std::vector<std::pair<Term_Id, Document_Id>> const& postings)
+    {
+        std::ofstream dstream(basename + ".docs");
+        std::ofstream fstream(basename + ".freqs");
+        std::vector<Term_Id> terms;
+        std::vector<Document_Id> documents;
+        std::vector<Frequency> frequencies;
+        auto first = postings.begin();
+        while (first != postings.end()) {
+            auto term = first->first;
+            terms.push_back(term);
+            documents.clear();
+            frequencies.clear();
+            while (first != postings.end() && first->first == term) {
+                auto current_doc = first->second;
+                auto last = std::find_if(first, postings.end(), [&](auto const& posting) {
+                    return posting.first != term || posting.second != current_doc;
+                });
+                documents.push_back(current_doc);
+                frequencies.push_back(Frequency(std::distance(first, last)));
+                first = last;
+            }
+            write_sequence(dstream, gsl::span<Document_Id const>(documents));
+            write_sequence(fstream, gsl::span<Frequency const>(frequencies));
+        }
+        std::ofstream tstream(basename + ".terms");
+        write_sequence(tstream, gsl::span<Term_Id const>(terms));
+    }
+
+    /// Cuts the forward index into runs of consecutive documents whose postings fit in
+    /// `memory_budget` bytes, and writes each run sorted to `run_directory`. Document sizes
+    /// are streamed to `<output_basename>.sizes` along the way. Runs of empty documents only
+    /// have no postings and are not written.
+    ///
+    /// \returns the run basenames, in document order
+    [[nodiscard]] auto build_runs(
+        binary_collection const& coll,
+        std::uint32_t document_count,
+        std::string const& output_basename,
+        boost::filesystem::path const& run_directory,
+        std::size_t memory_budget,
+        range_statistics::builder* stats = nullptr) -> std::vector<std::string>
+    {
+        std::size_t max_run_postings = std::max<std::size_t>(1, memory_budget / run_bytes_per_posting);
+        auto doc_iter = ++coll.begin();
+
+        std::ofstream sstream(output_basename + ".sizes");
+        sstream.write(reinterpret_cast<char const*>(&document_count), sizeof(document_count));
+
+        std::vector<std::string> runs;
+        std::vector<gsl::span<Term_Id const>> documents;
+        std::vector<std::size_t> offsets;
+        std::vector<std::pair<Term_Id, Document_Id>> postings;
+        std::uint32_t documents_processed = 0;
+        while (doc_iter != coll.end()) {
+            documents.clear();
+            offsets.assign(1, 0);
+            for (; doc_iter != coll.end(); ++doc_iter) {
+                auto document_sequence = *doc_iter;
+                if (not documents.empty()
+                    && offsets.back() + document_sequence.size() > max_run_postings) {
+                    break;
+                }
+                documents.emplace_back(
+                    reinterpret_cast<Term_Id const*>(document_sequence.begin()),
+                    document_sequence.size());
+                offsets.push_back(offsets.back() + document_sequence.size());
+                auto size = static_cast<std::uint32_t>(document_sequence.size());
+                sstream.write(reinterpret_cast<char const*>(&size), sizeof(size));
+                if (stats != nullptr) {
+                    stats->add_document(documents_processed + documents.size() - 1, size);
+                }
+            }
+            spdlog::info(
+                "Inverting run [{}, {})", documents_processed, documents_processed + documents.size());
+
+            postings.resize(offsets.back());
+            tbb::parallel_for(
+                tbb::blocked_range<std::size_t>(0, documents.size()), [&](auto const& range) {
+                    for (auto idx = range.begin(); idx != range.end(); ++idx) {
+                        auto docid = Document_Id(documents_processed + idx);
+                        std::transform(
+                            documents[idx].begin(),
+                            documents[idx].end(),
+                            std::next(postings.begin(), offsets[idx]),
+                            [docid](auto term) { return std::make_pair(term, docid); });
+                    }
+                });
+            std::sort(pstl::execution::par_unseq, postings.begin(), postings.end());
+
+            if (not postings.empty()) {
+                runs.push_back((run_directory / fmt::format("run.{}", runs.size())).string());
+                write_run(runs.back(), postings);
+            }
+            documents_processed += documents.size();
+        }
+        if (documents_processed != document_count) {
+            auto msg = fmt::format(
+                "Forward index declares {} documents but holds {}", document_count, documents_processed);
+            spdlog::error(msg);
+            throw std::runtime_error(msg);
+        }
+        return runs;
+    }
+
+    /// Merges sorted runs into the `.docs` and `.freqs` files of `output_basename`.
+    ///
+    /// Runs hold disjoint, increasing ranges of documents, so the list of a term is the
+    /// concatenation of its lists in run order. Runs only store the terms they contain, so they
+    /// are merged k-way on term ID with a heap of the next term of every run. Chunks of
+    /// consecutive terms are read in order, serialized by parallel tasks, and written in order.
+    /// The chunks held in memory at once share `memory_budget` bytes: with a small budget there
+    /// are fewer and smaller chunks, down to one term per chunk, since a list is never split.
+    void merge_runs(
+        std::vector<std::string> const& runs,
+        std::string const& output_basename,
+        std::uint32_t document_count,
+        std::uint32_t term_count,
+        std::size_t memory_budget,
+        range_statistics::builder* stats = nullptr)
+    {
+        constexpr std::size_t chunk_terms = 4096;
+        constexpr std::size_t min_chunk_postings = 1U << 16U;
+        constexpr std::size_t max_chunk_postings = 1U << 22U;
+        std::size_t max_chunks = std::clamp<std::size_t>(
+            memory_budget / (min_chunk_postings * merge_bytes_per_posting),
+            1,
+            2 * std::max<std::size_t>(1, tbb::this_task_arena::max_concurrency()));
+        std::size_t chunk_postings = std::clamp<std::size_t>(
+            memory_budget / (max_chunks * merge_bytes_per_posting), 1, max_chunk_postings);
+
+        struct RunCursor {
+            binary_collection terms;
+            binary_collection documents;
+            binary_collection frequencies;
+            binary_collection::const_sequence term_ids;
+            std::size_t position = 0;
+            binary_collection::const_iterator doc_iterator;
+            binary_collection::const_iterator freq_iterator;
+
+            explicit RunCursor(std::string const& run)
+                : terms((run + ".terms").c_str()),
+                  documents((run + ".docs").c_str()),
+                  frequencies((run + ".freqs").c_str()),
+                  term_ids(*terms.begin()),
+                  doc_iterator(documents.begin()),
+                  freq_iterator(frequencies.begin())
+            {}
+        };
+        std::vector<std::unique_ptr<RunCursor>> cursors;
+        cursors.reserve(runs.size());
+        // Min-heap of the next (term, run) of every run, so that equal terms pop in run order.
+        std::priority_queue<
+            std::pair<std::uint32_t, std::size_t>,
+            std::vector<std::pair<std::uint32_t, std::size_t>>,
+            std::greater<>>
+            heads;
+        for (auto const& run: runs) {
+            cursors.push_back(std::make_unique<RunCursor>(run));
+            if (cursors.back()->term_ids.size() > 0) {
+                heads.emplace(cursors.back()->term_ids[0], cursors.size() - 1);
+            }
+        }
+
+        struct Chunk {
+            std::uint32_t first_term = 0;
+            std::vector<std::vector<binary_collection::const_sequence>> documents{};
+            std::vector<std::vector<binary_collection::const_sequence>> frequencies{};
+            std::vector<std::uint32_t> docs_bytes{};
+            std::vector<std::uint32_t> freqs_bytes{};
+            std::optional<range_statistics::builder> stats{};
+        };
+        std::optional<range_statistics::builder> empty_stats{};
+        if (stats != nullptr) {
+            empty_stats = stats->chunk();
+        }
+
+        std::ofstream dos(output_basename + ".docs");
+        std::ofstream fos(output_basename + ".freqs");
+        write_sequence(dos, gsl::make_span<uint32_t const>(&document_count, 1));
+
+        auto serialize = [](auto const& lists, std::vector<std::uint32_t>& out) {
+            for (auto const& term_runs: lists) {
+                auto length_pos = out.size();
+                out.push_back(0);
+                for (auto const& seq: term_runs) {
+                    out.insert(out.end(), seq.begin(), seq.end());
+                }
+                out[length_pos] = static_cast<std::uint32_t>(out.size() - length_pos - 1);
+            }
+        };
+
+        std::uint32_t term_id = 0;
+        std::size_t postings_count = 0;
+        tbb::parallel_pipeline(
+            max_chunks,
+            tbb::make_filter<void, std::shared_ptr<Chunk>>(
+                tbb::filter::serial_in_order,
+                [&](tbb::flow_control& fc) -> std::shared_ptr<Chunk> {
+                    if (term_id == term_count) {
+                        if (not heads.empty()) {
+                            auto msg = fmt::format(
+                                "Term {} is out of range for {} terms", heads.top().first, term_count);
+                            spdlog::error(msg);
+                            throw std::runtime_error(msg);
+                        }
+                        fc.stop();
+                        return nullptr;
+                    }
+                    auto chunk = std::make_shared<Chunk>();
+                    chunk->first_term = term_id;
+                    std::size_t postings = 0;
+                    while (term_id < term_count && chunk->documents.size() < chunk_terms
+                           && postings < chunk_postings) {
+                        auto& documents = chunk->documents.emplace_back();
+                        auto& frequencies = chunk->frequencies.emplace_back();
+                        while (not heads.empty() && heads.top().first == term_id) {
+                            auto run = heads.top().second;
+                            heads.pop();
+                            auto& cursor = *cursors[run];
+                            documents.push_back(*cursor.doc_iterator);
+                            frequencies.push_back(*cursor.freq_iterator);
+                            ++cursor.doc_iterator;
+                            ++cursor.freq_iterator;
+                            if (documents.back().size() != frequencies.back().size()) {
+                                auto msg = fmt::format(
+                                    "Document and frequency lists must be equal length"
+                                    "but are {} and {} (term {}, run {})",
+                                    documents.back().size(),
+                                    frequencies.back().size(),
+                                    term_id,
+                                    run);
+                                spdlog::error(msg);
+                                throw std::runtime_error(msg);
+                            }
+                            postings += documents.back().size();
+                            if (++cursor.position < cursor.term_ids.size()) {
+                                heads.emplace(cursor.term_ids[cursor.position], run);
+                            }
+                        }
+                        term_id += 1;
+                    }
+                    return chunk;
+                })
+                & tbb::make_filter<std::shared_ptr<Chunk>, std::shared_ptr<Chunk>>(
+                    tbb::filter::parallel,
+                    [&](std::shared_ptr<Chunk> chunk) {
+                        serialize(chunk->documents, chunk->docs_bytes);
+                        serialize(chunk->frequencies, chunk->freqs_bytes);
+                        if (empty_stats) {
+                            chunk->stats = empty_stats->chunk();
+                            for (std::size_t term = 0; term < chunk->documents.size(); ++term) {
+                                auto const& documents = chunk->documents[term];
+                                for (std::size_t run = 0; run < documents.size(); ++run) {
+                                    chunk->stats->add_postings(
+                                        documents[run], chunk->frequencies[term][run]);
+                                }
+                                chunk->stats->finish_term();
+                            }
+                        }
+                        return chunk;
+                    })
+                & tbb::make_filter<std::shared_ptr<Chunk>, void>(
+                    tbb::filter::serial_in_order, [&](std::shared_ptr<Chunk> chunk) {
+                        auto term = chunk->first_term;
+                        for (auto const& documents: chunk->documents) {
+                            if (std::all_of(documents.begin(), documents.end(), [](auto const& seq) {
+                                    return seq.size() == 0;
+                                })) {
+                                auto msg = fmt::format("Posting list must be non-empty (term {})", term);
+                                spdlog::error(msg);
+                                throw std::runtime_error(msg);
+                            }
+                            term += 1;
+                        }
+                        postings_count += chunk->docs_bytes.size() - chunk->documents.size();
+                        if (chunk->stats) {
+                            stats->append(std::move(*chunk->stats));
+                        }
+                        dos.write(
+                            reinterpret_cast<char const*>(chunk->docs_bytes.data()),
+                            chunk->docs_bytes.size() * sizeof(std::uint32_t));
+                        fos.write(
+                            reinterpret_cast<char const*>(chunk->freqs_bytes.data()),
+                            chunk->freqs_bytes.size() * sizeof(std::uint32_t));
+                    }));
+
+        spdlog::info("Number of terms: {}", term_count);
+        spdlog::info("Number of documents: {}", document_count);
+        spdlog::info("Number of postings: {}", postings_count);
+    }
+
+    /// Stores the per-cluster statistics gathered while inverting as
+    /// `<output_basename>.range-stats`, in the format of `create_range_stats`.
+    void write_range_statistics(std::string const& output_basename, range_statistics::builder& builder)
+    {
+        range_statistics stats;
+        builder.build(stats);
+        mapper::freeze(stats, (output_basename + ".range-stats").c_str());
+        spdlog::info(
+            "Stored statistics of {} terms over {} ranges", stats.num_terms(), stats.num_ranges());
+    }
+
     void invert_forward_index(
         std::string const& input_basename,
         std::string const& output_basename,
         size_t batch_size,
         size_t threads,
-        std::optional<std::uint32_t> term_count = std::nullopt)
+        std::optional<std::uint32_t> term_count = std::nullopt,
+        std::optional<std::vector<std::uint32_t>> clusters = std::nullopt)
     {
         if (not term_count) {
             auto source = MemorySource::mapped_file(fmt::format("{}.termlex", input_basename));
@@ -352,7 +687,14 @@ namespace invert {
 
         uint32_t batch_count =
             invert::build_batches(input_basename, output_basename, *term_count, batch_size, threads);
-        invert::merge_batches(output_basename, batch_count, *term_count);
+        std::optional<range_statistics::builder> stats{};
+        if (clusters) {
+            stats.emplace(std::move(*clusters));
+        }
+        invert::merge_batches(output_basename, batch_count, *term_count, stats ? &*stats : nullptr);
+        if (stats) {
+            write_range_statistics(output_basename, *stats);
+        }
 
         for (auto batch: ranges::views::iota(uint32_t(0), batch_count)) {
             std::ostringstream batch_name_stream;
@@ -364,6 +706,50 @@ namespace invert {
         }
     }
 
+    /// Inverts the forward index in external memory: sorted runs of at most `memory_budget`
+    /// bytes are spilled to a temporary directory, created in `tmp_dir` if given, and then
+    /// merged into the output files within the same budget.
+    void invert_forward_index_external(
+        std::string const& input_basename,
+        std::string const& output_basename,
+        std::size_t memory_budget,
+        std::optional<std::uint32_t> term_count = std::nullopt,
+        std::optional<std::vector<std::uint32_t>> clusters = std::nullopt,
+        std::optional<std::string> const& tmp_dir = std::nullopt)
+    {
+        if (not term_count) {
+            auto source = MemorySource::mapped_file(fmt::format("{}.termlex", input_basename));
+            auto terms = Payload_Vector<>::from(source);
+            term_count = static_cast<std::uint32_t>(terms.size());
+        }
+
+        binary_collection coll(input_basename.c_str());
+        std::uint32_t document_count = *(*coll.begin()).begin();
+        std::optional<range_statistics::builder> stats{};
+        if (clusters) {
+            stats.emplace(std::move(*clusters));
+        }
+        auto tmp = tmp_dir ? Temporary_Directory(*tmp_dir) : Temporary_Directory();
+        auto runs = invert::build_runs(
+            coll,
+            document_count,
+            output_basename,
+            tmp.path(),
+            memory_budget,
+            stats ? &*stats : nullptr);
+        spdlog::info("Merging {} runs", runs.size());
+        invert::merge_runs(
+            runs,
+            output_basename,
+            document_count,
+            *term_count,
+            memory_budget,
+            stats ? &*stats : nullptr);
+        if (stats) {
+            write_range_statistics(output_basename, *stats);
+        }
+    }
+
 }  // namespace invert
 
 }  // namespace pisa
@@ -1,6 +1,9 @@
 #pragma once
 #include "spdlog/spdlog.h"
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <limits>
 #include <gsl/gsl_assert>
 
 namespace pisa {
@@ -25,4 +28,40 @@ struct LinearQuantizer {
     float m_scale;
 };
 
+/// Quantizes non-negative upper bounds of a single term to 8 bits.
+///
+/// Values are rounded up, so `operator()(value) * scale()` is never lower than `value`, and
+/// the dequantized bounds remain valid upper bounds.
+struct UpperBoundQuantizer {
+    explicit UpperBoundQuantizer(float max) : m_scale(max / std::numeric_limits<std::uint8_t>::max())
+    {
+        if (max <= 0) {
+            m_scale = 0;
+            return;
+        }
+        while (m_scale * std::numeric_limits<std::uint8_t>::max() < max) {
+            m_scale = std::nextafter(m_scale, std::numeric_limits<float>::max());
+        }
+    }
+
+    [[nodiscard]] auto operator()(float value) const -> std::uint8_t
+    {
+        if (value <= 0) {
+            return 0;
+        }
+        Expects(m_scale > 0);
+        float const max = std::numeric_limits<std::uint8_t>::max();
+        auto quantized = std::min(std::ceil(value / m_scale), max);
+        while (quantized < max && quantized * m_scale < value) {
+            quantized += 1;
+        }
+        return static_cast<std::uint8_t>(quantized);
+    }
+
+    [[nodiscard]] auto scale() const -> float { return m_scale; }
+
+  private:
+    float m_scale;
+};
+
 }  // namespace pisa
\ No newline at end of file
@@ -2,14 +2,22 @@
 
 #include <vector>
 
+#include "cluster_tiers.hpp"
 #include "clusters.hpp"
 #include "query/queries.hpp"
+#include "range_pair_bounds.hpp"
 #include "topk_queue.hpp"
 
 namespace pisa {
 
 struct wand_query {
-    explicit wand_query(topk_queue& topk, cluster_map& range_to_docid) : m_topk(topk), m_range_to_docid(range_to_docid) {}
+    explicit wand_query(
+        topk_queue& topk,
+        cluster_map& range_to_docid,
+        range_pair_bounds const* pair_bounds = nullptr,
+        cluster_tiers* tiers = nullptr)
+        : m_topk(topk), m_range_to_docid(range_to_docid), m_pair_bounds(pair_bounds), m_tiers(tiers)
+    {}
 
     template <typename CursorRange>
     void operator()(CursorRange&& cursors, uint64_t max_docid)
@@ -116,6 +124,9 @@ struct wand_query {
                 return;
             }
             ++processed_clusters;
+            if (m_tiers != nullptr) {
+                m_tiers->record_visit(shard_id);
+            }
 
             // Pick up the [start, end] range
             auto start = m_range_to_docid[shard_id].first;
@@ -224,17 +235,9 @@ struct wand_query {
             ordered_cursors.push_back(&en);
         }
 
-        // BoundSum computation: For each range, get the boundsum.
-        std::vector<std::pair<size_t, float>> range_and_score;
-        size_t range_id = 0;
-        for (const auto& range : m_range_to_docid) {
-            float range_bound_sum = 0.0f;
-            for (auto& en: cursors) {
-                range_bound_sum += en.get_range_max_score(range_id);
-            }
-            range_and_score.emplace_back(range_id, range_bound_sum);
-            ++range_id;
-        }
+        // BoundSum computation: For each range, get the boundsum. Frequent term pairs
+        // of the query are bounded by their (tighter) pair bounds, if provided.
+        auto range_and_score = range_bound_sums(cursors, m_range_to_docid.size(), m_pair_bounds);
         // Now, sort from high to low based on the BoundSum
         std::sort(range_and_score.begin(), range_and_score.end(), [](auto& l, auto& r){return l.second > r.second; });
 
@@ -248,6 +251,9 @@ struct wand_query {
                 return;
             }
             ++processed_clusters;
+            if (m_tiers != nullptr) {
+                m_tiers->record_visit(index.first);
+            }
 
             // Pick up the [start, end] range
             auto start = m_range_to_docid[index.first].first;
@@ -355,17 +361,9 @@ struct wand_query {
             ordered_cursors.push_back(&en);
         }
 
-        // BoundSum computation: For each range, get the boundsum.
-        std::vector<std::pair<size_t, float>> range_and_score;
-        size_t range_id = 0;
-        for (const auto& range : m_range_to_docid) {
-            float range_bound_sum = 0.0f;
-            for (auto& en: cursors) {
-                range_bound_sum += en.get_range_max_score(range_id);
-            }
-            range_and_score.emplace_back(range_id, range_bound_sum);
-            ++range_id;
-        }
+        // BoundSum computation: For each range, get the boundsum. Frequent term pairs
+        // of the query are bounded by their (tighter) pair bounds, if provided.
+        auto range_and_score = range_bound_sums(cursors, m_range_to_docid.size(), m_pair_bounds);
         // Now, sort from high to low based on the BoundSum
         std::sort(range_and_score.begin(), range_and_score.end(), [](auto& l, auto& r){return l.second > r.second; });
 
@@ -378,10 +376,22 @@ struct wand_query {
 
             // Termination check: elapsed time plus a risk-weighted average per-range latency > timeout,
             // and range-based thresholds
-            if ((elapsed_latency + (risk_factor * mean_latency) > timeout_microseconds) || !m_topk.would_enter(index.second)) {
+            if (!m_topk.would_enter(index.second)) {
+                return;
+            }
+            // Cold clusters may have to be paged in first, so they are expected to cost more. One
+            // that does not fit the budget is skipped, as a later hot cluster still might.
+            float cost = m_tiers != nullptr ? m_tiers->cost(index.first) : 1.0f;
+            if (elapsed_latency + (risk_factor * mean_latency * cost) > timeout_microseconds) {
+                if (cost > 1.0f) {
+                    continue;
+                }
                 return;
             }
             ++processed_clusters;
+            if (m_tiers != nullptr) {
+                m_tiers->record_visit(index.first);
+            }
 
             // Pick up the [start, end] range
             auto start = m_range_to_docid[index.first].first;
@@ -472,6 +482,8 @@ struct wand_query {
   private:
     topk_queue& m_topk;
     cluster_map& m_range_to_docid;
+    range_pair_bounds const* m_pair_bounds;
+    cluster_tiers* m_tiers;
 
 };
 
@@ -42,4 +42,15 @@ void remove_duplicate_terms(term_id_vec& terms);
 
 term_freq_vec query_freqs(term_id_vec terms);
 
+/// Fills `out` with the distinct terms of `terms`, in increasing order, and their counts.
+/// `out` keeps its capacity, so a buffer reused across queries does not allocate.
+void query_freqs(term_id_vec const& terms, term_freq_vec& out);
+
+/// A per-thread buffer for `query_freqs`, reused by the cursor factories.
+[[nodiscard]] inline auto query_freqs_buffer() -> term_freq_vec&
+{
+    thread_local term_freq_vec buffer;
+    return buffer;
+}
+
 }  // namespace pisa
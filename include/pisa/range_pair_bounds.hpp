@@ -0,0 +1,263 @@
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/algorithm/string/classification.hpp"
+#include "boost/algorithm/string/split.hpp"
+#include "spdlog/spdlog.h"
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include "binary_freq_collection.hpp"
+#include "mappable/mappable_vector.hpp"
+#include "mappable/mapper.hpp"
+#include "memory_source.hpp"
+#include "scorer/scorer.hpp"
+#include "util/progress.hpp"
+#include "wand_utils.hpp"
+
+// ANYTIME: Per-range upper bounds on the summed score of frequent term pairs. Summing the
+// range upper bounds of two terms overestimates whenever their maxima come from different
+// documents, so BoundSum uses the pair bound instead when a query contains the pair.
+
+namespace pisa {
+
+using term_pair = std::pair<std::uint32_t, std::uint32_t>;
+
+/// Reads term pairs, one per line, with the two term IDs separated by a space or a tab.
+/// This is the same format as the `--pairs` file of `kth_threshold`.
+[[nodiscard]] inline auto read_term_pairs(std::string const& filename) -> std::vector<term_pair>
+{
+    std::vector<term_pair> pairs;
+    std::ifstream is(filename);
+    std::string line;
+    while (std::getline(is, line)) {
+        std::vector<std::string> term_ids;
+        boost::algorithm::split(term_ids, line, boost::is_any_of(" \t"));
+        if (term_ids.size() != 2) {
+            throw std::runtime_error(fmt::format(
+                "Wrong number of terms in line: {} (expected 2 but found {})",
+                line,
+                term_ids.size()));
+        }
+        try {
+            pairs.emplace_back(std::stoul(term_ids[0]), std::stoul(term_ids[1]));
+        } catch (std::logic_error const&) {
+            throw std::runtime_error(fmt::format("Cannot convert term IDs to int in line: {}", line));
+        }
+    }
+    return pairs;
+}
+
+class range_pair_bounds {
+  public:
+    range_pair_bounds() = default;
+    explicit range_pair_bounds(MemorySource source) : m_source(std::move(source))
+    {
+        mapper::map(*this, m_source.data(), mapper::map_flags::warmup);
+    }
+
+    /// Computes, for each pair in `pairs`, the maximum summed score of both terms over the
+    /// documents of each range of `wdata` that contain both terms. Term IDs refer to `coll`,
+    /// so it must be the collection `wdata` was built from, with no dropped terms.
+    template <typename Wand>
+    range_pair_bounds(
+        binary_freq_collection const& coll,
+        Wand const& wdata,
+        ScorerParams const& scorer_params,
+        std::vector<term_pair> const& pairs)
+    {
+        std::vector<std::uint64_t> keys;
+        keys.reserve(pairs.size());
+        for (auto [left, right]: pairs) {
+            if (left >= coll.size() || right >= coll.size()) {
+                throw std::invalid_argument(fmt::format(
+                    "Pair ({}, {}) is out of bounds for {} terms", left, right, coll.size()));
+            }
+            if (left != right) {
+                keys.push_back(key(left, right));
+            }
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+        std::vector<std::uint32_t> boundaries;
+        for (size_t range = 0; range < wdata.num_ranges(); ++range) {
+            boundaries.push_back(wdata.doc_range(range));
+        }
+        DocToRange doc_to_range(boundaries);
+        m_num_ranges = std::max<std::uint64_t>(doc_to_range.size(), 1);
+
+        std::vector<std::uint32_t> terms;
+        for (auto k: keys) {
+            terms.push_back(k >> 32U);
+            terms.push_back(k & 0xFFFFFFFFU);
+        }
+        std::sort(terms.begin(), terms.end());
+        terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+        std::vector<binary_freq_collection::sequence> sequences;
+        sequences.reserve(terms.size());
+        {
+            auto next_term = terms.begin();
+            std::uint32_t term_id = 0;
+            for (auto it = coll.begin(); next_term != terms.end(); ++it, ++term_id) {
+                if (term_id == *next_term) {
+                    sequences.push_back(*it);
+                    ++next_term;
+                }
+            }
+        }
+        auto sequence = [&](std::uint32_t term_id) -> binary_freq_collection::sequence const& {
+            return sequences[std::lower_bound(terms.begin(), terms.end(), term_id) - terms.begin()];
+        };
+
+        auto scorer = scorer::from_params(scorer_params, wdata);
+        std::vector<float> bounds(keys.size() * m_num_ranges, 0.0F);
+        pisa::progress progress("Computing pair range upper bounds", keys.size());
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, keys.size()), [&](auto const& pair_range) {
+            for (auto pair = pair_range.begin(); pair != pair_range.end(); ++pair) {
+                std::uint32_t left = keys[pair] >> 32U;
+                std::uint32_t right = keys[pair] & 0xFFFFFFFFU;
+                auto const& lseq = sequence(left);
+                auto const& rseq = sequence(right);
+                auto lscorer = scorer->term_scorer(left);
+                auto rscorer = scorer->term_scorer(right);
+                auto* pair_bounds = &bounds[pair * m_num_ranges];
+                size_t lpos = 0;
+                size_t rpos = 0;
+                while (lpos < lseq.docs.size() && rpos < rseq.docs.size()) {
+                    std::uint64_t ldoc = *(lseq.docs.begin() + lpos);
+                    std::uint64_t rdoc = *(rseq.docs.begin() + rpos);
+                    if (ldoc < rdoc) {
+                        ++lpos;
+                    } else if (rdoc < ldoc) {
+                        ++rpos;
+                    } else {
+                        float score = lscorer(ldoc, *(lseq.freqs.begin() + lpos))
+                            + rscorer(rdoc, *(rseq.freqs.begin() + rpos));
+                        float& bound = pair_bounds[doc_to_range(ldoc)];
+                        bound = std::max(bound, score);
+                        ++lpos;
+                        ++rpos;
+                    }
+                }
+                progress.update(1);
+            }
+        });
+        m_pairs.steal(keys);
+        m_bounds.steal(bounds);
+    }
+
+    /// Position of the pair `(left, right)`, in either order, if its bounds are stored.
+    [[nodiscard]] auto find(std::uint32_t left, std::uint32_t right) const -> std::optional<size_t>
+    {
+        auto k = key(left, right);
+        auto pos = std::lower_bound(m_pairs.begin(), m_pairs.end(), k);
+        if (pos == m_pairs.end() || *pos != k) {
+            return std::nullopt;
+        }
+        return std::distance(m_pairs.begin(), pos);
+    }
+
+    /// Maximum summed score of the pair at position `pair` over the documents of `range`
+    /// containing both terms. Documents containing only one of the terms are bounded by that
+    /// term's own range upper bound.
+    [[nodiscard]] auto bound(size_t pair, size_t range) const -> float
+    {
+        return m_bounds[pair * m_num_ranges + range];
+    }
+
+    [[nodiscard]] auto size() const -> size_t { return m_pairs.size(); }
+    [[nodiscard]] auto num_ranges() const -> size_t { return m_num_ranges; }
+
+    template <typename Visitor>
+    void map(Visitor& visit)
+    {
+        visit(m_num_ranges, "m_num_ranges")(m_pairs, "m_pairs")(m_bounds, "m_bounds");
+    }
+
+  private:
+    [[nodiscard]] static auto key(std::uint32_t left, std::uint32_t right) -> std::uint64_t
+    {
+        if (left > right) {
+            std::swap(left, right);
+        }
+        return (static_cast<std::uint64_t>(left) << 32U) | right;
+    }
+
+    std::uint64_t m_num_ranges{0};
+    mapper::mappable_vector<std::uint64_t> m_pairs;
+    mapper::mappable_vector<float> m_bounds;
+    MemorySource m_source;
+};
+
+/// Computes the BoundSum of every range, i.e., the sum of the range upper bounds of `cursors`.
+/// If `pair_bounds` is given, disjoint pairs of query terms with stored pair bounds are bounded
+/// by the pair instead, picking in each range the pairs that tighten the sum the most.
+template <typename Cursors>
+[[nodiscard]] auto range_bound_sums(
+    Cursors& cursors, size_t num_ranges, range_pair_bounds const* pair_bounds = nullptr)
+    -> std::vector<std::pair<size_t, float>>
+{
+    struct candidate {
+        size_t left;
+        size_t right;
+        size_t pair;
+        float bound;
+        float gain;
+    };
+    std::vector<candidate> candidates;
+    if (pair_bounds != nullptr) {
+        for (size_t left = 0; left < cursors.size(); ++left) {
+            for (size_t right = left + 1; right < cursors.size(); ++right) {
+                if (auto pair = pair_bounds->find(cursors[left].term_id(), cursors[right].term_id());
+                    pair) {
+                    candidates.push_back(candidate{left, right, *pair, 0.0F, 0.0F});
+                }
+            }
+        }
+    }
+
+    std::vector<float> bounds(cursors.size());
+    std::vector<bool> paired(cursors.size());
+    std::vector<std::pair<size_t, float>> range_and_score;
+    range_and_score.reserve(num_ranges);
+    for (size_t range_id = 0; range_id < num_ranges; ++range_id) {
+        for (size_t pos = 0; pos < cursors.size(); ++pos) {
+            bounds[pos] = cursors[pos].get_range_max_score(range_id);
+        }
+        float range_bound_sum = 0.0F;
+        std::fill(paired.begin(), paired.end(), false);
+        if (not candidates.empty()) {
+            for (auto& c: candidates) {
+                c.bound = std::max(
+                    {pair_bounds->bound(c.pair, range_id), bounds[c.left], bounds[c.right]});
+                c.gain = bounds[c.left] + bounds[c.right] - c.bound;
+            }
+            std::sort(candidates.begin(), candidates.end(), [](auto const& l, auto const& r) {
+                return l.gain > r.gain;
+            });
+            for (auto const& c: candidates) {
+                if (c.gain > 0.0F && not paired[c.left] && not paired[c.right]) {
+                    range_bound_sum += c.bound;
+                    paired[c.left] = true;
+                    paired[c.right] = true;
+                }
+            }
+        }
+        for (size_t pos = 0; pos < cursors.size(); ++pos) {
+            if (not paired[pos]) {
+                range_bound_sum += bounds[pos];
+            }
+        }
+        range_and_score.emplace_back(range_id, range_bound_sum);
+    }
+    return range_and_score;
+}
+
+}  // namespace pisa
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+#include "binary_freq_collection.hpp"
+#include "clusters.hpp"
+#include "mappable/mappable_vector.hpp"
+#include "mappable/mapper.hpp"
+#include "memory_source.hpp"
+#include "query/queries.hpp"
+#include "util/progress.hpp"
+#include "wand_utils.hpp"
+
+// ANYTIME: Per-range (cluster) statistics of every term, used to rank ranges at query time
+// without an external, per-query cluster ordering.
+
+namespace pisa {
+
+class range_statistics {
+  public:
+    range_statistics() = default;
+    explicit range_statistics(MemorySource source) : m_source(std::move(source))
+    {
+        mapper::map(*this, m_source.data(), mapper::map_flags::warmup);
+    }
+
+    /// Accumulates the statistics of terms given in term order, one posting list at a time.
+    /// Chunks of consecutive terms can be counted in parallel, each by its own `chunk()`,
+    /// and appended in term order.
+    class builder {
+      public:
+        explicit builder(std::vector<std::uint32_t> boundaries)
+            : m_doc_to_range(std::move(boundaries)),
+              m_range_lengths(std::max<std::size_t>(m_doc_to_range.size(), 1), 0)
+        {}
+
+        /// An empty builder over the same ranges.
+        [[nodiscard]] auto chunk() const -> builder
+        {
+            return builder(m_doc_to_range, m_range_lengths.size());
+        }
+
+        void add_document(std::uint64_t docid, std::uint64_t length)
+        {
+            m_range_lengths[m_doc_to_range(docid)] += length;
+        }
+
+        /// Adds postings of the current term, which must follow those already added.
+        template <typename Documents, typename Frequencies>
+        void add_postings(Documents const& documents, Frequencies const& frequencies)
+        {
+            auto freq = std::begin(frequencies);
+            for (auto docid: documents) {
+                auto range = static_cast<std::uint32_t>(m_doc_to_range(static_cast<std::uint64_t>(docid)));
+                if (m_range_id.size() == m_terms_start.back() || m_range_id.back() != range) {
+                    m_range_id.push_back(range);
+                    m_range_df.push_back(0);
+                    m_range_max_tf.push_back(0);
+                }
+                m_range_df.back() += 1;
+                m_range_max_tf.back() =
+                    std::max(m_range_max_tf.back(), static_cast<std::uint32_t>(*freq++));
+            }
+        }
+
+        /// Closes the current term; the next postings belong to the following term.
+        void finish_term() { m_terms_start.push_back(m_range_id.size()); }
+
+        void append(builder&& chunk)
+        {
+            auto offset = m_range_id.size();
+            std::transform(
+                std::next(chunk.m_terms_start.begin()),
+                chunk.m_terms_start.end(),
+                std::back_inserter(m_terms_start),
+                [offset](auto start) { return start + offset; });
+            m_range_id.insert(m_range_id.end(), chunk.m_range_id.begin(), chunk.m_range_id.end());
+            m_range_df.insert(m_range_df.end(), chunk.m_range_df.begin(), chunk.m_range_df.end());
+            m_range_max_tf.insert(
+                m_range_max_tf.end(), chunk.m_range_max_tf.begin(), chunk.m_range_max_tf.end());
+            for (size_t range = 0; range < m_range_lengths.size(); ++range) {
+                m_range_lengths[range] += chunk.m_range_lengths[range];
+            }
+        }
+
+        void build(range_statistics& stats)
+        {
+            stats.m_num_ranges = m_range_lengths.size();
+            stats.m_terms_start.steal(m_terms_start);
+            stats.m_range_id.steal(m_range_id);
+            stats.m_range_df.steal(m_range_df);
+            stats.m_range_max_tf.steal(m_range_max_tf);
+            stats.m_range_lengths.steal(m_range_lengths);
+        }
+
+      private:
+        builder(DocToRange doc_to_range, std::size_t num_ranges)
+            : m_doc_to_range(std::move(doc_to_range)), m_range_lengths(num_ranges, 0)
+        {}
+
+        DocToRange m_doc_to_range;
+        std::vector<std::uint64_t> m_range_lengths;
+        std::vector<std::uint64_t> m_terms_start{0};
+        std::vector<std::uint32_t> m_range_id{};
+        std::vector<std::uint32_t> m_range_df{};
+        std::vector<std::uint32_t> m_range_max_tf{};
+    };
+
+    /// Counts the documents of each range of `wdata` containing each term of `coll`, their
+    /// maximum frequency, and the total length of each range. Term IDs refer to `coll`, so it
+    /// must be the collection `wdata` was built from, with no dropped terms.
+    template <typename Wand>
+    range_statistics(binary_freq_collection const& coll, Wand const& wdata)
+    {
+        std::vector<std::uint32_t> boundaries;
+        for (size_t range = 0; range < wdata.num_ranges(); ++range) {
+            boundaries.push_back(wdata.doc_range(range));
+        }
+        range_statistics::builder builder(std::move(boundaries));
+        for (std::uint64_t docid = 0; docid < coll.num_docs(); ++docid) {
+            builder.add_document(docid, wdata.doc_len(docid));
+        }
+
+        pisa::progress progress("Counting range document frequencies", coll.size());
+        for (auto const& seq: coll) {
+            builder.add_postings(seq.docs, seq.freqs);
+            builder.finish_term();
+            progress.update(1);
+        }
+        builder.build(*this);
+    }
+
+    [[nodiscard]] auto num_ranges() const -> size_t { return m_num_ranges; }
+    [[nodiscard]] auto num_terms() const -> size_t { return m_terms_start.size() - 1; }
+
+    /// Sum of the lengths of the documents in `range`.
+    [[nodiscard]] auto range_length(size_t range) const -> std::uint64_t
+    {
+        return m_range_lengths[range];
+    }
+
+    /// Number of ranges containing `term_id`.
+    [[nodiscard]] auto range_count(term_id_type term_id) const -> size_t
+    {
+        return m_terms_start[term_id + 1] - m_terms_start[term_id];
+    }
+
+    /// Calls `fn(range, df)` for every range containing `term_id`, in increasing range order.
+    template <typename Fn>
+    void for_each_range(term_id_type term_id, Fn fn) const
+    {
+        for (auto pos = m_terms_start[term_id]; pos < m_terms_start[term_id + 1]; ++pos) {
+            fn(m_range_id[pos], m_range_df[pos]);
+        }
+    }
+
+    /// Calls `fn(range, df, max_tf)` for every range containing `term_id`, in increasing range
+    /// order, where `max_tf` is the highest frequency of the term in a document of the range.
+    template <typename Fn>
+    void for_each_range_with_max_tf(term_id_type term_id, Fn fn) const
+    {
+        for (auto pos = m_terms_start[term_id]; pos < m_terms_start[term_id + 1]; ++pos) {
+            fn(m_range_id[pos], m_range_df[pos], m_range_max_tf[pos]);
+        }
+    }
+
+    template <typename Visitor>
+    void map(Visitor& visit)
+    {
+        visit(m_num_ranges, "m_num_ranges")(m_terms_start, "m_terms_start")(
+            m_range_id, "m_range_id")(m_range_df, "m_range_df")(m_range_max_tf, "m_range_max_tf")(
+            m_range_lengths, "m_range_lengths");
+    }
+
+  private:
+    std::uint64_t m_num_ranges{0};
+    mapper::mappable_vector<std::uint64_t> m_terms_start;
+    mapper::mappable_vector<std::uint32_t> m_range_id;
+    mapper::mappable_vector<std::uint32_t> m_range_df;
+    mapper::mappable_vector<std::uint32_t> m_range_max_tf;
+    mapper::mappable_vector<std::uint64_t> m_range_lengths;
+    MemorySource m_source;
+};
+
+/// Ranks the ranges of a query with CORI (Callan et al., 1995), treating every range as a
+/// collection. Ranges not containing any query term are left out of the queue, since they hold
+/// no matching documents.
+class cori_range_selector {
+  public:
+    explicit cori_range_selector(range_statistics const& stats, float b = 0.4F)
+        : m_stats(stats), m_b(b)
+    {
+        std::uint64_t total_length = 0;
+        for (size_t range = 0; range < stats.num_ranges(); ++range) {
+            total_length += stats.range_length(range);
+        }
+        m_avg_range_length = std::max(1.0F, static_cast<float>(total_length) / stats.num_ranges());
+    }
+
+    [[nodiscard]] auto operator()(Query const& query) const -> cluster_queue
+    {
+        auto num_ranges = m_stats.num_ranges();
+        std::vector<float> beliefs(num_ranges, 0.0F);
+        std::vector<bool> matched(num_ranges, false);
+        float log_ranges = std::log(num_ranges + 1.0F);
+        for (auto term_id: query.terms) {
+            if (term_id >= m_stats.num_terms() || m_stats.range_count(term_id) == 0) {
+                continue;
+            }
+            float idf = std::log((num_ranges + 0.5F) / m_stats.range_count(term_id)) / log_ranges;
+            m_stats.for_each_range(term_id, [&](auto range, auto df) {
+                float tf = df
+                    / (df + 50.0F + 150.0F * m_stats.range_length(range) / m_avg_range_length);
+                // Ranges without the term would add `b` for it: only the excess is accumulated.
+                beliefs[range] += (1.0F - m_b) * tf * idf;
+                matched[range] = true;
+            });
+        }
+        cluster_queue ranges;
+        for (size_t range = 0; range < num_ranges; ++range) {
+            if (matched[range]) {
+                ranges.push_back(range);
+            }
+        }
+        std::stable_sort(ranges.begin(), ranges.end(), [&](auto lhs, auto rhs) {
+            return beliefs[lhs] > beliefs[rhs];
+        });
+        return ranges;
+    }
+
+  private:
+    range_statistics const& m_stats;
+    float m_b;
+    float m_avg_range_length;
+};
+
+}  // namespace pisa
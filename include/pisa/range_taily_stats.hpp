@@ -0,0 +1,253 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#include <gsl/span>
+#include <taily.hpp>
+
+#include "spdlog/spdlog.h"
+
+#include "binary_freq_collection.hpp"
+#include "clusters.hpp"
+#include "mappable/mappable_vector.hpp"
+#include "mappable/mapper.hpp"
+#include "memory_source.hpp"
+#include "query/queries.hpp"
+#include "util/progress.hpp"
+#include "wand_utils.hpp"
+
+// ANYTIME: Taily feature statistics of every term within every range (cluster) of a single
+// index. Each range is treated as a Taily shard, so the number of top-k documents in each range
+// can be predicted without building one index per cluster.
+
+namespace pisa {
+
+class range_taily_stats {
+  public:
+    range_taily_stats() = default;
+    explicit range_taily_stats(MemorySource source) : m_source(std::move(source))
+    {
+        mapper::map(*this, m_source.data(), mapper::map_flags::warmup);
+    }
+
+    /// Computes the feature statistics of every term of `coll`, both over the whole collection
+    /// and within each range ending at `boundaries`, in a single pass over the postings.
+    /// Term IDs passed to `scorer` refer to `coll`.
+    template <typename Scorer>
+    range_taily_stats(
+        binary_freq_collection const& coll,
+        Scorer const& scorer,
+        std::vector<std::uint32_t> const& boundaries)
+    {
+        DocToRange doc_to_range(boundaries);
+        m_num_docs = coll.num_docs();
+        std::vector<std::int64_t> range_sizes(std::max<size_t>(doc_to_range.size(), 1), 0);
+        for (std::uint64_t docid = 0; docid < coll.num_docs(); ++docid) {
+            range_sizes[doc_to_range(docid)] += 1;
+        }
+
+        std::vector<std::uint64_t> terms_start{0};
+        std::vector<std::uint32_t> range_id;
+        std::vector<double> expected_value;
+        std::vector<double> variance;
+        std::vector<std::int64_t> frequency;
+        std::vector<double> global_expected_value;
+        std::vector<double> global_variance;
+        std::vector<std::int64_t> global_frequency;
+        auto push_stats = [&](auto const& stats) {
+            expected_value.push_back(stats.expected_value);
+            variance.push_back(stats.variance);
+            frequency.push_back(stats.frequency);
+        };
+
+        pisa::progress progress("Extracting range Taily statistics", coll.size());
+        std::vector<float> scores;
+        std::uint32_t term_id = 0;
+        for (auto const& seq: coll) {
+            auto term_scorer = scorer->term_scorer(term_id);
+            scores.clear();
+            for (std::size_t i = 0; i < seq.docs.size(); ++i) {
+                std::uint64_t docid = *(seq.docs.begin() + i);
+                scores.push_back(term_scorer(docid, *(seq.freqs.begin() + i)));
+            }
+            // Postings of a range are contiguous, so each range's statistics come from a slice.
+            std::size_t first = 0;
+            while (first < scores.size()) {
+                auto range = doc_to_range(*(seq.docs.begin() + first));
+                auto last = first + 1;
+                while (last < scores.size() && doc_to_range(*(seq.docs.begin() + last)) == range) {
+                    ++last;
+                }
+                range_id.push_back(range);
+                push_stats(taily::Feature_Statistics::from_features(
+                    gsl::make_span(scores).subspan(first, last - first)));
+                first = last;
+            }
+            terms_start.push_back(range_id.size());
+            auto global = taily::Feature_Statistics::from_features(scores);
+            global_expected_value.push_back(global.expected_value);
+            global_variance.push_back(global.variance);
+            global_frequency.push_back(global.frequency);
+            term_id += 1;
+            progress.update(1);
+        }
+        m_range_sizes.steal(range_sizes);
+        m_global_expected_value.steal(global_expected_value);
+        m_global_variance.steal(global_variance);
+        m_global_frequency.steal(global_frequency);
+        m_terms_start.steal(terms_start);
+        m_range_id.steal(range_id);
+        m_expected_value.steal(expected_value);
+        m_variance.steal(variance);
+        m_frequency.steal(frequency);
+    }
+
+    [[nodiscard]] auto num_docs() const -> std::uint64_t { return m_num_docs; }
+    [[nodiscard]] auto num_ranges() const -> size_t { return m_range_sizes.size(); }
+    [[nodiscard]] auto num_terms() const -> size_t { return m_terms_start.size() - 1; }
+    [[nodiscard]] auto range_size(size_t range) const -> std::int64_t
+    {
+        return m_range_sizes[range];
+    }
+
+    /// Statistics of `term_id` over the whole collection.
+    [[nodiscard]] auto term_stats(term_id_type term_id) const -> taily::Feature_Statistics
+    {
+        return taily::Feature_Statistics{
+            m_global_expected_value[term_id], m_global_variance[term_id], m_global_frequency[term_id]};
+    }
+
+    /// Calls `fn(range, stats)` for every range containing `term_id`, in increasing range order.
+    template <typename Fn>
+    void for_each_range(term_id_type term_id, Fn fn) const
+    {
+        for (auto pos = m_terms_start[term_id]; pos < m_terms_start[term_id + 1]; ++pos) {
+            fn(m_range_id[pos],
+               taily::Feature_Statistics{m_expected_value[pos], m_variance[pos], m_frequency[pos]});
+        }
+    }
+
+    /// Predicts how many of the top `k` documents of `query` each range holds. Ranges without
+    /// any query term are predicted to hold none.
+    [[nodiscard]] auto predict(Query const& query, std::size_t k) const -> std::vector<double>
+    {
+        taily::Query_Statistics global{{}, static_cast<std::int64_t>(m_num_docs)};
+        std::vector<taily::Query_Statistics> ranges;
+        ranges.reserve(num_ranges());
+        for (size_t range = 0; range < num_ranges(); ++range) {
+            ranges.push_back(taily::Query_Statistics{
+                std::vector<taily::Feature_Statistics>(query.terms.size(), {0.0, 0.0, 0}),
+                m_range_sizes[range]});
+        }
+        std::vector<bool> matched(num_ranges(), false);
+        for (size_t pos = 0; pos < query.terms.size(); ++pos) {
+            auto term_id = query.terms[pos];
+            if (term_id >= num_terms()) {
+                global.term_stats.push_back(taily::Feature_Statistics{0.0, 0.0, 0});
+                continue;
+            }
+            global.term_stats.push_back(term_stats(term_id));
+            for_each_range(term_id, [&](auto range, auto const& stats) {
+                ranges[range].term_stats[pos] = stats;
+                matched[range] = true;
+            });
+        }
+
+        // Taily is only asked about ranges that can match, so it never sees a range whose
+        // score distribution is empty.
+        std::vector<taily::Query_Statistics> matched_ranges;
+        for (size_t range = 0; range < num_ranges(); ++range) {
+            if (matched[range]) {
+                matched_ranges.push_back(std::move(ranges[range]));
+            }
+        }
+        std::vector<double> predictions(num_ranges(), 0.0);
+        if (matched_ranges.empty()) {
+            return predictions;
+        }
+        auto scores = taily::score_shards(global, matched_ranges, k);
+        auto score = scores.begin();
+        for (size_t range = 0; range < num_ranges(); ++range) {
+            if (matched[range]) {
+                predictions[range] = std::isfinite(*score) ? *score : 0.0;
+                ++score;
+            }
+        }
+        return predictions;
+    }
+
+    template <typename Visitor>
+    void map(Visitor& visit)
+    {
+        visit(m_num_docs, "m_num_docs")(m_range_sizes, "m_range_sizes")(
+            m_global_expected_value, "m_global_expected_value")(
+            m_global_variance, "m_global_variance")(m_global_frequency, "m_global_frequency")(
+            m_terms_start, "m_terms_start")(m_range_id, "m_range_id")(
+            m_expected_value, "m_expected_value")(m_variance, "m_variance")(
+            m_frequency, "m_frequency");
+    }
+
+  private:
+    std::uint64_t m_num_docs{0};
+    mapper::mappable_vector<std::int64_t> m_range_sizes;
+    mapper::mappable_vector<double> m_global_expected_value;
+    mapper::mappable_vector<double> m_global_variance;
+    mapper::mappable_vector<std::int64_t> m_global_frequency;
+    mapper::mappable_vector<std::uint64_t> m_terms_start;
+    mapper::mappable_vector<std::uint32_t> m_range_id;
+    mapper::mappable_vector<double> m_expected_value;
+    mapper::mappable_vector<double> m_variance;
+    mapper::mappable_vector<std::int64_t> m_frequency;
+    MemorySource m_source;
+};
+
+/// Orders the ranges of a query by the predicted number of top-k documents they hold, and
+/// stops once the ranges left behind are expected to hold fewer than `epsilon` of them in total.
+/// With `epsilon` of zero, every range containing a query term is kept.
+class taily_range_selector {
+  public:
+    taily_range_selector(range_taily_stats const& stats, std::size_t k, double epsilon = 0.0)
+        : m_stats(stats), m_k(k), m_epsilon(epsilon)
+    {}
+
+    [[nodiscard]] auto operator()(Query const& query) const -> cluster_queue
+    {
+        auto predictions = m_stats.predict(query, m_k);
+        std::vector<bool> matched(predictions.size(), false);
+        for (auto term_id: query.terms) {
+            if (term_id < m_stats.num_terms()) {
+                m_stats.for_each_range(term_id, [&](auto range, auto const&) { matched[range] = true; });
+            }
+        }
+        cluster_queue ranges;
+        for (size_t range = 0; range < predictions.size(); ++range) {
+            if (matched[range]) {
+                ranges.push_back(range);
+            }
+        }
+        std::stable_sort(ranges.begin(), ranges.end(), [&](auto lhs, auto rhs) {
+            return predictions[lhs] > predictions[rhs];
+        });
+        double remaining = 0.0;
+        for (auto range: ranges) {
+            remaining += predictions[range];
+        }
+        size_t selected = 0;
+        while (selected < ranges.size() && not(m_epsilon > 0.0 && remaining < m_epsilon)) {
+            remaining -= predictions[ranges[selected]];
+            ++selected;
+        }
+        ranges.resize(selected);
+        return ranges;
+    }
+
+  private:
+    range_taily_stats const& m_stats;
+    std::size_t m_k;
+    double m_epsilon;
+};
+
+}  // namespace pisa
@@ -9,12 +9,14 @@
 
 #include <gsl/span>
 #include <spdlog/spdlog.h>
+#include <tbb/parallel_for.h>
 
 #include "binary_freq_collection.hpp"
 #include "recursive_graph_bisection.hpp"
 #include "util/index_build_utils.hpp"
 #include "util/inverted_index_utils.hpp"
 #include "util/progress.hpp"
+#include "wand_utils.hpp"
 
 namespace pisa {
 
@@ -30,6 +32,11 @@ struct RecursiveGraphBisectionOptions {
     std::size_t min_length;
     bool compress_fwd;
     bool print_args;
+    // ANYTIME: Cluster-preserving BP. Documents are grouped by cluster, either contiguous ranges
+    // of a `.cluster-range` file or a per-document cluster map, and reordered within each cluster.
+    std::optional<std::string> document_clusters{};
+    std::optional<std::string> cluster_map{};
+    std::optional<std::string> output_clusters{};
 };
 
 namespace detail {
@@ -70,14 +77,97 @@ namespace detail {
         recursive_graph_bisection(initial_range, depth, depth - 6, bp_progress);
     }
 
+    /// Reads a cluster map with the cluster ID of each document, one per line, in document order.
+    inline auto read_cluster_map(std::string const& cluster_map, std::size_t num_docs)
+        -> std::vector<uint32_t>
+    {
+        std::vector<uint32_t> clusters;
+        clusters.reserve(num_docs);
+        std::ifstream is(cluster_map);
+        uint32_t cluster;
+        while (is >> cluster) {
+            clusters.push_back(cluster);
+        }
+        if (clusters.size() != num_docs) {
+            throw std::invalid_argument(fmt::format(
+                "Cluster map {} has {} documents but the collection has {}",
+                cluster_map,
+                clusters.size(),
+                num_docs));
+        }
+        return clusters;
+    }
+
+    /// Groups `documents` by cluster, keeping the relative order within each cluster, and returns
+    /// the exclusive end of every cluster up to the largest cluster ID. Clusters without documents
+    /// are kept as empty ranges, so that range IDs stay equal to the cluster IDs of the map.
+    inline auto group_by_cluster(std::vector<uint32_t>& documents, std::vector<uint32_t> const& clusters)
+        -> std::vector<uint32_t>
+    {
+        std::stable_sort(documents.begin(), documents.end(), [&](auto lhs, auto rhs) {
+            return clusters[lhs] < clusters[rhs];
+        });
+        std::vector<uint32_t> boundaries;
+        for (std::size_t pos = 0; pos < documents.size(); ++pos) {
+            // Every cluster before the one of this document ends here.
+            while (boundaries.size() < clusters[documents[pos]]) {
+                boundaries.push_back(pos);
+            }
+        }
+        boundaries.push_back(documents.size());
+        return boundaries;
+    }
+
+    /// Runs BP independently within every cluster ending at `boundaries`, in parallel. Each cluster
+    /// gets the default depth for its size unless `depth` is given.
+    inline void run_cluster_trees(
+        std::optional<size_t> depth,
+        const range_type& initial_range,
+        std::vector<uint32_t> const& boundaries)
+    {
+        std::vector<std::pair<range_type, size_t>> clusters;
+        std::ptrdiff_t total_count = 0;
+        std::ptrdiff_t first = 0;
+        for (auto last: boundaries) {
+            if (last - first > 1) {
+                auto cluster = initial_range(first, last);
+                auto cluster_depth = depth.value_or(static_cast<size_t>(
+                    std::max(1.0, std::log2(static_cast<double>(cluster.size())) - 5)));
+                total_count += cluster.size() * cluster_depth;
+                clusters.emplace_back(cluster, cluster_depth);
+            }
+            first = last;
+        }
+        spdlog::info(
+            "Reordering {} clusters independently, skipping {} with fewer than two documents",
+            clusters.size(),
+            boundaries.size() - clusters.size());
+        if (clusters.empty()) {
+            return;
+        }
+        pisa::progress bp_progress("Graph bisection", total_count);
+        bp_progress.update(0);
+        auto thread_local_data = std::make_shared<bp::ThreadLocal>();
+        tbb::parallel_for(size_t(0), clusters.size(), [&](size_t idx) {
+            auto [cluster, cluster_depth] = clusters[idx];
+            size_t cache_depth = cluster_depth > 6 ? cluster_depth - 6 : 0;
+            recursive_graph_bisection(cluster, cluster_depth, cache_depth, bp_progress, thread_local_data);
+        });
+    }
+
 }  // namespace detail
 
+
 [[nodiscard]] auto recursive_graph_bisection(RecursiveGraphBisectionOptions const& options) -> int
 {
     if (not options.output_basename && not options.output_fwd) {
         spdlog::error("Must define at least one output parameter.");
         return 1;
     }
+    if (options.cluster_map && options.output_basename && not options.output_clusters) {
+        spdlog::error("Reordering by cluster map needs an output cluster range file.");
+        return 1;
+    }
 
     forward_index fwd = options.input_fwd
         ? forward_index::read(*options.input_fwd)
@@ -94,7 +184,29 @@ namespace detail {
         std::vector<double> gains(fwd.size(), 0.0);
         detail::range_type initial_range(documents.begin(), documents.end(), fwd, gains);
 
-        if (options.node_config) {
+        if (options.document_clusters || options.cluster_map) {
+            std::vector<uint32_t> boundaries;
+            if (options.cluster_map) {
+                auto clusters = detail::read_cluster_map(*options.cluster_map, fwd.size());
+                boundaries = detail::group_by_cluster(documents, clusters);
+            } else {
+                // Ranges are already contiguous: the last one is extended to the last document,
+                // as in `DocToRange`.
+                boundaries = read_cluster_ranges(*options.document_clusters);
+                for (auto& boundary: boundaries) {
+                    boundary = std::min<uint32_t>(boundary, fwd.size());
+                }
+                if (boundaries.empty()) {
+                    boundaries.push_back(fwd.size());
+                } else {
+                    boundaries.back() = fwd.size();
+                }
+            }
+            detail::run_cluster_trees(options.depth, initial_range, boundaries);
+            if (options.output_clusters) {
+                write_cluster_ranges(boundaries, *options.output_clusters);
+            }
+        } else if (options.node_config) {
             detail::run_with_config(*options.node_config, initial_range);
         } else {
             detail::run_default_tree(
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <algorithm>
+#include <limits>
+#include <numeric>
+#include <optional>
 #include <random>
 #include <string>
 #include <unordered_map>
@@ -22,8 +25,11 @@
 #include <spdlog/spdlog.h>
 
 #include "binary_collection.hpp"
+#include "binary_freq_collection.hpp"
+#include "global_statistics.hpp"
 #include "invert.hpp"
 #include "io.hpp"
+#include "mappable/mapper.hpp"
 #include "payload_vector.hpp"
 #include "type_safe.hpp"
 #include "vec_map.hpp"
@@ -283,4 +289,125 @@ auto partition_fwd_index(
     });
 }
 
+/// ANYTIME: Cuts the inverted collection `input_basename` at the cluster `boundaries` (as read
+/// from a `.cluster-range` file) into one shard per cluster, processed in parallel. Shard `i`
+/// holds the documents of cluster `i`, renumbered from zero, and only the terms occurring in
+/// them. Each shard also gets the `.global-stats` of the whole collection: wand data built with
+/// them scores every posting exactly as the wand data of the monolithic collection.
+auto partition_inverted_index(
+    std::string const& input_basename,
+    std::string const& output_basename,
+    std::vector<std::uint32_t> boundaries,
+    std::optional<std::string> const& terms_filename = std::nullopt,
+    std::optional<std::string> const& documents_filename = std::nullopt)
+{
+    binary_freq_collection coll(input_basename.c_str());
+    binary_collection sizes_coll(fmt::format("{}.sizes", input_basename).c_str());
+    auto sizes = *sizes_coll.begin();
+    auto num_docs = coll.num_docs();
+
+    // As in `DocToRange`, the last cluster covers every remaining document.
+    for (auto& boundary: boundaries) {
+        boundary = std::min<std::uint64_t>(boundary, num_docs);
+    }
+    if (boundaries.empty()) {
+        boundaries.push_back(num_docs);
+    } else {
+        boundaries.back() = num_docs;
+    }
+
+    spdlog::info("Computing global statistics");
+    std::uint64_t collection_len = std::accumulate(sizes.begin(), sizes.end(), std::uint64_t(0));
+    std::vector<std::uint32_t> posting_counts;
+    std::vector<std::uint64_t> occurrence_counts;
+    for (auto const& seq: coll) {
+        posting_counts.push_back(seq.docs.size());
+        occurrence_counts.push_back(
+            std::accumulate(seq.freqs.begin(), seq.freqs.end(), std::uint64_t{0}));
+    }
+    std::optional<std::vector<std::string>> terms;
+    if (terms_filename) {
+        terms = io::read_string_vector(*terms_filename);
+    }
+    std::optional<std::vector<std::string>> documents;
+    if (documents_filename) {
+        documents = io::read_string_vector(*documents_filename);
+    }
+
+    auto shard_ids = ranges::views::iota(0_s, Shard_Id(boundaries.size())) | ranges::to_vector;
+    spdlog::info("Writing {} shards", shard_ids.size());
+    std::for_each(pstl::execution::par_unseq, shard_ids.begin(), shard_ids.end(), [&](auto shard_id) {
+        auto basename = format_shard(output_basename, shard_id);
+        auto shard = shard_id.as_int();
+        std::uint32_t first = shard == 0 ? 0 : boundaries[shard - 1];
+        std::uint32_t last = boundaries[shard];
+        if (first == last) {
+            spdlog::warn("Cluster {} is empty", shard);
+        }
+
+        std::ofstream dos(fmt::format("{}.docs", basename));
+        std::ofstream fos(fmt::format("{}.freqs", basename));
+        std::ofstream sos(fmt::format("{}.sizes", basename));
+        std::uint32_t shard_size = last - first;
+        write_sequence(dos, gsl::make_span<std::uint32_t const>(&shard_size, 1));
+        write_sequence(sos, gsl::span<std::uint32_t const>(sizes.begin() + first, shard_size));
+
+        std::vector<std::uint32_t> shard_terms;
+        std::vector<std::uint32_t> docs;
+        std::uint32_t term_id = 0;
+        for (auto const& seq: coll) {
+            auto begin = std::lower_bound(seq.docs.begin(), seq.docs.end(), first);
+            auto end = std::lower_bound(begin, seq.docs.end(), last);
+            if (begin != end) {
+                docs.clear();
+                std::transform(begin, end, std::back_inserter(docs), [&](auto docid) {
+                    return docid - first;
+                });
+                auto freqs = seq.freqs.begin() + std::distance(seq.docs.begin(), begin);
+                write_sequence(dos, gsl::span<std::uint32_t const>(docs));
+                write_sequence(fos, gsl::span<std::uint32_t const>(freqs, docs.size()));
+                shard_terms.push_back(term_id);
+            }
+            term_id += 1;
+        }
+
+        std::vector<std::uint32_t> shard_posting_counts;
+        std::vector<std::uint32_t> shard_occurrence_counts;
+        for (auto term: shard_terms) {
+            shard_posting_counts.push_back(posting_counts[term]);
+            // Global statistics store 32-bit counts: saturate rather than wrap around.
+            shard_occurrence_counts.push_back(static_cast<std::uint32_t>(std::min<std::uint64_t>(
+                occurrence_counts[term], std::numeric_limits<std::uint32_t>::max())));
+        }
+        global_statistics stats(
+            num_docs,
+            collection_len,
+            std::move(shard_posting_counts),
+            std::move(shard_occurrence_counts));
+        mapper::freeze(stats, fmt::format("{}.global-stats", basename).c_str());
+
+        if (terms) {
+            std::ofstream tos(fmt::format("{}.terms", basename));
+            for (auto term: shard_terms) {
+                tos << (*terms)[term] << '\n';
+            }
+            tos.close();
+            std::ifstream tis(fmt::format("{}.terms", basename));
+            encode_payload_vector(std::istream_iterator<io::Line>(tis), std::istream_iterator<io::Line>())
+                .to_file(fmt::format("{}.termlex", basename));
+        }
+        if (documents) {
+            std::ofstream tos(fmt::format("{}.documents", basename));
+            for (auto docid = first; docid < last; ++docid) {
+                tos << (*documents)[docid] << '\n';
+            }
+            tos.close();
+            std::ifstream tis(fmt::format("{}.documents", basename));
+            encode_payload_vector(std::istream_iterator<io::Line>(tis), std::istream_iterator<io::Line>())
+                .to_file(fmt::format("{}.doclex", basename));
+        }
+        spdlog::info("Shard {} finished.", shard);
+    });
+}
+
 }  // namespace pisa
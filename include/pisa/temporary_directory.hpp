@@ -5,8 +5,10 @@
 #include "boost/filesystem.hpp"
 
 struct Temporary_Directory {
-    Temporary_Directory()
-        : dir_(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+    Temporary_Directory() : Temporary_Directory(boost::filesystem::temp_directory_path()) {}
+    /// Creates the directory inside `parent` rather than the system temporary directory.
+    explicit Temporary_Directory(boost::filesystem::path const& parent)
+        : dir_(parent / boost::filesystem::unique_path())
     {
         if (boost::filesystem::exists(dir_)) {
             boost::filesystem::remove_all(dir_);
@@ -45,6 +45,25 @@ void get_size_stats(block_freq_index<BlockCodec, Profile>& coll, uint64_t& docs_
     docs_size = total_size - freqs_size;
 }
 
+/// The cluster directories are counted with the documents.
+template <typename BlockCodec, bool Interleaved>
+void get_size_stats(
+    clustered_block_freq_index<BlockCodec, Interleaved>& coll, uint64_t& docs_size, uint64_t& freqs_size)
+{
+    auto size_tree = mapper::size_tree_of(coll);
+    size_tree->dump();
+    uint64_t total_size = 0;
+    for (auto const& node: size_tree->children) {
+        total_size += node->size;
+    }
+
+    freqs_size = 0;
+    for (size_t i = 0; i < coll.size(); ++i) {
+        freqs_size += coll[i].stats_freqs_size();
+    }
+    docs_size = total_size - freqs_size;
+}
+
 template <typename Collection>
 void dump_stats(Collection& coll, std::string const& type, uint64_t postings)
 {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <x86intrin.h>
 #if defined(__SSE4_2__)
@@ -74,4 +75,53 @@ namespace pisa { namespace intrinsics {
 
 #endif /* USE_POPCNT */
 
+    /// Docids are decoded and searched in chunks of this many values.
+    constexpr std::size_t docid_chunk_size = 8;
+
+    /// Turns the `docid_chunk_size` docid gaps (each stored minus one) at `buf` into docids,
+    /// following the docid `previous`.
+    __INTRIN_INLINE void prefix_sum_gaps(uint32_t* buf, uint32_t previous)
+    {
+#if defined(__SSE4_1__)
+        __m128i const ones = _mm_set1_epi32(1);
+        __m128i lo = _mm_add_epi32(_mm_loadu_si128((__m128i const*)buf), ones);
+        __m128i hi = _mm_add_epi32(_mm_loadu_si128((__m128i const*)(buf + 4)), ones);
+        lo = _mm_add_epi32(lo, _mm_slli_si128(lo, 4));
+        hi = _mm_add_epi32(hi, _mm_slli_si128(hi, 4));
+        lo = _mm_add_epi32(lo, _mm_slli_si128(lo, 8));
+        hi = _mm_add_epi32(hi, _mm_slli_si128(hi, 8));
+        hi = _mm_add_epi32(hi, _mm_shuffle_epi32(lo, 0xFF));
+        __m128i carry = _mm_set1_epi32(previous);
+        _mm_storeu_si128((__m128i*)buf, _mm_add_epi32(lo, carry));
+        _mm_storeu_si128((__m128i*)(buf + 4), _mm_add_epi32(hi, carry));
+#else
+        for (std::size_t pos = 0; pos < docid_chunk_size; ++pos) {
+            previous = buf[pos] += previous + 1;
+        }
+#endif
+    }
+
+    /// Bit `i` is set if `buf[i] >= value`, for each of the `docid_chunk_size` values at `buf`.
+    __INTRIN_INLINE uint32_t geq_mask(uint32_t const* buf, uint32_t value)
+    {
+#if defined(__AVX2__)
+        __m256i values = _mm256_loadu_si256((__m256i const*)buf);
+        __m256i geq = _mm256_cmpeq_epi32(_mm256_max_epu32(values, _mm256_set1_epi32(value)), values);
+        return _mm256_movemask_ps(_mm256_castsi256_ps(geq));
+#elif defined(__SSE4_1__)
+        __m128i const needle = _mm_set1_epi32(value);
+        __m128i lo = _mm_loadu_si128((__m128i const*)buf);
+        __m128i hi = _mm_loadu_si128((__m128i const*)(buf + 4));
+        lo = _mm_cmpeq_epi32(_mm_max_epu32(lo, needle), lo);
+        hi = _mm_cmpeq_epi32(_mm_max_epu32(hi, needle), hi);
+        return _mm_movemask_ps(_mm_castsi128_ps(lo)) | (_mm_movemask_ps(_mm_castsi128_ps(hi)) << 4);
+#else
+        uint32_t mask = 0;
+        for (std::size_t pos = 0; pos < docid_chunk_size; ++pos) {
+            mask |= uint32_t(buf[pos] >= value) << pos;
+        }
+        return mask;
+#endif
+    }
+
 }}  // namespace pisa::intrinsics
@@ -1,14 +1,20 @@
 #pragma once
 
 #include <algorithm>
+#include <fstream>
 #include <numeric>
+#include <optional>
+#include <string>
 #include <unordered_set>
 
 #include "boost/variant.hpp"
 #include "spdlog/spdlog.h"
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
 
 #include "binary_collection.hpp"
 #include "binary_freq_collection.hpp"
+#include "global_statistics.hpp"
 #include "mappable/mappable_vector.hpp"
 #include "mappable/mapper.hpp"
 #include "memory_source.hpp"
@@ -47,92 +53,68 @@ class wand_data {
         BlockSize block_size,
         bool is_quantized,
         std::unordered_set<size_t> const& terms_to_drop,
-        std::vector<uint32_t>& clusters)
+        std::vector<uint32_t>& clusters,
+        bool quantize_range_bounds = false,
+        global_statistics const* global_stats = nullptr)
         : m_num_docs(num_docs)
     {
-        std::vector<uint32_t> doc_lens(num_docs);
-        std::vector<float> max_term_weight;
-        std::vector<uint32_t> term_occurrence_counts;
-        std::vector<uint32_t> term_posting_counts;
         global_parameters params;
-        spdlog::info("Reading sizes...");
-
-        for (size_t i = 0; i < num_docs; ++i) {
-            uint32_t len = *len_it++;
-            doc_lens[i] = len;
-            m_collection_len += len;
-        }
-
-        m_avg_len = float(m_collection_len / double(num_docs));
-
+        read_statistics(len_it, coll, terms_to_drop, global_stats);
         typename block_wand_type::builder builder(coll, params);
-
-        {
-            pisa::progress progress("Storing terms statistics", coll.size());
-            size_t term_id = 0;
-            for (auto const& seq: coll) {
-                if (terms_to_drop.find(term_id) != terms_to_drop.end()) {
-                    progress.update(1);
-                    term_id += 1;
-                    continue;
-                }
-
-                size_t term_occurrence_count = std::accumulate(seq.freqs.begin(), seq.freqs.end(), 0);
-                term_occurrence_counts.push_back(term_occurrence_count);
-                term_posting_counts.push_back(seq.docs.size());
-                term_id += 1;
-                progress.update(1);
-            }
-        }
-        m_doc_lens.steal(doc_lens);
-        m_term_occurrence_counts.steal(term_occurrence_counts);
-        m_term_posting_counts.steal(term_posting_counts);
-
-        auto scorer = scorer::from_params(scorer_params, *this);
-        {
-
-            spdlog::info("Mapping document identifiers to ranges...");
-            std::unordered_map<uint32_t, uint32_t> doc_to_range;
-            uint32_t doc_id = 0;
-            for (uint32_t cluster_id = 0; cluster_id < clusters.size(); ++cluster_id) {
-                while (doc_id < clusters[cluster_id]) {
-                    doc_to_range[doc_id] = cluster_id;
-                    ++doc_id;
-                }
-            }
-            spdlog::info("Mapped {} documents to ranges.", doc_to_range.size());
-
-            pisa::progress progress("Storing score upper bounds", coll.size());
-            size_t term_id = 0;
-            size_t new_term_id = 0;
-            for (auto const& seq: coll) {
-                if (terms_to_drop.find(term_id) != terms_to_drop.end()) {
-                    progress.update(1);
-                    term_id += 1;
-                    continue;
-                }
-                auto v = builder.add_sequence(
-                    seq, coll, doc_lens, m_avg_len, scorer->term_scorer(new_term_id), block_size, doc_to_range);
-                max_term_weight.push_back(v);
-                m_index_max_term_weight = std::max(m_index_max_term_weight, v);
-                term_id += 1;
-                new_term_id += 1;
-                progress.update(1);
-            }
-            if (is_quantized) {
-                LinearQuantizer quantizer(
-                    m_index_max_term_weight, configuration::get().quantization_bits);
-                for (auto&& w: max_term_weight) {
-                    w = quantizer(w);
-                }
-                builder.quantize_block_max_term_weights(m_index_max_term_weight);
-            }
-        }
+        auto max_term_weight = compute_upper_bounds(
+            builder,
+            coll,
+            scorer_params,
+            block_size,
+            is_quantized,
+            quantize_range_bounds,
+            terms_to_drop,
+            clusters);
         builder.build(m_block_wand);
         m_max_term_weight.steal(max_term_weight);
         m_doc_ranges.steal(clusters);
     }
 
+    /// Builds wand data directly into `output` with `block_wand_type::stream_builder`, which
+    /// keeps block and range upper bounds in temporary files rather than in memory.
+    /// The written file is identical to freezing an instance built in memory.
+    template <typename LengthsIterator>
+    static void stream(
+        std::string const& output,
+        LengthsIterator len_it,
+        uint64_t num_docs,
+        binary_freq_collection const& coll,
+        const ScorerParams& scorer_params,
+        BlockSize block_size,
+        bool is_quantized,
+        std::unordered_set<size_t> const& terms_to_drop,
+        std::vector<uint32_t>& clusters,
+        bool quantize_range_bounds = false,
+        global_statistics const* global_stats = nullptr)
+    {
+        wand_data wdata;
+        wdata.m_num_docs = num_docs;
+        global_parameters params;
+        wdata.read_statistics(len_it, coll, terms_to_drop, global_stats);
+        typename block_wand_type::stream_builder builder(coll, params);
+        auto max_term_weight = wdata.compute_upper_bounds(
+            builder,
+            coll,
+            scorer_params,
+            block_size,
+            is_quantized,
+            quantize_range_bounds,
+            terms_to_drop,
+            clusters);
+        wdata.m_max_term_weight.steal(max_term_weight);
+        wdata.m_doc_ranges.steal(clusters);
+
+        std::ofstream os(output, std::ios::binary);
+        mapper::detail::freeze_visitor freezer(os, 0);
+        builder.build(os);
+        wdata.map_statistics(freezer);
+    }
+
     float norm_len(uint64_t doc_id) const { return m_doc_lens[doc_id] / m_avg_len; }
 
     size_t doc_len(uint64_t doc_id) const { return m_doc_lens[doc_id]; }
@@ -164,6 +146,7 @@ class wand_data {
 
     float index_max_term_weight() const { return m_index_max_term_weight; }
 
+    /// For a shard built with global statistics, the number of documents of the whole collection.
     size_t num_docs() const { return m_num_docs; }
 
     float avg_len() const { return m_avg_len; }
@@ -182,9 +165,16 @@ class wand_data {
     template <typename Visitor>
     void map(Visitor& visit)
     {
-        visit(m_block_wand, "m_block_wand")(m_doc_lens, "m_doc_lens")(
+        visit(m_block_wand, "m_block_wand");
+        map_statistics(visit);
+    }
 
-            m_term_occurrence_counts, "m_term_occurrence_counts")(
+  private:
+    /// Visits all members stored after `m_block_wand`.
+    template <typename Visitor>
+    void map_statistics(Visitor& visit)
+    {
+        visit(m_doc_lens, "m_doc_lens")(m_term_occurrence_counts, "m_term_occurrence_counts")(
             m_term_posting_counts, "m_term_posting_counts")(m_avg_len, "m_avg_len")(
             m_collection_len, "m_collection_len")(m_num_docs, "m_num_docs")(
             m_max_term_weight, "m_max_term_weight")(
@@ -192,7 +182,161 @@ class wand_data {
             m_doc_ranges, "m_doc_ranges");
     }
 
-  private:
+    /// Reads document lengths and per-term statistics of the terms that are not dropped.
+    /// With `global_stats`, everything but the document lengths is taken from there instead.
+    template <typename LengthsIterator>
+    void read_statistics(
+        LengthsIterator len_it,
+        binary_freq_collection const& coll,
+        std::unordered_set<size_t> const& terms_to_drop,
+        global_statistics const* global_stats = nullptr)
+    {
+        std::vector<uint32_t> doc_lens(m_num_docs);
+        std::vector<uint32_t> term_occurrence_counts;
+        std::vector<uint32_t> term_posting_counts;
+        spdlog::info("Reading sizes...");
+
+        for (size_t i = 0; i < m_num_docs; ++i) {
+            uint32_t len = *len_it++;
+            doc_lens[i] = len;
+            m_collection_len += len;
+        }
+
+        m_avg_len = float(m_collection_len / double(m_num_docs));
+        if (global_stats != nullptr) {
+            if (global_stats->num_terms() != coll.size()) {
+                throw std::invalid_argument("Global statistics do not match the collection terms");
+            }
+            m_collection_len = global_stats->collection_len();
+            m_num_docs = global_stats->num_docs();
+            m_avg_len = float(m_collection_len / double(m_num_docs));
+        }
+
+        {
+            pisa::progress progress("Storing terms statistics", coll.size());
+            size_t term_id = 0;
+            for (auto const& seq: coll) {
+                if (terms_to_drop.find(term_id) != terms_to_drop.end()) {
+                    progress.update(1);
+                    term_id += 1;
+                    continue;
+                }
+
+                if (global_stats != nullptr) {
+                    term_occurrence_counts.push_back(global_stats->term_occurrence_count(term_id));
+                    term_posting_counts.push_back(global_stats->term_posting_count(term_id));
+                    term_id += 1;
+                    progress.update(1);
+                    continue;
+                }
+                size_t term_occurrence_count = std::accumulate(seq.freqs.begin(), seq.freqs.end(), 0);
+                term_occurrence_counts.push_back(term_occurrence_count);
+                term_posting_counts.push_back(seq.docs.size());
+                term_id += 1;
+                progress.update(1);
+            }
+        }
+        m_doc_lens.steal(doc_lens);
+        m_term_occurrence_counts.steal(term_occurrence_counts);
+        m_term_posting_counts.steal(term_posting_counts);
+    }
+
+    /// Adds all terms that are not dropped to `builder`, and returns their max weights.
+    template <typename Builder>
+    auto compute_upper_bounds(
+        Builder& builder,
+        binary_freq_collection const& coll,
+        const ScorerParams& scorer_params,
+        BlockSize block_size,
+        bool is_quantized,
+        bool quantize_range_bounds,
+        std::unordered_set<size_t> const& terms_to_drop,
+        std::vector<uint32_t> const& clusters) -> std::vector<float>
+    {
+        std::vector<uint32_t> const doc_lens;
+        std::vector<float> max_term_weight(m_term_posting_counts.size());
+        auto scorer = scorer::from_params(scorer_params, *this);
+
+        // ANYTIME: Ranges are looked up by binary search over the cluster boundaries.
+        DocToRange doc_to_range(clusters);
+        spdlog::info("Mapping document identifiers to {} ranges", doc_to_range.size());
+
+        pisa::progress progress("Storing score upper bounds", coll.size());
+
+        // Terms are read sequentially in batches, and each batch is split into chunks
+        // of consecutive terms scored in parallel by their own builders. Chunks are
+        // appended in term order, so the output is identical to a sequential build.
+        std::vector<binary_freq_collection::sequence> batch;
+        batch.reserve(batch_size);
+        size_t first_term_id = 0;
+        auto process_batch = [&] {
+            auto num_chunks = (batch.size() + chunk_size - 1) / chunk_size;
+            std::vector<decltype(builder.chunk())> chunks;
+            chunks.reserve(num_chunks);
+            for (size_t chunk = 0; chunk < num_chunks; ++chunk) {
+                chunks.push_back(builder.chunk());
+            }
+            tbb::parallel_for(
+                tbb::blocked_range<size_t>(0, num_chunks), [&](auto const& chunk_range) {
+                    for (auto chunk = chunk_range.begin(); chunk != chunk_range.end(); ++chunk) {
+                        auto last = std::min((chunk + 1) * chunk_size, batch.size());
+                        for (auto idx = chunk * chunk_size; idx < last; ++idx) {
+                            auto new_term_id = first_term_id + idx;
+                            max_term_weight[new_term_id] = chunks[chunk].add_sequence(
+                                batch[idx],
+                                coll,
+                                doc_lens,
+                                m_avg_len,
+                                scorer->term_scorer(new_term_id),
+                                block_size,
+                                doc_to_range);
+                            progress.update(1);
+                        }
+                    }
+                });
+            for (auto&& chunk: chunks) {
+                builder.append(std::move(chunk));
+            }
+            first_term_id += batch.size();
+            batch.clear();
+        };
+
+        size_t term_id = 0;
+        for (auto const& seq: coll) {
+            if (terms_to_drop.find(term_id) != terms_to_drop.end()) {
+                progress.update(1);
+            } else {
+                batch.push_back(seq);
+                if (batch.size() == batch_size) {
+                    process_batch();
+                }
+            }
+            term_id += 1;
+        }
+        process_batch();
+
+        if (not max_term_weight.empty()) {
+            m_index_max_term_weight =
+                *std::max_element(max_term_weight.begin(), max_term_weight.end());
+        }
+        if (is_quantized) {
+            LinearQuantizer quantizer(m_index_max_term_weight, configuration::get().quantization_bits);
+            for (auto&& w: max_term_weight) {
+                w = quantizer(w);
+            }
+            builder.quantize_block_max_term_weights(m_index_max_term_weight);
+        }
+        if (quantize_range_bounds) {
+            builder.quantize_range_max_term_weights();
+        }
+        return max_term_weight;
+    }
+
+    /// Number of terms held in memory at once while building.
+    static constexpr size_t batch_size = 1U << 16U;
+    /// Number of consecutive terms scored by a single task.
+    static constexpr size_t chunk_size = 256;
+
     uint64_t m_num_docs = 0;
     float m_avg_len = 0;
     uint64_t m_collection_len = 0;
@@ -215,7 +359,10 @@ void create_wand_data(
     bool compress,
     bool quantize,
     std::unordered_set<size_t> const& dropped_term_ids,
-    const std::optional<std::string>& clusters_filename)
+    const std::optional<std::string>& clusters_filename,
+    bool streaming = false,
+    bool quantize_range_bounds = false,
+    const std::optional<std::string>& global_stats_filename = std::nullopt)
 {
     spdlog::info("Dropping {} terms", dropped_term_ids.size());
     binary_collection sizes_coll((input_basename + ".sizes").c_str());
@@ -224,20 +371,15 @@ void create_wand_data(
     // ANYTIME: Read cluster mapping into wand data
     std::vector<uint32_t> clusters;
     if (clusters_filename) {
-        uint64_t cluster_id, doc_id;
-        uint64_t expected_id = 0;
-        std::ifstream tin(*clusters_filename);
-        while (tin >> cluster_id >> doc_id) {
-            if (cluster_id != expected_id) {
-                spdlog::error("Cluster range file must be sorted in ascending order of range.");
-                std::exit(EXIT_FAILURE);
-            }
-            clusters.push_back(doc_id);
-            ++expected_id;
-        }
-        spdlog::info("Read {} cluster ranges", clusters.size());
+        clusters = read_cluster_ranges(*clusters_filename);
     }
 
+    // ANYTIME: Score a shard with the statistics of the collection it was cut from
+    std::optional<global_statistics> global_stats;
+    if (global_stats_filename) {
+        global_stats.emplace(MemorySource::mapped_file(*global_stats_filename));
+    }
+    global_statistics const* global_stats_ptr = global_stats ? &*global_stats : nullptr;
 
     if (compress) {
         wand_data<wand_data_compressed<>> wdata(
@@ -248,7 +390,9 @@ void create_wand_data(
             block_size,
             quantize,
             dropped_term_ids,
-            clusters);
+            clusters,
+            quantize_range_bounds,
+            global_stats_ptr);
         mapper::freeze(wdata, output.c_str());
     } else if (range) {
         wand_data<wand_data_range<128, 1024>> wdata(
@@ -259,8 +403,23 @@ void create_wand_data(
             block_size,
             quantize,
             dropped_term_ids,
-            clusters);
+            clusters,
+            quantize_range_bounds,
+            global_stats_ptr);
         mapper::freeze(wdata, output.c_str());
+    } else if (streaming) {
+        wand_data<wand_data_raw>::stream(
+            output,
+            sizes_coll.begin()->begin(),
+            coll.num_docs(),
+            coll,
+            scorer_params,
+            block_size,
+            quantize,
+            dropped_term_ids,
+            clusters,
+            quantize_range_bounds,
+            global_stats_ptr);
     } else {
         wand_data<wand_data_raw> wdata(
             sizes_coll.begin()->begin(),
@@ -270,7 +429,9 @@ void create_wand_data(
             block_size,
             quantize,
             dropped_term_ids,
-            clusters);
+            clusters,
+            quantize_range_bounds,
+            global_stats_ptr);
         mapper::freeze(wdata, output.c_str());
     }
 }
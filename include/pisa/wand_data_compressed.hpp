@@ -99,12 +99,38 @@ class wand_data_compressed {
         builder(binary_freq_collection const& coll, global_parameters const& params)
             : total_elements(0),
               total_blocks(0),
-              params(params),
-              compressor_builder(coll.num_docs(), params)
+              num_docs(coll.num_docs()),
+              params(params)
         {
             spdlog::info("Storing max weight for each list and for each block...");
         }
 
+        /// Creates an empty builder for a contiguous chunk of terms, to be merged back
+        /// into this one with `append`.
+        [[nodiscard]] auto chunk() const -> builder { return builder(num_docs, params); }
+
+        /// Appends all sequences added to `other` after the ones already stored here.
+        void append(builder&& other)
+        {
+            std::move(
+                other.block_max_documents.begin(),
+                other.block_max_documents.end(),
+                std::back_inserter(block_max_documents));
+            std::move(
+                other.unquantized_block_max_scores.begin(),
+                other.unquantized_block_max_scores.end(),
+                std::back_inserter(unquantized_block_max_scores));
+            max_term_weight.insert(
+                max_term_weight.end(), other.max_term_weight.begin(), other.max_term_weight.end());
+            total_elements += other.total_elements;
+            total_blocks += other.total_blocks;
+            other.block_max_documents.clear();
+            other.unquantized_block_max_scores.clear();
+            other.max_term_weight.clear();
+            other.total_elements = 0;
+            other.total_blocks = 0;
+        }
+
         template <typename Scorer>
         float add_sequence(
             binary_freq_collection::sequence const& seq,
@@ -113,19 +139,29 @@ class wand_data_compressed {
             float avg_len,
             Scorer scorer,
             BlockSize block_size,
-            std::unordered_map<uint32_t, uint32_t>& doc_to_range)
+            DocToRange const& doc_to_range)
         {
 
             // ANYTIME: We do not support compressed wand data yet -- please use plain wand data for now.
-            if (doc_to_range.size() > 0) {
+            if (not doc_to_range.empty()) {
                 spdlog::error("Sorry, compressed wand data and clusters are not yet supported together.");
                 std::exit(EXIT_FAILURE);
             }
 
             auto t = block_size.type() == typeid(FixedBlock)
-                ? static_block_partition(seq, scorer, boost::get<FixedBlock>(block_size).size, doc_to_range)
+                ? static_block_partition(
+                    seq,
+                    scorer,
+                    boost::get<FixedBlock>(block_size).size,
+                    doc_to_range,
+                    boost::get<FixedBlock>(block_size).range_aligned)
                 : variable_block_partition(
-                    coll, seq, scorer, doc_to_range, boost::get<VariableBlock>(block_size).lambda);
+                    coll,
+                    seq,
+                    scorer,
+                    doc_to_range,
+                    boost::get<VariableBlock>(block_size).lambda,
+                    boost::get<VariableBlock>(block_size).range_aligned);
 
             float max_score = *(std::max_element(std::get<1>(t).begin(), std::get<1>(t).end()));
             max_term_weight.push_back(max_score);
@@ -140,8 +176,12 @@ class wand_data_compressed {
 
         void quantize_block_max_term_weights(float index_max_term_weight) {}
 
+        // ANYTIME: Range upper bounds are not stored.
+        void quantize_range_max_term_weights() {}
+
         void build(wand_data_compressed& wdata)
         {
+            typename uniform_score_compressor::builder compressor_builder(num_docs, params);
             auto index_max_term_weight =
                 *(std::max_element(max_term_weight.begin(), max_term_weight.end()));
             for (auto&& [docs, scores]:
@@ -164,8 +204,13 @@ class wand_data_compressed {
         std::vector<std::vector<uint32_t>> block_max_documents;
         std::vector<std::vector<float>> unquantized_block_max_scores;
         std::vector<float> max_term_weight;
+        uint64_t num_docs;
         global_parameters const& params;
-        typename uniform_score_compressor::builder compressor_builder;
+
+      private:
+        builder(uint64_t num_docs, global_parameters const& params)
+            : total_elements(0), total_blocks(0), num_docs(num_docs), params(params)
+        {}
     };
 
     class enumerator {
@@ -54,6 +54,27 @@ class wand_data_range {
                 posting_lists);
         }
 
+        /// Creates an empty builder for a contiguous chunk of terms, to be merged back
+        /// into this one with `append`.
+        [[nodiscard]] auto chunk() const -> builder { return builder(blocks_num); }
+
+        /// Appends all sequences added to `other` after the ones already stored here.
+        void append(builder&& other)
+        {
+            auto offset = blocks_start.back();
+            std::transform(
+                std::next(other.blocks_start.begin()),
+                other.blocks_start.end(),
+                std::back_inserter(blocks_start),
+                [&](auto start) { return start + offset; });
+            block_max_term_weight.insert(
+                block_max_term_weight.end(),
+                other.block_max_term_weight.begin(),
+                other.block_max_term_weight.end());
+            total_elements += other.total_elements;
+            other = builder(blocks_num);
+        }
+
         // ANYTIME: Unimplemented
         template <typename Scorer>
         float add_sequence(
@@ -63,10 +84,10 @@ class wand_data_range {
             float avg_len,
             Scorer scorer,
             [[maybe_unused]] BlockSize block_size,
-            std::unordered_map<uint32_t, uint32_t>& doc_to_range)
+            DocToRange const& doc_to_range)
         {
 
-            if (doc_to_range.size() > 0) {
+            if (not doc_to_range.empty()) {
                 spdlog::error("Sorry, ranges and clusters are not yet supported together.");
                 std::exit(EXIT_FAILURE);
             }
@@ -102,6 +123,9 @@ class wand_data_range {
             }
         }
 
+        // ANYTIME: Range upper bounds are not stored.
+        void quantize_range_max_term_weights() {}
+
         void build(wand_data_range& wdata)
         {
             wdata.m_blocks_num = blocks_num;
@@ -116,6 +140,11 @@ class wand_data_range {
         uint64_t total_elements;
         std::vector<uint64_t> blocks_start;
         std::vector<float> block_max_term_weight;
+
+      private:
+        explicit builder(uint64_t blocks_num)
+            : blocks_num(blocks_num), total_elements(0), blocks_start{0}, block_max_term_weight{}
+        {}
     };
 
     class enumerator {
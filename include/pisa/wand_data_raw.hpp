@@ -1,5 +1,9 @@
 #pragma once
 
+#include <array>
+#include <fstream>
+#include <stdexcept>
+
 #include "boost/variant.hpp"
 #include "spdlog/spdlog.h"
 
@@ -8,6 +12,7 @@
 #include "binary_freq_collection.hpp"
 #include "global_parameters.hpp"
 #include "linear_quantizer.hpp"
+#include "temporary_directory.hpp"
 #include "util/compiler_attribute.hpp"
 #include "wand_utils.hpp"
 
@@ -15,22 +20,67 @@ namespace pisa {
 
 class wand_data_raw {
   public:
+    /// Starts every file, so that files written before it was added are rejected, not misread.
+    static constexpr std::array<char, 8> format_magic{'P', 'I', 'S', 'A', 'W', 'D', 'R', '1'};
+
+    struct format_flags {
+        enum : uint64_t { quantized_range_bounds = 1 };
+    };
+
     wand_data_raw() = default;
 
+    class stream_builder;
+
     class builder {
+        friend class stream_builder;
+
       public:
         builder(binary_freq_collection const& coll, global_parameters const& params)
         {
             (void)coll;
             (void)params;
             spdlog::info("Storing max weight for each list and for each block...");
-            total_elements = 0;
-            total_blocks = 0;
-            effective_list = 0;
             blocks_start.push_back(0);
             ranges_start.push_back(0);
         }
 
+        /// Creates an empty builder for a contiguous chunk of terms, to be merged back
+        /// into this one with `append`.
+        [[nodiscard]] auto chunk() const -> builder { return builder(); }
+
+        /// Appends all sequences added to `other` after the ones already stored here.
+        void append(builder&& other)
+        {
+            auto blocks_offset = blocks_start.back();
+            auto ranges_offset = ranges_start.back();
+            std::transform(
+                std::next(other.blocks_start.begin()),
+                other.blocks_start.end(),
+                std::back_inserter(blocks_start),
+                [&](auto start) { return start + blocks_offset; });
+            std::transform(
+                std::next(other.ranges_start.begin()),
+                other.ranges_start.end(),
+                std::back_inserter(ranges_start),
+                [&](auto start) { return start + ranges_offset; });
+            block_max_term_weight.insert(
+                block_max_term_weight.end(),
+                other.block_max_term_weight.begin(),
+                other.block_max_term_weight.end());
+            block_docid.insert(block_docid.end(), other.block_docid.begin(), other.block_docid.end());
+            max_term_weight.insert(
+                max_term_weight.end(), other.max_term_weight.begin(), other.max_term_weight.end());
+            range_max_term_weight.insert(
+                range_max_term_weight.end(),
+                other.range_max_term_weight.begin(),
+                other.range_max_term_weight.end());
+            range_id.insert(range_id.end(), other.range_id.begin(), other.range_id.end());
+            total_elements += other.total_elements;
+            total_blocks += other.total_blocks;
+            effective_list += other.effective_list;
+            other = builder();
+        }
+
         // ANYTIME
         template <typename Scorer>
         float add_sequence(
@@ -40,13 +90,22 @@ class wand_data_raw {
             float avg_len,
             Scorer scorer,
             BlockSize block_size,
-            std::unordered_map<uint32_t, uint32_t>& doc_to_range)
-
+            DocToRange const& doc_to_range)
         {
             auto t = block_size.type() == typeid(FixedBlock)
-                ? static_block_partition(seq, scorer, boost::get<FixedBlock>(block_size).size, doc_to_range)
+                ? static_block_partition(
+                    seq,
+                    scorer,
+                    boost::get<FixedBlock>(block_size).size,
+                    doc_to_range,
+                    boost::get<FixedBlock>(block_size).range_aligned)
                 : variable_block_partition(
-                    coll, seq, scorer, doc_to_range, boost::get<VariableBlock>(block_size).lambda);
+                    coll,
+                    seq,
+                    scorer,
+                    doc_to_range,
+                    boost::get<VariableBlock>(block_size).lambda,
+                    boost::get<VariableBlock>(block_size).range_aligned);
 
             block_max_term_weight.insert(
                 block_max_term_weight.end(), std::get<1>(t).begin(), std::get<1>(t).end());
@@ -71,22 +130,41 @@ class wand_data_raw {
             }
         }
 
+        /// Replaces range upper bounds with 8-bit values and a scale per term.
+        void quantize_range_max_term_weights()
+        {
+            range_max_quantized.reserve(range_max_term_weight.size());
+            for (size_t term = 0; term + 1 < ranges_start.size(); ++term) {
+                auto first = std::next(range_max_term_weight.begin(), ranges_start[term]);
+                auto last = std::next(range_max_term_weight.begin(), ranges_start[term + 1]);
+                UpperBoundQuantizer quantizer(first == last ? 0.0F : *std::max_element(first, last));
+                range_scale.push_back(quantizer.scale());
+                std::transform(first, last, std::back_inserter(range_max_quantized), quantizer);
+            }
+            range_max_term_weight.clear();
+            range_max_term_weight.shrink_to_fit();
+            flags |= format_flags::quantized_range_bounds;
+        }
+
         void build(wand_data_raw& wdata)
         {
+            wdata.m_flags = flags;
             wdata.m_block_max_term_weight.steal(block_max_term_weight);
             wdata.m_blocks_start.steal(blocks_start);
             wdata.m_block_docid.steal(block_docid);
             wdata.m_ranges_start.steal(ranges_start);
             wdata.m_range_max_term_weight.steal(range_max_term_weight);
             wdata.m_range_id.steal(range_id);
+            wdata.m_range_scale.steal(range_scale);
+            wdata.m_range_max_quantized.steal(range_max_quantized);
             spdlog::info(
                 "number of elements / number of blocks: {}",
                 static_cast<float>(total_elements) / static_cast<float>(total_blocks));
         }
 
-        uint64_t total_elements;
-        uint64_t total_blocks;
-        uint64_t effective_list;
+        uint64_t total_elements = 0;
+        uint64_t total_blocks = 0;
+        uint64_t effective_list = 0;
         std::vector<float> max_term_weight;
         std::vector<uint64_t> blocks_start;
         std::vector<float> block_max_term_weight;
@@ -95,6 +173,217 @@ class wand_data_raw {
         std::vector<uint64_t> ranges_start;
         std::vector<float> range_max_term_weight;
         std::vector<uint32_t> range_id;
+        // Quantized range upper bounds, if enabled.
+        std::vector<float> range_scale;
+        std::vector<uint8_t> range_max_quantized;
+        uint64_t flags = 0;
+
+      private:
+        builder() : blocks_start{0}, ranges_start{0} {}
+    };
+
+    /// Builds the same data as `builder`, but appends every term's blocks and ranges to
+    /// temporary files instead of keeping them in memory. Terms are added in chunks,
+    /// built in memory with a regular `builder` returned by `chunk`, and the final layout
+    /// is assembled with sequential I/O by `build`.
+    class stream_builder {
+      public:
+        stream_builder(binary_freq_collection const& coll, global_parameters const& params)
+            : m_blocks_start(m_tmp, "blocks_start"),
+              m_block_max_term_weight(m_tmp, "block_max_term_weight"),
+              m_block_docid(m_tmp, "block_docid"),
+              m_ranges_start(m_tmp, "ranges_start"),
+              m_range_max_term_weight(m_tmp, "range_max_term_weight"),
+              m_range_id(m_tmp, "range_id"),
+              m_range_scale(m_tmp, "range_scale"),
+              m_range_max_quantized(m_tmp, "range_max_quantized")
+        {
+            (void)coll;
+            (void)params;
+            spdlog::info("Streaming max weight for each list and for each block...");
+            m_blocks_start.push_back(0);
+            m_ranges_start.push_back(0);
+        }
+
+        [[nodiscard]] auto chunk() const -> builder { return builder(); }
+
+        /// Spills all sequences added to `other` after the ones already written.
+        void append(builder&& other)
+        {
+            auto blocks_offset = m_blocks_start.back();
+            auto ranges_offset = m_ranges_start.back();
+            for (auto it = std::next(other.blocks_start.begin()); it != other.blocks_start.end();
+                 ++it) {
+                m_blocks_start.push_back(*it + blocks_offset);
+            }
+            for (auto it = std::next(other.ranges_start.begin()); it != other.ranges_start.end();
+                 ++it) {
+                m_ranges_start.push_back(*it + ranges_offset);
+            }
+            m_block_max_term_weight.append(other.block_max_term_weight);
+            m_block_docid.append(other.block_docid);
+            m_range_max_term_weight.append(other.range_max_term_weight);
+            m_range_id.append(other.range_id);
+            total_elements += other.total_elements;
+            total_blocks += other.total_blocks;
+            other = builder();
+        }
+
+        void quantize_block_max_term_weights(float index_max_term_weight)
+        {
+            LinearQuantizer quantizer(index_max_term_weight, configuration::get().quantization_bits);
+            m_block_max_term_weight.transform([&](float w) -> float { return quantizer(w); });
+        }
+
+        /// Replaces range upper bounds with 8-bit values and a scale per term.
+        /// No more terms can be added afterwards.
+        void quantize_range_max_term_weights()
+        {
+            auto starts = m_ranges_start.read();
+            auto weights = m_range_max_term_weight.read();
+            std::vector<float> term_weights;
+            std::vector<uint8_t> quantized;
+            uint64_t begin = 0;
+            starts.read(reinterpret_cast<char*>(&begin), sizeof(begin));
+            for (uint64_t term = 0; term + 1 < m_ranges_start.size(); ++term) {
+                uint64_t end = 0;
+                starts.read(reinterpret_cast<char*>(&end), sizeof(end));
+                term_weights.resize(end - begin);
+                weights.read(
+                    reinterpret_cast<char*>(term_weights.data()), term_weights.size() * sizeof(float));
+                UpperBoundQuantizer quantizer(
+                    term_weights.empty()
+                        ? 0.0F
+                        : *std::max_element(term_weights.begin(), term_weights.end()));
+                quantized.clear();
+                std::transform(
+                    term_weights.begin(), term_weights.end(), std::back_inserter(quantized), quantizer);
+                m_range_scale.push_back(quantizer.scale());
+                m_range_max_quantized.append(quantized);
+                begin = end;
+            }
+            m_range_max_term_weight.clear();
+            m_flags |= format_flags::quantized_range_bounds;
+        }
+
+        /// Writes all vectors, in the order of `wand_data_raw::map`, to `os`.
+        void build(std::ofstream& os)
+        {
+            os.write(format_magic.data(), format_magic.size());
+            os.write(reinterpret_cast<char const*>(&m_flags), sizeof(m_flags));
+            m_blocks_start.write(os);
+            m_block_max_term_weight.write(os);
+            m_block_docid.write(os);
+            m_ranges_start.write(os);
+            m_range_max_term_weight.write(os);
+            m_range_id.write(os);
+            if ((m_flags & format_flags::quantized_range_bounds) != 0) {
+                m_range_scale.write(os);
+                m_range_max_quantized.write(os);
+            }
+            spdlog::info(
+                "number of elements / number of blocks: {}",
+                static_cast<float>(total_elements) / static_cast<float>(total_blocks));
+        }
+
+        uint64_t total_elements = 0;
+        uint64_t total_blocks = 0;
+
+      private:
+        /// Vector of PODs written to a temporary file.
+        template <typename T>
+        class spill_vector {
+          public:
+            spill_vector(Temporary_Directory& tmp, std::string const& name)
+                : m_path((tmp.path() / name).string()), m_output(m_path, std::ios::binary)
+            {}
+
+            void push_back(T value)
+            {
+                m_output.write(reinterpret_cast<char const*>(&value), sizeof(T));
+                m_back = value;
+                m_size += 1;
+            }
+
+            void append(std::vector<T> const& values)
+            {
+                if (values.empty()) {
+                    return;
+                }
+                m_output.write(
+                    reinterpret_cast<char const*>(values.data()), values.size() * sizeof(T));
+                m_back = values.back();
+                m_size += values.size();
+            }
+
+            [[nodiscard]] auto back() const -> T { return m_back; }
+
+            [[nodiscard]] auto size() const -> uint64_t { return m_size; }
+
+            /// Closes the file for writing and opens it for reading.
+            [[nodiscard]] auto read() -> std::ifstream
+            {
+                m_output.close();
+                return std::ifstream(m_path, std::ios::binary);
+            }
+
+            void clear()
+            {
+                m_output.close();
+                m_output.open(m_path, std::ios::binary | std::ios::trunc);
+                m_size = 0;
+                m_back = T{};
+            }
+
+            /// Rewrites all values in place with `fn`, one buffer at a time.
+            template <typename Fn>
+            void transform(Fn fn)
+            {
+                m_output.close();
+                std::fstream file(m_path, std::ios::binary | std::ios::in | std::ios::out);
+                std::vector<T> buffer(buffer_size);
+                for (uint64_t pos = 0; pos < m_size; pos += buffer.size()) {
+                    auto len = std::min<uint64_t>(buffer.size(), m_size - pos);
+                    file.seekg(pos * sizeof(T));
+                    file.read(reinterpret_cast<char*>(buffer.data()), len * sizeof(T));
+                    std::transform(buffer.begin(), std::next(buffer.begin(), len), buffer.begin(), fn);
+                    file.seekp(pos * sizeof(T));
+                    file.write(reinterpret_cast<char const*>(buffer.data()), len * sizeof(T));
+                }
+                file.close();
+                m_output.open(m_path, std::ios::binary | std::ios::app);
+            }
+
+            /// Writes the vector to `os` the way `mapper::freeze` writes a `mappable_vector`.
+            void write(std::ofstream& os)
+            {
+                m_output.close();
+                os.write(reinterpret_cast<char const*>(&m_size), sizeof(m_size));
+                if (m_size > 0) {
+                    std::ifstream input(m_path, std::ios::binary);
+                    os << input.rdbuf();
+                }
+            }
+
+          private:
+            static constexpr std::size_t buffer_size = 1U << 20U;
+
+            std::string m_path;
+            std::ofstream m_output;
+            uint64_t m_size = 0;
+            T m_back{};
+        };
+
+        Temporary_Directory m_tmp{};
+        spill_vector<uint64_t> m_blocks_start;
+        spill_vector<float> m_block_max_term_weight;
+        spill_vector<uint32_t> m_block_docid;
+        spill_vector<uint64_t> m_ranges_start;
+        spill_vector<float> m_range_max_term_weight;
+        spill_vector<uint32_t> m_range_id;
+        spill_vector<float> m_range_scale;
+        spill_vector<uint8_t> m_range_max_quantized;
+        uint64_t m_flags = 0;
     };
     class enumerator {
         friend class wand_data_raw;
@@ -108,16 +397,22 @@ class wand_data_raw {
             uint32_t _range_start,
             uint32_t _range_number,
             mapper::mappable_vector<float> const& max_range_weight,
-            mapper::mappable_vector<uint32_t> const& range_id)
+            mapper::mappable_vector<uint32_t> const& range_id,
+            mapper::mappable_vector<uint8_t> const& range_max_quantized,
+            bool quantized,
+            float range_scale)
             : cur_pos(0),
               block_start(_block_start),
               block_number(_block_number),
               range_start(_range_start),
               range_number(_range_number),
+              quantized(quantized),
+              range_scale(range_scale),
               m_block_max_term_weight(max_term_weight),
               m_block_docid(block_docid),
               m_range_max_term_weight(max_range_weight),
-              m_range_id(range_id) 
+              m_range_id(range_id),
+              m_range_max_quantized(range_max_quantized)
         {}
 
         void PISA_NOINLINE next_geq(uint64_t lower_bound)
@@ -144,6 +439,9 @@ class wand_data_raw {
                 ++i;
             }
             if (m_range_id[range_start + i] == range_id) {
+                if (quantized) {
+                    return m_range_max_quantized[range_start + i] * range_scale;
+                }
                 return m_range_max_term_weight[range_start + i];
             }
             return 0.0f;
@@ -164,10 +462,13 @@ class wand_data_raw {
         uint64_t block_number;
         uint64_t range_start;
         uint64_t range_number;
+        bool quantized;
+        float range_scale;
         mapper::mappable_vector<float> const& m_block_max_term_weight;
         mapper::mappable_vector<uint32_t> const& m_block_docid;
         mapper::mappable_vector<float> const& m_range_max_term_weight;
         mapper::mappable_vector<uint32_t> const& m_range_id;
+        mapper::mappable_vector<uint8_t> const& m_range_max_quantized;
     };
 
     enumerator get_enum(uint32_t i, float) const
@@ -180,26 +481,50 @@ class wand_data_raw {
             m_ranges_start[i],
             m_ranges_start[i + 1] - m_ranges_start[i],
             m_range_max_term_weight,
-            m_range_id);
+            m_range_id,
+            m_range_max_quantized,
+            quantized_range_bounds(),
+            quantized_range_bounds() ? m_range_scale[i] : 0.0F);
     }
 
+    /// Whether range upper bounds are stored as 8-bit values.
+    [[nodiscard]] auto quantized_range_bounds() const -> bool
+    {
+        return (m_flags & format_flags::quantized_range_bounds) != 0;
+    }
+
+    /// The quantized range upper bounds are only stored when `m_flags` says so.
     template <typename Visitor>
     void map(Visitor& visit)
     {
-        visit(m_blocks_start, "m_blocks_start")(m_block_max_term_weight, "m_block_max_term_weight")(
-            m_block_docid, "m_block_docid")(
+        visit(m_magic, "m_magic");
+        if (m_magic != format_magic) {
+            throw std::runtime_error(
+                "Unsupported wand data format: the file was written by an older version, "
+                "rebuild it with create_wand_data");
+        }
+        visit(m_flags, "m_flags")(m_blocks_start, "m_blocks_start")(
+            m_block_max_term_weight, "m_block_max_term_weight")(m_block_docid, "m_block_docid")(
             m_ranges_start, "m_ranges_start")(
             m_range_max_term_weight, "m_range_max_term_weight")(
             m_range_id, "m_range_id");
+        if (quantized_range_bounds()) {
+            visit(m_range_scale, "m_range_scale")(m_range_max_quantized, "m_range_max_quantized");
+        }
     }
 
   private:
+    std::array<char, 8> m_magic = format_magic;
+    uint64_t m_flags = 0;
     mapper::mappable_vector<uint64_t> m_blocks_start;
     mapper::mappable_vector<float> m_block_max_term_weight;
     mapper::mappable_vector<uint32_t> m_block_docid;
     mapper::mappable_vector<uint64_t> m_ranges_start;
     mapper::mappable_vector<float> m_range_max_term_weight;
     mapper::mappable_vector<uint32_t> m_range_id;
+    // ANYTIME: Quantized range upper bounds, stored instead of `m_range_max_term_weight`.
+    mapper::mappable_vector<float> m_range_scale;
+    mapper::mappable_vector<uint8_t> m_range_max_quantized;
 };
 
 }  // namespace pisa
@@ -1,6 +1,15 @@
 #pragma once
 
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "boost/variant.hpp"
+#include "spdlog/spdlog.h"
 
 #include "binary_freq_collection.hpp"
 #include "configuration.hpp"
@@ -8,23 +17,207 @@
 
 namespace pisa {
 
+// ANYTIME: If `range_aligned` is set, a block never spans two ranges (clusters).
 struct FixedBlock {
     uint64_t size;
-    explicit FixedBlock(const uint64_t in_size) : size(in_size) {}
+    bool range_aligned;
+    explicit FixedBlock(const uint64_t in_size, bool in_range_aligned = false)
+        : size(in_size), range_aligned(in_range_aligned)
+    {}
 };
 
 struct VariableBlock {
     float lambda;
-    explicit VariableBlock(const float in_lambda) : lambda(in_lambda) {}
+    bool range_aligned;
+    explicit VariableBlock(const float in_lambda, bool in_range_aligned = false)
+        : lambda(in_lambda), range_aligned(in_range_aligned)
+    {}
 };
 
 using BlockSize = boost::variant<FixedBlock, VariableBlock>;
 
-// ANYTIME
+// ANYTIME: Maps document identifiers to the range (cluster) that contains them.
+// Ranges are defined by their exclusive end points, as listed in a `.cluster-range` file,
+// so a lookup is a binary search over a few hundred boundaries instead of a per-document
+// table. Without boundaries, every document belongs to range 0. Documents past the last
+// boundary are attributed to the last range so that range identifiers stay sorted.
+class DocToRange {
+  public:
+    DocToRange() = default;
+    explicit DocToRange(std::vector<uint32_t> boundaries) : m_boundaries(std::move(boundaries))
+    {
+        if (not std::is_sorted(m_boundaries.begin(), m_boundaries.end())) {
+            throw std::invalid_argument("Cluster boundaries must be sorted in ascending order");
+        }
+    }
+
+    [[nodiscard]] auto empty() const -> bool { return m_boundaries.empty(); }
+
+    [[nodiscard]] auto size() const -> std::size_t { return m_boundaries.size(); }
+
+    [[nodiscard]] auto operator()(uint64_t docid) const -> uint32_t
+    {
+        if (m_boundaries.empty()) {
+            return 0;
+        }
+        auto pos = std::upper_bound(m_boundaries.begin(), m_boundaries.end(), docid);
+        if (pos == m_boundaries.end()) {
+            return m_boundaries.size() - 1;
+        }
+        return std::distance(m_boundaries.begin(), pos);
+    }
+
+    /// First document of the given range.
+    [[nodiscard]] auto begin(uint32_t range) const -> uint64_t
+    {
+        return range == 0 ? 0 : m_boundaries[range - 1];
+    }
+
+    /// Exclusive end of the given range; the last range is open-ended.
+    [[nodiscard]] auto end(uint32_t range) const -> uint64_t
+    {
+        if (range + 1 >= m_boundaries.size()) {
+            return std::numeric_limits<uint64_t>::max();
+        }
+        return m_boundaries[range];
+    }
+
+  private:
+    std::vector<uint32_t> m_boundaries;
+};
+
+// ANYTIME: Reads the boundaries of a `.cluster-range` file, where each line holds a range
+// identifier and the exclusive end of that range, in ascending order of range.
+[[nodiscard]] inline auto read_cluster_ranges(std::string const& filename) -> std::vector<uint32_t>
+{
+    std::vector<uint32_t> clusters;
+    uint64_t cluster_id, doc_id;
+    uint64_t expected_id = 0;
+    std::ifstream tin(filename);
+    while (tin >> cluster_id >> doc_id) {
+        if (cluster_id != expected_id) {
+            spdlog::error("Cluster range file must be sorted in ascending order of range.");
+            std::exit(EXIT_FAILURE);
+        }
+        clusters.push_back(doc_id);
+        ++expected_id;
+    }
+    spdlog::info("Read {} cluster ranges", clusters.size());
+    return clusters;
+}
+
+// ANYTIME: Writes `boundaries` in the format of `read_cluster_ranges`.
+inline void write_cluster_ranges(std::vector<uint32_t> const& boundaries, std::string const& filename)
+{
+    std::ofstream os(filename);
+    for (std::size_t cluster = 0; cluster < boundaries.size(); ++cluster) {
+        os << cluster << ' ' << boundaries[cluster] << '\n';
+    }
+}
+
+// ANYTIME: Reads the parent cluster of every sub-range, one `sub-range parent` pair per line in
+// ascending order of sub-range, as written by `write_cluster_parents`.
+[[nodiscard]] inline auto read_cluster_parents(std::string const& filename) -> std::vector<uint32_t>
+{
+    std::vector<uint32_t> parents;
+    uint64_t range_id, parent_id;
+    std::ifstream tin(filename);
+    while (tin >> range_id >> parent_id) {
+        if (range_id != parents.size()) {
+            spdlog::error("Cluster parent file must be sorted in ascending order of range.");
+            std::exit(EXIT_FAILURE);
+        }
+        parents.push_back(parent_id);
+    }
+    return parents;
+}
+
+inline void write_cluster_parents(std::vector<uint32_t> const& parents, std::string const& filename)
+{
+    std::ofstream os(filename);
+    for (std::size_t range = 0; range < parents.size(); ++range) {
+        os << range << ' ' << parents[range] << '\n';
+    }
+}
+
+// ANYTIME: Splits every range whose posting volume exceeds `target_volume` into docid-contiguous
+// sub-ranges of roughly equal volume, where `document_volumes` holds the number of postings of
+// every document. Returns the boundaries of the sub-ranges and the range each one comes from.
+[[nodiscard]] inline auto split_cluster_ranges(
+    std::vector<uint32_t> boundaries,
+    std::vector<uint64_t> const& document_volumes,
+    uint64_t target_volume) -> std::pair<std::vector<uint32_t>, std::vector<uint32_t>>
+{
+    if (target_volume == 0) {
+        throw std::invalid_argument("Target posting volume must be positive");
+    }
+    // As in `DocToRange`, the last range covers every remaining document.
+    auto num_docs = static_cast<uint32_t>(document_volumes.size());
+    for (auto& boundary: boundaries) {
+        boundary = std::min(boundary, num_docs);
+    }
+    if (boundaries.empty()) {
+        boundaries.push_back(num_docs);
+    } else {
+        boundaries.back() = num_docs;
+    }
+
+    std::vector<uint32_t> split_boundaries;
+    std::vector<uint32_t> parents;
+    uint32_t first = 0;
+    for (uint32_t range = 0; range < boundaries.size(); ++range) {
+        uint32_t last = boundaries[range];
+        uint64_t volume = 0;
+        for (auto document = first; document < last; ++document) {
+            volume += document_volumes[document];
+        }
+        uint64_t pieces = std::max<uint64_t>((volume + target_volume - 1) / target_volume, 1);
+        uint64_t accumulated = 0;
+        uint64_t piece = 1;
+        for (auto document = first; document < last && piece < pieces; ++document) {
+            accumulated += document_volumes[document];
+            // Cut once this piece reaches its share of the volume, leaving the rest of the range
+            // to the following pieces.
+            if (accumulated * pieces >= volume * piece && document + 1 < last) {
+                split_boundaries.push_back(document + 1);
+                parents.push_back(range);
+                ++piece;
+            }
+        }
+        split_boundaries.push_back(last);
+        parents.push_back(range);
+        first = last;
+    }
+    return {split_boundaries, parents};
+}
+
+namespace detail {
+    /// Appends empty blocks covering every document from `first` up to `end` (exclusive), one
+    /// per range so that they do not span two ranges either. Empty ranges get no block, and
+    /// nothing is appended if `first` is not below `end`, as for a list starting at document 0.
+    inline void push_empty_blocks(
+        std::vector<uint32_t>& block_docid,
+        std::vector<float>& block_max_term_weight,
+        DocToRange const& doc_to_range,
+        uint64_t first,
+        uint64_t end)
+    {
+        while (first < end) {
+            auto last = std::min(end, doc_to_range.end(doc_to_range(first)));
+            block_docid.push_back(last - 1);
+            block_max_term_weight.push_back(0);
+            first = last;
+        }
+    }
+}  // namespace detail
+
+// ANYTIME: If `range_aligned` is set, blocks never span two ranges: a new block is also started at
+// the first posting of every range, the block before it ends with the previous range, and ranges
+// without postings are covered by empty blocks.
 template <typename Scorer>
 std::tuple<std::vector<uint32_t>, std::vector<float>, std::vector<uint32_t>, std::vector<float>> static_block_partition(
     binary_freq_collection::sequence const& seq, Scorer scorer, const uint64_t block_size,
-    std::unordered_map<uint32_t, uint32_t>& doc_to_range)
+    DocToRange const& doc_to_range, bool range_aligned = false)
 {
     std::vector<uint32_t> block_docid;
     std::vector<float> block_max_term_weight;
@@ -34,30 +227,49 @@ std::tuple<std::vector<uint32_t>, std::vector<float>, std::vector<uint32_t>, std
     // Auxiliary vector
     float max_score = 0;
     float block_max_score = 0;
-    size_t current_block = 0;
+    size_t block_begin = 0;
     size_t i;
-    uint32_t current_range = doc_to_range[*(seq.docs.begin())];
+    uint32_t current_range = doc_to_range(*(seq.docs.begin()));
+    uint64_t current_range_end = doc_to_range.end(current_range);
     float range_max_score = 0;
 
+    if (range_aligned && current_range > 0) {
+        detail::push_empty_blocks(
+            block_docid, block_max_term_weight, doc_to_range, 0, doc_to_range.begin(current_range));
+    }
+
     for (i = 0; i < seq.docs.size(); ++i) {
         uint64_t docid = *(seq.docs.begin() + i);
         uint64_t freq = *(seq.freqs.begin() + i);
         float score = scorer(docid, freq);
         max_score = std::max(max_score, score);
-        if (i == 0 || (i / block_size) == current_block) {
+        bool range_switch = docid >= current_range_end;
+        if (i == 0 || (i - block_begin < block_size && not(range_aligned && range_switch))) {
             block_max_score = std::max(block_max_score, score);
         } else {
-            block_docid.push_back(*(seq.docs.begin() + i) - 1);
-            block_max_term_weight.push_back(block_max_score);
-            current_block++;
+            if (range_aligned && range_switch) {
+                block_docid.push_back(current_range_end - 1);
+                block_max_term_weight.push_back(block_max_score);
+                detail::push_empty_blocks(
+                    block_docid,
+                    block_max_term_weight,
+                    doc_to_range,
+                    current_range_end,
+                    doc_to_range.begin(doc_to_range(docid)));
+            } else {
+                block_docid.push_back(*(seq.docs.begin() + i) - 1);
+                block_max_term_weight.push_back(block_max_score);
+            }
+            block_begin = i;
             block_max_score = std::max((float)0, score);
         }
         // ANYTIME: Range max score check
-        if (doc_to_range[docid] != current_range) {
+        if (range_switch) {
             range_docid.push_back(current_range);
             range_max_term_weight.push_back(range_max_score);
             range_max_score = std::max((float)0, score);
-            current_range = doc_to_range[docid];
+            current_range = doc_to_range(docid);
+            current_range_end = doc_to_range.end(current_range);
         } else {
           range_max_score = std::max(range_max_score, score);
         }
@@ -70,14 +282,16 @@ std::tuple<std::vector<uint32_t>, std::vector<float>, std::vector<uint32_t>, std
     return std::make_tuple(block_docid, block_max_term_weight, range_docid, range_max_term_weight);
 }
 
-// ANYTIME
+// ANYTIME: If `range_aligned` is set, each range is partitioned on its own, with the same block
+// layout at range boundaries as `static_block_partition`.
 template <typename Scorer>
 std::tuple<std::vector<uint32_t>, std::vector<float>, std::vector<uint32_t>, std::vector<float>> variable_block_partition(
     binary_freq_collection const& coll,
     binary_freq_collection::sequence const& seq,
     Scorer scorer,
-    std::unordered_map<uint32_t, uint32_t>& doc_to_range,
+    DocToRange const& doc_to_range,
     const float lambda,
+    bool range_aligned = false,
     // Antonio Mallia, Giuseppe Ottaviano, Elia Porciani, Nicola Tonellotto, and Rossano Venturini.
     // 2017. Faster BlockMax WAND with Variable-sized Blocks. In Proc. SIGIR
     double eps1 = 0.01,
@@ -100,28 +314,71 @@ std::tuple<std::vector<uint32_t>, std::vector<float>, std::vector<uint32_t>, std
     std::vector<uint32_t> range_docid;
     std::vector<float> range_max_term_weight;
     
-    uint32_t current_range = doc_to_range[doc_score[0].first];
+    // Positions at which each range begins, plus the end of the list.
+    std::vector<size_t> range_begin{0};
+
+    uint32_t current_range = doc_to_range(doc_score[0].first);
+    uint64_t current_range_end = doc_to_range.end(current_range);
     float range_max_score = 0;
 
     for (size_t i = 0; i < doc_score.size(); ++i) {
         uint64_t docid = doc_score[i].first;
         float score = doc_score[i].second;
         // Range max score check
-        if (doc_to_range[docid] != current_range) {
+        if (docid >= current_range_end) {
+            range_begin.push_back(i);
             range_docid.push_back(current_range);
             range_max_term_weight.push_back(range_max_score);
             range_max_score = std::max((float)0, score);
-            current_range = doc_to_range[docid];
+            current_range = doc_to_range(docid);
+            current_range_end = doc_to_range.end(current_range);
         } else {
           range_max_score = std::max(range_max_score, score);
         }
     }
     range_docid.push_back(current_range);
     range_max_term_weight.push_back(range_max_score);
-    
-    auto p = score_opt_partition(doc_score.begin(), 0, doc_score.size(), eps1, eps2, lambda);
-    
-    return std::make_tuple(p.docids, p.max_values, range_docid, range_max_term_weight);
+    range_begin.push_back(doc_score.size());
+
+    if (not range_aligned) {
+        auto p = score_opt_partition(doc_score.begin(), 0, doc_score.size(), eps1, eps2, lambda);
+        return std::make_tuple(p.docids, p.max_values, range_docid, range_max_term_weight);
+    }
+
+    std::vector<uint32_t> block_docid;
+    std::vector<float> block_max_term_weight;
+    if (range_docid.front() > 0) {
+        detail::push_empty_blocks(
+            block_docid,
+            block_max_term_weight,
+            doc_to_range,
+            0,
+            doc_to_range.begin(range_docid.front()));
+    }
+    for (size_t r = 0; r < range_docid.size(); ++r) {
+        auto p = score_opt_partition(
+            std::next(doc_score.begin(), range_begin[r]),
+            0,
+            range_begin[r + 1] - range_begin[r],
+            eps1,
+            eps2,
+            lambda);
+        if (r + 1 < range_docid.size()) {
+            p.docids.back() = doc_to_range.end(range_docid[r]) - 1;
+        }
+        block_docid.insert(block_docid.end(), p.docids.begin(), p.docids.end());
+        block_max_term_weight.insert(
+            block_max_term_weight.end(), p.max_values.begin(), p.max_values.end());
+        if (r + 1 < range_docid.size()) {
+            detail::push_empty_blocks(
+                block_docid,
+                block_max_term_weight,
+                doc_to_range,
+                doc_to_range.end(range_docid[r]),
+                doc_to_range.begin(range_docid[r + 1]));
+        }
+    }
+    return std::make_tuple(block_docid, block_max_term_weight, range_docid, range_max_term_weight);
 }
 
 }  // namespace pisa
@@ -104,16 +104,27 @@ void remove_duplicate_terms(term_id_vec& terms)
 term_freq_vec query_freqs(term_id_vec terms)
 {
     term_freq_vec query_term_freqs;
-    std::sort(terms.begin(), terms.end());
+    query_freqs(terms, query_term_freqs);
+    return query_term_freqs;
+}
+
+void query_freqs(term_id_vec const& terms, term_freq_vec& out)
+{
+    out.clear();
+    for (auto term: terms) {
+        out.emplace_back(term, 1);
+    }
+    std::sort(out.begin(), out.end());
     // count query term frequencies
-    for (size_t i = 0; i < terms.size(); ++i) {
-        if (i == 0 || terms[i] != terms[i - 1]) {
-            query_term_freqs.emplace_back(terms[i], 1);
+    std::size_t distinct = 0;
+    for (size_t i = 0; i < out.size(); ++i) {
+        if (i == 0 || out[i].first != out[distinct - 1].first) {
+            out[distinct++] = out[i];
         } else {
-            query_term_freqs.back().second += 1;
+            out[distinct - 1].second += 1;
         }
     }
-    return query_term_freqs;
+    out.resize(distinct);
 }
 
 }  // namespace pisa
@@ -0,0 +1,162 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "test_generic_sequence.hpp"
+
+#include "block_cache.hpp"
+#include "block_freq_index.hpp"
+#include "codec/block_codecs.hpp"
+#include "codec/simdbp.hpp"
+
+TEST_CASE("BlockCache evicts with CLOCK", "[block_cache]")
+{
+    std::size_t block_size = 4;
+    // Two blocks of four docids and four freqs, in a single shard
+    pisa::BlockCache cache(2 * 2 * block_size * sizeof(uint32_t), block_size, 1);
+    std::vector<uint32_t> docs{1, 2, 3, 4};
+    std::vector<uint32_t> freqs{5, 6, 7, 8};
+    std::vector<uint32_t> docs_out(block_size);
+    std::vector<uint32_t> freqs_out(block_size);
+
+    REQUIRE_FALSE(cache.lookup(0, 0, docs_out.data(), freqs_out.data(), block_size));
+    cache.insert(0, 0, docs.data(), freqs.data(), block_size);
+    cache.insert(0, 1, docs.data(), freqs.data(), 2);
+    REQUIRE(cache.lookup(0, 0, docs_out.data(), freqs_out.data(), block_size));
+    REQUIRE(docs_out == docs);
+    REQUIRE(freqs_out == freqs);
+
+    // Block (0, 0) was referenced since insertion, so (0, 1) goes first
+    cache.insert(1, 0, docs.data(), freqs.data(), block_size);
+    REQUIRE(cache.lookup(0, 0, docs_out.data(), freqs_out.data(), block_size));
+    REQUIRE_FALSE(cache.lookup(0, 1, docs_out.data(), freqs_out.data(), 2));
+    REQUIRE(cache.lookup(1, 0, docs_out.data(), freqs_out.data(), block_size));
+
+    auto stats = cache.stats();
+    REQUIRE(stats.hits == 3);
+    REQUIRE(stats.misses == 2);
+    REQUIRE(stats.evictions == 1);
+}
+
+TEST_CASE("BlockCache never holds more blocks than its budget", "[block_cache]")
+{
+    std::size_t block_size = 128;
+    std::size_t block_bytes = 2 * block_size * sizeof(uint32_t);
+    std::vector<uint32_t> postings(block_size, 1);
+    std::vector<uint32_t> docs_out(block_size);
+    std::vector<uint32_t> freqs_out(block_size);
+
+    pisa::BlockCache cache(3 * block_bytes + block_bytes / 2, block_size);
+    REQUIRE(cache.capacity() == 3);
+    for (uint32_t term = 0; term < 100; ++term) {
+        cache.insert(term, 0, postings.data(), postings.data(), block_size);
+    }
+    std::size_t cached = 0;
+    for (uint32_t term = 0; term < 100; ++term) {
+        cached += cache.lookup(term, 0, docs_out.data(), freqs_out.data(), block_size) ? 1 : 0;
+    }
+    REQUIRE(cached == 3);
+
+    pisa::BlockCache empty(block_bytes - 1, block_size);
+    REQUIRE(empty.capacity() == 0);
+    empty.insert(0, 0, postings.data(), postings.data(), block_size);
+    REQUIRE_FALSE(empty.lookup(0, 0, docs_out.data(), freqs_out.data(), block_size));
+}
+
+TEST_CASE("BlockCache hits stay consistent under concurrent inserts", "[block_cache]")
+{
+    std::size_t block_size = 128;
+    pisa::BlockCache cache(64 * 2 * block_size * sizeof(uint32_t), block_size, 4);
+    auto expected_doc = [](uint32_t term, uint32_t block, uint32_t idx) {
+        return term * 1000 + block * 10 + idx;
+    };
+    std::atomic<std::size_t> torn{0};
+    std::vector<std::thread> threads;
+    for (uint32_t seed = 0; seed < 4; ++seed) {
+        threads.emplace_back([&, seed] {
+            std::mt19937 rng(seed);
+            std::vector<uint32_t> docs(block_size);
+            std::vector<uint32_t> freqs(block_size);
+            for (int iteration = 0; iteration < 20000; ++iteration) {
+                uint32_t term = rng() % 50;
+                uint32_t block = rng() % 8;
+                if (cache.lookup(term, block, docs.data(), freqs.data(), block_size)) {
+                    for (uint32_t idx = 0; idx < block_size; ++idx) {
+                        if (docs[idx] != expected_doc(term, block, idx)
+                            || freqs[idx] != docs[idx] + 1) {
+                            ++torn;
+                            break;
+                        }
+                    }
+                } else {
+                    for (uint32_t idx = 0; idx < block_size; ++idx) {
+                        docs[idx] = expected_doc(term, block, idx);
+                        freqs[idx] = docs[idx] + 1;
+                    }
+                    cache.insert(term, block, docs.data(), freqs.data(), block_size);
+                }
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    REQUIRE(torn == 0);
+    auto stats = cache.stats();
+    REQUIRE(stats.hits + stats.misses == 4 * 20000);
+}
+
+template <typename BlockCodec>
+void test_block_cache_index()
+{
+    pisa::global_parameters params;
+    uint64_t universe = 20000;
+    using collection_type = pisa::block_freq_index<BlockCodec>;
+    typename collection_type::builder b(universe, params);
+
+    using vec_type = std::vector<uint64_t>;
+    std::vector<std::pair<vec_type, vec_type>> posting_lists(30);
+    for (auto& plist: posting_lists) {
+        double avg_gap = 1.1 + double(rand()) / RAND_MAX * 10;
+        auto n = uint64_t(universe / avg_gap);
+        plist.first = random_sequence(universe, n, true);
+        plist.second.resize(n);
+        std::generate(plist.second.begin(), plist.second.end(), []() { return (rand() % 256) + 1; });
+        b.add_posting_list(n, plist.first.begin(), plist.second.begin(), 0);
+    }
+    collection_type coll;
+    b.build(coll);
+
+    // Small enough that later passes both hit and evict
+    pisa::BlockCache cache(1 << 20U, BlockCodec::block_size, 4);
+    coll.set_block_cache(&cache);
+    for (int pass = 0; pass < 3; ++pass) {
+        for (size_t i = 0; i < posting_lists.size(); ++i) {
+            auto const& plist = posting_lists[i];
+            auto doc_enum = coll[i];
+            for (size_t p = 0; p < plist.first.size(); p += 1 + rand() % (pass * 100 + 1)) {
+                doc_enum.next_geq(plist.first[p]);
+                MY_REQUIRE_EQUAL(plist.first[p], doc_enum.docid(), "i = " << i << " p = " << p);
+                MY_REQUIRE_EQUAL(plist.second[p], doc_enum.freq(), "i = " << i << " p = " << p);
+            }
+            doc_enum.next_geq(plist.first.back() + 1);
+            REQUIRE(coll.num_docs() == doc_enum.docid());
+        }
+    }
+    auto stats = cache.stats();
+    REQUIRE(stats.hits > 0);
+    REQUIRE(stats.evictions > 0);
+}
+
+TEST_CASE("block_freq_index with a block cache", "[block_cache]")
+{
+    test_block_cache_index<pisa::interpolative_block>();
+    test_block_cache_index<pisa::simdbp_block>();
+    test_block_cache_index<pisa::with_docid_decoding<pisa::interpolative_block, true>>();
+}
@@ -2,9 +2,11 @@
 #include "catch2/catch.hpp"
 
 #include <cstdlib>
+#include <sstream>
 #include <vector>
 
 #include "codec/block_codecs.hpp"
+#include "codec/hybrid.hpp"
 #include "codec/maskedvbyte.hpp"
 #include "codec/qmx.hpp"
 #include "codec/simdbp.hpp"
@@ -54,4 +56,46 @@ TEST_CASE("block_codecs")
     test_block_codec<pisa::simple8b_block>();
     test_block_codec<pisa::simdbp_block>();
     test_block_codec<pisa::simple16_block>();
+    test_block_codec<pisa::hybrid_block>();
+}
+
+TEST_CASE("hybrid_block encodes with the codec its policy picks")
+{
+    using codec = pisa::hybrid_policy::codec;
+    std::vector<uint32_t> values(pisa::hybrid_block::block_size);
+    std::generate(values.begin(), values.end(), []() { return (uint32_t)rand() % (1 << 12); });
+    auto default_policy = pisa::hybrid_block::policy();
+    for (auto c: {codec::interpolative, codec::optpfor, codec::simdbp}) {
+        // Every codec but `c` is predicted to take far too long
+        auto& policy = pisa::hybrid_block::policy();
+        policy.bytes_per_ns = 1;
+        for (auto& predictor: policy.predictors) {
+            predictor.bias() = 1e6;
+        }
+        policy.predictor(c).bias() = 0;
+
+        std::vector<uint8_t> encoded;
+        pisa::hybrid_block::encode(values.data(), uint32_t(-1), values.size(), encoded);
+        REQUIRE(encoded[0] == static_cast<uint8_t>(c));
+        std::vector<uint32_t> decoded(values.size());
+        uint8_t const* out = pisa::hybrid_block::decode(
+            encoded.data(), decoded.data(), uint32_t(-1), values.size());
+        REQUIRE(encoded.size() == out - encoded.data());
+        REQUIRE(decoded == values);
+    }
+    pisa::hybrid_block::policy() = default_policy;
+}
+
+TEST_CASE("hybrid_policy reads weights")
+{
+    using pisa::time_prediction::feature_type;
+    std::istringstream is("bytes_per_ns 0.5\n\nsimdbp bias 10\noptpfor max_b 2.5\n");
+    auto policy = pisa::hybrid_policy::from_stream(is);
+    REQUIRE(policy.bytes_per_ns == Approx(0.5));
+    REQUIRE(policy.predictor(pisa::hybrid_policy::codec::simdbp).bias() == Approx(10));
+    REQUIRE(policy.predictor(pisa::hybrid_policy::codec::optpfor)[feature_type::max_b] == Approx(2.5));
+    REQUIRE(policy.predictor(pisa::hybrid_policy::codec::interpolative).bias() == Approx(1000));
+
+    std::istringstream invalid("bp128 bias 10\n");
+    REQUIRE_THROWS_AS(pisa::hybrid_policy::from_stream(invalid), std::invalid_argument);
 }
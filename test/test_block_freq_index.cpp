@@ -4,6 +4,7 @@
 #include "test_generic_sequence.hpp"
 
 #include "codec/block_codecs.hpp"
+#include "codec/hybrid.hpp"
 #include "codec/maskedvbyte.hpp"
 #include "codec/qmx.hpp"
 #include "codec/simdbp.hpp"
@@ -21,7 +22,7 @@
 #include <cstdlib>
 #include <vector>
 
-template <typename BlockCodec>
+template <typename BlockCodec, bool Prefetch = false>
 void test_block_freq_index()
 {
     pisa::global_parameters params;
@@ -50,7 +51,8 @@ void test_block_freq_index()
     }
 
     {
-        collection_type coll(pisa::MemorySource::mapped_file(filename));
+        pisa::block_freq_index<BlockCodec, false, Prefetch> coll(
+            pisa::MemorySource::mapped_file(filename));
         for (size_t i = 0; i < posting_lists.size(); ++i) {
             auto const& plist = posting_lists[i];
             auto doc_enum = coll[i];
@@ -60,6 +62,13 @@ void test_block_freq_index()
                 MY_REQUIRE_EQUAL(plist.second[p], doc_enum.freq(), "i = " << i << " p = " << p);
             }
             REQUIRE(coll.num_docs() == doc_enum.docid());
+
+            auto skip_enum = coll[i];
+            for (size_t p = 0; p < plist.first.size(); p += 1 + rand() % 300) {
+                skip_enum.next_geq(plist.first[p]);
+                MY_REQUIRE_EQUAL(plist.first[p], skip_enum.docid(), "i = " << i << " p = " << p);
+                MY_REQUIRE_EQUAL(plist.second[p], skip_enum.freq(), "i = " << i << " p = " << p);
+            }
         }
     }
 }
@@ -76,4 +85,14 @@ TEST_CASE("block_freq_index")
     test_block_freq_index<pisa::simple8b_block>();
     test_block_freq_index<pisa::simple16_block>();
     test_block_freq_index<pisa::simdbp_block>();
+    test_block_freq_index<pisa::hybrid_block>();
+    test_block_freq_index<pisa::with_dense_bitmaps<pisa::simdbp_block>>();
+}
+
+TEST_CASE("block_freq_index with prefetching")
+{
+    test_block_freq_index<pisa::optpfor_block, true>();
+    test_block_freq_index<pisa::interpolative_block, true>();
+    test_block_freq_index<pisa::simdbp_block, true>();
+    test_block_freq_index<pisa::with_dense_bitmaps<pisa::simdbp_block>, true>();
 }
@@ -4,6 +4,7 @@
 #include "test_generic_sequence.hpp"
 
 #include "codec/block_codecs.hpp"
+#include "codec/hybrid.hpp"
 #include "codec/maskedvbyte.hpp"
 #include "codec/qmx.hpp"
 #include "codec/simdbp.hpp"
@@ -104,6 +105,44 @@ void test_block_posting_list_reordering()
     }
 }
 
+template <typename BlockCodec>
+void test_block_posting_list_skips()
+{
+    using posting_list_type = pisa::block_posting_list<BlockCodec>;
+    uint64_t universe = 20000;
+    for (size_t t = 0; t < 20; ++t) {
+        double avg_gap = 1.1 + double(rand()) / RAND_MAX * 10;
+        auto n = uint64_t(universe / avg_gap);
+        std::vector<uint64_t> docs, freqs;
+        random_posting_data(n, universe, docs, freqs);
+        std::vector<uint8_t> data;
+        posting_list_type::write(data, n, docs.begin(), freqs.begin());
+
+        auto expected_geq = [&](uint64_t lower_bound) -> uint64_t {
+            auto pos = std::lower_bound(docs.begin(), docs.end(), lower_bound);
+            return pos == docs.end() ? universe : *pos;
+        };
+        typename posting_list_type::document_enumerator e(data.data(), universe);
+        for (uint64_t lower_bound = 0; lower_bound < universe; lower_bound = e.docid() + rand() % 40) {
+            e.next_geq(lower_bound);
+            MY_REQUIRE_EQUAL(expected_geq(lower_bound), e.docid(), "lower_bound = " << lower_bound);
+        }
+        e.reset();
+        for (uint64_t pos = 0; pos < n; pos += 1 + rand() % 50) {
+            e.move(pos);
+            MY_REQUIRE_EQUAL(docs[pos], e.docid(), "pos = " << pos);
+            MY_REQUIRE_EQUAL(freqs[pos], e.freq(), "pos = " << pos);
+        }
+        // `global_geq` can also move backwards
+        for (uint64_t lower_bound = universe; lower_bound > 1000; lower_bound -= 1 + rand() % 1000) {
+            e.global_geq(lower_bound);
+            MY_REQUIRE_EQUAL(expected_geq(lower_bound), e.docid(), "lower_bound = " << lower_bound);
+        }
+        e.global_geq(0);
+        REQUIRE(docs.front() == e.docid());
+    }
+}
+
 TEST_CASE("block_posting_list")
 {
     test_block_posting_list<pisa::optpfor_block>();
@@ -116,8 +155,30 @@ TEST_CASE("block_posting_list")
     test_block_posting_list<pisa::simple8b_block>();
     test_block_posting_list<pisa::simple16_block>();
     test_block_posting_list<pisa::simdbp_block>();
+    test_block_posting_list<pisa::hybrid_block>();
 }
 TEST_CASE("block_posting_list_reordering")
 {
     test_block_posting_list_reordering<pisa::optpfor_block>();
 }
+
+TEST_CASE("block_posting_list with absolute docid decoding")
+{
+    test_block_posting_list<pisa::with_docid_decoding<pisa::interpolative_block, true>>();
+    test_block_posting_list<pisa::with_docid_decoding<pisa::optpfor_block, true>>();
+    test_block_posting_list<pisa::with_docid_decoding<pisa::simdbp_block, false>>();
+    test_block_posting_list_skips<pisa::with_docid_decoding<pisa::interpolative_block, false>>();
+    test_block_posting_list_skips<pisa::with_docid_decoding<pisa::interpolative_block, true>>();
+    test_block_posting_list_skips<pisa::simdbp_block>();
+    test_block_posting_list_skips<pisa::optpfor_block>();
+}
+
+TEST_CASE("block_posting_list with dense bitmaps")
+{
+    test_block_posting_list<pisa::with_dense_bitmaps<pisa::simdbp_block>>();
+    test_block_posting_list<pisa::with_dense_bitmaps<pisa::interpolative_block, 2>>();
+    test_block_posting_list_reordering<pisa::with_dense_bitmaps<pisa::optpfor_block>>();
+    test_block_posting_list_skips<pisa::with_dense_bitmaps<pisa::simdbp_block>>();
+    test_block_posting_list_skips<
+        pisa::with_docid_decoding<pisa::with_dense_bitmaps<pisa::interpolative_block, 8>, true>>();
+}
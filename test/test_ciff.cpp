@@ -0,0 +1,161 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "binary_collection.hpp"
+#include "binary_freq_collection.hpp"
+#include "ciff.hpp"
+#include "memory_source.hpp"
+#include "temporary_directory.hpp"
+
+using namespace pisa;
+
+namespace {
+
+void put_varint(std::string& out, std::uint64_t value)
+{
+    while (value >= 0x80U) {
+        out.push_back(static_cast<char>((value & 0x7FU) | 0x80U));
+        value >>= 7U;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+void put_varint_field(std::string& out, std::uint32_t field, std::uint64_t value)
+{
+    put_varint(out, field << 3U);
+    put_varint(out, value);
+}
+
+void put_bytes_field(std::string& out, std::uint32_t field, std::string const& bytes)
+{
+    put_varint(out, (field << 3U) | 2U);
+    put_varint(out, bytes.size());
+    out.append(bytes);
+}
+
+void put_delimited(std::string& out, std::string const& message)
+{
+    put_varint(out, message.size());
+    out.append(message);
+}
+
+auto postings_list(
+    std::string const& term, std::vector<std::uint32_t> docs, std::vector<std::uint32_t> tfs)
+    -> std::string
+{
+    std::string message;
+    put_bytes_field(message, 1, term);
+    put_varint_field(message, 2, docs.size());
+    std::uint32_t previous = 0;
+    for (std::size_t idx = 0; idx < docs.size(); ++idx) {
+        std::string posting;
+        put_varint_field(posting, 1, docs[idx] - previous);
+        put_varint_field(posting, 2, tfs[idx]);
+        put_bytes_field(message, 4, posting);
+        previous = docs[idx];
+    }
+    return message;
+}
+
+auto doc_record(std::uint32_t docid, std::string const& name, std::uint32_t length) -> std::string
+{
+    std::string message;
+    put_varint_field(message, 1, docid);
+    put_bytes_field(message, 2, name);
+    put_varint_field(message, 3, length);
+    return message;
+}
+
+auto read_lines(std::string const& path) -> std::vector<std::string>
+{
+    std::ifstream is(path);
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(is, line);) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+}  // namespace
+
+TEST_CASE("Convert a CIFF index to a binary collection", "[ciff]")
+{
+    std::string header;
+    put_varint_field(header, 1, 1);
+    put_varint_field(header, 2, 3);
+    put_varint_field(header, 3, 4);
+    put_varint_field(header, 4, 3);
+    put_varint_field(header, 5, 4);
+    put_varint_field(header, 6, 11);
+    // An unknown field is skipped, as is a known one with an unexpected wire type.
+    put_bytes_field(header, 9, "ignored");
+    put_bytes_field(header, 3, "ignored");
+    put_bytes_field(header, 8, "test index");
+
+    std::string blob;
+    put_delimited(blob, header);
+    put_delimited(blob, postings_list("apple", {0, 2, 3}, {1, 2, 1}));
+    put_delimited(blob, postings_list("banana", {1}, {4}));
+    put_delimited(blob, postings_list("cherry", {0, 1, 2, 3}, {1, 1, 1, 1}));
+    // Document records may come in any order.
+    put_delimited(blob, doc_record(1, "doc-b", 5));
+    put_delimited(blob, doc_record(0, "doc-a", 2));
+    put_delimited(blob, doc_record(2, "doc-c", 3));
+    put_delimited(blob, doc_record(3, "doc-d", 2));
+
+    Temporary_Directory tmpdir;
+    auto basename = (tmpdir.path() / "coll").string();
+    ciff::to_collection(MemorySource::from_vector({blob.begin(), blob.end()}), basename);
+
+    binary_freq_collection collection(basename.c_str());
+    REQUIRE(collection.num_docs() == 4);
+    std::vector<std::vector<std::uint32_t>> docs;
+    std::vector<std::vector<std::uint32_t>> freqs;
+    for (auto const& seq: collection) {
+        docs.emplace_back(seq.docs.begin(), seq.docs.end());
+        freqs.emplace_back(seq.freqs.begin(), seq.freqs.end());
+    }
+    REQUIRE(docs == std::vector<std::vector<std::uint32_t>>{{0, 2, 3}, {1}, {0, 1, 2, 3}});
+    REQUIRE(freqs == std::vector<std::vector<std::uint32_t>>{{1, 2, 1}, {4}, {1, 1, 1, 1}});
+
+    binary_collection sizes((basename + ".sizes").c_str());
+    auto sizes_seq = *sizes.begin();
+    REQUIRE(
+        std::vector<std::uint32_t>(sizes_seq.begin(), sizes_seq.end())
+        == std::vector<std::uint32_t>{2, 5, 3, 2});
+
+    REQUIRE(read_lines(basename + ".terms") == std::vector<std::string>{"apple", "banana", "cherry"});
+    REQUIRE(
+        read_lines(basename + ".documents")
+        == std::vector<std::string>{"doc-a", "doc-b", "doc-c", "doc-d"});
+
+    SECTION("Truncated input is rejected")
+    {
+        blob.resize(blob.size() - 3);
+        REQUIRE_THROWS_AS(
+            ciff::to_collection(
+                MemorySource::from_vector({blob.begin(), blob.end()}), basename + ".truncated"),
+            std::runtime_error);
+    }
+
+    SECTION("Lists that are not strictly increasing are rejected")
+    {
+        // A zero gap repeats a document, and a gap past 2^32 wraps back into range.
+        auto list = GENERATE(
+            std::vector<std::uint32_t>{0, 2, 2}, std::vector<std::uint32_t>{1, 3, 2});
+        std::string malformed;
+        put_delimited(malformed, header);
+        put_delimited(malformed, postings_list("apple", list, {1, 1, 1}));
+        put_delimited(malformed, postings_list("banana", {1}, {4}));
+        put_delimited(malformed, postings_list("cherry", {0, 1, 2, 3}, {1, 1, 1, 1}));
+        REQUIRE_THROWS_AS(
+            ciff::to_collection(
+                MemorySource::from_vector({malformed.begin(), malformed.end()}),
+                basename + ".malformed"),
+            std::runtime_error);
+    }
+}
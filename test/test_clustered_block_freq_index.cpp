@@ -0,0 +1,205 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include "test_generic_sequence.hpp"
+
+#include "codec/block_codecs.hpp"
+#include "codec/simdbp.hpp"
+#include "temporary_directory.hpp"
+
+#include "clustered_block_freq_index.hpp"
+#include "mappable/mapper.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+template <typename BlockCodec, bool Interleaved>
+void test_clustered_block_freq_index()
+{
+    pisa::global_parameters params;
+    uint64_t universe = 20000;
+    // The second cluster is empty, and the last boundary is past the end of the collection.
+    std::vector<uint32_t> boundaries{3000, 3000, 7000, 12000, 30000};
+    std::vector<uint64_t> cluster_begins{0, 3000, 3000, 7000, 12000};
+    using collection_type = pisa::clustered_block_freq_index<BlockCodec, Interleaved>;
+    typename collection_type::builder b(universe, params, boundaries);
+
+    using vec_type = std::vector<uint64_t>;
+    std::vector<std::pair<vec_type, vec_type>> posting_lists(30);
+    for (auto& plist: posting_lists) {
+        double avg_gap = 1.1 + double(rand()) / RAND_MAX * 1000;
+        auto n = std::max(uint64_t(1), uint64_t(universe / avg_gap));
+        plist.first = random_sequence(universe, n, true);
+        plist.second.resize(n);
+        std::generate(plist.second.begin(), plist.second.end(), []() { return (rand() % 256) + 1; });
+
+        b.add_posting_list(n, plist.first.begin(), plist.second.begin(), 0);
+    }
+
+    Temporary_Directory tmpdir;
+    auto filename = (tmpdir.path() / "temp.bin").string();
+    {
+        collection_type coll;
+        b.build(coll);
+        pisa::mapper::freeze(coll, filename.c_str());
+    }
+
+    collection_type coll(pisa::MemorySource::mapped_file(filename));
+    REQUIRE(coll.num_clusters() == 5);
+    for (size_t i = 0; i < posting_lists.size(); ++i) {
+        auto const& docs = posting_lists[i].first;
+        auto const& freqs = posting_lists[i].second;
+        auto doc_enum = coll[i];
+        REQUIRE(docs.size() == doc_enum.size());
+        for (size_t p = 0; p < docs.size(); ++p, doc_enum.next()) {
+            MY_REQUIRE_EQUAL(docs[p], doc_enum.docid(), "i = " << i << " p = " << p);
+            MY_REQUIRE_EQUAL(freqs[p], doc_enum.freq(), "i = " << i << " p = " << p);
+            MY_REQUIRE_EQUAL(p, doc_enum.position(), "i = " << i << " p = " << p);
+        }
+        REQUIRE(coll.num_docs() == doc_enum.docid());
+
+        auto expected_geq = [&](uint64_t lower_bound) -> uint64_t {
+            auto pos = std::lower_bound(docs.begin(), docs.end(), lower_bound);
+            return pos == docs.end() ? universe : *pos;
+        };
+
+        // Clusters are entered in reverse order, so every entry moves backwards.
+        for (auto cluster = cluster_begins.size(); cluster > 0; --cluster) {
+            auto begin = cluster_begins[cluster - 1];
+            doc_enum.enter_cluster(cluster - 1);
+            MY_REQUIRE_EQUAL(expected_geq(begin), doc_enum.docid(), "i = " << i << " c = " << cluster);
+            doc_enum.global_geq(begin + 17);
+            MY_REQUIRE_EQUAL(
+                expected_geq(begin + 17), doc_enum.docid(), "i = " << i << " c = " << cluster);
+        }
+
+        doc_enum.reset();
+        for (uint64_t lower_bound = 0; lower_bound < universe; lower_bound += rand() % 700) {
+            doc_enum.next_geq(lower_bound);
+            MY_REQUIRE_EQUAL(expected_geq(lower_bound), doc_enum.docid(), "i = " << i);
+            if (doc_enum.docid() < universe) {
+                auto pos = std::distance(
+                    docs.begin(), std::lower_bound(docs.begin(), docs.end(), doc_enum.docid()));
+                MY_REQUIRE_EQUAL(freqs[pos], doc_enum.freq(), "i = " << i);
+            }
+        }
+
+        doc_enum.reset();
+        for (uint64_t pos = 0; pos < docs.size(); pos += 1 + rand() % 50) {
+            doc_enum.move(pos);
+            MY_REQUIRE_EQUAL(docs[pos], doc_enum.docid(), "i = " << i << " p = " << pos);
+        }
+    }
+}
+
+TEST_CASE("clustered_block_freq_index")
+{
+    test_clustered_block_freq_index<pisa::interpolative_block, false>();
+    test_clustered_block_freq_index<pisa::interpolative_block, true>();
+    test_clustered_block_freq_index<pisa::simdbp_block, false>();
+    test_clustered_block_freq_index<pisa::simdbp_block, true>();
+}
+
+TEST_CASE("clustered_block_freq_index enters clusters past the first bitmap word")
+{
+    using collection_type = pisa::clustered_block_freq_index<pisa::interpolative_block>;
+    pisa::global_parameters params;
+    uint64_t universe = 15000;
+    std::vector<uint32_t> boundaries;
+    for (uint32_t boundary = 100; boundary <= universe; boundary += 100) {
+        boundaries.push_back(boundary);
+    }
+    collection_type::builder b(universe, params, boundaries);
+    std::vector<std::vector<uint64_t>> posting_lists(10);
+    for (auto& docs: posting_lists) {
+        docs = random_sequence(universe, 1 + rand() % 500, true);
+        std::vector<uint64_t> freqs(docs.size(), 1);
+        b.add_posting_list(docs.size(), docs.begin(), freqs.begin(), 0);
+    }
+    collection_type coll;
+    b.build(coll);
+
+    REQUIRE(coll.num_clusters() == 150);
+    for (size_t i = 0; i < posting_lists.size(); ++i) {
+        auto const& docs = posting_lists[i];
+        auto doc_enum = coll[i];
+        for (uint64_t cluster = coll.num_clusters(); cluster > 0; --cluster) {
+            doc_enum.enter_cluster(cluster - 1);
+            auto pos = std::lower_bound(docs.begin(), docs.end(), (cluster - 1) * 100);
+            uint64_t expected = pos == docs.end() ? universe : *pos;
+            MY_REQUIRE_EQUAL(expected, doc_enum.docid(), "i = " << i << " c = " << cluster);
+        }
+        doc_enum.enter_cluster(coll.num_clusters());
+        REQUIRE(doc_enum.docid() == universe);
+    }
+}
+
+TEST_CASE("Tiered clustered_block_freq_index")
+{
+    using collection_type = pisa::clustered_block_freq_index<pisa::interpolative_block, true>;
+    pisa::global_parameters params;
+    uint64_t universe = 20000;
+    collection_type::builder b(universe, params, {5000, 10000, 15000, 20000});
+    std::vector<std::vector<uint64_t>> posting_lists(10);
+    for (auto& docs: posting_lists) {
+        docs = random_sequence(universe, 1 + rand() % 5000, true);
+        std::vector<uint64_t> freqs(docs.size(), 1);
+        b.add_posting_list(docs.size(), docs.begin(), freqs.begin(), 0);
+    }
+
+    Temporary_Directory tmpdir;
+    auto filename = (tmpdir.path() / "temp.bin").string();
+    auto tiered_filename = (tmpdir.path() / "tiered.bin").string();
+    auto cold_filename = (tmpdir.path() / "cold.bin").string();
+    {
+        collection_type coll;
+        b.build(coll);
+        coll.write_tiered({true, true, false, true}, tiered_filename, cold_filename);
+    }
+
+    collection_type coll(pisa::MemorySource::mapped_file(tiered_filename));
+    REQUIRE(coll.is_tiered());
+    REQUIRE(coll.is_cold(1));
+    REQUIRE_FALSE(coll.is_cold(2));
+    coll.open_cold_tier(cold_filename);
+
+    // Opening cursors and entering cold clusters only reads the directory.
+    for (size_t i = 0; i < posting_lists.size(); ++i) {
+        auto const& docs = posting_lists[i];
+        auto doc_enum = coll[i];
+        REQUIRE(docs.size() == doc_enum.size());
+        REQUIRE(doc_enum.docid() == docs.front());
+        REQUIRE(doc_enum.position() == 0);
+        doc_enum.enter_cluster(1);
+        auto pos = std::lower_bound(docs.begin(), docs.end(), 5000);
+        REQUIRE(doc_enum.docid() == (pos == docs.end() ? universe : *pos));
+    }
+    REQUIRE(coll.cold_tier_resident_bytes() == 0);
+    REQUIRE_FALSE(coll.is_resident(0));
+    REQUIRE(coll.is_resident(2));
+
+    {
+        auto doc_enum = coll[0];
+        REQUIRE(doc_enum.freq() == 1);
+        REQUIRE(coll.is_resident(0));
+        REQUIRE_FALSE(coll.is_resident(1));
+        REQUIRE(coll.cold_tier_resident_bytes() > 0);
+        REQUIRE_FALSE(coll.enforce_cold_tier_budget(coll.cold_tier_resident_bytes()));
+        REQUIRE(coll.enforce_cold_tier_budget(0));
+        REQUIRE(coll.cold_tier_resident_bytes() == 0);
+        REQUIRE_FALSE(coll.is_resident(0));
+    }
+    for (size_t i = 0; i < posting_lists.size(); ++i) {
+        auto const& docs = posting_lists[i];
+        auto doc_enum = coll[i];
+        REQUIRE(docs.size() == doc_enum.size());
+        for (size_t p = 0; p < docs.size(); ++p, doc_enum.next()) {
+            MY_REQUIRE_EQUAL(docs[p], doc_enum.docid(), "i = " << i << " p = " << p);
+        }
+        coll.evict_cold_tier();
+        doc_enum.global_geq(15000);
+        auto pos = std::lower_bound(docs.begin(), docs.end(), 15000);
+        REQUIRE(doc_enum.docid() == (pos == docs.end() ? universe : *pos));
+    }
+}
@@ -0,0 +1,118 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <fstream>
+
+#include "cluster_tiers.hpp"
+#include "clusters.hpp"
+#include "temporary_directory.hpp"
+#include "wand_utils.hpp"
+
+using namespace pisa;
+
+TEST_CASE("Binary selected clusters")
+{
+    Temporary_Directory tmp;
+    auto text_path = (tmp.path() / "clusters.txt").string();
+    auto binary_path = (tmp.path() / "clusters.bin").string();
+    {
+        std::ofstream os(text_path);
+        os << "123: 0 63 22\n";
+        os << "7:\n";
+        os << "42: 1000000000 5 5 999999999\n";
+    }
+    write_selected_clusters(read_selected_clusters(text_path), binary_path);
+
+    auto selected_clusters = SelectedClusters::from_mapped(binary_path);
+    REQUIRE(selected_clusters.size() == 3);
+    REQUIRE(*selected_clusters.find("123") == cluster_queue{0, 63, 22});
+    REQUIRE(selected_clusters.find("7")->empty());
+    REQUIRE(*selected_clusters.find("42") == cluster_queue{1000000000, 5, 5, 999999999});
+    REQUIRE_FALSE(selected_clusters.find("8").has_value());
+
+    std::vector<Query> queries(3);
+    queries[0].id = "42";
+    queries[1].id = "123";
+    queries[2].id = "7";
+    auto from_text = read_query_clusters(text_path, queries);
+    auto from_binary = read_query_clusters(binary_path, queries);
+    REQUIRE(from_text == from_binary);
+    REQUIRE(from_binary[1] == cluster_queue{0, 63, 22});
+}
+
+TEST_CASE("Binary selected clusters with deltas beyond 32 bits")
+{
+    Temporary_Directory tmp;
+    auto binary_path = (tmp.path() / "clusters.bin").string();
+    cluster_queue extremes{0, 4294967295U, 0, 4294967295U, 3000000000U, 1};
+    write_selected_clusters({{"1", extremes}}, binary_path);
+    REQUIRE(*SelectedClusters::from_mapped(binary_path).find("1") == extremes);
+}
+
+TEST_CASE("Corrupted binary selected clusters are rejected")
+{
+    Temporary_Directory tmp;
+    auto binary_path = (tmp.path() / "clusters.bin").string();
+    write_selected_clusters({{"1", {0, 5, 7}}}, binary_path);
+    std::vector<char> bytes;
+    {
+        std::ifstream is(binary_path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+    }
+    // The queue is the last payload: its length 3, then the deltas 0, 5 and 2.
+    REQUIRE(bytes[bytes.size() - 4] == static_cast<char>(0x83));
+    SECTION("More clusters than bytes")
+    {
+        bytes[bytes.size() - 4] = static_cast<char>(0x80 | 100);
+    }
+    SECTION("Truncated length")
+    {
+        std::fill(std::prev(bytes.end(), 4), bytes.end(), 0x7F);
+    }
+    {
+        std::ofstream os(binary_path, std::ios::binary | std::ios::trunc);
+        os.write(bytes.data(), bytes.size());
+    }
+    auto selected_clusters = SelectedClusters::from_mapped(binary_path);
+    REQUIRE_THROWS_AS(selected_clusters.find("1"), std::runtime_error);
+}
+
+TEST_CASE("Expand cluster queues into sub-ranges")
+{
+    Temporary_Directory tmp;
+    auto parents_path = (tmp.path() / "clusters.parents").string();
+    write_cluster_parents({0, 0, 1, 1, 1, 2}, parents_path);
+    auto parents = read_cluster_parents(parents_path);
+    REQUIRE(parents == std::vector<uint32_t>{0, 0, 1, 1, 1, 2});
+
+    REQUIRE(expand_cluster_queue({2, 0}, parents) == cluster_queue{5, 0, 1});
+    REQUIRE(expand_cluster_queue({1}, parents) == cluster_queue{2, 3, 4});
+    REQUIRE(expand_cluster_queue({}, parents).empty());
+    REQUIRE(expand_cluster_queue({7}, parents).empty());
+}
+
+TEST_CASE("Classify cluster tiers from visits")
+{
+    std::vector<uint64_t> visits{10, 0, 50, 30, 10};
+    REQUIRE(classify_clusters(visits, 0.5) == std::vector<bool>{true, true, false, true, true});
+    REQUIRE(classify_clusters(visits, 0.8) == std::vector<bool>{true, true, false, false, true});
+    REQUIRE(classify_clusters(visits, 1.0) == std::vector<bool>{false, true, false, false, false});
+
+    Temporary_Directory tmp;
+    auto visits_path = (tmp.path() / "visits").string();
+    write_cluster_visits(visits, visits_path);
+    REQUIRE(read_cluster_visits(visits_path) == visits);
+    auto tiers_path = (tmp.path() / "tiers").string();
+    write_cluster_tiers(classify_clusters(visits, 0.8), tiers_path);
+    REQUIRE(read_cluster_tiers(tiers_path) == classify_clusters(visits, 0.8));
+
+    cluster_tiers tiers(read_cluster_tiers(tiers_path), 4.0);
+    REQUIRE(tiers.cost(0) == 4.0);
+    REQUIRE(tiers.cost(2) == 1.0);
+    tiers.track_residency([](std::size_t cluster) { return cluster == 1; });
+    REQUIRE(tiers.cost(0) == 4.0);
+    REQUIRE(tiers.cost(1) == 1.0);
+    tiers.record_visit(3);
+    tiers.record_visit(3);
+    REQUIRE(tiers.visits() == std::vector<uint64_t>{0, 0, 0, 2, 0});
+}
@@ -0,0 +1,93 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <fstream>
+#include <numeric>
+
+#include "binary_freq_collection.hpp"
+#include "document_clustering.hpp"
+#include "pisa_config.hpp"
+#include "temporary_directory.hpp"
+
+using namespace pisa;
+
+/// Builds a forward index from the sorted term IDs of each document, the same way
+/// `forward_index::from_inverted_index` does.
+auto make_forward_index(std::vector<std::vector<std::uint32_t>> const& documents, std::size_t term_count)
+    -> forward_index
+{
+    forward_index fwd(documents.size(), term_count);
+    for (std::size_t document = 0; document < documents.size(); ++document) {
+        std::uint32_t prev = 0;
+        for (auto term: documents[document]) {
+            TightVariableByte::encode_single(term - prev, fwd[document]);
+            prev = term;
+        }
+    }
+    return forward_index::compress(fwd);
+}
+
+TEST_CASE("K-means separates documents with disjoint vocabularies")
+{
+    std::vector<std::vector<std::uint32_t>> documents;
+    for (std::uint32_t document = 0; document < 40; ++document) {
+        std::uint32_t first = document % 2 == 0 ? 0 : 10;
+        documents.push_back({first + document % 5, first + 5 + document % 3, first + 9});
+    }
+    auto fwd = make_forward_index(documents, 20);
+    std::vector<std::uint32_t> all(documents.size());
+    std::iota(all.begin(), all.end(), 0U);
+
+    std::mt19937_64 rng(17);
+    kmeans_clustering kmeans(fwd, 2, 100);
+    kmeans.fit(all, 5, rng);
+    std::vector<std::uint32_t> clusters;
+    kmeans.assign(all, clusters);
+    REQUIRE(clusters.size() == documents.size());
+    REQUIRE(clusters[0] != clusters[1]);
+    for (std::size_t document = 2; document < documents.size(); ++document) {
+        REQUIRE(clusters[document] == clusters[document % 2]);
+    }
+}
+
+TEST_CASE("Cluster documents of a collection")
+{
+    Temporary_Directory tmpdir;
+    auto input = PISA_SOURCE_DIR "/test/test_data/test_collection";
+    auto output = (tmpdir.path() / "clustered").string();
+    auto ranges = (tmpdir.path() / "clustered.ranges").string();
+    REQUIRE(
+        cluster_documents(KMeansClusteringOptions{
+            .input_basename = input,
+            .output_basename = output,
+            .output_clusters = ranges,
+            .input_fwd = std::nullopt,
+            .document_lexicon = std::nullopt,
+            .reordered_document_lexicon = std::nullopt,
+            .num_clusters = 8,
+            .sample_size = 1000,
+            .iterations = 3,
+            .centroid_terms = 100,
+            .min_length = 0,
+            .seed = 7,
+        })
+        == 0);
+
+    binary_freq_collection original(input);
+    binary_freq_collection clustered(output.c_str());
+    auto boundaries = read_cluster_ranges(ranges);
+    REQUIRE(not boundaries.empty());
+    REQUIRE(boundaries.size() <= 8);
+    REQUIRE(std::is_sorted(boundaries.begin(), boundaries.end()));
+    REQUIRE(boundaries.back() == original.num_docs());
+    REQUIRE(clustered.num_docs() == original.num_docs());
+
+    auto lhs = original.begin();
+    auto rhs = clustered.begin();
+    for (; lhs != original.end(); ++lhs, ++rhs) {
+        REQUIRE(rhs != clustered.end());
+        REQUIRE(lhs->docs.size() == rhs->docs.size());
+        REQUIRE(std::is_sorted(rhs->docs.begin(), rhs->docs.end()));
+    }
+    REQUIRE(rhs == clustered.end());
+}
@@ -0,0 +1,179 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <fstream>
+#include <memory>
+#include <unordered_map>
+
+#include "cursor/block_max_scored_cursor.hpp"
+#include "cursor/max_scored_cursor.hpp"
+#include "cursor/scored_cursor.hpp"
+#include "cursor/shard_cursor.hpp"
+#include "index_types.hpp"
+#include "pisa_config.hpp"
+#include "query/algorithm.hpp"
+#include "sharding.hpp"
+#include "temporary_directory.hpp"
+#include "wand_data.hpp"
+#include "wand_data_raw.hpp"
+
+using namespace pisa;
+
+using WandType = wand_data<wand_data_raw>;
+using Index = block_simdbp_index;
+
+void build_index(binary_freq_collection const& collection, Index& index)
+{
+    global_parameters params;
+    Index::builder builder(collection.num_docs(), params);
+    for (auto const& plist: collection) {
+        uint64_t freqs_sum = std::accumulate(plist.freqs.begin(), plist.freqs.end(), uint64_t(0));
+        builder.add_posting_list(plist.docs.size(), plist.docs.begin(), plist.freqs.begin(), freqs_sum);
+    }
+    builder.build(index);
+}
+
+struct Shard {
+    explicit Shard(std::string const& basename)
+        : collection(basename.c_str()),
+          sizes((basename + ".sizes").c_str()),
+          stats(MemorySource::mapped_file(basename + ".global-stats"))
+    {
+        std::unordered_set<size_t> dropped_term_ids;
+        std::vector<uint32_t> no_clusters;
+        wdata = std::make_unique<WandType>(
+            sizes.begin()->begin(),
+            collection.num_docs(),
+            collection,
+            ScorerParams("bm25"),
+            FixedBlock(64),
+            false,
+            dropped_term_ids,
+            no_clusters,
+            false,
+            &stats);
+        build_index(collection, index);
+        auto terms = io::read_string_vector(basename + ".terms");
+        for (size_t term = 0; term < terms.size(); ++term) {
+            local_terms[std::stoul(terms[term])] = term;
+        }
+    }
+
+    /// The query with its terms translated to the shard; terms not in the shard are dropped.
+    [[nodiscard]] auto local_query(Query const& query) const -> Query
+    {
+        Query local;
+        for (auto term: query.terms) {
+            if (auto pos = local_terms.find(term); pos != local_terms.end()) {
+                local.terms.push_back(pos->second);
+            }
+        }
+        return local;
+    }
+
+    binary_freq_collection collection;
+    binary_collection sizes;
+    global_statistics stats;
+    std::unique_ptr<WandType> wdata;
+    Index index;
+    std::unordered_map<term_id_type, term_id_type> local_terms;
+};
+
+TEST_CASE("Federated BoundSum queries over cluster shards", "[query][ranked][integration]")
+{
+    std::string input(PISA_SOURCE_DIR "/test/test_data/test_collection");
+    binary_freq_collection collection(input.c_str());
+    binary_collection sizes((input + ".sizes").c_str());
+    Temporary_Directory tmpdir;
+    auto terms_file = (tmpdir.path() / "terms").string();
+    {
+        std::ofstream os(terms_file);
+        for (size_t term = 0; term < collection.size(); ++term) {
+            os << term << '\n';
+        }
+    }
+    std::vector<uint32_t> boundaries{1000, 2000, static_cast<uint32_t>(collection.num_docs())};
+    auto shard_basename = (tmpdir.path() / "shard").string();
+    partition_inverted_index(input, shard_basename, boundaries, terms_file);
+
+    std::unordered_set<size_t> dropped_term_ids;
+    std::vector<uint32_t> no_clusters;
+    WandType wdata(
+        sizes.begin()->begin(),
+        collection.num_docs(),
+        collection,
+        ScorerParams("bm25"),
+        FixedBlock(64),
+        false,
+        dropped_term_ids,
+        no_clusters);
+    Index index;
+    build_index(collection, index);
+    auto scorer = scorer::from_params(ScorerParams("bm25"), wdata);
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::vector<cluster_map> shard_ranges;
+    std::vector<uint64_t> shard_sizes;
+    std::vector<std::unique_ptr<index_scorer<WandType>>> shard_scorers;
+    for (size_t shard = 0; shard < boundaries.size(); ++shard) {
+        shards.push_back(std::make_unique<Shard>(format_shard(shard_basename, Shard_Id(shard))));
+        shard_ranges.push_back(shards.back()->wdata->all_ranges());
+        shard_sizes.push_back(shards.back()->collection.num_docs());
+        shard_scorers.push_back(scorer::from_params(ScorerParams("bm25"), *shards.back()->wdata));
+    }
+    auto [ranges, spaces] = federate_ranges(shard_ranges, shard_sizes);
+    REQUIRE(ranges.size() == boundaries.size());
+
+    std::vector<Query> queries;
+    std::ifstream qfile(PISA_SOURCE_DIR "/test/test_data/queries");
+    io::for_each_line(qfile, [&](auto const& line) { queries.push_back(parse_query_ids(line)); });
+
+    auto federated_cursors = [&](auto make_cursors, Query const& query) {
+        using Cursor = typename decltype(make_cursors(0, query))::value_type;
+        std::vector<ShardCursor<Cursor>> cursors;
+        for (size_t shard = 0; shard < shards.size(); ++shard) {
+            append_shard_cursors(
+                cursors, make_cursors(shard, shards[shard]->local_query(query)), spaces[shard]);
+        }
+        return cursors;
+    };
+    auto max_scored = [&](size_t shard, Query const& query) {
+        return make_max_scored_cursors(
+            shards[shard]->index, *shards[shard]->wdata, *shard_scorers[shard], query);
+    };
+    auto block_max_scored = [&](size_t shard, Query const& query) {
+        return make_block_max_scored_cursors(
+            shards[shard]->index, *shards[shard]->wdata, *shard_scorers[shard], query);
+    };
+
+    for (auto const& query: queries) {
+        topk_queue expected(10);
+        ranked_or_query or_q(expected);
+        or_q(make_scored_cursors(index, *scorer, query), index.num_docs());
+        expected.finalize();
+
+        auto require_expected = [&](topk_queue const& topk) {
+            REQUIRE(topk.topk().size() == expected.topk().size());
+            for (size_t i = 0; i < topk.topk().size(); ++i) {
+                REQUIRE(topk.topk()[i].first == Approx(expected.topk()[i].first).epsilon(0.01));
+            }
+        };
+
+        topk_queue wand_topk(10);
+        wand_query(wand_topk, ranges).boundsum_range_query(federated_cursors(max_scored, query), ranges.size());
+        wand_topk.finalize();
+        require_expected(wand_topk);
+
+        topk_queue maxscore_topk(10);
+        maxscore_query(maxscore_topk, ranges)
+            .boundsum_range_query(federated_cursors(max_scored, query), ranges.size());
+        maxscore_topk.finalize();
+        require_expected(maxscore_topk);
+
+        topk_queue bmw_topk(10);
+        block_max_wand_query(bmw_topk, ranges)
+            .boundsum_range_query(federated_cursors(block_max_scored, query), ranges.size());
+        bmw_topk.finalize();
+        require_expected(bmw_topk);
+    }
+}
@@ -1,6 +1,7 @@
 #define CATCH_CONFIG_MAIN
 #include "catch2/catch.hpp"
 
+#include <array>
 #include <cstdio>
 #include <string>
 
@@ -11,7 +12,9 @@
 #include "binary_collection.hpp"
 #include "filesystem.hpp"
 #include "invert.hpp"
+#include "io.hpp"
 #include "pisa_config.hpp"
+#include "range_statistics.hpp"
 #include "temporary_directory.hpp"
 
 using namespace boost::filesystem;
@@ -334,3 +337,112 @@ TEST_CASE("Invert collection", "[invert][unit]")
         }
     }
 }
+
+TEST_CASE("Invert collection in external memory", "[invert][unit]")
+{
+    Temporary_Directory tmpdir;
+    auto collection_filename = (tmpdir.path() / "fwd").string();
+    {
+        std::vector<uint32_t> collection_data{
+            /* size */ 1,  /* count */ 5,
+            /* size */ 5,  /* Doc 0 */ 2, 0, 3, 9, 0,
+            /* size */ 9,  /* Doc 1 */ 5, 0, 3, 4, 2, 6, 7, 4, 5,
+            /* size */ 6,  /* Doc 2 */ 5, 1, 8, 9, 8, 8,
+            /* size */ 3,  /* Doc 3 */ 8, 5, 9,
+            /* size */ 11, /* Doc 4 */ 8, 6, 9, 6, 6, 5, 4, 3, 1, 0, 6};
+        std::ofstream os(collection_filename);
+        os.write(
+            reinterpret_cast<char*>(collection_data.data()),
+            collection_data.size() * sizeof(uint32_t));
+    }
+    auto expected_basename = (tmpdir.path() / "expected").string();
+    invert::invert_forward_index(collection_filename, expected_basename, 100, 1, 10);
+
+    // From one document per run up to the whole collection in one run.
+    std::size_t budget_postings = GENERATE(1, 5, 9, 14, 20, 34, 1000);
+    auto actual_basename = (tmpdir.path() / "actual").string();
+    auto runs_dir = tmpdir.path() / "runs";
+    boost::filesystem::create_directory(runs_dir);
+    invert::invert_forward_index_external(
+        collection_filename,
+        actual_basename,
+        budget_postings * invert::run_bytes_per_posting,
+        10,
+        std::nullopt,
+        runs_dir.string());
+    REQUIRE(boost::filesystem::is_empty(runs_dir));
+    for (auto suffix: {".docs", ".freqs", ".sizes"}) {
+        INFO("Budget of " << budget_postings << " postings, file " << suffix);
+        REQUIRE(
+            io::load_data(expected_basename + suffix) == io::load_data(actual_basename + suffix));
+    }
+}
+
+TEST_CASE("Write a run with only the terms it contains", "[invert][unit]")
+{
+    Temporary_Directory tmpdir;
+    auto run = (tmpdir.path() / "run").string();
+    invert::write_run(
+        run,
+        posting_vector_type{
+            {3_t, 0_d}, {3_t, 0_d}, {3_t, 2_d}, {7_t, 1_d}, {7_t, 2_d}, {7_t, 2_d}, {7_t, 2_d}});
+    auto sequences = [](std::string const& path) {
+        std::vector<std::vector<std::uint32_t>> sequences;
+        for (auto const& seq: binary_collection(path.c_str())) {
+            sequences.emplace_back(seq.begin(), seq.end());
+        }
+        return sequences;
+    };
+    REQUIRE(sequences(run + ".terms") == std::vector<std::vector<std::uint32_t>>{{3, 7}});
+    REQUIRE(sequences(run + ".docs") == std::vector<std::vector<std::uint32_t>>{{0, 2}, {1, 2}});
+    REQUIRE(sequences(run + ".freqs") == std::vector<std::vector<std::uint32_t>>{{2, 1}, {1, 3}});
+}
+
+TEST_CASE("Gather per-cluster statistics while inverting", "[invert][unit]")
+{
+    Temporary_Directory tmpdir;
+    auto collection_filename = (tmpdir.path() / "fwd").string();
+    {
+        std::vector<uint32_t> collection_data{
+            /* size */ 1,  /* count */ 5,
+            /* size */ 5,  /* Doc 0 */ 2, 0, 3, 9, 0,
+            /* size */ 9,  /* Doc 1 */ 5, 0, 3, 4, 2, 6, 7, 4, 5,
+            /* size */ 6,  /* Doc 2 */ 5, 1, 8, 9, 8, 8,
+            /* size */ 3,  /* Doc 3 */ 8, 5, 9,
+            /* size */ 11, /* Doc 4 */ 8, 6, 9, 6, 6, 5, 4, 3, 1, 0, 6};
+        std::ofstream os(collection_filename);
+        os.write(
+            reinterpret_cast<char*>(collection_data.data()),
+            collection_data.size() * sizeof(uint32_t));
+    }
+    auto index_basename = (tmpdir.path() / "idx").string();
+    std::vector<std::uint32_t> clusters{2, 4, 5};
+    bool external = GENERATE(false, true);
+    if (external) {
+        invert::invert_forward_index_external(
+            collection_filename, index_basename, 5 * invert::run_bytes_per_posting, 10, clusters);
+    } else {
+        invert::invert_forward_index(collection_filename, index_basename, 2, 2, 10, clusters);
+    }
+
+    range_statistics stats(MemorySource::mapped_file(index_basename + ".range-stats"));
+    REQUIRE(stats.num_ranges() == 3);
+    REQUIRE(stats.num_terms() == 10);
+    REQUIRE(stats.range_length(0) == 14);
+    REQUIRE(stats.range_length(1) == 9);
+    REQUIRE(stats.range_length(2) == 11);
+
+    auto collect = [&](term_id_type term_id) {
+        std::vector<std::array<std::uint32_t, 3>> entries;
+        stats.for_each_range_with_max_tf(term_id, [&](auto range, auto df, auto max_tf) {
+            entries.push_back({range, df, max_tf});
+        });
+        return entries;
+    };
+    using entries = std::vector<std::array<std::uint32_t, 3>>;
+    REQUIRE(collect(0) == entries{{0, 2, 2}, {2, 1, 1}});
+    REQUIRE(collect(6) == entries{{0, 1, 1}, {2, 1, 4}});
+    REQUIRE(collect(7) == entries{{0, 1, 1}});
+    REQUIRE(collect(8) == entries{{1, 2, 3}, {2, 1, 1}});
+    REQUIRE(collect(9) == entries{{0, 1, 1}, {1, 2, 1}, {2, 1, 1}});
+}
@@ -22,6 +22,7 @@
 #include "pisa_config.hpp"
 #include "sharding.hpp"
 #include "temporary_directory.hpp"
+#include "wand_data.hpp"
 
 using namespace boost::filesystem;
 using namespace pisa;
@@ -330,3 +331,108 @@ TEST_CASE("partition_fwd_index", "[invert][integration]")
         }
     }
 }
+
+TEST_CASE("Partition inverted index at cluster boundaries", "[invert][integration]")
+{
+    GIVEN("A test collection and its clusters")
+    {
+        std::string input(PISA_SOURCE_DIR "/test/test_data/test_collection");
+        binary_freq_collection collection(input.c_str());
+        binary_collection sizes((input + ".sizes").c_str());
+        std::vector<uint32_t> boundaries{1000, 2500, 3000, static_cast<uint32_t>(collection.num_docs())};
+        Temporary_Directory tmpdir;
+        auto output_basename = (tmpdir.path() / "shards").string();
+        auto terms_file = (tmpdir.path() / "terms").string();
+        {
+            std::ofstream os(terms_file);
+            for (size_t term = 0; term < collection.size(); ++term) {
+                os << term << '\n';
+            }
+        }
+
+        WHEN("Partitioned into one shard per cluster")
+        {
+            partition_inverted_index(input, output_basename, boundaries, terms_file);
+
+            THEN("Every posting is in the shard of its cluster, renumbered from the cluster start")
+            {
+                using postings_type = std::vector<std::pair<uint32_t, uint32_t>>;
+                std::vector<postings_type> expected(collection.size());
+                std::vector<postings_type> actual(collection.size());
+                size_t term = 0;
+                for (auto const& seq: collection) {
+                    for (size_t pos = 0; pos < seq.docs.size(); ++pos) {
+                        expected[term].emplace_back(seq.docs[pos], seq.freqs[pos]);
+                    }
+                    term += 1;
+                }
+                uint32_t first = 0;
+                for (size_t shard = 0; shard < boundaries.size(); ++shard) {
+                    auto basename = format_shard(output_basename, Shard_Id(shard));
+                    binary_freq_collection shard_collection(basename.c_str());
+                    REQUIRE(shard_collection.num_docs() == boundaries[shard] - first);
+                    auto shard_terms = io::read_string_vector(basename + ".terms");
+                    REQUIRE(shard_terms.size() == shard_collection.size());
+                    global_statistics stats(MemorySource::mapped_file(basename + ".global-stats"));
+                    REQUIRE(stats.num_docs() == collection.num_docs());
+                    REQUIRE(stats.num_terms() == shard_collection.size());
+                    size_t local_term = 0;
+                    for (auto const& seq: shard_collection) {
+                        auto global_term = std::stoul(shard_terms[local_term]);
+                        REQUIRE(stats.term_posting_count(local_term) == expected[global_term].size());
+                        for (size_t pos = 0; pos < seq.docs.size(); ++pos) {
+                            actual[global_term].emplace_back(first + seq.docs[pos], seq.freqs[pos]);
+                        }
+                        local_term += 1;
+                    }
+                    first = boundaries[shard];
+                }
+                REQUIRE(actual == expected);
+            }
+
+            THEN("Shard wand data built with the global statistics matches the full wand data")
+            {
+                std::unordered_set<size_t> dropped_term_ids;
+                std::vector<uint32_t> no_clusters;
+                wand_data<wand_data_raw> wdata(
+                    sizes.begin()->begin(),
+                    collection.num_docs(),
+                    collection,
+                    ScorerParams("bm25"),
+                    FixedBlock(64),
+                    false,
+                    dropped_term_ids,
+                    no_clusters);
+                auto basename = format_shard(output_basename, Shard_Id(1));
+                binary_freq_collection shard_collection(basename.c_str());
+                binary_collection shard_sizes((basename + ".sizes").c_str());
+                auto shard_terms = io::read_string_vector(basename + ".terms");
+                global_statistics stats(MemorySource::mapped_file(basename + ".global-stats"));
+                std::vector<uint32_t> shard_clusters;
+                wand_data<wand_data_raw> shard_wdata(
+                    shard_sizes.begin()->begin(),
+                    shard_collection.num_docs(),
+                    shard_collection,
+                    ScorerParams("bm25"),
+                    FixedBlock(64),
+                    false,
+                    dropped_term_ids,
+                    shard_clusters,
+                    false,
+                    &stats);
+                REQUIRE(shard_wdata.num_docs() == wdata.num_docs());
+                REQUIRE(shard_wdata.avg_len() == Approx(wdata.avg_len()));
+                for (uint32_t doc = 0; doc < shard_collection.num_docs(); ++doc) {
+                    REQUIRE(shard_wdata.norm_len(doc) == Approx(wdata.norm_len(boundaries[0] + doc)));
+                }
+                for (size_t term = 0; term < shard_collection.size(); ++term) {
+                    auto global_term = std::stoul(shard_terms[term]);
+                    REQUIRE(shard_wdata.term_posting_count(term) == wdata.term_posting_count(global_term));
+                    REQUIRE(
+                        shard_wdata.term_occurrence_count(term)
+                        == wdata.term_occurrence_count(global_term));
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,133 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <unordered_map>
+
+#include <tbb/task_scheduler_init.h>
+
+#include "binary_collection.hpp"
+#include "binary_freq_collection.hpp"
+#include "pisa_config.hpp"
+#include "range_pair_bounds.hpp"
+#include "scorer/scorer.hpp"
+#include "wand_data.hpp"
+#include "wand_data_raw.hpp"
+
+using namespace pisa;
+
+/// Exposes only what `range_bound_sums` needs from a max-scored cursor.
+struct RangeBoundCursor {
+    std::uint32_t m_term_id;
+    wand_data_raw::enumerator m_wdata;
+
+    [[nodiscard]] auto term_id() const -> std::uint32_t { return m_term_id; }
+    [[nodiscard]] auto get_range_max_score(uint64_t range) const -> float
+    {
+        return m_wdata.range_score(range);
+    }
+};
+
+TEST_CASE("Range pair bounds")
+{
+    tbb::task_scheduler_init init;
+    binary_freq_collection const collection(PISA_SOURCE_DIR "/test/test_data/test_collection");
+    binary_collection document_sizes(PISA_SOURCE_DIR "/test/test_data/test_collection.sizes");
+    auto num_docs = static_cast<uint32_t>(collection.num_docs());
+    std::vector<uint32_t> clusters{num_docs / 4, num_docs / 2, num_docs};
+    std::unordered_set<size_t> dropped_term_ids;
+    wand_data<wand_data_raw> wdata(
+        document_sizes.begin()->begin(),
+        collection.num_docs(),
+        collection,
+        ScorerParams("bm25"),
+        BlockSize(FixedBlock(5)),
+        false,
+        dropped_term_ids,
+        clusters);
+    DocToRange doc_to_range(std::vector<uint32_t>{num_docs / 4, num_docs / 2, num_docs});
+
+    std::vector<std::uint32_t> terms;
+    std::vector<binary_freq_collection::sequence> sequences;
+    std::uint32_t term_id = 0;
+    for (auto const& seq: collection) {
+        if (seq.docs.size() >= 1000 && terms.size() < 6) {
+            terms.push_back(term_id);
+            sequences.push_back(seq);
+        }
+        term_id += 1;
+    }
+    REQUIRE(terms.size() == 6);
+    std::vector<term_pair> pairs{
+        {terms[1], terms[0]}, {terms[2], terms[3]}, {terms[0], terms[1]}, {terms[4], terms[4]}};
+    range_pair_bounds bounds(collection, wdata, ScorerParams("bm25"), pairs);
+    REQUIRE(bounds.size() == 2);
+    REQUIRE(bounds.num_ranges() == 3);
+
+    SECTION("Lookup is order-insensitive")
+    {
+        REQUIRE(bounds.find(terms[0], terms[1]) == bounds.find(terms[1], terms[0]));
+        REQUIRE(bounds.find(terms[3], terms[2]).has_value());
+        REQUIRE_FALSE(bounds.find(terms[0], terms[2]).has_value());
+        REQUIRE_FALSE(bounds.find(terms[4], terms[4]).has_value());
+    }
+
+    auto scorer = scorer::from_params(ScorerParams("bm25"), wdata);
+    // Returns the per-range maxima of the summed score over all documents containing either
+    // term, and over only the documents containing both.
+    auto brute_force = [&](size_t left, size_t right) {
+        std::vector<float> any(3, 0.0F);
+        std::vector<float> both(3, 0.0F);
+        std::unordered_map<uint64_t, std::pair<float, int>> scores;
+        for (auto pos: {left, right}) {
+            auto term_scorer = scorer->term_scorer(terms[pos]);
+            auto const& seq = sequences[pos];
+            for (size_t i = 0; i < seq.docs.size(); ++i) {
+                uint64_t docid = *(seq.docs.begin() + i);
+                auto& [score, count] = scores[docid];
+                score += term_scorer(docid, *(seq.freqs.begin() + i));
+                count += 1;
+            }
+        }
+        for (auto&& [docid, score_count]: scores) {
+            auto range = doc_to_range(docid);
+            any[range] = std::max(any[range], score_count.first);
+            if (score_count.second == 2) {
+                both[range] = std::max(both[range], score_count.first);
+            }
+        }
+        return std::make_pair(any, both);
+    };
+
+    SECTION("Bounds are the maxima over co-occurring documents")
+    {
+        for (auto [left, right]: {std::make_pair(0, 1), std::make_pair(2, 3)}) {
+            auto pair = *bounds.find(terms[left], terms[right]);
+            auto both = brute_force(left, right).second;
+            for (size_t range = 0; range < 3; ++range) {
+                REQUIRE(bounds.bound(pair, range) == Approx(both[range]));
+            }
+        }
+    }
+
+    SECTION("BoundSum with pair bounds is tighter but still safe")
+    {
+        std::vector<RangeBoundCursor> cursors;
+        for (auto pos: {0, 1, 2, 3, 5}) {
+            cursors.push_back(RangeBoundCursor{terms[pos], wdata.getenum(terms[pos])});
+        }
+        auto singles = range_bound_sums(cursors, 3);
+        auto tightened = range_bound_sums(cursors, 3, &bounds);
+        auto [any01, both01] = brute_force(0, 1);
+        auto [any23, both23] = brute_force(2, 3);
+        bool tighter = false;
+        for (size_t range = 0; range < 3; ++range) {
+            REQUIRE(singles[range].first == range);
+            REQUIRE(tightened[range].first == range);
+            REQUIRE(tightened[range].second <= singles[range].second);
+            float exact = any01[range] + any23[range] + cursors[4].get_range_max_score(range);
+            REQUIRE(tightened[range].second >= exact * (1 - 1e-5));
+            tighter = tighter || tightened[range].second < singles[range].second;
+        }
+        REQUIRE(tighter);
+    }
+}
@@ -0,0 +1,126 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <numeric>
+#include <unordered_set>
+
+#include "binary_collection.hpp"
+#include "binary_freq_collection.hpp"
+#include "mappable/mapper.hpp"
+#include "pisa_config.hpp"
+#include "range_statistics.hpp"
+#include "temporary_directory.hpp"
+#include "wand_data.hpp"
+#include "wand_data_raw.hpp"
+
+using namespace pisa;
+
+TEST_CASE("Range statistics")
+{
+    binary_freq_collection const collection(PISA_SOURCE_DIR "/test/test_data/test_collection");
+    binary_collection document_sizes(PISA_SOURCE_DIR "/test/test_data/test_collection.sizes");
+    auto num_docs = static_cast<uint32_t>(collection.num_docs());
+    std::vector<uint32_t> clusters{num_docs / 4, num_docs / 2, num_docs};
+    DocToRange doc_to_range(clusters);
+    std::unordered_set<size_t> dropped_term_ids;
+    wand_data<wand_data_raw> wdata(
+        document_sizes.begin()->begin(),
+        collection.num_docs(),
+        collection,
+        ScorerParams("bm25"),
+        BlockSize(FixedBlock(5)),
+        false,
+        dropped_term_ids,
+        clusters);
+
+    range_statistics built(collection, wdata);
+    Temporary_Directory tmpdir;
+    auto stats_path = (tmpdir.path() / "range_stats").string();
+    mapper::freeze(built, stats_path.c_str());
+    range_statistics stats(MemorySource::mapped_file(stats_path));
+    REQUIRE(stats.num_ranges() == 3);
+    REQUIRE(stats.num_terms() == collection.size());
+
+    SECTION("Counts match the collection")
+    {
+        std::uint64_t total_length = 0;
+        for (size_t range = 0; range < 3; ++range) {
+            total_length += stats.range_length(range);
+        }
+        auto lengths = document_sizes.begin()->begin();
+        REQUIRE(total_length == std::accumulate(lengths, lengths + num_docs, std::uint64_t{0}));
+
+        term_id_type term_id = 0;
+        for (auto const& seq: collection) {
+            std::vector<std::uint32_t> expected(3, 0);
+            std::vector<std::uint32_t> expected_max_tf(3, 0);
+            auto freq = seq.freqs.begin();
+            for (auto docid: seq.docs) {
+                expected[doc_to_range(docid)] += 1;
+                expected_max_tf[doc_to_range(docid)] =
+                    std::max(expected_max_tf[doc_to_range(docid)], *freq++);
+            }
+            std::vector<std::uint32_t> actual(3, 0);
+            stats.for_each_range(term_id, [&](auto range, auto df) { actual[range] = df; });
+            REQUIRE(actual == expected);
+            std::vector<std::uint32_t> actual_max_tf(3, 0);
+            stats.for_each_range_with_max_tf(
+                term_id, [&](auto range, auto, auto max_tf) { actual_max_tf[range] = max_tf; });
+            REQUIRE(actual_max_tf == expected_max_tf);
+            REQUIRE(
+                stats.range_count(term_id)
+                == static_cast<size_t>(std::count_if(
+                    expected.begin(), expected.end(), [](auto df) { return df > 0; })));
+            term_id += 1;
+        }
+    }
+
+    SECTION("Selector ranks matching ranges by CORI belief")
+    {
+        cori_range_selector select(stats);
+        term_id_type term_id = 0;
+        std::vector<term_id_type> rare;
+        std::vector<term_id_type> frequent;
+        for (auto const& seq: collection) {
+            if (rare.empty() || stats.range_count(term_id) < stats.range_count(rare[0])) {
+                rare = {term_id};
+            }
+            if (seq.docs.size() >= 1000 && frequent.size() < 2) {
+                frequent.push_back(term_id);
+            }
+            term_id += 1;
+        }
+        REQUIRE(rare.size() == 1);
+        REQUIRE(frequent.size() == 2);
+
+        auto ranges = select(Query{{}, rare, {}});
+        REQUIRE(ranges.size() == stats.range_count(rare[0]));
+        stats.for_each_range(rare[0], [&](auto range, auto) {
+            REQUIRE(std::find(ranges.begin(), ranges.end(), range) != ranges.end());
+        });
+
+        ranges = select(Query{{}, frequent, {}});
+        std::unordered_set<size_t> unique(ranges.begin(), ranges.end());
+        REQUIRE(unique.size() == ranges.size());
+        REQUIRE(ranges.size() == 3);
+
+        // Score the ranges directly from the statistics and check the order.
+        float avg_length = 0.0F;
+        for (size_t range = 0; range < 3; ++range) {
+            avg_length += stats.range_length(range) / 3.0F;
+        }
+        std::vector<float> beliefs(3, 0.0F);
+        for (auto term: frequent) {
+            float idf = std::log(3.5F / stats.range_count(term)) / std::log(4.0F);
+            stats.for_each_range(term, [&](auto range, auto df) {
+                beliefs[range] +=
+                    0.6F * idf * df / (df + 50.0F + 150.0F * stats.range_length(range) / avg_length);
+            });
+        }
+        for (size_t pos = 1; pos < ranges.size(); ++pos) {
+            REQUIRE(beliefs[ranges[pos - 1]] >= beliefs[ranges[pos]]);
+        }
+
+        REQUIRE(select(Query{{}, {}, {}}).empty());
+    }
+}
@@ -0,0 +1,117 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <unordered_set>
+
+#include "binary_collection.hpp"
+#include "binary_freq_collection.hpp"
+#include "mappable/mapper.hpp"
+#include "pisa_config.hpp"
+#include "range_taily_stats.hpp"
+#include "scorer/scorer.hpp"
+#include "temporary_directory.hpp"
+#include "wand_data.hpp"
+#include "wand_data_raw.hpp"
+
+using namespace pisa;
+
+TEST_CASE("Range Taily statistics")
+{
+    binary_freq_collection const collection(PISA_SOURCE_DIR "/test/test_data/test_collection");
+    binary_collection document_sizes(PISA_SOURCE_DIR "/test/test_data/test_collection.sizes");
+    auto num_docs = static_cast<uint32_t>(collection.num_docs());
+    std::vector<uint32_t> clusters{num_docs / 4, num_docs / 2, num_docs};
+    DocToRange doc_to_range(clusters);
+    std::unordered_set<size_t> dropped_term_ids;
+    wand_data<wand_data_raw> wdata(
+        document_sizes.begin()->begin(),
+        collection.num_docs(),
+        collection,
+        ScorerParams("bm25"),
+        BlockSize(FixedBlock(5)),
+        false,
+        dropped_term_ids,
+        clusters);
+    auto scorer = scorer::from_params(ScorerParams("bm25"), wdata);
+
+    range_taily_stats built(collection, scorer, {num_docs / 4, num_docs / 2, num_docs});
+    Temporary_Directory tmpdir;
+    auto stats_path = (tmpdir.path() / "range_taily_stats").string();
+    mapper::freeze(built, stats_path.c_str());
+    range_taily_stats stats(MemorySource::mapped_file(stats_path));
+    REQUIRE(stats.num_docs() == num_docs);
+    REQUIRE(stats.num_ranges() == 3);
+    REQUIRE(stats.num_terms() == collection.size());
+    REQUIRE(stats.range_size(0) + stats.range_size(1) + stats.range_size(2) == num_docs);
+
+    SECTION("Statistics match the scores of each range")
+    {
+        term_id_type term_id = 0;
+        for (auto const& seq: collection) {
+            auto term_scorer = scorer->term_scorer(term_id);
+            std::vector<float> all;
+            std::vector<std::vector<float>> ranges(3);
+            for (size_t i = 0; i < seq.docs.size(); ++i) {
+                uint64_t docid = *(seq.docs.begin() + i);
+                float score = term_scorer(docid, *(seq.freqs.begin() + i));
+                all.push_back(score);
+                ranges[doc_to_range(docid)].push_back(score);
+            }
+            auto global = taily::Feature_Statistics::from_features(all);
+            REQUIRE(stats.term_stats(term_id).expected_value == Approx(global.expected_value));
+            REQUIRE(stats.term_stats(term_id).variance == Approx(global.variance));
+            REQUIRE(stats.term_stats(term_id).frequency == global.frequency);
+            std::vector<bool> seen(3, false);
+            stats.for_each_range(term_id, [&](auto range, auto const& range_stats) {
+                auto expected = taily::Feature_Statistics::from_features(ranges[range]);
+                REQUIRE(range_stats.expected_value == Approx(expected.expected_value));
+                REQUIRE(range_stats.variance == Approx(expected.variance));
+                REQUIRE(range_stats.frequency == expected.frequency);
+                seen[range] = true;
+            });
+            for (size_t range = 0; range < 3; ++range) {
+                REQUIRE(seen[range] == not ranges[range].empty());
+            }
+            term_id += 1;
+        }
+    }
+
+    SECTION("Ranges are selected by predicted top-k documents")
+    {
+        std::vector<term_id_type> terms;
+        term_id_type term_id = 0;
+        for (auto const& seq: collection) {
+            if (seq.docs.size() >= 1000 && terms.size() < 2) {
+                terms.push_back(term_id);
+            }
+            term_id += 1;
+        }
+        REQUIRE(terms.size() == 2);
+        Query query{{}, terms, {}};
+
+        auto predictions = stats.predict(query, 10);
+        REQUIRE(predictions.size() == 3);
+        for (auto prediction: predictions) {
+            REQUIRE(prediction >= 0.0);
+        }
+
+        auto ranges = taily_range_selector(stats, 10)(query);
+        REQUIRE(ranges.size() == 3);
+        for (size_t pos = 1; pos < ranges.size(); ++pos) {
+            REQUIRE(predictions[ranges[pos - 1]] >= predictions[ranges[pos]]);
+        }
+
+        // Stopping leaves behind fewer than epsilon expected documents, and keeps a prefix.
+        double epsilon = predictions[ranges.back()] + 1e-3;
+        auto stopped = taily_range_selector(stats, 10, epsilon)(query);
+        REQUIRE(stopped.size() < ranges.size());
+        REQUIRE(std::equal(stopped.begin(), stopped.end(), ranges.begin()));
+        double remaining = 0.0;
+        for (auto pos = stopped.size(); pos < ranges.size(); ++pos) {
+            remaining += predictions[ranges[pos]];
+        }
+        REQUIRE(remaining < epsilon);
+
+        REQUIRE(taily_range_selector(stats, 10)(Query{{}, {}, {}}).empty());
+    }
+}
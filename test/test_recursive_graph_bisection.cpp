@@ -2,10 +2,13 @@
 
 #include <catch2/catch.hpp>
 
+#include <unordered_map>
+
 #include "pisa/forward_index_builder.hpp"
 #include "pisa/invert.hpp"
 #include "pisa/reorder_docids.hpp"
 #include "pisa/temporary_directory.hpp"
+#include "pisa/wand_utils.hpp"
 #include "pisa_config.hpp"
 
 using namespace pisa;
@@ -132,5 +135,102 @@ TEST_CASE("Reorder documents with BP")
                 compare_strcolls(expected, actual);
             }
         }
+
+        WHEN("Reordered documents with BP within clusters")
+        {
+            auto map_path = (tmp.path() / "clusters.map").string();
+            auto ranges_path = (tmp.path() / "clusters.ranges").string();
+            pisa::binary_freq_collection inv(inv_path.c_str());
+            {
+                std::ofstream os(map_path);
+                for (std::size_t document = 0; document < inv.num_docs(); ++document) {
+                    os << (document % 3) * 2 << '\n';
+                }
+            }
+            int code = recursive_graph_bisection(RecursiveGraphBisectionOptions{
+                .input_basename = inv_path,
+                .output_basename = bp_inv_path,
+                .output_fwd = std::nullopt,
+                .input_fwd = std::nullopt,
+                .document_lexicon = fmt::format("{}.doclex", fwd_path),
+                .reordered_document_lexicon = fmt::format("{}.doclex", bp_fwd_path),
+                .depth = std::nullopt,
+                .node_config = std::nullopt,
+                .min_length = 0,
+                .compress_fwd = false,
+                .print_args = false,
+                .document_clusters = std::nullopt,
+                .cluster_map = map_path,
+                .output_clusters = ranges_path,
+            });
+            REQUIRE(code == 0);
+            THEN("Both collections are equal when mapped to strings")
+            {
+                auto expected = coll_to_strings(inv_path, fmt::format("{}.doclex", fwd_path));
+                auto actual = coll_to_strings(bp_inv_path, fmt::format("{}.doclex", bp_fwd_path));
+                compare_strcolls(expected, actual);
+            }
+            THEN("Every document stays in its cluster")
+            {
+                // Clusters 1 and 3 have no documents but keep their (empty) ranges.
+                auto boundaries = read_cluster_ranges(ranges_path);
+                REQUIRE(boundaries.size() == 5);
+                REQUIRE(boundaries[0] == boundaries[1]);
+                REQUIRE(boundaries[2] == boundaries[3]);
+                REQUIRE(boundaries.back() == inv.num_docs());
+                DocToRange doc_to_range(boundaries);
+
+                auto doclex_buf = Payload_Vector_Buffer::from_file(fmt::format("{}.doclex", fwd_path));
+                pisa::Payload_Vector<> doclex(doclex_buf);
+                auto bp_doclex_buf =
+                    Payload_Vector_Buffer::from_file(fmt::format("{}.doclex", bp_fwd_path));
+                pisa::Payload_Vector<> bp_doclex(bp_doclex_buf);
+                std::unordered_map<std::string, std::uint32_t> bp_ids;
+                for (std::uint32_t document = 0; document < bp_doclex.size(); ++document) {
+                    bp_ids[std::string(bp_doclex[document])] = document;
+                }
+                for (std::uint32_t document = 0; document < doclex.size(); ++document) {
+                    auto bp_id = bp_ids.at(std::string(doclex[document]));
+                    REQUIRE(doc_to_range(bp_id) == (document % 3) * 2);
+                }
+            }
+        }
+
+        WHEN("Reordered documents with BP within single-document clusters")
+        {
+            auto map_path = (tmp.path() / "clusters.map").string();
+            auto ranges_path = (tmp.path() / "clusters.ranges").string();
+            pisa::binary_freq_collection inv(inv_path.c_str());
+            {
+                std::ofstream os(map_path);
+                for (std::size_t document = 0; document < inv.num_docs(); ++document) {
+                    os << document << '\n';
+                }
+            }
+            int code = recursive_graph_bisection(RecursiveGraphBisectionOptions{
+                .input_basename = inv_path,
+                .output_basename = bp_inv_path,
+                .output_fwd = std::nullopt,
+                .input_fwd = std::nullopt,
+                .document_lexicon = fmt::format("{}.doclex", fwd_path),
+                .reordered_document_lexicon = fmt::format("{}.doclex", bp_fwd_path),
+                .depth = std::nullopt,
+                .node_config = std::nullopt,
+                .min_length = 0,
+                .compress_fwd = false,
+                .print_args = false,
+                .document_clusters = std::nullopt,
+                .cluster_map = map_path,
+                .output_clusters = ranges_path,
+            });
+            REQUIRE(code == 0);
+            THEN("Every cluster is left as it is")
+            {
+                auto expected = coll_to_strings(inv_path, fmt::format("{}.doclex", fwd_path));
+                auto actual = coll_to_strings(bp_inv_path, fmt::format("{}.doclex", bp_fwd_path));
+                compare_strcolls(expected, actual);
+                REQUIRE(read_cluster_ranges(ranges_path).size() == inv.num_docs());
+            }
+        }
     }
 }
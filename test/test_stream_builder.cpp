@@ -4,6 +4,7 @@
 #include <functional>
 
 #include "accumulator/lazy_accumulator.hpp"
+#include "compress.hpp"
 #include "cursor/block_max_scored_cursor.hpp"
 #include "cursor/max_scored_cursor.hpp"
 #include "cursor/scored_cursor.hpp"
@@ -51,3 +52,31 @@ TEST_CASE("Stream builder for block index", "[index]")
     CHECK(expected_bytes.size() == actual_bytes.size());
     REQUIRE(expected_bytes == actual_bytes);
 }
+
+TEST_CASE("Parallel streaming compression matches the sequential builder", "[index]")
+{
+    using index_type = block_simdbp_index;
+
+    binary_freq_collection collection(PISA_SOURCE_DIR "/test/test_data/test_collection");
+    Temporary_Directory tmp;
+    auto expected_path = tmp.path() / "expected";
+    auto actual_path = tmp.path() / "actual";
+
+    typename index_type::builder builder(collection.num_docs(), global_parameters{});
+    for (auto const& plist: collection) {
+        uint64_t freqs_sum = std::accumulate(plist.freqs.begin(), plist.freqs.end(), uint64_t(0));
+        builder.add_posting_list(
+            plist.docs.size(), plist.docs.begin(), plist.freqs.begin(), freqs_sum);
+    }
+    index_type index;
+    builder.build(index);
+    mapper::freeze(index, expected_path.c_str());
+
+    compress_index_streaming<index_type, wand_data<wand_data_raw>>(
+        collection, global_parameters{}, actual_path.string(), std::nullopt, false);
+
+    auto expected_bytes = io::load_data(expected_path.string());
+    auto actual_bytes = io::load_data(actual_path.string());
+    CHECK(expected_bytes.size() == actual_bytes.size());
+    REQUIRE(expected_bytes == actual_bytes);
+}
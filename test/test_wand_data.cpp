@@ -16,9 +16,108 @@
 #include "wand_data_range.hpp"
 
 #include "scorer/scorer.hpp"
+#include "temporary_directory.hpp"
 
 using namespace pisa;
 
+TEST_CASE("DocToRange")
+{
+    SECTION("No clusters")
+    {
+        DocToRange doc_to_range;
+        REQUIRE(doc_to_range.empty());
+        REQUIRE(doc_to_range(0) == 0);
+        REQUIRE(doc_to_range(1000) == 0);
+        REQUIRE(doc_to_range.end(0) == std::numeric_limits<uint64_t>::max());
+    }
+    SECTION("Cluster boundaries")
+    {
+        DocToRange doc_to_range(std::vector<uint32_t>{3, 5, 10});
+        REQUIRE(doc_to_range.size() == 3);
+        std::vector<uint32_t> expected{0, 0, 0, 1, 1, 2, 2, 2, 2, 2, 2, 2};
+        for (uint32_t docid = 0; docid < expected.size(); ++docid) {
+            REQUIRE(doc_to_range(docid) == expected[docid]);
+        }
+        REQUIRE(doc_to_range.end(0) == 3);
+        REQUIRE(doc_to_range.end(1) == 5);
+        REQUIRE(doc_to_range.end(2) == std::numeric_limits<uint64_t>::max());
+    }
+    SECTION("Unsorted boundaries")
+    {
+        REQUIRE_THROWS_AS(DocToRange(std::vector<uint32_t>{5, 3}), std::invalid_argument);
+    }
+}
+
+TEST_CASE("Split cluster ranges")
+{
+    std::vector<uint64_t> volumes{1, 1, 1, 1, 1, 1, 1, 1, 5, 1};
+    SECTION("Oversized ranges are split by posting volume")
+    {
+        auto [boundaries, parents] = split_cluster_ranges({8, 10}, volumes, 4);
+        REQUIRE(boundaries == std::vector<uint32_t>{4, 8, 9, 10});
+        REQUIRE(parents == std::vector<uint32_t>{0, 0, 1, 1});
+    }
+    SECTION("Small ranges are kept and the last range covers all documents")
+    {
+        auto [boundaries, parents] = split_cluster_ranges({3, 8, 20}, volumes, 100);
+        REQUIRE(boundaries == std::vector<uint32_t>{3, 8, 10});
+        REQUIRE(parents == std::vector<uint32_t>{0, 1, 2});
+    }
+    SECTION("A single document is never split")
+    {
+        auto [boundaries, parents] = split_cluster_ranges({8, 9, 10}, volumes, 2);
+        REQUIRE(boundaries == std::vector<uint32_t>{2, 4, 6, 8, 9, 10});
+        REQUIRE(parents == std::vector<uint32_t>{0, 0, 0, 0, 1, 2});
+    }
+}
+
+TEST_CASE("UpperBoundQuantizer rounds up")
+{
+    auto max = GENERATE(0.001F, 1.0F, 7.3F, 1234.5F);
+    UpperBoundQuantizer quantizer(max);
+    REQUIRE(quantizer(max) == 255);
+    REQUIRE(quantizer(0.0F) == 0);
+    for (int step = 1; step <= 1000; ++step) {
+        float value = max * step / 1000;
+        auto quantized = quantizer(value);
+        REQUIRE(quantized * quantizer.scale() >= value);
+        REQUIRE((quantized - 1) * quantizer.scale() < value);
+    }
+}
+
+TEST_CASE("Range-aligned block partitions")
+{
+    binary_freq_collection const collection(PISA_SOURCE_DIR "/test/test_data/test_collection");
+    auto num_docs = static_cast<uint32_t>(collection.num_docs());
+    // The second layout starts with an empty cluster and has an empty one in the middle.
+    auto boundaries = GENERATE_COPY(
+        std::vector<uint32_t>{num_docs / 4, num_docs / 3, num_docs},
+        std::vector<uint32_t>{0, num_docs / 3, num_docs / 3, num_docs});
+    DocToRange doc_to_range(boundaries);
+    auto scorer = [](uint64_t docid, uint64_t freq) { return freq + (docid % 7) / 10.0F; };
+    auto variable = GENERATE(false, true);
+    for (auto const& seq: collection) {
+        auto [block_docid, block_max, range_id, range_max] = variable
+            ? variable_block_partition(collection, seq, scorer, doc_to_range, 12.0, true)
+            : static_block_partition(seq, scorer, 5, doc_to_range, true);
+        REQUIRE(block_docid.back() == *std::prev(seq.docs.end()));
+        uint64_t first = 0;
+        for (auto last: block_docid) {
+            REQUIRE(first <= last);
+            REQUIRE(last < num_docs);
+            REQUIRE(doc_to_range(first) == doc_to_range(last));
+            first = last + 1;
+        }
+        size_t block = 0;
+        for (auto&& [docid, freq]: ranges::views::zip(seq.docs, seq.freqs)) {
+            while (block_docid[block] < docid) {
+                ++block;
+            }
+            REQUIRE(block_max[block] >= scorer(docid, freq));
+        }
+    }
+}
+
 TEST_CASE("wand_data_range")
 {
     tbb::task_scheduler_init init;
@@ -30,6 +129,7 @@ TEST_CASE("wand_data_range")
     binary_freq_collection const collection(PISA_SOURCE_DIR "/test/test_data/test_collection");
     binary_collection document_sizes(PISA_SOURCE_DIR "/test/test_data/test_collection.sizes");
     std::unordered_set<size_t> dropped_term_ids;
+    std::vector<uint32_t> clusters;
     WandType wdata_range(
         document_sizes.begin()->begin(),
         collection.num_docs(),
@@ -37,7 +137,8 @@ TEST_CASE("wand_data_range")
         ScorerParams(scorer_name),
         BlockSize(FixedBlock(5)),
         false,
-        dropped_term_ids);
+        dropped_term_ids,
+        clusters);
 
     auto scorer = scorer::from_params(ScorerParams(scorer_name), wdata_range);
 
@@ -128,3 +229,158 @@ TEST_CASE("wand_data_range")
         }
     }
 }
+
+TEST_CASE("Streaming wand data is identical to frozen wand data")
+{
+    tbb::task_scheduler_init init;
+    binary_freq_collection const collection(PISA_SOURCE_DIR "/test/test_data/test_collection");
+    binary_collection document_sizes(PISA_SOURCE_DIR "/test/test_data/test_collection.sizes");
+    std::unordered_set<size_t> dropped_term_ids{0, 7};
+    auto quantized = GENERATE(false, true);
+    auto block_size = GENERATE(BlockSize(FixedBlock(5)), BlockSize(VariableBlock(12.0)));
+
+    Temporary_Directory tmp;
+    auto frozen_path = (tmp.path() / "frozen").string();
+    auto streamed_path = (tmp.path() / "streamed").string();
+    {
+        std::vector<uint32_t> clusters{500, 1000, static_cast<uint32_t>(collection.num_docs())};
+        wand_data<wand_data_raw> wdata(
+            document_sizes.begin()->begin(),
+            collection.num_docs(),
+            collection,
+            ScorerParams("bm25"),
+            block_size,
+            quantized,
+            dropped_term_ids,
+            clusters);
+        mapper::freeze(wdata, frozen_path.c_str());
+    }
+    {
+        std::vector<uint32_t> clusters{500, 1000, static_cast<uint32_t>(collection.num_docs())};
+        wand_data<wand_data_raw>::stream(
+            streamed_path,
+            document_sizes.begin()->begin(),
+            collection.num_docs(),
+            collection,
+            ScorerParams("bm25"),
+            block_size,
+            quantized,
+            dropped_term_ids,
+            clusters);
+    }
+    auto read_all = [](std::string const& path) {
+        std::ifstream is(path, std::ios::binary);
+        return std::vector<char>(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+    };
+    REQUIRE(read_all(frozen_path) == read_all(streamed_path));
+}
+
+TEST_CASE("Quantized range upper bounds survive freezing and streaming")
+{
+    tbb::task_scheduler_init init;
+    binary_freq_collection const collection(PISA_SOURCE_DIR "/test/test_data/test_collection");
+    binary_collection document_sizes(PISA_SOURCE_DIR "/test/test_data/test_collection.sizes");
+    std::unordered_set<size_t> dropped_term_ids;
+    auto const boundaries =
+        std::vector<uint32_t>{500, 1000, 4000, static_cast<uint32_t>(collection.num_docs())};
+    auto block_size = BlockSize(FixedBlock(5));
+
+    Temporary_Directory tmp;
+    auto frozen_path = (tmp.path() / "frozen").string();
+    auto streamed_path = (tmp.path() / "streamed").string();
+    auto clusters = boundaries;
+    wand_data<wand_data_raw> exact(
+        document_sizes.begin()->begin(),
+        collection.num_docs(),
+        collection,
+        ScorerParams("bm25"),
+        block_size,
+        false,
+        dropped_term_ids,
+        clusters);
+    REQUIRE_FALSE(exact.get_block_wand().quantized_range_bounds());
+    {
+        auto clusters = boundaries;
+        wand_data<wand_data_raw> wdata(
+            document_sizes.begin()->begin(),
+            collection.num_docs(),
+            collection,
+            ScorerParams("bm25"),
+            block_size,
+            false,
+            dropped_term_ids,
+            clusters,
+            true);
+        mapper::freeze(wdata, frozen_path.c_str());
+    }
+    {
+        auto clusters = boundaries;
+        wand_data<wand_data_raw>::stream(
+            streamed_path,
+            document_sizes.begin()->begin(),
+            collection.num_docs(),
+            collection,
+            ScorerParams("bm25"),
+            block_size,
+            false,
+            dropped_term_ids,
+            clusters,
+            true);
+    }
+
+    for (auto const& path: {frozen_path, streamed_path}) {
+        wand_data<wand_data_raw> quantized(MemorySource::mapped_file(path));
+        REQUIRE(quantized.get_block_wand().quantized_range_bounds());
+        REQUIRE(quantized.num_ranges() == exact.num_ranges());
+        for (size_t term_id = 0; term_id < collection.size(); ++term_id) {
+            auto exact_enum = exact.getenum(term_id);
+            auto quantized_enum = quantized.getenum(term_id);
+            for (size_t range = 0; range < exact.num_ranges(); ++range) {
+                CHECKED_ELSE(quantized_enum.range_score(range) >= exact_enum.range_score(range))
+                {
+                    FAIL("Term: " << term_id << " range: " << range << " file: " << path);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Wand data without a format header is rejected")
+{
+    tbb::task_scheduler_init init;
+    binary_freq_collection const collection(PISA_SOURCE_DIR "/test/test_data/test_collection");
+    binary_collection document_sizes(PISA_SOURCE_DIR "/test/test_data/test_collection.sizes");
+    std::unordered_set<size_t> dropped_term_ids;
+    std::vector<uint32_t> clusters;
+
+    Temporary_Directory tmp;
+    auto path = (tmp.path() / "wand").string();
+    {
+        wand_data<wand_data_raw> wdata(
+            document_sizes.begin()->begin(),
+            collection.num_docs(),
+            collection,
+            ScorerParams("bm25"),
+            BlockSize(FixedBlock(5)),
+            false,
+            dropped_term_ids,
+            clusters);
+        mapper::freeze(wdata, path.c_str());
+    }
+    // Strip the magic and flags words, as in files written before they were added.
+    std::vector<char> bytes;
+    {
+        std::ifstream is(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+    }
+    auto header = sizeof(uint64_t);
+    bytes.erase(
+        std::next(bytes.begin(), header),
+        std::next(bytes.begin(), header + wand_data_raw::format_magic.size() + sizeof(uint64_t)));
+    {
+        std::ofstream os(path, std::ios::binary | std::ios::trunc);
+        os.write(bytes.data(), bytes.size());
+    }
+    REQUIRE_THROWS_AS(
+        wand_data<wand_data_raw>(MemorySource::mapped_file(path)), std::runtime_error);
+}
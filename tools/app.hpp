@@ -11,6 +11,7 @@
 #include <range/v3/view/transform.hpp>
 #include <spdlog/spdlog.h>
 
+#include "codec/hybrid.hpp"
 #include "io.hpp"
 #include "query/queries.hpp"
 #include "scorer/scorer.hpp"
@@ -122,6 +123,33 @@ namespace arg {
             return q;
         }
 
+        /// Reads the lines of the query file, or of the standard input, only once, so that
+        /// they can be parsed with several term lexicons.
+        [[nodiscard]] auto query_lines() const -> std::vector<std::string>
+        {
+            std::vector<std::string> lines;
+            auto push_line = [&lines](std::string const& line) { lines.push_back(line); };
+            if (m_query_file) {
+                std::ifstream is(*m_query_file);
+                io::for_each_line(is, push_line);
+            } else {
+                io::for_each_line(std::cin, push_line);
+            }
+            return lines;
+        }
+
+        /// Parses `lines` read with `query_lines`.
+        [[nodiscard]] auto queries(std::vector<std::string> const& lines) const
+            -> std::vector<::pisa::Query>
+        {
+            std::vector<::pisa::Query> q;
+            auto parse_query = resolve_query_parser(q, m_term_lexicon, m_stop_words, m_stemmer);
+            for (auto const& line: lines) {
+                parse_query(line);
+            }
+            return q;
+        }
+
         [[nodiscard]] auto k() const -> int { return m_k; }
 
       protected:
@@ -288,6 +316,15 @@ namespace arg {
                 ->required();
             app->add_option(
                 "--term-count", m_term_count, "Number of distinct terms in the forward index");
+            auto* memory_budget = app->add_option(
+                "--memory-budget",
+                m_memory_budget,
+                "Invert in external memory, sorting runs of at most this many MiB on disk");
+            app->add_option(
+                   "--tmp-dir",
+                   m_tmp_dir,
+                   "Directory for the runs of external inversion (default: system temporary directory)")
+                ->needs(memory_budget);
         }
 
         [[nodiscard]] auto input_basename() const -> std::string { return m_input_basename; }
@@ -296,6 +333,16 @@ namespace arg {
         {
             return m_term_count;
         }
+        /// Memory budget of external inversion in bytes, if requested.
+        [[nodiscard]] auto memory_budget() const -> std::optional<std::size_t>
+        {
+            if (m_memory_budget) {
+                return *m_memory_budget * 1024 * 1024;
+            }
+            return std::nullopt;
+        }
+        /// Directory in which the runs of external inversion are written, if not the default.
+        [[nodiscard]] auto tmp_dir() const -> std::optional<std::string> { return m_tmp_dir; }
 
         /// Transform paths for `shard`.
         void apply_shard(Shard_Id shard)
@@ -308,6 +355,8 @@ namespace arg {
         std::string m_input_basename{};
         std::string m_output_basename{};
         std::optional<std::uint32_t> m_term_count{};
+        std::optional<std::size_t> m_memory_budget{};
+        std::optional<std::string> m_tmp_dir{};
     };
 
     struct Compress {
@@ -316,12 +365,28 @@ namespace arg {
             app->add_option("-c,--collection", m_input_basename, "Forward index basename")->required();
             app->add_option("-o,--output", m_output, "Output inverted index")->required();
             app->add_flag("--check", m_check, "Check the correctness of the index");
+            app->add_option(
+                "--hybrid-policy",
+                m_hybrid_policy,
+                "File of block_hybrid codec selection weights (see the compression docs)");
         }
 
         [[nodiscard]] auto input_basename() const -> std::string { return m_input_basename; }
         [[nodiscard]] auto output() const -> std::string { return m_output; }
         [[nodiscard]] auto check() const -> bool { return m_check; }
 
+        /// Sets the codec selection policy of `block_hybrid` from `--hybrid-policy`, if given.
+        ///
+        /// \throws io::NoSuchFile          if the file doesn't exist
+        /// \throws std::invalid_argument   if the policy is malformed
+        void apply_hybrid_policy() const
+        {
+            if (m_hybrid_policy) {
+                std::ifstream is(io::resolve_path(*m_hybrid_policy).string());
+                hybrid_block::policy() = hybrid_policy::from_stream(is);
+            }
+        }
+
         /// Transform paths for `shard`.
         void apply_shard(Shard_Id shard)
         {
@@ -333,6 +398,7 @@ namespace arg {
         std::string m_input_basename{};
         std::string m_output{};
         bool m_check = false;
+        std::optional<std::string> m_hybrid_policy{};
     };
 
     struct CreateWandData {
@@ -348,6 +414,10 @@ namespace arg {
                     ->add_option("-l,--lambda", m_lambda, "Lambda parameter for variable blocks")
                     ->excludes(block_size_opt);
             block_group->require_option();
+            app->add_flag(
+                "--range-aligned-blocks",
+                m_range_aligned,
+                "Start a new block at every document cluster boundary");
 
             app->add_flag("--compress", m_compress, "Compress additional data");
             app->add_flag("--quantize", m_quantize, "Quantize scores");
@@ -359,6 +429,22 @@ namespace arg {
                 "--terms-to-drop",
                 m_terms_to_drop_filename,
                 "A filename containing a list of term IDs that we want to drop");
+            app->add_flag(
+                   "--streaming",
+                   m_streaming,
+                   "Spill block and range bounds to temporary files to reduce memory usage")
+                ->excludes("--compress")
+                ->excludes("--range");
+            app->add_flag(
+                   "--quantize-range-bounds",
+                   m_quantize_range_bounds,
+                   "Store document cluster upper bounds as 8-bit values")
+                ->excludes("--compress")
+                ->excludes("--range");
+            app->add_option(
+                "--global-stats",
+                m_global_stats_filename,
+                "Score a shard with the statistics of its whole collection (see shards partition-clusters)");
         }
 
         [[nodiscard]] auto input_basename() const -> std::string { return m_input_basename; }
@@ -368,10 +454,10 @@ namespace arg {
         {
             if (m_lambda) {
                 spdlog::info("Lambda {}", *m_lambda);
-                return VariableBlock(*m_lambda);
+                return VariableBlock(*m_lambda, m_range_aligned);
             }
             spdlog::info("Fixed block size: {}", *m_fixed_block_size);
-            return FixedBlock(*m_fixed_block_size);
+            return FixedBlock(*m_fixed_block_size, m_range_aligned);
         }
         [[nodiscard]] auto dropped_term_ids() const
         {
@@ -387,12 +473,18 @@ namespace arg {
         [[nodiscard]] auto compress() const -> bool { return m_compress; }
         [[nodiscard]] auto range() const -> bool { return m_range; }
         [[nodiscard]] auto quantize() const -> bool { return m_quantize; }
+        [[nodiscard]] auto streaming() const -> bool { return m_streaming; }
+        [[nodiscard]] auto quantize_range_bounds() const -> bool { return m_quantize_range_bounds; }
+        [[nodiscard]] auto global_stats_file() const { return m_global_stats_filename; }
 
         /// Transform paths for `shard`.
         void apply_shard(Shard_Id shard)
         {
             m_input_basename = expand_shard(m_input_basename, shard);
             m_output = expand_shard(m_output, shard);
+            if (m_global_stats_filename) {
+                m_global_stats_filename = expand_shard(*m_global_stats_filename, shard);
+            }
         }
 
         template <typename T>
@@ -407,7 +499,11 @@ namespace arg {
         bool m_compress = false;
         bool m_range = false;
         bool m_quantize = false;
+        bool m_streaming = false;
+        bool m_range_aligned = false;
+        bool m_quantize_range_bounds = false;
         std::string m_terms_to_drop_filename;
+        std::optional<std::string> m_global_stats_filename;
     };
 
     struct ReorderDocuments {
@@ -452,6 +548,27 @@ namespace arg {
             app->add_flag("--nogb", m_nogb, "No VarIntGB compression in forward index")->needs(bp);
             app->add_flag("-p,--print", m_print, "Print ordering to standard output")->needs(bp);
             optconf->excludes(optdepth);
+            // ANYTIME: Cluster-preserving BP
+            auto optoutclusters = app->add_option(
+                                         "--output-clusters",
+                                         m_output_clusters,
+                                         "Output cluster range file of the reordered collection")
+                                      ->needs(output);
+            auto optranges = app->add_option(
+                                    "--document-clusters",
+                                    m_document_clusters,
+                                    "Reorder within the ranges of this cluster range file")
+                                 ->needs(bp)
+                                 ->excludes(optconf);
+            app->add_option(
+                   "--cluster-map",
+                   m_cluster_map,
+                   "Group documents by the cluster IDs in this file (one per document) and "
+                   "reorder within each cluster")
+                ->needs(bp)
+                ->needs(optoutclusters)
+                ->excludes(optconf)
+                ->excludes(optranges);
         }
 
         [[nodiscard]] auto input_basename() const -> std::string { return m_input_basename; }
@@ -490,6 +607,18 @@ namespace arg {
         {
             return m_node_config;
         }
+        [[nodiscard]] auto document_clusters() const -> std::optional<std::string>
+        {
+            return m_document_clusters;
+        }
+        [[nodiscard]] auto cluster_map() const -> std::optional<std::string>
+        {
+            return m_cluster_map;
+        }
+        [[nodiscard]] auto output_clusters() const -> std::optional<std::string>
+        {
+            return m_output_clusters;
+        }
 
         void apply_shard(Shard_Id shard)
         {
@@ -513,6 +642,15 @@ namespace arg {
             if (m_feature) {
                 m_feature = expand_shard(*m_feature, shard);
             }
+            if (m_document_clusters) {
+                m_document_clusters = expand_shard(*m_document_clusters, shard);
+            }
+            if (m_cluster_map) {
+                m_cluster_map = expand_shard(*m_cluster_map, shard);
+            }
+            if (m_output_clusters) {
+                m_output_clusters = expand_shard(*m_output_clusters, shard);
+            }
         }
 
       private:
@@ -537,6 +675,9 @@ namespace arg {
         bool m_nogb = false;
         bool m_print = false;
         std::optional<std::string> m_node_config{};
+        std::optional<std::string> m_document_clusters{};
+        std::optional<std::string> m_cluster_map{};
+        std::optional<std::string> m_output_clusters{};
     };
 
     struct Separator {
@@ -588,7 +729,7 @@ namespace arg {
         explicit QueryClusters(CLI::App* app)
         {
              m_option = app->add_option(
-                "--query-clusters", m_clusters_filename, "File containing clusters to visit for each query.");
+                "--query-clusters", m_clusters_filename, "File containing clusters to visit for each query (text or binary).");
         }
 
         [[nodiscard]] auto clusters_file() const { return m_clusters_filename; }
@@ -599,6 +740,125 @@ namespace arg {
         CLI::Option* m_option;
     };
 
+    // ANYTIME: Handles input of the parent cluster of every sub-range (see split-clusters)
+    struct ClusterParents {
+        explicit ClusterParents(CLI::App* app)
+        {
+            m_option = app->add_option(
+                "--cluster-parents",
+                m_cluster_parents_filename,
+                "File mapping sub-ranges to the clusters of --query-clusters.");
+        }
+
+        [[nodiscard]] auto cluster_parents_file() const { return m_cluster_parents_filename; }
+        [[nodiscard]] auto* cluster_parents_option() { return m_option; }
+
+      private:
+        std::optional<std::string> m_cluster_parents_filename;
+        CLI::Option* m_option;
+    };
+
+    // ANYTIME: Handles hot and cold cluster tiers, and recording the cluster visits they come from
+    struct ClusterTiers {
+        explicit ClusterTiers(CLI::App* app)
+        {
+            m_option = app->add_option(
+                "--cluster-tiers",
+                m_cluster_tiers_filename,
+                "File flagging every cluster as hot or cold (see tier-clusters).");
+            app->add_option(
+                   "--cold-cost",
+                   m_cold_cost,
+                   "Expected cost of a cold cluster, relative to a hot one (timeout queries)",
+                   true)
+                ->needs(m_option);
+            auto* cold_tier = app->add_option(
+                "--cold-tier", m_cold_tier_filename, "Cold tier of a tiered clustered index.");
+            app->add_option(
+                   "--cold-tier-budget",
+                   m_cold_tier_budget_mib,
+                   "Release the cold tier after a query once more than this many MiB of it were read.")
+                ->needs(cold_tier);
+            app->add_option(
+                "--record-cluster-visits",
+                m_cluster_visits_filename,
+                "Output file counting the visits of the anytime algorithms to each cluster.");
+        }
+
+        [[nodiscard]] auto cluster_tiers_file() const { return m_cluster_tiers_filename; }
+        [[nodiscard]] auto cold_cost() const { return m_cold_cost; }
+        [[nodiscard]] auto cold_tier_file() const { return m_cold_tier_filename; }
+        [[nodiscard]] auto cold_tier_budget_mib() const { return m_cold_tier_budget_mib; }
+        [[nodiscard]] auto cluster_visits_file() const { return m_cluster_visits_filename; }
+        [[nodiscard]] auto* cluster_tiers_option() { return m_option; }
+
+      private:
+        std::optional<std::string> m_cluster_tiers_filename;
+        float m_cold_cost = 4.0;
+        std::optional<std::string> m_cold_tier_filename;
+        std::size_t m_cold_tier_budget_mib = 0;
+        std::optional<std::string> m_cluster_visits_filename;
+        CLI::Option* m_option;
+    };
+
+    // ANYTIME: Handles input of term-pair range upper bounds
+    struct PairBounds {
+        explicit PairBounds(CLI::App* app)
+        {
+             m_option = app->add_option(
+                "--pair-bounds", m_pair_bounds_filename, "File containing term-pair range upper bounds (BoundSum queries).");
+        }
+
+        [[nodiscard]] auto pair_bounds_file() const { return m_pair_bounds_filename; }
+        [[nodiscard]] auto* pair_bounds_option() { return m_option; }
+
+      private:
+        std::optional<std::string> m_pair_bounds_filename;
+        CLI::Option* m_option;
+    };
+
+    // ANYTIME: Handles input of per-range term statistics, used to select clusters at query time
+    struct RangeStats {
+        explicit RangeStats(CLI::App* app)
+        {
+        m_option = app->add_option(
+                "--range-stats", m_range_stats_filename, "File containing per-range term statistics; ordered range queries then select clusters themselves.");
+        }
+
+        [[nodiscard]] auto range_stats_file() const { return m_range_stats_filename; }
+        [[nodiscard]] auto* range_stats_option() { return m_option; }
+
+      private:
+        std::optional<std::string> m_range_stats_filename;
+        CLI::Option* m_option;
+    };
+
+    // ANYTIME: Handles input of per-range Taily statistics, used to select clusters at query time
+    struct RangeTailyStats {
+        explicit RangeTailyStats(CLI::App* app)
+        {
+            m_option = app->add_option(
+                "--range-taily-stats",
+                m_range_taily_stats_filename,
+                "File containing per-range Taily statistics; ordered range queries then select clusters themselves.");
+            app->add_option(
+                   "--taily-epsilon",
+                   m_epsilon,
+                   "Stop selecting clusters once the rest are expected to hold fewer top-k documents",
+                   true)
+                ->needs(m_option);
+        }
+
+        [[nodiscard]] auto range_taily_stats_file() const { return m_range_taily_stats_filename; }
+        [[nodiscard]] auto taily_epsilon() const { return m_epsilon; }
+        [[nodiscard]] auto* range_taily_stats_option() { return m_option; }
+
+      private:
+        std::optional<std::string> m_range_taily_stats_filename;
+        double m_epsilon = 0.0;
+        CLI::Option* m_option;
+    };
+
 }  // namespace arg
 
 template <typename... Args>
@@ -623,11 +883,16 @@ struct Args: public T... {
     }
 };
 
-using InvertArgs = Args<arg::Invert, arg::Threads, arg::BatchSize<100'000>>;
+using InvertArgs =
+    Args<arg::Invert, arg::Threads, arg::BatchSize<100'000>, arg::DocumentClusters>;
 using ReorderDocuments = Args<arg::ReorderDocuments, arg::Threads>;
-using CompressArgs =
-    pisa::Args<arg::Compress, arg::Encoding, arg::Quantize<arg::ScorerMode::Optional>>;
-using CreateWandDataArgs = pisa::Args<arg::CreateWandData, arg::DocumentClusters>;
+using CompressArgs = pisa::Args<
+    arg::Compress,
+    arg::Encoding,
+    arg::Quantize<arg::ScorerMode::Optional>,
+    arg::DocumentClusters,
+    arg::Threads>;
+using CreateWandDataArgs = pisa::Args<arg::CreateWandData, arg::DocumentClusters, arg::Threads>;
 
 struct TailyStatsArgs: pisa::Args<arg::WandData<arg::WandMode::Required>, arg::Scorer> {
     explicit TailyStatsArgs(CLI::App* app)
@@ -654,6 +919,196 @@ struct TailyStatsArgs: pisa::Args<arg::WandData<arg::WandMode::Required>, arg::S
     std::string m_output_path;
 };
 
+struct CreatePairBoundsArgs
+    : pisa::Args<arg::WandData<arg::WandMode::Required>, arg::Scorer, arg::Threads> {
+    explicit CreatePairBoundsArgs(CLI::App* app)
+        : pisa::Args<arg::WandData<arg::WandMode::Required>, arg::Scorer, arg::Threads>(app)
+    {
+        app->add_option("-c,--collection", m_collection_path, "Binary collection basename")->required();
+        app->add_option("-p,--pairs", m_pairs_path, "A tab separated file containing term pairs")
+            ->required();
+        app->add_option("-o,--output", m_output_path, "Output file path")->required();
+        app->set_config("--config", "", "Configuration .ini file", false);
+    }
+
+    [[nodiscard]] auto collection_path() const -> std::string const& { return m_collection_path; }
+    [[nodiscard]] auto pairs_path() const -> std::string const& { return m_pairs_path; }
+    [[nodiscard]] auto output_path() const -> std::string const& { return m_output_path; }
+
+  private:
+    std::string m_collection_path;
+    std::string m_pairs_path;
+    std::string m_output_path;
+};
+
+struct CreateRangeStatsArgs: pisa::Args<arg::WandData<arg::WandMode::Required>> {
+    explicit CreateRangeStatsArgs(CLI::App* app)
+        : pisa::Args<arg::WandData<arg::WandMode::Required>>(app)
+    {
+        app->add_option("-c,--collection", m_collection_path, "Binary collection basename")->required();
+        app->add_option("-o,--output", m_output_path, "Output file path")->required();
+        app->set_config("--config", "", "Configuration .ini file", false);
+    }
+
+    [[nodiscard]] auto collection_path() const -> std::string const& { return m_collection_path; }
+    [[nodiscard]] auto output_path() const -> std::string const& { return m_output_path; }
+
+  private:
+    std::string m_collection_path;
+    std::string m_output_path;
+};
+
+struct RangeTailyStatsArgs
+    : pisa::Args<arg::WandData<arg::WandMode::Required>, arg::Scorer, arg::DocumentClusters> {
+    explicit RangeTailyStatsArgs(CLI::App* app)
+        : pisa::Args<arg::WandData<arg::WandMode::Required>, arg::Scorer, arg::DocumentClusters>(app)
+    {
+        app->add_option("-c,--collection", m_collection_path, "Binary collection basename")->required();
+        app->add_option("-o,--output", m_output_path, "Output file path")->required();
+        app->set_config("--config", "", "Configuration .ini file", false);
+    }
+
+    [[nodiscard]] auto collection_path() const -> std::string const& { return m_collection_path; }
+    [[nodiscard]] auto output_path() const -> std::string const& { return m_output_path; }
+
+  private:
+    std::string m_collection_path;
+    std::string m_output_path;
+};
+
+struct ClusterDocumentsArgs: pisa::Args<arg::Threads> {
+    explicit ClusterDocumentsArgs(CLI::App* app) : pisa::Args<arg::Threads>(app)
+    {
+        app->add_option("-c,--collection", m_input_basename, "Collection basename")->required();
+        app->add_option("-o,--output", m_output_basename, "Output basename")->required();
+        app->add_option(
+               "--output-clusters", m_output_clusters, "Output cluster range file of the reordered collection")
+            ->required();
+        app->add_option("-k,--clusters", m_num_clusters, "Number of clusters")->required();
+        auto docs_opt = app->add_option("--documents", m_doclex, "Document lexicon");
+        app->add_option("--reordered-documents", m_reordered_doclex, "Reordered document lexicon")
+            ->needs(docs_opt);
+        app->add_option("--fwdidx", m_input_fwd, "Use this forward index");
+        app->add_option("-m,--min-len", m_min_len, "Minimum list threshold");
+        app->add_option("--sample-size", m_sample_size, "Number of documents to fit clusters on", true);
+        app->add_option("--iterations", m_iterations, "Number of k-means iterations", true);
+        app->add_option(
+            "--centroid-terms", m_centroid_terms, "Number of terms kept in each centroid", true);
+        app->add_option("--seed", m_seed, "Random seed.");
+        app->set_config("--config", "", "Configuration .ini file", false);
+    }
+
+    [[nodiscard]] auto input_basename() const -> std::string const& { return m_input_basename; }
+    [[nodiscard]] auto output_basename() const -> std::string const& { return m_output_basename; }
+    [[nodiscard]] auto output_clusters() const -> std::string const& { return m_output_clusters; }
+    [[nodiscard]] auto document_lexicon() const { return m_doclex; }
+    [[nodiscard]] auto reordered_document_lexicon() const { return m_reordered_doclex; }
+    [[nodiscard]] auto input_fwd() const { return m_input_fwd; }
+    [[nodiscard]] auto num_clusters() const -> std::size_t { return m_num_clusters; }
+    [[nodiscard]] auto min_length() const -> std::size_t { return m_min_len; }
+    [[nodiscard]] auto sample_size() const -> std::size_t { return m_sample_size; }
+    [[nodiscard]] auto iterations() const -> std::size_t { return m_iterations; }
+    [[nodiscard]] auto centroid_terms() const -> std::size_t { return m_centroid_terms; }
+    [[nodiscard]] auto seed() const -> std::uint64_t { return m_seed; }
+
+  private:
+    std::string m_input_basename{};
+    std::string m_output_basename{};
+    std::string m_output_clusters{};
+    std::optional<std::string> m_doclex{};
+    std::optional<std::string> m_reordered_doclex{};
+    std::optional<std::string> m_input_fwd{};
+    std::size_t m_num_clusters = 0;
+    std::size_t m_min_len = 0;
+    std::size_t m_sample_size = 100000;
+    std::size_t m_iterations = 10;
+    std::size_t m_centroid_terms = 10000;
+    std::uint64_t m_seed = std::random_device{}();
+};
+
+struct SplitClustersArgs: pisa::Args<arg::DocumentClusters> {
+    explicit SplitClustersArgs(CLI::App* app) : pisa::Args<arg::DocumentClusters>(app)
+    {
+        clusters_option()->required();
+        app->add_option("-c,--collection", m_collection_path, "Binary collection basename")->required();
+        app->add_option("-o,--output", m_output_path, "Output cluster range file")->required();
+        app->add_option(
+               "--output-parents", m_parents_path, "Output file mapping sub-ranges to their clusters")
+            ->required();
+        app->add_option(
+               "--target-postings", m_target_postings, "Target number of postings per sub-range")
+            ->required();
+        app->set_config("--config", "", "Configuration .ini file", false);
+    }
+
+    [[nodiscard]] auto collection_path() const -> std::string const& { return m_collection_path; }
+    [[nodiscard]] auto output_path() const -> std::string const& { return m_output_path; }
+    [[nodiscard]] auto parents_path() const -> std::string const& { return m_parents_path; }
+    [[nodiscard]] auto target_postings() const -> std::uint64_t { return m_target_postings; }
+
+  private:
+    std::string m_collection_path;
+    std::string m_output_path;
+    std::string m_parents_path;
+    std::uint64_t m_target_postings = 0;
+};
+
+struct PartitionClustersArgs: pisa::Args<arg::DocumentClusters, arg::Threads> {
+    explicit PartitionClustersArgs(CLI::App* app)
+        : pisa::Args<arg::DocumentClusters, arg::Threads>(app)
+    {
+        clusters_option()->required();
+        app->add_option("-c,--collection", m_input_basename, "Collection basename")->required();
+        app->add_option("-o,--output", m_output_basename, "Basename of the shards")->required();
+        app->add_option("--terms", m_terms_file, "Term list of the collection, one per line");
+        app->add_option(
+            "--documents", m_documents_file, "Document titles of the collection, one per line");
+        app->set_config("--config", "", "Configuration .ini file", false);
+    }
+
+    [[nodiscard]] auto input_basename() const -> std::string const& { return m_input_basename; }
+    [[nodiscard]] auto output_basename() const -> std::string const& { return m_output_basename; }
+    [[nodiscard]] auto terms_file() const { return m_terms_file; }
+    [[nodiscard]] auto documents_file() const { return m_documents_file; }
+
+  private:
+    std::string m_input_basename;
+    std::string m_output_basename;
+    std::optional<std::string> m_terms_file;
+    std::optional<std::string> m_documents_file;
+};
+
+struct TierClustersArgs: pisa::Args<> {
+    explicit TierClustersArgs(CLI::App* app) : pisa::Args<>(app)
+    {
+        app->add_option("-i,--index", m_index_path, "Interleaved clustered index")->required();
+        app->add_option("--visits", m_visits_path, "Cluster visits (see --record-cluster-visits)")
+            ->required();
+        app->add_option(
+            "--hot-fraction", m_hot_fraction, "Fraction of the visits served by hot clusters", true);
+        app->add_option("-o,--output", m_output_path, "Output tiered index")->required();
+        app->add_option("--cold-output", m_cold_output_path, "Output cold tier")->required();
+        app->add_option("--output-tiers", m_tiers_path, "Output file flagging clusters as hot or cold")
+            ->required();
+        app->set_config("--config", "", "Configuration .ini file", false);
+    }
+
+    [[nodiscard]] auto index_path() const -> std::string const& { return m_index_path; }
+    [[nodiscard]] auto visits_path() const -> std::string const& { return m_visits_path; }
+    [[nodiscard]] auto hot_fraction() const -> double { return m_hot_fraction; }
+    [[nodiscard]] auto output_path() const -> std::string const& { return m_output_path; }
+    [[nodiscard]] auto cold_output_path() const -> std::string const& { return m_cold_output_path; }
+    [[nodiscard]] auto tiers_path() const -> std::string const& { return m_tiers_path; }
+
+  private:
+    std::string m_index_path;
+    std::string m_visits_path;
+    double m_hot_fraction = 0.9;
+    std::string m_output_path;
+    std::string m_cold_output_path;
+    std::string m_tiers_path;
+};
+
 struct TailyRankArgs: pisa::Args<arg::Query<arg::QueryMode::Ranked>> {
     explicit TailyRankArgs(CLI::App* app) : pisa::Args<arg::Query<arg::QueryMode::Ranked>>(app)
     {
@@ -696,4 +1151,60 @@ struct TailyThresholds: pisa::Args<arg::Query<arg::QueryMode::Ranked>> {
     std::string m_stats;
 };
 
+struct FederatedQueriesArgs: pisa::Args<
+                                 arg::Encoding,
+                                 arg::WandData<arg::WandMode::Required>,
+                                 arg::Query<arg::QueryMode::Ranked>,
+                                 arg::Algorithm,
+                                 arg::Scorer,
+                                 arg::Threads> {
+    explicit FederatedQueriesArgs(CLI::App* app)
+        : pisa::Args<
+            arg::Encoding,
+            arg::WandData<arg::WandMode::Required>,
+            arg::Query<arg::QueryMode::Ranked>,
+            arg::Algorithm,
+            arg::Scorer,
+            arg::Threads>(app)
+    {
+        arg::Query<arg::QueryMode::Ranked>::terms_option()->required(true);
+        app->add_option("-i,--index", m_index, "Shard inverted indexes")->required();
+        app->add_option("--shard-terms", m_shard_term_lexicon, "Shard-level term lexicons")->required();
+        app->add_option("--documents", m_documents, "Document lexicon of the whole collection")
+            ->required();
+        app->add_option("-r,--run", m_run_id, "Run identifier");
+        app->add_flag("--quantized", m_quantized, "Quantized scores");
+        app->add_option("--timeout", m_timeout, "Query timeout in microseconds (for timeout queries).");
+        app->add_option("--risk", m_risk_factor, "Risk factor (for timeout queries)");
+        app->add_option("--max-clusters", m_max_clusters, "The maximum number of clusters to visit.");
+    }
+
+    [[nodiscard]] auto index_filename() const -> std::string const& { return m_index; }
+    [[nodiscard]] auto documents_file() const -> std::string const& { return m_documents; }
+    [[nodiscard]] auto run_id() const -> std::string const& { return m_run_id; }
+    [[nodiscard]] auto quantized() const -> bool { return m_quantized; }
+    [[nodiscard]] auto timeout() const -> std::size_t { return m_timeout; }
+    [[nodiscard]] auto risk_factor() const -> float { return m_risk_factor; }
+    [[nodiscard]] auto max_clusters() const -> std::size_t { return m_max_clusters; }
+
+    /// Transform paths for `shard`.
+    void apply_shard(Shard_Id shard)
+    {
+        m_index = expand_shard(m_index, shard);
+        arg::WandData<arg::WandMode::Required>::apply_shard(shard);
+        m_shard_term_lexicon = expand_shard(m_shard_term_lexicon, shard);
+        override_term_lexicon(m_shard_term_lexicon);
+    }
+
+  private:
+    std::string m_index;
+    std::string m_shard_term_lexicon;
+    std::string m_documents;
+    std::string m_run_id = "R0";
+    bool m_quantized = false;
+    std::size_t m_timeout = 0;
+    float m_risk_factor = 1.0F;
+    std::size_t m_max_clusters = 0;
+};
+
 }  // namespace pisa
@@ -0,0 +1,32 @@
+#include <CLI/CLI.hpp>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+#include <tbb/global_control.h>
+
+#include "app.hpp"
+#include "ciff.hpp"
+#include "memory_source.hpp"
+
+int main(int argc, const char** argv)
+{
+    spdlog::drop("");
+    spdlog::set_default_logger(spdlog::stderr_color_mt(""));
+
+    std::string ciff_file;
+    std::string output_basename;
+
+    CLI::App app{"Converts a CIFF index into an uncompressed PISA collection."};
+    app.add_option("--ciff-file", ciff_file, "CIFF index file")->required();
+    app.add_option("-o,--output", output_basename, "Output collection basename")->required();
+    pisa::Args<pisa::arg::Threads> args(&app);
+    CLI11_PARSE(app, argc, argv);
+
+    tbb::global_control control(tbb::global_control::max_allowed_parallelism, args.threads() + 1);
+    spdlog::info("Number of worker threads: {}", args.threads());
+    try {
+        pisa::ciff::to_collection(pisa::MemorySource::mapped_file(ciff_file), output_basename);
+    } catch (std::exception const& err) {
+        spdlog::error("{}", err.what());
+        return 1;
+    }
+}
@@ -0,0 +1,39 @@
+#include <CLI/CLI.hpp>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+#include <tbb/global_control.h>
+
+#include "app.hpp"
+#include "document_clustering.hpp"
+
+int main(int argc, const char** argv)
+{
+    spdlog::drop("");
+    spdlog::set_default_logger(spdlog::stderr_color_mt(""));
+
+    CLI::App app{"Clusters documents with k-means and reassigns their IDs so that clusters are contiguous."};
+    pisa::ClusterDocumentsArgs args(&app);
+    CLI11_PARSE(app, argc, argv);
+    tbb::global_control control(tbb::global_control::max_allowed_parallelism, args.threads() + 1);
+    spdlog::info("Number of worker threads: {}", args.threads());
+
+    try {
+        return pisa::cluster_documents(pisa::KMeansClusteringOptions{
+            .input_basename = args.input_basename(),
+            .output_basename = args.output_basename(),
+            .output_clusters = args.output_clusters(),
+            .input_fwd = args.input_fwd(),
+            .document_lexicon = args.document_lexicon(),
+            .reordered_document_lexicon = args.reordered_document_lexicon(),
+            .num_clusters = args.num_clusters(),
+            .sample_size = args.sample_size(),
+            .iterations = args.iterations(),
+            .centroid_terms = args.centroid_terms(),
+            .min_length = args.min_length(),
+            .seed = args.seed(),
+        });
+    } catch (std::exception const& err) {
+        spdlog::error("{}", err.what());
+        return 1;
+    }
+}
@@ -0,0 +1,49 @@
+#include <iostream>
+
+#include <CLI/CLI.hpp>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include "clusters.hpp"
+
+using namespace pisa;
+
+int main(int argc, const char** argv)
+{
+    spdlog::drop("");
+    spdlog::set_default_logger(spdlog::stderr_color_mt(""));
+
+    std::string input;
+    std::string output;
+    bool print = false;
+
+    CLI::App app{"Converts the clusters to visit for each query to the binary format."};
+    app.add_option("-i,--input", input, "File of clusters to visit for each query")->required();
+    auto* out = app.add_option("-o,--output", output, "Binary output file");
+    app.add_flag("--print", print, "Print a binary file back in the text format")->excludes(out);
+    CLI11_PARSE(app, argc, argv);
+    if (not print && output.empty()) {
+        spdlog::error("Either --output or --print is required");
+        return 1;
+    }
+
+    try {
+        if (print) {
+            auto selected_clusters = SelectedClusters::from_mapped(input);
+            selected_clusters.for_each([](auto id, auto const& clusters) {
+                std::cout << id << ':';
+                for (auto cluster: clusters) {
+                    std::cout << ' ' << cluster;
+                }
+                std::cout << '\n';
+            });
+            return 0;
+        }
+        auto selected_clusters = read_selected_clusters(input);
+        spdlog::info("Read {} queries worth of selected clusters.", selected_clusters.size());
+        write_selected_clusters(selected_clusters, output);
+    } catch (std::exception const& err) {
+        spdlog::error("{}", err.what());
+        return 1;
+    }
+}
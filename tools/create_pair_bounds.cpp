@@ -0,0 +1,52 @@
+#include <CLI/CLI.hpp>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+#include <tbb/global_control.h>
+
+#include "app.hpp"
+#include "binary_freq_collection.hpp"
+#include "mappable/mapper.hpp"
+#include "memory_source.hpp"
+#include "range_pair_bounds.hpp"
+#include "wand_data.hpp"
+#include "wand_data_compressed.hpp"
+#include "wand_data_raw.hpp"
+
+using pisa::wand_data;
+using pisa::wand_data_compressed;
+using pisa::wand_data_raw;
+
+template <typename Wand>
+void create_pair_bounds(pisa::CreatePairBoundsArgs const& args)
+{
+    pisa::binary_freq_collection collection(args.collection_path().c_str());
+    Wand wdata(pisa::MemorySource::mapped_file(args.wand_data_path()));
+    auto pairs = pisa::read_term_pairs(args.pairs_path());
+    spdlog::info("Number of pairs loaded: {}", pairs.size());
+    pisa::range_pair_bounds bounds(collection, wdata, args.scorer_params(), pairs);
+    spdlog::info("Stored bounds of {} pairs over {} ranges", bounds.size(), bounds.num_ranges());
+    pisa::mapper::freeze(bounds, args.output_path().c_str());
+}
+
+int main(int argc, const char** argv)
+{
+    spdlog::drop("");
+    spdlog::set_default_logger(spdlog::stderr_color_mt(""));
+
+    CLI::App app{"Computes per-range upper bounds of term pairs for BoundSum queries."};
+    pisa::CreatePairBoundsArgs args(&app);
+    CLI11_PARSE(app, argc, argv);
+    tbb::global_control control(tbb::global_control::max_allowed_parallelism, args.threads() + 1);
+    spdlog::info("Number of worker threads: {}", args.threads());
+
+    try {
+        if (args.is_wand_compressed()) {
+            create_pair_bounds<wand_data<wand_data_compressed<>>>(args);
+        } else {
+            create_pair_bounds<wand_data<wand_data_raw>>(args);
+        }
+    } catch (std::exception const& err) {
+        spdlog::error("{}", err.what());
+        return 1;
+    }
+}
@@ -0,0 +1,47 @@
+#include <CLI/CLI.hpp>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include "app.hpp"
+#include "binary_freq_collection.hpp"
+#include "mappable/mapper.hpp"
+#include "memory_source.hpp"
+#include "range_statistics.hpp"
+#include "wand_data.hpp"
+#include "wand_data_compressed.hpp"
+#include "wand_data_raw.hpp"
+
+using pisa::wand_data;
+using pisa::wand_data_compressed;
+using pisa::wand_data_raw;
+
+template <typename Wand>
+void create_range_stats(pisa::CreateRangeStatsArgs const& args)
+{
+    pisa::binary_freq_collection collection(args.collection_path().c_str());
+    Wand wdata(pisa::MemorySource::mapped_file(args.wand_data_path()));
+    pisa::range_statistics stats(collection, wdata);
+    spdlog::info("Stored statistics of {} terms over {} ranges", stats.num_terms(), stats.num_ranges());
+    pisa::mapper::freeze(stats, args.output_path().c_str());
+}
+
+int main(int argc, const char** argv)
+{
+    spdlog::drop("");
+    spdlog::set_default_logger(spdlog::stderr_color_mt(""));
+
+    CLI::App app{"Computes per-range term statistics for selecting clusters at query time."};
+    pisa::CreateRangeStatsArgs args(&app);
+    CLI11_PARSE(app, argc, argv);
+
+    try {
+        if (args.is_wand_compressed()) {
+            create_range_stats<wand_data<wand_data_compressed<>>>(args);
+        } else {
+            create_range_stats<wand_data<wand_data_raw>>(args);
+        }
+    } catch (std::exception const& err) {
+        spdlog::error("{}", err.what());
+        return 1;
+    }
+}
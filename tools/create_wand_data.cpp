@@ -1,4 +1,7 @@
 #include "CLI/CLI.hpp"
+#include "spdlog/spdlog.h"
+#include "tbb/global_control.h"
+
 #include "app.hpp"
 #include "wand_data.hpp"
 
@@ -7,6 +10,8 @@ int main(int argc, const char** argv)
     CLI::App app{"Creates additional data for query processing."};
     pisa::CreateWandDataArgs args(&app);
     CLI11_PARSE(app, argc, argv);
+    tbb::global_control control(tbb::global_control::max_allowed_parallelism, args.threads() + 1);
+    spdlog::info("Number of worker threads: {}", args.threads());
     pisa::create_wand_data(
         args.output(),
         args.input_basename(),
@@ -16,5 +21,8 @@ int main(int argc, const char** argv)
         args.compress(),
         args.quantize(),
         args.dropped_term_ids(),
-        args.clusters_file());
+        args.clusters_file(),
+        args.streaming(),
+        args.quantize_range_bounds(),
+        args.global_stats_file());
 }
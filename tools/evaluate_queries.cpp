@@ -4,6 +4,7 @@
 
 #include <CLI/CLI.hpp>
 #include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <functional>
 #include <mappable/mapper.hpp>
@@ -16,6 +17,7 @@
 
 #include "accumulator/lazy_accumulator.hpp"
 #include "app.hpp"
+#include "cluster_tiers.hpp"
 #include "clusters.hpp"
 #include "cursor/block_max_scored_cursor.hpp"
 #include "cursor/max_scored_cursor.hpp"
@@ -23,6 +25,9 @@
 #include "index_types.hpp"
 #include "io.hpp"
 #include "query/algorithm.hpp"
+#include "range_pair_bounds.hpp"
+#include "range_statistics.hpp"
+#include "range_taily_stats.hpp"
 #include "scorer/scorer.hpp"
 #include "util/util.hpp"
 #include "wand_data_compressed.hpp"
@@ -39,6 +44,16 @@ void evaluate_queries(
     const std::vector<Query>& queries,
     const std::optional<std::string>& thresholds_filename,
     const std::optional<std::string>& clusters_filename,
+    const std::optional<std::string>& cluster_parents_filename,
+    const std::optional<std::string>& pair_bounds_filename,
+    const std::optional<std::string>& range_stats_filename,
+    const std::optional<std::string>& range_taily_stats_filename,
+    double taily_epsilon,
+    const std::optional<std::string>& cluster_tiers_filename,
+    const float cold_cost,
+    const std::optional<std::string>& cold_tier_filename,
+    const size_t cold_tier_budget_mib,
+    const std::optional<std::string>& cluster_visits_filename,
     std::string const& type,
     std::string const& query_type,
     uint64_t k,
@@ -51,22 +66,101 @@ void evaluate_queries(
     std::string const& iteration)
 {
     IndexType index(MemorySource::mapped_file(index_filename));
+
+    // ANYTIME: Attach the cold tier of a tiered clustered index; it is mapped on first access
+    if constexpr (std::is_same_v<typename IndexType::index_layout_tag, ClusteredIndexTag>) {
+        if (cold_tier_filename) {
+            index.open_cold_tier(*cold_tier_filename);
+        } else if (index.is_tiered()) {
+            spdlog::error("The index is tiered, but no --cold-tier was given.");
+            std::exit(1);
+        }
+    } else if (cold_tier_filename) {
+        spdlog::error("Only clustered indexes have a cold tier.");
+        std::exit(1);
+    }
+
     WandType const wdata(MemorySource::mapped_file(wand_data_filename));
 
     // ANYTIME: Grab the ranges from the wand data structure
     auto all_ranges = wdata.all_ranges();
  
-    // ANYTIME: Read the input clusters (if any)
-    std::unordered_map<std::string, cluster_queue> ordered_clusters;
+    // ANYTIME: Read the input clusters (if any), in either the text or the binary format
+    std::vector<cluster_queue> ordered_clusters(queries.size());
     if (clusters_filename) {
-        ordered_clusters = read_selected_clusters(*clusters_filename);
-        spdlog::info("Read {} queries worth of selected clusters.", ordered_clusters.size());
-        if (ordered_clusters.size() != queries.size()) {
-            spdlog::error("Mismatch in length between queries ({}) and clusters ({}).", queries.size(), ordered_clusters.size());
+        ordered_clusters = read_query_clusters(*clusters_filename, queries);
+    }
+
+    // ANYTIME: Expand the clusters of each query into their sub-ranges (if the clusters were split)
+    if (cluster_parents_filename) {
+        auto parents = read_cluster_parents(*cluster_parents_filename);
+        if (parents.size() != std::max<size_t>(all_ranges.size(), 1)) {
+            spdlog::error("Mismatch in ranges between wand data ({}) and cluster parents ({}).", all_ranges.size(), parents.size());
+            std::exit(1);
+        }
+        for (auto& queue: ordered_clusters) {
+            queue = expand_cluster_queue(queue, parents);
+        }
+    }
+
+    // ANYTIME: Read the term-pair range bounds (if any), used by BoundSum queries
+    std::optional<range_pair_bounds> pair_bounds;
+    if (pair_bounds_filename) {
+        pair_bounds.emplace(MemorySource::mapped_file(*pair_bounds_filename));
+        spdlog::info("Read range bounds of {} term pairs.", pair_bounds->size());
+        if (pair_bounds->num_ranges() != std::max<size_t>(all_ranges.size(), 1)) {
+            spdlog::error("Mismatch in ranges between wand data ({}) and pair bounds ({}).", all_ranges.size(), pair_bounds->num_ranges());
+            std::exit(1);
+        }
+    }
+    range_pair_bounds const* pair_bounds_ptr = pair_bounds ? &*pair_bounds : nullptr;
+
+    // ANYTIME: Read the per-range term or Taily statistics (if any), used to select clusters at query time
+    if (range_stats_filename && range_taily_stats_filename) {
+        spdlog::error("Only one of --range-stats and --range-taily-stats can be used.");
+        std::exit(1);
+    }
+    std::optional<range_statistics> range_stats;
+    std::optional<range_taily_stats> range_taily;
+    std::function<cluster_queue(Query const&)> range_selector;
+    if (range_stats_filename) {
+        range_stats.emplace(MemorySource::mapped_file(*range_stats_filename));
+        if (range_stats->num_ranges() != std::max<size_t>(all_ranges.size(), 1)) {
+            spdlog::error("Mismatch in ranges between wand data ({}) and range statistics ({}).", all_ranges.size(), range_stats->num_ranges());
             std::exit(1);
         }
+        range_selector = cori_range_selector(*range_stats);
+    }
+    if (range_taily_stats_filename) {
+        range_taily.emplace(MemorySource::mapped_file(*range_taily_stats_filename));
+        if (range_taily->num_ranges() != std::max<size_t>(all_ranges.size(), 1)) {
+            spdlog::error("Mismatch in ranges between wand data ({}) and range Taily statistics ({}).", all_ranges.size(), range_taily->num_ranges());
+            std::exit(1);
+        }
+        range_selector = taily_range_selector(*range_taily, k, taily_epsilon);
     }
  
+    // ANYTIME: Read the cluster tiers (if any), or only count the visits to each cluster
+    std::optional<cluster_tiers> tiers;
+    if (cluster_tiers_filename) {
+        auto cold = read_cluster_tiers(*cluster_tiers_filename);
+        if (cold.size() != std::max<size_t>(all_ranges.size(), 1)) {
+            spdlog::error("Mismatch in ranges between wand data ({}) and cluster tiers ({}).", all_ranges.size(), cold.size());
+            std::exit(1);
+        }
+        tiers.emplace(std::move(cold), cold_cost);
+    } else if (cluster_visits_filename) {
+        tiers.emplace(std::max<size_t>(all_ranges.size(), 1));
+    }
+    cluster_tiers* tiers_ptr = tiers ? &*tiers : nullptr;
+
+    // ANYTIME: Cold clusters already read cost as much as hot ones, until the tier is released
+    if constexpr (std::is_same_v<typename IndexType::index_layout_tag, ClusteredIndexTag>) {
+        if (tiers && index.is_tiered()) {
+            tiers->track_residency([&index](std::size_t cluster) { return index.is_resident(cluster); });
+        }
+    }
+
     auto scorer = scorer::from_params(scorer_params, wdata);
     std::function<std::vector<std::pair<float, uint64_t>>(Query, const cluster_queue&)> query_fun;
 
@@ -82,7 +176,7 @@ void evaluate_queries(
     } else if (query_type == "wand_ordered_range") {
         query_fun = [&](Query query, const cluster_queue& ordered_clusters) {
             topk_queue topk(k);
-            wand_query wand_q(topk, all_ranges);
+            wand_query wand_q(topk, all_ranges, nullptr, tiers_ptr);
             wand_q.ordered_range_query(
                 make_max_scored_cursors(index, wdata, *scorer, query), ordered_clusters, max_clusters);
             topk.finalize();
@@ -92,7 +186,7 @@ void evaluate_queries(
     } else if (query_type == "wand_boundsum") {
         query_fun = [&](Query query, const cluster_queue&) {
             topk_queue topk(k);
-            wand_query wand_q(topk, all_ranges);
+            wand_query wand_q(topk, all_ranges, pair_bounds_ptr, tiers_ptr);
             wand_q.boundsum_range_query(
                 make_max_scored_cursors(index, wdata, *scorer, query), max_clusters);
             topk.finalize();
@@ -102,7 +196,7 @@ void evaluate_queries(
     } else if (query_type == "wand_boundsum_timeout") {
         query_fun = [&](Query query, const cluster_queue&) {
             topk_queue topk(k);
-            wand_query wand_q(topk, all_ranges);
+            wand_query wand_q(topk, all_ranges, pair_bounds_ptr, tiers_ptr);
             wand_q.boundsum_timeout_query(
                 make_max_scored_cursors(index, wdata, *scorer, query), timeout_microsec, risk_factor);
             topk.finalize();
@@ -121,7 +215,7 @@ void evaluate_queries(
     } else if (query_type == "block_max_wand_ordered_range") {
         query_fun = [&](Query query, const cluster_queue& ordered_clusters) {
             topk_queue topk(k);
-            block_max_wand_query block_max_wand_q(topk, all_ranges);
+            block_max_wand_query block_max_wand_q(topk, all_ranges, nullptr, tiers_ptr);
             block_max_wand_q.ordered_range_query(
                 make_block_max_scored_cursors(index, wdata, *scorer, query), ordered_clusters, max_clusters);
             topk.finalize();
@@ -131,7 +225,7 @@ void evaluate_queries(
     } else if (query_type == "block_max_wand_boundsum") {
         query_fun = [&](Query query, const cluster_queue&) {
             topk_queue topk(k);
-            block_max_wand_query block_max_wand_q(topk, all_ranges);
+            block_max_wand_query block_max_wand_q(topk, all_ranges, pair_bounds_ptr, tiers_ptr);
             block_max_wand_q.boundsum_range_query(
                 make_block_max_scored_cursors(index, wdata, *scorer, query), max_clusters);
             topk.finalize();
@@ -141,7 +235,7 @@ void evaluate_queries(
     } else if (query_type == "block_max_wand_boundsum_timeout") {
         query_fun = [&](Query query, const cluster_queue&) {
             topk_queue topk(k);
-            block_max_wand_query block_max_wand_q(topk, all_ranges);
+            block_max_wand_query block_max_wand_q(topk, all_ranges, pair_bounds_ptr, tiers_ptr);
             block_max_wand_q.boundsum_timeout_query(
                 make_block_max_scored_cursors(index, wdata, *scorer, query), timeout_microsec, risk_factor);
             topk.finalize();
@@ -193,7 +287,7 @@ void evaluate_queries(
     } else if (query_type == "maxscore_ordered_range") {
         query_fun = [&](Query query, const cluster_queue& ordered_clusters) {
             topk_queue topk(k);
-            maxscore_query maxscore_q(topk, all_ranges);
+            maxscore_query maxscore_q(topk, all_ranges, nullptr, tiers_ptr);
             maxscore_q.ordered_range_query(
                 make_max_scored_cursors(index, wdata, *scorer, query), ordered_clusters, max_clusters);
             topk.finalize();
@@ -203,7 +297,7 @@ void evaluate_queries(
     } else if (query_type == "maxscore_boundsum") {
         query_fun = [&](Query query, const cluster_queue&) {
             topk_queue topk(k);
-            maxscore_query maxscore_q(topk, all_ranges);
+            maxscore_query maxscore_q(topk, all_ranges, pair_bounds_ptr, tiers_ptr);
             maxscore_q.boundsum_range_query(
                 make_max_scored_cursors(index, wdata, *scorer, query), max_clusters);
             topk.finalize();
@@ -213,7 +307,7 @@ void evaluate_queries(
     } else if (query_type == "maxscore_boundsum_timeout") {
         query_fun = [&](Query query, const cluster_queue&) {
             topk_queue topk(k);
-            maxscore_query maxscore_q(topk, all_ranges);
+            maxscore_query maxscore_q(topk, all_ranges, pair_bounds_ptr, tiers_ptr);
             maxscore_q.boundsum_timeout_query(
                 make_max_scored_cursors(index, wdata, *scorer, query), timeout_microsec, risk_factor);
             topk.finalize();
@@ -242,13 +336,31 @@ void evaluate_queries(
         spdlog::error("Unsupported query type: {}", query_type);
     }
 
+    // ANYTIME: Rank the clusters in the engine instead of reading them from --query-clusters
+    if (range_selector && boost::algorithm::ends_with(query_type, "_ordered_range")) {
+        query_fun = [&, ordered_range_fun = std::move(query_fun)](Query query, const cluster_queue&) {
+            return ordered_range_fun(query, range_selector(query));
+        };
+    }
+
+    // ANYTIME: Release the cold tier after any query that leaves too much of it in memory
+    if constexpr (std::is_same_v<typename IndexType::index_layout_tag, ClusteredIndexTag>) {
+        if (cold_tier_budget_mib > 0) {
+            query_fun = [&, budgeted_fun = std::move(query_fun)](Query query, const cluster_queue& clusters) {
+                auto result = budgeted_fun(query, clusters);
+                index.enforce_cold_tier_budget(cold_tier_budget_mib << 20U);
+                return result;
+            };
+        }
+    }
+
     auto source = std::make_shared<mio::mmap_source>(documents_filename.c_str());
     auto docmap = Payload_Vector<>::from(*source);
 
     std::vector<std::vector<std::pair<float, uint64_t>>> raw_results(queries.size());
     auto start_batch = std::chrono::steady_clock::now();
     tbb::parallel_for(size_t(0), queries.size(), [&, query_fun](size_t query_idx) {
-        raw_results[query_idx] = query_fun(queries[query_idx], ordered_clusters[queries[query_idx].id.value()]);
+        raw_results[query_idx] = query_fun(queries[query_idx], ordered_clusters[query_idx]);
     });
     auto end_batch = std::chrono::steady_clock::now();
 
@@ -273,6 +385,10 @@ void evaluate_queries(
         std::chrono::duration_cast<std::chrono::milliseconds>(end_print - start_batch).count();
     spdlog::info("Time taken to process queries: {}ms", batch_ms);
     spdlog::info("Time taken to process queries with printing: {}ms", batch_with_print_ms);
+
+    if (cluster_visits_filename) {
+        write_cluster_visits(tiers->visits(), *cluster_visits_filename);
+    }
 }
 
 using wand_raw_index = wand_data<wand_data_raw>;
@@ -297,7 +413,12 @@ int main(int argc, const char** argv)
         arg::Scorer,
         arg::Thresholds,
         arg::Threads,
-        arg::QueryClusters>
+        arg::QueryClusters,
+        arg::ClusterParents,
+        arg::ClusterTiers,
+        arg::PairBounds,
+        arg::RangeStats,
+        arg::RangeTailyStats>
         app{"Retrieves query results in TREC format."};
     app.add_option("-r,--run", run_id, "Run identifier");
     app.add_option("--documents", documents_file, "Document lexicon")->required();
@@ -305,6 +426,7 @@ int main(int argc, const char** argv)
     app.add_option("--timeout", timeout_micro, "Query timeout in microseconds (for timeout queries).");
     app.add_option("--risk", risk_factor, "Risk factor (for timeout queries)");
     app.add_option("--max-clusters", max_clusters, "The maximum number of clusters to visit.");
+    app.cluster_parents_option()->needs(app.clusters_option());
  
     CLI11_PARSE(app, argc, argv);
 
@@ -323,6 +445,16 @@ int main(int argc, const char** argv)
         app.queries(),
         app.thresholds_file(),
         app.clusters_file(),
+        app.cluster_parents_file(),
+        app.pair_bounds_file(),
+        app.range_stats_file(),
+        app.range_taily_stats_file(),
+        app.taily_epsilon(),
+        app.cluster_tiers_file(),
+        app.cold_cost(),
+        app.cold_tier_file(),
+        app.cold_tier_budget_mib(),
+        app.cluster_visits_file(),
         app.index_encoding(),
         app.algorithm(),
         app.k(),
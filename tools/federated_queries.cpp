@@ -0,0 +1,215 @@
+#include <iostream>
+#include <memory>
+#include <optional>
+
+#include <CLI/CLI.hpp>
+#include <mio/mmap.hpp>
+#include <range/v3/view/enumerate.hpp>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+#include <tbb/global_control.h>
+#include <tbb/parallel_for.h>
+
+#include "app.hpp"
+#include "clusters.hpp"
+#include "cursor/block_max_scored_cursor.hpp"
+#include "cursor/max_scored_cursor.hpp"
+#include "cursor/shard_cursor.hpp"
+#include "index_types.hpp"
+#include "payload_vector.hpp"
+#include "query/algorithm.hpp"
+#include "scorer/scorer.hpp"
+#include "sharding.hpp"
+#include "wand_data_compressed.hpp"
+#include "wand_data_raw.hpp"
+
+using namespace pisa;
+using ranges::views::enumerate;
+
+// ANYTIME: Federated queries. The clusters of every shard are processed by a single anytime
+// query, in one global BoundSum order, with one top-k queue and one timeout. Shard wand data
+// must be built with `--global-stats`, so that scores are comparable across shards.
+template <typename IndexType, typename WandType>
+void federated_queries(FederatedQueriesArgs const& args, std::vector<Shard_Id> const& shard_ids)
+{
+    std::vector<std::unique_ptr<IndexType>> indexes;
+    std::vector<std::unique_ptr<WandType>> wdatas;
+    std::vector<std::unique_ptr<index_scorer<WandType>>> scorers;
+    std::vector<std::vector<Query>> shard_queries;
+    std::vector<cluster_map> shard_ranges;
+    std::vector<std::uint64_t> shard_sizes;
+    // Read once: every shard parses the same lines with its own term lexicon.
+    auto query_lines = args.query_lines();
+    for (auto shard: shard_ids) {
+        auto shard_args = args;
+        shard_args.apply_shard(shard);
+        spdlog::info("Loading shard {} from {}", shard.as_int(), shard_args.index_filename());
+        indexes.push_back(
+            std::make_unique<IndexType>(MemorySource::mapped_file(shard_args.index_filename())));
+        wdatas.push_back(
+            std::make_unique<WandType>(MemorySource::mapped_file(shard_args.wand_data_path())));
+        scorers.push_back(scorer::from_params(args.scorer_params(), *wdatas.back()));
+        shard_queries.push_back(shard_args.queries(query_lines));
+        shard_ranges.push_back(wdatas.back()->all_ranges());
+        shard_sizes.push_back(indexes.back()->num_docs());
+        if (shard_queries.back().size() != shard_queries.front().size()) {
+            spdlog::error("Shard {} parsed a different number of queries.", shard.as_int());
+            std::exit(1);
+        }
+    }
+    auto [all_ranges, spaces] = federate_ranges(shard_ranges, shard_sizes);
+    spdlog::info("Federating {} ranges over {} shards", all_ranges.size(), shard_ids.size());
+
+    auto k = args.k();
+    auto max_clusters = args.max_clusters() > 0 ? args.max_clusters() : all_ranges.size();
+    auto timeout_microsec = args.timeout();
+    auto risk_factor = args.risk_factor();
+
+    auto max_scored = [&](std::size_t shard, Query const& query) {
+        return make_max_scored_cursors(*indexes[shard], *wdatas[shard], *scorers[shard], query);
+    };
+    auto block_max_scored = [&](std::size_t shard, Query const& query) {
+        return make_block_max_scored_cursors(*indexes[shard], *wdatas[shard], *scorers[shard], query);
+    };
+    auto federated_cursors = [&](auto make_cursors, std::size_t query_idx) {
+        using Cursor = typename decltype(make_cursors(0, Query{}))::value_type;
+        std::vector<ShardCursor<Cursor>> cursors;
+        for (std::size_t shard = 0; shard < shard_ids.size(); ++shard) {
+            append_shard_cursors(
+                cursors, make_cursors(shard, shard_queries[shard][query_idx]), spaces[shard]);
+        }
+        return cursors;
+    };
+
+    auto const& query_type = args.algorithm();
+    std::function<std::vector<std::pair<float, uint64_t>>(std::size_t)> query_fun;
+    if (query_type == "wand_boundsum") {
+        query_fun = [&](std::size_t query_idx) {
+            topk_queue topk(k);
+            wand_query wand_q(topk, all_ranges);
+            wand_q.boundsum_range_query(federated_cursors(max_scored, query_idx), max_clusters);
+            topk.finalize();
+            return topk.topk();
+        };
+    } else if (query_type == "wand_boundsum_timeout") {
+        query_fun = [&](std::size_t query_idx) {
+            topk_queue topk(k);
+            wand_query wand_q(topk, all_ranges);
+            wand_q.boundsum_timeout_query(
+                federated_cursors(max_scored, query_idx), timeout_microsec, risk_factor);
+            topk.finalize();
+            return topk.topk();
+        };
+    } else if (query_type == "block_max_wand_boundsum") {
+        query_fun = [&](std::size_t query_idx) {
+            topk_queue topk(k);
+            block_max_wand_query block_max_wand_q(topk, all_ranges);
+            block_max_wand_q.boundsum_range_query(
+                federated_cursors(block_max_scored, query_idx), max_clusters);
+            topk.finalize();
+            return topk.topk();
+        };
+    } else if (query_type == "block_max_wand_boundsum_timeout") {
+        query_fun = [&](std::size_t query_idx) {
+            topk_queue topk(k);
+            block_max_wand_query block_max_wand_q(topk, all_ranges);
+            block_max_wand_q.boundsum_timeout_query(
+                federated_cursors(block_max_scored, query_idx), timeout_microsec, risk_factor);
+            topk.finalize();
+            return topk.topk();
+        };
+    } else if (query_type == "maxscore_boundsum") {
+        query_fun = [&](std::size_t query_idx) {
+            topk_queue topk(k);
+            maxscore_query maxscore_q(topk, all_ranges);
+            maxscore_q.boundsum_range_query(federated_cursors(max_scored, query_idx), max_clusters);
+            topk.finalize();
+            return topk.topk();
+        };
+    } else if (query_type == "maxscore_boundsum_timeout") {
+        query_fun = [&](std::size_t query_idx) {
+            topk_queue topk(k);
+            maxscore_query maxscore_q(topk, all_ranges);
+            maxscore_q.boundsum_timeout_query(
+                federated_cursors(max_scored, query_idx), timeout_microsec, risk_factor);
+            topk.finalize();
+            return topk.topk();
+        };
+    } else {
+        spdlog::error("Unsupported query type: {}", query_type);
+        std::exit(1);
+    }
+
+    // Shards are cut from contiguous docid ranges, so global docids are those of the collection
+    auto source = std::make_shared<mio::mmap_source>(args.documents_file().c_str());
+    auto docmap = Payload_Vector<>::from(*source);
+
+    auto const& queries = shard_queries.front();
+    std::vector<std::vector<std::pair<float, uint64_t>>> raw_results(queries.size());
+    auto start_batch = std::chrono::steady_clock::now();
+    tbb::parallel_for(size_t(0), queries.size(), [&](size_t query_idx) {
+        raw_results[query_idx] = query_fun(query_idx);
+    });
+    auto end_batch = std::chrono::steady_clock::now();
+
+    for (size_t query_idx = 0; query_idx < raw_results.size(); ++query_idx) {
+        auto qid = queries[query_idx].id;
+        for (auto&& [rank, result]: enumerate(raw_results[query_idx])) {
+            std::cout << fmt::format(
+                "{}\t{}\t{}\t{}\t{}\t{}\n",
+                qid.value_or(std::to_string(query_idx)),
+                "Q0",
+                docmap[result.second],
+                rank,
+                result.first,
+                args.run_id());
+        }
+    }
+    double batch_ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(end_batch - start_batch).count();
+    spdlog::info("Time taken to process queries: {}ms", batch_ms);
+}
+
+using wand_raw_index = wand_data<wand_data_raw>;
+using wand_uniform_index = wand_data<wand_data_compressed<>>;
+using wand_uniform_index_quantized = wand_data<wand_data_compressed<PayloadType::Quantized>>;
+
+int main(int argc, const char** argv)
+{
+    spdlog::set_default_logger(spdlog::stderr_color_mt("default"));
+
+    CLI::App app{"Retrieves query results from several shards at once, in TREC format."};
+    FederatedQueriesArgs args(&app);
+    CLI11_PARSE(app, argc, argv);
+
+    tbb::global_control control(tbb::global_control::max_allowed_parallelism, args.threads() + 1);
+    spdlog::info("Number of worker threads: {}", args.threads());
+
+    auto shards = resolve_shards(args.index_filename());
+    if (shards.empty()) {
+        return 1;
+    }
+
+    /**/
+    if (false) {
+#define LOOP_BODY(R, DATA, T)                                                                           \
+    }                                                                                                   \
+    else if (args.index_encoding() == BOOST_PP_STRINGIZE(T))                                            \
+    {                                                                                                   \
+        if (args.is_wand_compressed()) {                                                                \
+            if (args.quantized()) {                                                                     \
+                federated_queries<BOOST_PP_CAT(T, _index), wand_uniform_index_quantized>(args, shards); \
+            } else {                                                                                    \
+                federated_queries<BOOST_PP_CAT(T, _index), wand_uniform_index>(args, shards);           \
+            }                                                                                           \
+        } else {                                                                                        \
+            federated_queries<BOOST_PP_CAT(T, _index), wand_raw_index>(args, shards);                   \
+        }
+        /**/
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PISA_INDEX_TYPES);
+#undef LOOP_BODY
+
+    } else {
+        spdlog::error("Unknown type {}", args.index_encoding());
+    }
+}
@@ -23,12 +23,27 @@ int main(int argc, char** argv)
     tbb::global_control control(tbb::global_control::max_allowed_parallelism, args.threads() + 1);
     spdlog::info("Number of worker threads: {}", args.threads());
     try {
+        std::optional<std::vector<std::uint32_t>> clusters{};
+        if (auto clusters_file = args.clusters_file(); clusters_file) {
+            clusters = pisa::read_cluster_ranges(*clusters_file);
+        }
+        if (auto memory_budget = args.memory_budget(); memory_budget) {
+            pisa::invert::invert_forward_index_external(
+                args.input_basename(),
+                args.output_basename(),
+                *memory_budget,
+                args.term_count(),
+                std::move(clusters),
+                args.tmp_dir());
+            return 0;
+        }
         pisa::invert::invert_forward_index(
             args.input_basename(),
             args.output_basename(),
             args.batch_size(),
             args.threads(),
-            args.term_count());
+            args.term_count(),
+            std::move(clusters));
         return 0;
     } catch (pisa::io::NoSuchFile err) {
         spdlog::error("{}", err.what());
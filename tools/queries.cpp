@@ -6,6 +6,7 @@
 
 #include <CLI/CLI.hpp>
 #include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <range/v3/view/enumerate.hpp>
 #include <spdlog/sinks/null_sink.h>
@@ -14,6 +15,8 @@
 
 #include "accumulator/lazy_accumulator.hpp"
 #include "app.hpp"
+#include "block_cache.hpp"
+#include "cluster_tiers.hpp"
 #include "clusters.hpp"
 #include "cursor/block_max_scored_cursor.hpp"
 #include "cursor/cursor.hpp"
@@ -23,6 +26,9 @@
 #include "mappable/mapper.hpp"
 #include "memory_source.hpp"
 #include "query/algorithm.hpp"
+#include "range_pair_bounds.hpp"
+#include "range_statistics.hpp"
+#include "range_taily_stats.hpp"
 #include "scorer/scorer.hpp"
 #include "timer.hpp"
 #include "topk_queue.hpp"
@@ -39,7 +45,7 @@ void extract_times(
     Fn fn,
     std::vector<Query> const& queries,
     std::vector<Threshold> const& thresholds,
-    std::unordered_map<std::string, cluster_queue>& selected_clusters,
+    std::vector<cluster_queue> const& selected_clusters,
     std::string const& index_type,
     std::string const& query_type,
     size_t runs,
@@ -47,8 +53,8 @@ void extract_times(
 {
     std::vector<std::size_t> times(runs);
     for (auto&& [qid, query]: enumerate(queries)) {
-        do_not_optimize_away(fn(query, thresholds[qid], selected_clusters[query.id.value()]));
-        std::generate(times.begin(), times.end(), [&fn, &q = query, &t = thresholds[qid], &s = selected_clusters[query.id.value()]]() {
+        do_not_optimize_away(fn(query, thresholds[qid], selected_clusters[qid]));
+        std::generate(times.begin(), times.end(), [&fn, &q = query, &t = thresholds[qid], &s = selected_clusters[qid]]() {
             return run_with_timer<std::chrono::microseconds>(
                        [&]() { do_not_optimize_away(fn(q, t, s)); })
                 .count();
@@ -63,7 +69,7 @@ void op_perftest(
     Functor query_func,
     std::vector<Query> const& queries,
     std::vector<Threshold> const& thresholds,
-    std::unordered_map<std::string, cluster_queue>& selected_clusters,
+    std::vector<cluster_queue> const& selected_clusters,
     std::string const& index_type,
     std::string const& query_type,
     size_t runs,
@@ -78,10 +84,10 @@ void op_perftest(
         size_t idx = 0;
         for (auto const& query: queries) {
             auto usecs = run_with_timer<std::chrono::microseconds>([&]() {
-                uint64_t result = query_func(query, thresholds[idx], selected_clusters[query.id.value()]);
+                uint64_t result = query_func(query, thresholds[idx], selected_clusters[idx]);
                 if (safe && result < k) {
                     num_reruns += 1;
-                    result = query_func(query, 0, selected_clusters[query.id.value()]);
+                    result = query_func(query, 0, selected_clusters[idx]);
                 }
                 do_not_optimize_away(result);
             });
@@ -125,6 +131,16 @@ void perftest(
     const std::vector<Query>& queries,
     const std::optional<std::string>& thresholds_filename,
     const std::optional<std::string>& clusters_filename,
+    const std::optional<std::string>& cluster_parents_filename,
+    const std::optional<std::string>& pair_bounds_filename,
+    const std::optional<std::string>& range_stats_filename,
+    const std::optional<std::string>& range_taily_stats_filename,
+    double taily_epsilon,
+    const std::optional<std::string>& cluster_tiers_filename,
+    const float cold_cost,
+    const std::optional<std::string>& cold_tier_filename,
+    const size_t cold_tier_budget_mib,
+    const std::optional<std::string>& cluster_visits_filename,
     std::string const& type,
     std::string const& query_type,
     uint64_t k,
@@ -133,11 +149,36 @@ void perftest(
     bool safe,
     const size_t timeout_microsec,
     const float risk_factor,
-    const size_t max_clusters)
+    const size_t max_clusters,
+    const size_t block_cache_mib)
 {
     spdlog::info("Loading index from {}", index_filename);
     IndexType index(MemorySource::mapped_file(index_filename));
 
+    std::optional<BlockCache> block_cache;
+    if constexpr (std::is_same_v<typename IndexType::index_layout_tag, BlockIndexTag>) {
+        if (block_cache_mib > 0) {
+            block_cache.emplace(block_cache_mib << 20U, IndexType::block_size);
+            index.set_block_cache(&*block_cache);
+        }
+    } else if (block_cache_mib > 0) {
+        spdlog::error("Only block indexes have a block cache.");
+        std::exit(1);
+    }
+
+    // ANYTIME: Attach the cold tier of a tiered clustered index; it is mapped on first access
+    if constexpr (std::is_same_v<typename IndexType::index_layout_tag, ClusteredIndexTag>) {
+        if (cold_tier_filename) {
+            index.open_cold_tier(*cold_tier_filename);
+        } else if (index.is_tiered()) {
+            spdlog::error("The index is tiered, but no --cold-tier was given.");
+            std::exit(1);
+        }
+    } else if (cold_tier_filename) {
+        spdlog::error("Only clustered indexes have a cold tier.");
+        std::exit(1);
+    }
+
     spdlog::info("Warming up posting lists");
     std::unordered_set<term_id_type> warmed_up;
     for (auto const& q: queries) {
@@ -173,15 +214,80 @@ void perftest(
     // ANYTIME: Grab the ranges from the wand data structure
     auto all_ranges = wdata.all_ranges();
  
-    // ANYTIME: Read the input clusters (if any)
-    std::unordered_map<std::string, cluster_queue> ordered_clusters;
+    // ANYTIME: Read the input clusters (if any), in either the text or the binary format
+    std::vector<cluster_queue> ordered_clusters(queries.size());
     if (clusters_filename) {
-        ordered_clusters = read_selected_clusters(*clusters_filename);
-        spdlog::info("Read {} queries worth of selected clusters.", ordered_clusters.size());
-        if (ordered_clusters.size() != queries.size()) {
-            spdlog::error("Mismatch in length between queries ({}) and clusters ({}).", queries.size(), ordered_clusters.size());
+        ordered_clusters = read_query_clusters(*clusters_filename, queries);
+    }
+
+    // ANYTIME: Expand the clusters of each query into their sub-ranges (if the clusters were split)
+    if (cluster_parents_filename) {
+        auto parents = read_cluster_parents(*cluster_parents_filename);
+        if (parents.size() != std::max<size_t>(all_ranges.size(), 1)) {
+            spdlog::error("Mismatch in ranges between wand data ({}) and cluster parents ({}).", all_ranges.size(), parents.size());
+            std::exit(1);
+        }
+        for (auto& queue: ordered_clusters) {
+            queue = expand_cluster_queue(queue, parents);
+        }
+    }
+
+    // ANYTIME: Read the term-pair range bounds (if any), used by BoundSum queries
+    std::optional<range_pair_bounds> pair_bounds;
+    if (pair_bounds_filename) {
+        pair_bounds.emplace(MemorySource::mapped_file(*pair_bounds_filename));
+        spdlog::info("Read range bounds of {} term pairs.", pair_bounds->size());
+        if (pair_bounds->num_ranges() != std::max<size_t>(all_ranges.size(), 1)) {
+            spdlog::error("Mismatch in ranges between wand data ({}) and pair bounds ({}).", all_ranges.size(), pair_bounds->num_ranges());
+            std::exit(1);
+        }
+    }
+    range_pair_bounds const* pair_bounds_ptr = pair_bounds ? &*pair_bounds : nullptr;
+
+    // ANYTIME: Read the per-range term or Taily statistics (if any), used to select clusters at query time
+    if (range_stats_filename && range_taily_stats_filename) {
+        spdlog::error("Only one of --range-stats and --range-taily-stats can be used.");
+        std::exit(1);
+    }
+    std::optional<range_statistics> range_stats;
+    std::optional<range_taily_stats> range_taily;
+    std::function<cluster_queue(Query const&)> range_selector;
+    if (range_stats_filename) {
+        range_stats.emplace(MemorySource::mapped_file(*range_stats_filename));
+        if (range_stats->num_ranges() != std::max<size_t>(all_ranges.size(), 1)) {
+            spdlog::error("Mismatch in ranges between wand data ({}) and range statistics ({}).", all_ranges.size(), range_stats->num_ranges());
+            std::exit(1);
+        }
+        range_selector = cori_range_selector(*range_stats);
+    }
+    if (range_taily_stats_filename) {
+        range_taily.emplace(MemorySource::mapped_file(*range_taily_stats_filename));
+        if (range_taily->num_ranges() != std::max<size_t>(all_ranges.size(), 1)) {
+            spdlog::error("Mismatch in ranges between wand data ({}) and range Taily statistics ({}).", all_ranges.size(), range_taily->num_ranges());
             std::exit(1);
         }
+        range_selector = taily_range_selector(*range_taily, k, taily_epsilon);
+    }
+
+    // ANYTIME: Read the cluster tiers (if any), or only count the visits to each cluster
+    std::optional<cluster_tiers> tiers;
+    if (cluster_tiers_filename) {
+        auto cold = read_cluster_tiers(*cluster_tiers_filename);
+        if (cold.size() != std::max<size_t>(all_ranges.size(), 1)) {
+            spdlog::error("Mismatch in ranges between wand data ({}) and cluster tiers ({}).", all_ranges.size(), cold.size());
+            std::exit(1);
+        }
+        tiers.emplace(std::move(cold), cold_cost);
+    } else if (cluster_visits_filename) {
+        tiers.emplace(std::max<size_t>(all_ranges.size(), 1));
+    }
+    cluster_tiers* tiers_ptr = tiers ? &*tiers : nullptr;
+
+    // ANYTIME: Cold clusters already read cost as much as hot ones, until the tier is released
+    if constexpr (std::is_same_v<typename IndexType::index_layout_tag, ClusteredIndexTag>) {
+        if (tiers && index.is_tiered()) {
+            tiers->track_residency([&index](std::size_t cluster) { return index.is_resident(cluster); });
+        }
     }
 
     auto scorer = scorer::from_params(scorer_params, wdata);
@@ -227,7 +333,7 @@ void perftest(
             query_fun = [&](Query query, Threshold t, const cluster_queue& ordered_clusters) {
                 topk_queue topk(k);
                 topk.set_threshold(t);
-                wand_query wand_q(topk, all_ranges);
+                wand_query wand_q(topk, all_ranges, nullptr, tiers_ptr);
                 wand_q.ordered_range_query(
                     make_max_scored_cursors(index, wdata, *scorer, query), ordered_clusters, max_clusters);
                 topk.finalize();
@@ -238,7 +344,7 @@ void perftest(
             query_fun = [&](Query query, Threshold t, const cluster_queue&) {
                 topk_queue topk(k);
                 topk.set_threshold(t);
-                wand_query wand_q(topk, all_ranges);
+                wand_query wand_q(topk, all_ranges, pair_bounds_ptr, tiers_ptr);
                 wand_q.boundsum_range_query(
                     make_max_scored_cursors(index, wdata, *scorer, query), max_clusters);
                 topk.finalize();
@@ -249,7 +355,7 @@ void perftest(
             query_fun = [&](Query query, Threshold t, const cluster_queue&) {
                 topk_queue topk(k);
                 topk.set_threshold(t);
-                wand_query wand_q(topk, all_ranges);
+                wand_query wand_q(topk, all_ranges, pair_bounds_ptr, tiers_ptr);
                 wand_q.boundsum_timeout_query(
                     make_max_scored_cursors(index, wdata, *scorer, query), timeout_microsec, risk_factor);
                 topk.finalize();
@@ -270,7 +376,7 @@ void perftest(
             query_fun = [&](Query query, Threshold t, const cluster_queue& ordered_clusters) {
                 topk_queue topk(k);
                 topk.set_threshold(t);
-                block_max_wand_query block_max_wand_q(topk, all_ranges);
+                block_max_wand_query block_max_wand_q(topk, all_ranges, nullptr, tiers_ptr);
                 block_max_wand_q.ordered_range_query(
                     make_block_max_scored_cursors(index, wdata, *scorer, query), ordered_clusters, max_clusters);
                 topk.finalize();
@@ -281,7 +387,7 @@ void perftest(
             query_fun = [&](Query query, Threshold t, const cluster_queue&) {
                 topk_queue topk(k);
                 topk.set_threshold(t);
-                block_max_wand_query block_max_wand_q(topk, all_ranges);
+                block_max_wand_query block_max_wand_q(topk, all_ranges, pair_bounds_ptr, tiers_ptr);
                 block_max_wand_q.boundsum_range_query(
                     make_block_max_scored_cursors(index, wdata, *scorer, query), max_clusters);
                 topk.finalize();
@@ -292,7 +398,7 @@ void perftest(
             query_fun = [&](Query query, Threshold t, const cluster_queue&) {
                 topk_queue topk(k);
                 topk.set_threshold(t);
-                block_max_wand_query block_max_wand_q(topk, all_ranges);
+                block_max_wand_query block_max_wand_q(topk, all_ranges, pair_bounds_ptr, tiers_ptr);
                 block_max_wand_q.boundsum_timeout_query(
                     make_block_max_scored_cursors(index, wdata, *scorer, query), timeout_microsec, risk_factor);
                 topk.finalize();
@@ -350,7 +456,7 @@ void perftest(
             query_fun = [&](Query query, Threshold t, const cluster_queue& ordered_clusters) {
                 topk_queue topk(k);
                 topk.set_threshold(t);
-                maxscore_query maxscore_q(topk, all_ranges);
+                maxscore_query maxscore_q(topk, all_ranges, nullptr, tiers_ptr);
                 maxscore_q.ordered_range_query(
                     make_max_scored_cursors(index, wdata, *scorer, query), ordered_clusters, max_clusters);
                 topk.finalize();
@@ -361,7 +467,7 @@ void perftest(
             query_fun = [&](Query query, Threshold t, const cluster_queue&) {
                 topk_queue topk(k);
                 topk.set_threshold(t);
-                maxscore_query maxscore_q(topk, all_ranges);
+                maxscore_query maxscore_q(topk, all_ranges, pair_bounds_ptr, tiers_ptr);
                 maxscore_q.boundsum_range_query(
                     make_max_scored_cursors(index, wdata, *scorer, query), max_clusters);
                 topk.finalize();
@@ -372,7 +478,7 @@ void perftest(
             query_fun = [&](Query query, Threshold t, const cluster_queue&) {
                 topk_queue topk(k);
                 topk.set_threshold(t);
-                maxscore_query maxscore_q(topk, all_ranges);
+                maxscore_query maxscore_q(topk, all_ranges, pair_bounds_ptr, tiers_ptr);
                 maxscore_q.boundsum_timeout_query(
                     make_max_scored_cursors(index, wdata, *scorer, query), timeout_microsec, risk_factor);
                 topk.finalize();
@@ -404,12 +510,38 @@ void perftest(
             spdlog::error("Unsupported query type: {}", t);
             break;
         }
+        // ANYTIME: Rank the clusters in the engine instead of reading them from --query-clusters
+        if (range_selector && boost::algorithm::ends_with(t, "_ordered_range")) {
+            query_fun = [&, ordered_range_fun = std::move(query_fun)](Query query, Threshold t, const cluster_queue&) {
+                return ordered_range_fun(query, t, range_selector(query));
+            };
+        }
+        // ANYTIME: Release the cold tier after any query that leaves too much of it in memory
+        if constexpr (std::is_same_v<typename IndexType::index_layout_tag, ClusteredIndexTag>) {
+            if (cold_tier_budget_mib > 0) {
+                query_fun = [&, budgeted_fun = std::move(query_fun)](
+                                Query query, Threshold t, const cluster_queue& clusters) {
+                    auto result = budgeted_fun(query, t, clusters);
+                    index.enforce_cold_tier_budget(cold_tier_budget_mib << 20U);
+                    return result;
+                };
+            }
+        }
         if (extract) {
             extract_times(query_fun, queries, thresholds, ordered_clusters, type, t, 2, std::cout);
         } else {
             op_perftest(query_fun, queries, thresholds, ordered_clusters, type, t, 2, k, safe);
         }
     }
+    // ANYTIME: Every run of every query is counted, which keeps the visits proportional
+    if (cluster_visits_filename) {
+        write_cluster_visits(tiers->visits(), *cluster_visits_filename);
+    }
+    if (block_cache) {
+        auto stats = block_cache->stats();
+        spdlog::info(
+            "Block cache: {} hits, {} misses, {} evictions", stats.hits, stats.misses, stats.evictions);
+    }
 }
 
 using wand_raw_index = wand_data<wand_data_raw>;
@@ -424,6 +556,7 @@ int main(int argc, const char** argv)
     bool quantized = false;
     size_t timeout_micro = 0;
     size_t max_clusters = 0;
+    size_t block_cache_mib = 0;
     float risk_factor = 1.0f;
 
     App<arg::Index,
@@ -432,7 +565,12 @@ int main(int argc, const char** argv)
         arg::Algorithm,
         arg::Scorer,
         arg::Thresholds,
-        arg::QueryClusters>
+        arg::QueryClusters,
+        arg::ClusterParents,
+        arg::ClusterTiers,
+        arg::PairBounds,
+        arg::RangeStats,
+        arg::RangeTailyStats>
         app{"Benchmarks queries on a given index."};
     app.add_flag("--quantized", quantized, "Quantized scores");
     app.add_flag("--extract", extract, "Extract individual query times");
@@ -442,6 +580,9 @@ int main(int argc, const char** argv)
     app.add_option("--timeout", timeout_micro, "Query timeout in microseconds (for timeout queries).");
     app.add_option("--risk", risk_factor, "Risk factor (for timeout queries)");
     app.add_option("--max-clusters", max_clusters, "The maximum number of clusters to visit.");
+    app.add_option(
+        "--block-cache", block_cache_mib, "Share decoded blocks across queries, in this many MiB.");
+    app.cluster_parents_option()->needs(app.clusters_option());
     CLI11_PARSE(app, argc, argv);
 
     if (silent) {
@@ -459,6 +600,16 @@ int main(int argc, const char** argv)
         app.queries(),
         app.thresholds_file(),
         app.clusters_file(),
+        app.cluster_parents_file(),
+        app.pair_bounds_file(),
+        app.range_stats_file(),
+        app.range_taily_stats_file(),
+        app.taily_epsilon(),
+        app.cluster_tiers_file(),
+        app.cold_cost(),
+        app.cold_tier_file(),
+        app.cold_tier_budget_mib(),
+        app.cluster_visits_file(),
         app.index_encoding(),
         app.algorithm(),
         app.k(),
@@ -467,7 +618,8 @@ int main(int argc, const char** argv)
         safe,
         timeout_micro,
         risk_factor,
-        max_clusters);
+        max_clusters,
+        block_cache_mib);
 
     /**/
     if (false) {
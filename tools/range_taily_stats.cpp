@@ -0,0 +1,57 @@
+#include <CLI/CLI.hpp>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include "app.hpp"
+#include "binary_freq_collection.hpp"
+#include "mappable/mapper.hpp"
+#include "memory_source.hpp"
+#include "range_taily_stats.hpp"
+#include "scorer/scorer.hpp"
+#include "wand_data.hpp"
+#include "wand_data_compressed.hpp"
+#include "wand_data_raw.hpp"
+
+using pisa::wand_data;
+using pisa::wand_data_compressed;
+using pisa::wand_data_raw;
+
+template <typename Wand>
+void extract_range_taily_stats(pisa::RangeTailyStatsArgs const& args)
+{
+    pisa::binary_freq_collection collection(args.collection_path().c_str());
+    Wand wdata(pisa::MemorySource::mapped_file(args.wand_data_path()));
+    std::vector<std::uint32_t> boundaries;
+    if (auto clusters_file = args.clusters_file(); clusters_file) {
+        boundaries = pisa::read_cluster_ranges(*clusters_file);
+    } else {
+        for (size_t range = 0; range < wdata.num_ranges(); ++range) {
+            boundaries.push_back(wdata.doc_range(range));
+        }
+    }
+    auto scorer = pisa::scorer::from_params(args.scorer_params(), wdata);
+    pisa::range_taily_stats stats(collection, scorer, boundaries);
+    spdlog::info("Stored statistics of {} terms over {} ranges", stats.num_terms(), stats.num_ranges());
+    pisa::mapper::freeze(stats, args.output_path().c_str());
+}
+
+int main(int argc, const char** argv)
+{
+    spdlog::drop("");
+    spdlog::set_default_logger(spdlog::stderr_color_mt(""));
+
+    CLI::App app{"Extracts Taily statistics of every cluster range and stores them in a file."};
+    pisa::RangeTailyStatsArgs args(&app);
+    CLI11_PARSE(app, argc, argv);
+
+    try {
+        if (args.is_wand_compressed()) {
+            extract_range_taily_stats<wand_data<wand_data_compressed<>>>(args);
+        } else {
+            extract_range_taily_stats<wand_data<wand_data_raw>>(args);
+        }
+    } catch (std::exception const& err) {
+        spdlog::error("{}", err.what());
+        return 1;
+    }
+}
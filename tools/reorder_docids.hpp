@@ -23,6 +23,9 @@ auto reorder_docids(ReorderDocuments args) -> int
                 .min_length = args.min_length(),
                 .compress_fwd = not args.nogb(),
                 .print_args = args.print(),
+                .document_clusters = args.document_clusters(),
+                .cluster_map = args.cluster_map(),
+                .output_clusters = args.output_clusters(),
             });
         }
         ReorderOptions options{.input_basename = args.input_basename(),
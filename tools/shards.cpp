@@ -19,12 +19,16 @@
 #include "util/util.hpp"
 #include "vec_map.hpp"
 #include "wand_data.hpp"
+#include "wand_utils.hpp"
 
 namespace invert = pisa::invert;
 using pisa::CompressArgs;
 using pisa::CreateWandDataArgs;
 using pisa::format_shard;
 using pisa::InvertArgs;
+using pisa::partition_inverted_index;
+using pisa::PartitionClustersArgs;
+using pisa::read_cluster_ranges;
 using pisa::ReorderDocuments;
 using pisa::resolve_shards;
 using pisa::Shard_Id;
@@ -52,6 +56,8 @@ int main(int argc, char** argv)
     CLI::App app{"Executes commands for shards."};
     auto* invert =
         app.add_subcommand("invert", "Constructs an inverted index from a forward index.");
+    auto* partition_clusters = app.add_subcommand(
+        "partition-clusters", "Cuts an inverted index into one shard per document cluster.");
     auto* reorder = app.add_subcommand("reorder-docids", "Reorder document IDs.");
     auto* compress = app.add_subcommand("compress", "Compresses an inverted index");
     auto* wand = app.add_subcommand("wand-data", "Creates additional data for query processing.");
@@ -64,6 +70,7 @@ int main(int argc, char** argv)
         " DO NOT provide already parsed and resolved queries (with IDs instead of terms).");
     auto* taily_thresholds = app.add_subcommand("taily-thresholds", "Computes Taily thresholds.");
     InvertArgs invert_args(invert);
+    PartitionClustersArgs partition_clusters_args(partition_clusters);
     ReorderDocuments reorder_args(reorder);
     CompressArgs compress_args(compress);
     CreateWandDataArgs wand_args(wand);
@@ -78,16 +85,42 @@ int main(int argc, char** argv)
             tbb::global_control control(
                 tbb::global_control::max_allowed_parallelism, invert_args.threads() + 1);
             spdlog::info("Number of worker threads: {}", invert_args.threads());
+            if (invert_args.clusters_file()) {
+                spdlog::warn("Document clusters are ignored when inverting shards");
+            }
             Shard_Id shard_id{0};
             for (auto shard: resolve_shards(invert_args.input_basename())) {
-                invert::invert_forward_index(
-                    format_shard(invert_args.input_basename(), shard_id),
-                    format_shard(invert_args.output_basename(), shard_id),
-                    invert_args.batch_size(),
-                    invert_args.threads());
+                if (auto memory_budget = invert_args.memory_budget(); memory_budget) {
+                    invert::invert_forward_index_external(
+                        format_shard(invert_args.input_basename(), shard_id),
+                        format_shard(invert_args.output_basename(), shard_id),
+                        *memory_budget,
+                        std::nullopt,
+                        std::nullopt,
+                        invert_args.tmp_dir());
+                } else {
+                    invert::invert_forward_index(
+                        format_shard(invert_args.input_basename(), shard_id),
+                        format_shard(invert_args.output_basename(), shard_id),
+                        invert_args.batch_size(),
+                        invert_args.threads());
+                }
                 shard_id += 1;
             }
         }
+        if (partition_clusters->parsed()) {
+            tbb::global_control control(
+                tbb::global_control::max_allowed_parallelism,
+                partition_clusters_args.threads() + 1);
+            spdlog::info("Number of worker threads: {}", partition_clusters_args.threads());
+            partition_inverted_index(
+                partition_clusters_args.input_basename(),
+                partition_clusters_args.output_basename(),
+                read_cluster_ranges(*partition_clusters_args.clusters_file()),
+                partition_clusters_args.terms_file(),
+                partition_clusters_args.documents_file());
+            return 0;
+        }
         if (reorder->parsed()) {
             auto shards = resolve_shards(reorder_args.input_basename(), ".docs");
             spdlog::info("Processing {} shards", shards.size());
@@ -101,8 +134,11 @@ int main(int argc, char** argv)
             return 0;
         }
         if (compress->parsed()) {
+            tbb::global_control control(
+                tbb::global_control::max_allowed_parallelism, compress_args.threads() + 1);
             auto shards = resolve_shards(compress_args.input_basename(), ".docs");
             spdlog::info("Processing {} shards", shards.size());
+            compress_args.apply_hybrid_policy();
             for (auto shard: shards) {
                 auto shard_args = compress_args;
                 shard_args.apply_shard(shard);
@@ -113,11 +149,14 @@ int main(int argc, char** argv)
                     shard_args.output(),
                     shard_args.scorer_params(),
                     shard_args.quantize(),
-                    shard_args.check());
+                    shard_args.check(),
+                    shard_args.clusters_file());
             }
             return 0;
         }
         if (wand->parsed()) {
+            tbb::global_control control(
+                tbb::global_control::max_allowed_parallelism, wand_args.threads() + 1);
             auto shards = resolve_shards(wand_args.input_basename(), ".docs");
             spdlog::info("Processing {} shards", shards.size());
             for (auto shard: shards) {
@@ -131,7 +170,11 @@ int main(int argc, char** argv)
                     shard_args.range(),
                     shard_args.compress(),
                     shard_args.quantize(),
-                    shard_args.dropped_term_ids());
+                    shard_args.dropped_term_ids(),
+                    shard_args.clusters_file(),
+                    shard_args.streaming(),
+                    shard_args.quantize_range_bounds(),
+                    shard_args.global_stats_file());
             }
         }
         if (taily->parsed()) {
@@ -0,0 +1,42 @@
+#include <CLI/CLI.hpp>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include "app.hpp"
+#include "binary_freq_collection.hpp"
+#include "util/progress.hpp"
+#include "wand_utils.hpp"
+
+int main(int argc, const char** argv)
+{
+    spdlog::drop("");
+    spdlog::set_default_logger(spdlog::stderr_color_mt(""));
+
+    CLI::App app{"Splits oversized document clusters into sub-ranges of a target posting volume."};
+    pisa::SplitClustersArgs args(&app);
+    CLI11_PARSE(app, argc, argv);
+
+    try {
+        pisa::binary_freq_collection collection(args.collection_path().c_str());
+        std::vector<std::uint64_t> document_volumes(collection.num_docs(), 0);
+        {
+            pisa::progress progress("Counting document postings", collection.size());
+            for (auto const& seq: collection) {
+                for (auto docid: seq.docs) {
+                    document_volumes[docid] += 1;
+                }
+                progress.update(1);
+            }
+        }
+
+        auto boundaries = pisa::read_cluster_ranges(*args.clusters_file());
+        auto [sub_ranges, parents] =
+            pisa::split_cluster_ranges(boundaries, document_volumes, args.target_postings());
+        spdlog::info("Split {} clusters into {} sub-ranges", boundaries.size(), sub_ranges.size());
+        pisa::write_cluster_ranges(sub_ranges, args.output_path());
+        pisa::write_cluster_parents(parents, args.parents_path());
+    } catch (std::exception const& err) {
+        spdlog::error("{}", err.what());
+        return 1;
+    }
+}
@@ -0,0 +1,42 @@
+#include <algorithm>
+
+#include <CLI/CLI.hpp>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include "app.hpp"
+#include "cluster_tiers.hpp"
+#include "index_types.hpp"
+
+int main(int argc, const char** argv)
+{
+    spdlog::drop("");
+    spdlog::set_default_logger(spdlog::stderr_color_mt(""));
+
+    CLI::App app{"Moves the clusters rarely visited by a query log to the cold tier of an index."};
+    pisa::TierClustersArgs args(&app);
+    CLI11_PARSE(app, argc, argv);
+
+    try {
+        pisa::clustered_interleaved_simdbp_index index(
+            pisa::MemorySource::mapped_file(args.index_path()));
+        auto visits = pisa::read_cluster_visits(args.visits_path());
+        if (visits.size() != index.num_clusters()) {
+            spdlog::error(
+                "Visits are given for {} clusters, but the index has {}",
+                visits.size(),
+                index.num_clusters());
+            return 1;
+        }
+        auto cold = pisa::classify_clusters(visits, args.hot_fraction());
+        spdlog::info(
+            "{} of {} clusters are cold",
+            std::count(cold.begin(), cold.end(), true),
+            cold.size());
+        index.write_tiered(cold, args.output_path(), args.cold_output_path());
+        pisa::write_cluster_tiers(cold, args.tiers_path());
+    } catch (std::exception const& err) {
+        spdlog::error("{}", err.what());
+        return 1;
+    }
+}